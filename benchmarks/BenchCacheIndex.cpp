@@ -0,0 +1,93 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: finding an answer key in the node based map DnsCache
+ * used to keep (unordered_map<CacheKey, bucket>) against the FlatIndex
+ * over a slab it keeps now. Both use the same transparent hash, so the
+ * difference is probing: a chain of heap nodes against a group of control
+ * bytes and one slab compare. Half the lookups miss.
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../lib/cache/CacheKey.hpp"
+#include "../lib/cache/FlatIndex.hpp"
+
+constexpr size_t LOOKUPS = 2000000;
+
+// a stand-in for the cached records, so keys don't sit back to back
+struct Bucket {
+  CacheKey key;
+  uint64_t payload[8];
+};
+
+template <typename Fn>
+double nsPerLookup(const std::vector<CacheKeyView> &probes, Fn &&find) {
+  size_t found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    found += find(probes[i % probes.size()]);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  if (found != LOOKUPS / 2) {
+    std::cerr << "unexpected hit count " << found << "\n";
+  }
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         LOOKUPS;
+}
+
+int main() {
+  std::cout << "=== Answer key lookup (ns, 50% hits) ===\n"
+            << std::left << std::setw(10) << "keys" << std::setw(16)
+            << "unordered_map" << "flat index\n"
+            << std::fixed << std::setprecision(1);
+
+  for (size_t count : {1000, 10000, 100000, 1000000}) {
+    std::vector<DnsName> names;
+    for (size_t i = 0; i < count * 2; i++) {
+      names.emplace_back("host-" + std::to_string(i) + ".example.com");
+    }
+
+    std::unordered_map<CacheKey, Bucket, CacheKeyHash, CacheKeyEqual> map;
+    map.reserve(count);
+    std::vector<Bucket> slab(count);
+    FlatIndex index(count);
+
+    for (size_t i = 0; i < count; i++) {
+      CacheKey key{names[i], 1};
+      map.try_emplace(key, Bucket{key, {}});
+      slab[i].key = key;
+      index.insert(CacheKeyHash{}(key), static_cast<uint32_t>(i),
+                   [&](uint32_t id) { return CacheKeyHash{}(slab[id].key); });
+    }
+
+    // the first `count` names are cached, the rest miss
+    std::vector<CacheKeyView> probes;
+    for (const auto &name : names) {
+      probes.emplace_back(name, 1);
+    }
+    std::shuffle(probes.begin(), probes.end(), std::mt19937(42));
+
+    double mapNs = nsPerLookup(probes, [&](const CacheKeyView &key) {
+      return map.find(key) != map.end();
+    });
+    double flatNs = nsPerLookup(probes, [&](const CacheKeyView &key) {
+      return index.find(CacheKeyHash{}(key), [&](uint32_t id) {
+               return CacheKeyView(slab[id].key) == key;
+             }) != FlatIndex::NONE;
+    });
+
+    std::cout << std::setw(10) << count << std::setw(16) << mapNs << flatNs
+              << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: what a name costs the cache once it has been parsed. An
+ * answer cache hit, and the nameserver walk a miss does from the query
+ * name up through its parent zones until one of them is cached.
+ **/
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../lib/cache/DnsCache.hpp"
+#include "../lib/names/DnsName.hpp"
+
+constexpr size_t ZONES = 512;
+constexpr size_t NAMES = 4096;
+constexpr int ROUNDS = 100;
+
+static volatile size_t sink = 0;
+
+template <typename Fn> double nsPerName(Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    fn();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         (ROUNDS * NAMES);
+}
+
+int main() {
+  DnsCache cache;
+
+  // names three labels under a cached zone, the way a client sends them
+  std::vector<DnsName> names;
+  for (size_t i = 0; i < NAMES; i++) {
+    std::string zone = "zone-" + std::to_string(i % ZONES) + ".example.com";
+    std::string name = "Host-" + std::to_string(i) + ".Edge.Svc." + zone;
+    names.emplace_back(name);
+
+    cache.insert(names.back(), A{},
+                 std::vector<DnsRecord>{
+                     ARecord{name.c_str(), {192, 0, 2, 1}, 3600}});
+    if (i < ZONES) {
+      cache.insertNS(DnsName(zone), {192, 0, 2, 53}, 3600);
+    }
+  }
+
+  double hit = nsPerName([&] {
+    for (const auto &name : names) {
+      sink = sink + cache.lookup(name, A{})->size();
+    }
+  });
+
+  double walk = nsPerName([&] {
+    for (const auto &name : names) {
+      for (DnsNameView domain = name; !domain.isRoot();
+           domain = domain.parent()) {
+        auto ns = cache.lookupNS(domain);
+        if (ns.has_value()) {
+          sink = sink + (*ns)[3];
+          break;
+        }
+      }
+    }
+  });
+
+  std::cout << "=== Cache keys (ns/name, lower is better) ===\n"
+            << std::left << std::fixed << std::setprecision(1)
+            << std::setw(24) << "answer cache hit" << hit << "\n"
+            << std::setw(24) << "ns walk, 4 levels" << walk << "\n";
+  return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: cache throughput as threads are added. Every thread runs
+ * the same mix, 90% lookups and 10% inserts over a shared set of names,
+ * against one DnsCache behind an outer lock (the layout before sharding)
+ * and against ThreadSafeCache with a growing number of shards. The total
+ * work is fixed, so on a machine with fewer cores than threads the numbers
+ * show lock overhead rather than scaling.
+ **/
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../lib/cache/DnsCache.hpp"
+#include "../lib/cache/ThreadSafeCache.hpp"
+
+constexpr size_t NAMES = 16384;
+constexpr size_t TOTAL_OPS = 200000;
+constexpr size_t THREAD_COUNTS[] = {1, 2, 4, 8, 16, 32, 64};
+
+static std::vector<DnsName> names;
+static std::vector<DnsRecord> answer{
+    ARecord{"example.com", {192, 0, 2, 1}, 3600}};
+
+// one cache, every call through a global lock first
+class GlobalLockCache {
+private:
+  DnsCache cache;
+  std::shared_mutex mtx;
+
+public:
+  GlobalLockCache() : cache(CacheConfig(60, 86400, NAMES * 2)) {}
+
+  void lookup(const DnsName &qname) {
+    std::shared_lock<std::shared_mutex> lock(this->mtx);
+    this->cache.lookup(qname, A{});
+  }
+
+  void insert(const DnsName &qname) {
+    std::unique_lock<std::shared_mutex> lock(this->mtx);
+    this->cache.insert(qname, A{}, answer);
+  }
+};
+
+class ShardedCache {
+private:
+  ThreadSafeCache cache;
+
+public:
+  explicit ShardedCache(size_t shards)
+      : cache(CacheConfig(60, 86400, NAMES * 2, size_t{64} << 20, true,
+                          shards)) {}
+
+  void lookup(const DnsName &qname) { this->cache.lookup(qname, A{}); }
+  void insert(const DnsName &qname) { this->cache.insert(qname, A{}, answer); }
+};
+
+// million operations per second with `threads` threads sharing the work
+template <typename Cache> double throughput(Cache &cache, size_t threads) {
+  size_t perThread = TOTAL_OPS / threads;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&cache, perThread, t] {
+      uint64_t state = 0x9E3779B97F4A7C15ull * (t + 1);
+      for (size_t i = 0; i < perThread; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        const DnsName &name = names[state % NAMES];
+        if (state % 10 == 0) {
+          cache.insert(name);
+        } else {
+          cache.lookup(name);
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return static_cast<double>(perThread * threads) / seconds / 1e6;
+}
+
+template <typename Cache, typename Make>
+void row(const char *label, Make &&make) {
+  std::cout << std::setw(22) << label;
+  for (size_t threads : THREAD_COUNTS) {
+    Cache cache = make();
+    for (const auto &name : names) {
+      cache.insert(name);
+    }
+    std::cout << std::setw(8) << throughput(cache, threads);
+  }
+  std::cout << "\n";
+}
+
+int main() {
+  for (size_t i = 0; i < NAMES; i++) {
+    names.emplace_back("host-" + std::to_string(i) + ".example.com");
+  }
+
+  std::cout << "=== Cache throughput (Mops/s, 90% lookup, "
+            << std::thread::hardware_concurrency() << " cpus) ===\n"
+            << std::left << std::fixed << std::setprecision(2)
+            << std::setw(22) << "threads";
+  for (size_t threads : THREAD_COUNTS) {
+    std::cout << std::setw(8) << threads;
+  }
+  std::cout << "\n";
+
+  row<GlobalLockCache>("global lock", [] { return GlobalLockCache(); });
+  for (size_t shards : {1, 4, 16, 64}) {
+    std::string label = std::to_string(shards) + " shard(s)";
+    row<ShardedCache>(label.c_str(), [shards] { return ShardedCache(shards); });
+  }
+  return 0;
+}
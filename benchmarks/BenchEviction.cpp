@@ -0,0 +1,140 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: hit ratio and cost per request of the eviction policies
+ * on Zipfian traces. "lru" is the std::list + map of iterators DnsCache
+ * used to keep, splicing the key to the front on every hit. "clock" and
+ * "sieve" are the EvictionEngine, where a hit only sets a bit. Every run
+ * does the same map lookup per request, only the eviction side differs.
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../lib/cache/EvictionEngine.hpp"
+
+constexpr uint32_t UNIVERSE = 100000;
+constexpr size_t REQUESTS = 2000000;
+
+static std::vector<uint32_t> zipfTrace(double alpha) {
+  std::vector<double> cdf(UNIVERSE);
+  double sum = 0;
+  for (uint32_t i = 0; i < UNIVERSE; i++) {
+    sum += 1.0 / std::pow(i + 1, alpha);
+    cdf[i] = sum;
+  }
+
+  // popular keys are spread over the id space
+  std::vector<uint32_t> ids(UNIVERSE);
+  for (uint32_t i = 0; i < UNIVERSE; i++) {
+    ids[i] = i;
+  }
+  std::mt19937 gen(42);
+  std::shuffle(ids.begin(), ids.end(), gen);
+
+  std::uniform_real_distribution<double> uniform(0, sum);
+  std::vector<uint32_t> trace(REQUESTS);
+  for (auto &key : trace) {
+    auto rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(gen)) -
+                cdf.begin();
+    key = ids[std::min<size_t>(rank, UNIVERSE - 1)];
+  }
+  return trace;
+}
+
+struct Result {
+  double hitRatio;
+  double nsPerRequest;
+};
+
+template <typename Fn> Result run(const std::vector<uint32_t> &trace, Fn &&fn) {
+  size_t hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t key : trace) {
+    hits += fn(key);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return {100.0 * hits / trace.size(),
+          std::chrono::duration<double, std::nano>(end - start).count() /
+              trace.size()};
+}
+
+static Result runLru(const std::vector<uint32_t> &trace, size_t capacity) {
+  std::list<uint32_t> order;
+  std::unordered_map<uint32_t, std::list<uint32_t>::iterator> index;
+  index.reserve(capacity);
+
+  return run(trace, [&](uint32_t key) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+      order.splice(order.begin(), order, it->second);
+      return true;
+    }
+
+    if (index.size() >= capacity) {
+      index.erase(order.back());
+      order.pop_back();
+    }
+    order.push_front(key);
+    index.emplace(key, order.begin());
+    return false;
+  });
+}
+
+static Result runEngine(const std::vector<uint32_t> &trace, size_t capacity,
+                        EvictionPolicy policy) {
+  EvictionEngine engine(policy, capacity);
+  std::vector<uint32_t> slotKeys(capacity);
+  std::unordered_map<uint32_t, uint32_t> index;
+  index.reserve(capacity);
+
+  return run(trace, [&](uint32_t key) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+      engine.touch(it->second);
+      return true;
+    }
+
+    if (engine.full()) {
+      uint32_t slot = engine.victim();
+      index.erase(slotKeys[slot]);
+      engine.remove(slot);
+    }
+    uint32_t slot = engine.add();
+    slotKeys[slot] = key;
+    index.emplace(key, slot);
+    return false;
+  });
+}
+
+int main() {
+  std::cout << "=== Eviction on Zipf traces (" << UNIVERSE << " keys, "
+            << REQUESTS << " requests) ===\n"
+            << std::left << std::setw(8) << "alpha" << std::setw(10)
+            << "capacity" << std::setw(8) << "policy" << std::setw(12)
+            << "hit %" << "ns/request\n"
+            << std::fixed << std::setprecision(2);
+
+  for (double alpha : {0.8, 1.0, 1.2}) {
+    auto trace = zipfTrace(alpha);
+    for (size_t capacity : {UNIVERSE / 100, UNIVERSE / 10}) {
+      auto print = [&](const char *name, Result result) {
+        std::cout << std::setw(8) << alpha << std::setw(10) << capacity
+                  << std::setw(8) << name << std::setw(12) << result.hitRatio
+                  << result.nsPerRequest << "\n";
+      };
+      print("lru", runLru(trace, capacity));
+      print("clock", runEngine(trace, capacity, EvictionPolicy::Clock));
+      print("sieve", runEngine(trace, capacity, EvictionPolicy::Sieve));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: how long expiry holds a cache's exclusive lock. The old
+ * cleanup walked every record once a minute in one hold, its cost is shown
+ * as a walk checking the expiry of as many records. The timer wheel only
+ * touches what is due: a pass with nothing due, and the longest single
+ * slice while every entry expires at once.
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../lib/cache/DnsCache.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double usSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(Clock::now() - start)
+      .count();
+}
+
+int main() {
+  constexpr size_t SLICE = 256;
+
+  std::cout << "=== Exclusive lock hold for expiry (us) ===\n"
+            << std::left << std::setw(10) << "entries" << std::setw(14)
+            << "full scan" << std::setw(14) << "idle pass" << std::setw(14)
+            << "worst slice" << "slices\n"
+            << std::fixed << std::setprecision(1);
+
+  for (size_t count : {10000, 100000, 1000000}) {
+    DnsCache cache(CacheConfig(1, 86400, count, SIZE_MAX, true, 1,
+                               EvictionPolicy::Sieve, SLICE));
+    std::vector<CacheEntry> records;
+    for (size_t i = 0; i < count; i++) {
+      DnsName name("host-" + std::to_string(i) + ".example.com");
+      std::vector<DnsRecord> answer{ARecord{"example.com", {192, 0, 2, 1}, 1}};
+      cache.insert(name, A{}, answer);
+      records.push_back(CacheEntry{answer[0], Clock::now(),
+                                   Clock::now() + std::chrono::hours(1), 1, 0});
+    }
+
+    // what the periodic scan did, with nothing expired yet
+    auto start = Clock::now();
+    size_t live = 0;
+    auto now = Clock::now();
+    for (const auto &record : records) {
+      live += !record.isExpired(now);
+    }
+    double scan = usSince(start);
+    if (live != count) {
+      std::cerr << "unexpected scan result\n";
+    }
+
+    start = Clock::now();
+    cache.expireDue(SLICE);
+    double idle = usSince(start);
+
+    // everything comes due, worked off a slice at a time
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+    double worst = 0;
+    size_t slices = 0;
+    size_t expired = SLICE;
+    while (expired == SLICE) {
+      start = Clock::now();
+      expired = cache.expireDue(SLICE);
+      worst = std::max(worst, usSince(start));
+      slices++;
+    }
+
+    std::cout << std::setw(10) << count << std::setw(14) << scan
+              << std::setw(14) << idle << std::setw(14) << worst << slices
+              << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: name kernels at every SIMD level this CPU supports, plus
+ * the writeQName / readQName round trip they sit under. Names are drawn
+ * from a rough query-name length mix: mostly short to mid-length, with a
+ * tail of long CDN and tracking names.
+ **/
+
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../lib/BytePacketBuffer.hpp"
+#include "../lib/names/NameKernels.hpp"
+
+using namekernels::SimdLevel;
+
+constexpr size_t NAMES = 4096;
+constexpr int ROUNDS = 200;
+
+static volatile size_t sink = 0;
+
+static std::vector<std::string> makeNames() {
+  std::mt19937 gen(7);
+  std::discrete_distribution<int> bucket({40, 35, 20, 5});
+  const size_t bounds[][2] = {{8, 16}, {17, 32}, {33, 64}, {65, 120}};
+  const std::string alphabet =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-";
+  std::uniform_int_distribution<size_t> letter(0, alphabet.size() - 1);
+  std::uniform_int_distribution<size_t> labelLength(2, 14);
+
+  std::vector<std::string> names;
+  for (size_t i = 0; i < NAMES; i++) {
+    auto range = bounds[bucket(gen)];
+    size_t target = std::uniform_int_distribution<size_t>(range[0],
+                                                           range[1])(gen);
+    std::string name;
+    while (name.size() < target) {
+      if (!name.empty()) {
+        name += '.';
+      }
+      size_t len = std::min(labelLength(gen), target - name.size() + 1);
+      for (size_t j = 0; j < len; j++) {
+        name += alphabet[letter(gen)];
+      }
+    }
+    names.push_back(name);
+  }
+  return names;
+}
+
+template <typename Fn> double nsPerName(Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    fn();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         (ROUNDS * NAMES);
+}
+
+static const char *levelName(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Scalar:
+    return "scalar";
+  case SimdLevel::SSE2:
+    return "sse2";
+  case SimdLevel::AVX2:
+    return "avx2";
+  }
+  return "?";
+}
+
+int main() {
+  std::vector<std::string> names = makeNames();
+  std::vector<std::string> folded = names;
+  std::vector<std::string> labelsOnly = names;
+  size_t totalLength = 0;
+  for (size_t i = 0; i < NAMES; i++) {
+    for (auto &c : folded[i]) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    for (auto &c : labelsOnly[i]) {
+      c = c == '.' ? '-' : c;
+    }
+    totalLength += names[i].size();
+  }
+
+  std::cout << "=== Name kernels (ns/name, mean length " << std::fixed
+            << std::setprecision(1)
+            << static_cast<double>(totalLength) / NAMES << ") ===\n";
+  std::cout << std::left << std::setw(10) << "level" << std::setw(12)
+            << "toLower" << std::setw(18) << "equalsIgnoreCase"
+            << "labelBytesValid\n";
+
+  char out[512];
+  std::cout << std::setw(10) << "tolower()" << std::setw(12)
+            << nsPerName([&] {
+                 for (const auto &name : names) {
+                   for (size_t i = 0; i < name.size(); i++) {
+                     out[i] = static_cast<char>(
+                         std::tolower(static_cast<unsigned char>(name[i])));
+                   }
+                   sink = sink + out[0];
+                 }
+               })
+            << "\n";
+
+  for (auto level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+    if (!namekernels::supported(level)) {
+      continue;
+    }
+    const auto &kernels = namekernels::kernelsFor(level);
+
+    double lower = nsPerName([&] {
+      for (const auto &name : names) {
+        kernels.toLower(name.data(), out, name.size());
+        sink = sink + out[0];
+      }
+    });
+    double equals = nsPerName([&] {
+      for (size_t i = 0; i < NAMES; i++) {
+        sink = sink + kernels.equalsIgnoreCase(names[i].data(),
+                                               folded[i].data(),
+                                               names[i].size());
+      }
+    });
+    double valid = nsPerName([&] {
+      for (const auto &name : labelsOnly) {
+        sink = sink + kernels.labelBytesValid(name.data(), name.size());
+      }
+    });
+
+    std::cout << std::setw(10) << levelName(level) << std::setw(12) << lower
+              << std::setw(18) << equals << valid << "\n";
+  }
+
+  std::cout << "\n=== Wire round trip, "
+            << levelName(namekernels::kernels().level) << " (ns/name) ===\n";
+
+  BytePacketBuffer buffer;
+  double write = nsPerName([&] {
+    for (const auto &name : names) {
+      buffer.seek(12);
+      buffer.writeQName(name);
+    }
+  });
+
+  std::vector<BytePacketBuffer> wires(NAMES);
+  for (size_t i = 0; i < NAMES; i++) {
+    wires[i].seek(12);
+    wires[i].writeQName(names[i]);
+  }
+  std::string name;
+  double read = nsPerName([&] {
+    for (auto &wire : wires) {
+      name.clear();
+      wire.seek(12);
+      wire.readQName(name);
+      sink = sink + name.size();
+    }
+  });
+
+  std::cout << std::setw(14) << "writeQName" << write << "\n"
+            << std::setw(14) << "readQName" << read << "\n";
+  return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: heap allocations per query. Serves the same cache hit
+ * with the query's packets on the default (heap) resource and inside a
+ * QueryArena::Scope, counting every operator new along the way, then runs
+ * the real fast path and worker handlers end to end.
+ **/
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../lib/Core.hpp"
+
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+// std::pmr::new_delete_resource() allocates through the aligned overloads
+void *operator new(size_t size, std::align_val_t align) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  size_t alignment = static_cast<size_t>(align);
+  size_t rounded = (size + alignment - 1) / alignment * alignment;
+  if (void *ptr = std::aligned_alloc(alignment, rounded == 0 ? alignment
+                                                            : rounded)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+constexpr uint64_t QUERIES = 100000;
+
+// long enough that none of the names fit in a small-string buffer
+static const char *const QNAME = "www.example-service.com";
+static const char *const TARGET = "edge-01.cdn.example-service.com";
+
+static BytePacketBuffer makeQuery(uint16_t id) {
+  DnsPacket packet;
+  packet.header.id = id;
+  packet.header.questions = 1;
+  packet.header.recursionDesired = true;
+  packet.questions.push_back(DnsQuestion(QNAME, A{}));
+
+  BytePacketBuffer buffer;
+  packet.write(buffer);
+  buffer.seek(0);
+  return buffer;
+}
+
+// what an upstream server answers for QNAME
+static BytePacketBuffer makeReply(uint16_t id) {
+  DnsPacket packet;
+  packet.header.id = id;
+  packet.header.response = true;
+  packet.header.questions = 1;
+  packet.header.answers = 2;
+  packet.questions.push_back(DnsQuestion(QNAME, A{}));
+  packet.answers.push_back(CNAMERecord{QNAME, TARGET, 300});
+  packet.answers.push_back(ARecord{TARGET, {192, 0, 2, 1}, 300});
+
+  BytePacketBuffer buffer;
+  packet.write(buffer);
+  buffer.seek(0);
+  return buffer;
+}
+
+// a worker's packets for one resolved query: parse the client's query and
+// the upstream reply, move the reply's records into the response and
+// serialize it. no cache and no sockets
+static void serveQuery(const BytePacketBuffer &query,
+                       const BytePacketBuffer &reply) {
+  BytePacketBuffer reqBuffer = query;
+  DnsPacket request =
+      DnsPacket::fromBuffer(reqBuffer, QueryArena::resource());
+  DnsPacket result = DnsPacketView(reply).toPacket(request.get_allocator());
+
+  DnsPacket response = makeResponse(request);
+  DnsQuestion question(std::move(request.questions.back()),
+                       request.get_allocator());
+  fillResponse(response, question, result);
+
+  BytePacketBuffer resBuffer;
+  response.write(resBuffer);
+}
+
+template <typename Fn> double allocationsPerQuery(Fn &&fn) {
+  // warm up so one-time allocations (thread locals, the arena's first
+  // chunk) don't count
+  for (int i = 0; i < 100; i++) {
+    fn();
+  }
+
+  uint64_t before = allocations.load();
+  for (uint64_t i = 0; i < QUERIES; i++) {
+    fn();
+  }
+  return static_cast<double>(allocations.load() - before) / QUERIES;
+}
+
+int main() {
+  // the handlers log every query, keep that out of the output
+  std::ostringstream discard;
+  std::streambuf *stdoutBuf = std::cout.rdbuf(discard.rdbuf());
+  auto report = [stdoutBuf](const std::string &label, double perQuery) {
+    std::ostream out(stdoutBuf);
+    out << std::left << std::setw(36) << label << std::fixed
+        << std::setprecision(2) << perQuery << "\n";
+  };
+
+  BytePacketBuffer query = makeQuery(4242);
+  BytePacketBuffer reply = makeReply(4242);
+
+  // nothing actually goes out on a socket
+  ResponseBatcher::routeTo([](int, const uint8_t *, size_t,
+                              const struct sockaddr_in &) { return true; });
+
+  {
+    std::ostream out(stdoutBuf);
+    out << "=== Heap allocations per query (lower is better) ===\n";
+  }
+
+  report("packets on the heap", allocationsPerQuery([&] {
+           serveQuery(query, reply);
+         }));
+  report("packets in a QueryArena", allocationsPerQuery([&] {
+           QueryArena::Scope arena;
+           serveQuery(query, reply);
+         }));
+
+  ThreadSafeCache cache;
+  cache.insert(DnsName(QNAME), A{}, DnsPacketView(reply).toPacket().answers);
+  // never refuse, every query should take the cache hit path
+  RateLimitConfig rateLimitConfig;
+  rateLimitConfig.maxQueriesPerWindow = 4 * QUERIES;
+  RateLimiter rateLimiter{rateLimitConfig};
+  TransactionTracker tracker;
+  UpstreamSocketPool upstream(tracker, 1);
+  NetworkConfig netConf;
+  struct sockaddr_in client = serverToSockaddr(Server{{127, 0, 0, 1}, 4000});
+
+  report("cache hit, answerFromCache", allocationsPerQuery([&] {
+           BytePacketBuffer reqBuffer = query;
+           answerFromCache(-1, reqBuffer, client, cache, rateLimiter, {});
+         }));
+  report("cache hit, handleQueryThreaded", allocationsPerQuery([&] {
+           BytePacketBuffer reqBuffer = query;
+           handleQueryThreaded(-1, reqBuffer, client, cache, rateLimiter,
+                               tracker, upstream, netConf, true);
+         }));
+
+  ResponseBatcher::routeTo(nullptr);
+  std::cout.rdbuf(stdoutBuf);
+  return 0;
+}
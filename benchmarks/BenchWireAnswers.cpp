@@ -0,0 +1,128 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: serving a cache hit from the cached records (copy them
+ * out, build a DnsPacket, serialize it) against serving it from the
+ * encoded response the wire tier keeps (copy, patch id/flags/TTLs). Once
+ * for the cache step alone and once through the whole fast path.
+ **/
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../lib/Core.hpp"
+
+constexpr size_t NAMES = 1024;
+constexpr int ROUNDS = 200;
+
+static volatile size_t sink = 0;
+
+template <typename Fn> double nsPerHit(Fn &&fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    fn();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         (ROUNDS * NAMES);
+}
+
+// a CDN style answer: a CNAME and the two addresses behind it
+static std::vector<DnsRecord> answerFor(const std::string &name) {
+  std::string target = "edge-01.cdn." + name;
+  return {CNAMERecord{name.c_str(), target.c_str(), 3600},
+          ARecord{target.c_str(), {192, 0, 2, 1}, 300},
+          ARecord{target.c_str(), {192, 0, 2, 2}, 300}};
+}
+
+static BytePacketBuffer makeQuery(uint16_t id, const std::string &name) {
+  DnsPacket packet;
+  packet.header.id = id;
+  packet.header.questions = 1;
+  packet.header.recursionDesired = true;
+  packet.questions.push_back(DnsQuestion(name, A{}));
+
+  BytePacketBuffer buffer;
+  packet.write(buffer);
+  buffer.seek(0);
+  return buffer;
+}
+
+int main() {
+  CacheConfig recordsOnly;
+  recordsOnly.wireAnswers = false;
+  ThreadSafeCache records(recordsOnly);
+  ThreadSafeCache wire;
+
+  std::vector<DnsName> names;
+  std::vector<BytePacketBuffer> queries;
+  for (size_t i = 0; i < NAMES; i++) {
+    std::string name = "www.service-" + std::to_string(i) + ".example.com";
+    names.emplace_back(name);
+    queries.push_back(makeQuery(static_cast<uint16_t>(i), name));
+
+    auto answer = answerFor(name);
+    records.insert(names.back(), A{}, answer);
+    wire.insert(names.back(), A{}, answer);
+  }
+
+  double fromRecords = nsPerHit([&] {
+    for (const auto &name : names) {
+      auto cached = records.lookup(name, A{});
+      DnsPacket response;
+      response.header.response = true;
+      response.questions.push_back(DnsQuestion(name.toString(), A{}));
+      response.answers.assign(std::make_move_iterator(cached->begin()),
+                              std::make_move_iterator(cached->end()));
+      BytePacketBuffer out;
+      response.write(out);
+      sink = sink + out.currentPosition();
+    }
+  });
+
+  double fromWire = nsPerHit([&] {
+    uint8_t out[512];
+    for (size_t i = 0; i < NAMES; i++) {
+      size_t length = wire.lookupWire(names[i], A{}, out);
+      out[0] = static_cast<uint8_t>(i >> 8);
+      out[1] = static_cast<uint8_t>(i);
+      sink = sink + length;
+    }
+  });
+
+  // the fast path end to end, responses stop at the batcher
+  ResponseBatcher::routeTo([](int, const uint8_t *, size_t len,
+                              const struct sockaddr_in &) {
+    sink = sink + len;
+    return true;
+  });
+  RateLimitConfig rateLimitConfig;
+  rateLimitConfig.maxQueriesPerWindow = 8 * ROUNDS * NAMES;
+  RateLimiter rateLimiter{rateLimitConfig};
+  struct sockaddr_in client = serverToSockaddr(Server{{127, 0, 0, 1}, 4000});
+
+  auto fastPath = [&](ThreadSafeCache &cache) {
+    return nsPerHit([&] {
+      for (auto &query : queries) {
+        answerFromCache(-1, query, client, cache, rateLimiter, {});
+      }
+    });
+  };
+  double fastRecords = fastPath(records);
+  double fastWire = fastPath(wire);
+  ResponseBatcher::routeTo(nullptr);
+
+  std::cout << "=== Cache hit serving (ns/hit, lower is better) ===\n"
+            << std::left << std::fixed << std::setprecision(1)
+            << std::setw(34) << "records: lookup, build, write" << fromRecords
+            << "\n"
+            << std::setw(34) << "wire: lookupWire, patch" << fromWire << "\n"
+            << std::setw(34) << "answerFromCache, records" << fastRecords
+            << "\n"
+            << std::setw(34) << "answerFromCache, wire" << fastWire << "\n";
+  return 0;
+}
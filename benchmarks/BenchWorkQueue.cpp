@@ -0,0 +1,91 @@
+/**
+ * Author: frostzt
+ *
+ * Microbenchmark: ThreadPool work distribution, mutex + condvar queue vs the
+ * lock-free bounded ring. Producers push std::function tasks (what the
+ * receive loop hands the pool), consumers pop and run them.
+ **/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../lib/WorkQueue.hpp"
+
+constexpr uint64_t ITEMS_PER_PRODUCER = 200000;
+
+template <typename Queue>
+double run(Queue &queue, size_t producers, size_t consumers) {
+  std::atomic<uint64_t> executed{0};
+  uint64_t total = ITEMS_PER_PRODUCER * producers;
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::jthread> threads;
+  for (size_t c = 0; c < consumers; c++) {
+    threads.emplace_back([&queue] {
+      std::function<void()> task;
+      while (queue.pop(task)) {
+        task();
+      }
+    });
+  }
+
+  {
+    std::vector<std::jthread> producerThreads;
+    for (size_t p = 0; p < producers; p++) {
+      producerThreads.emplace_back([&queue, &executed] {
+        for (uint64_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+          queue.push([&executed] {
+            executed.fetch_add(1, std::memory_order_relaxed);
+          });
+        }
+      });
+    }
+  }
+
+  while (executed.load() < total) {
+    std::this_thread::yield();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  queue.shutdownQueue();
+  threads.clear();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return total / seconds / 1e6;
+}
+
+int main() {
+  struct Shape {
+    size_t producers;
+    size_t consumers;
+  };
+  std::vector<Shape> shapes = {{1, 1}, {1, 4}, {4, 4}, {2, 8}};
+
+  std::cout << "=== Work queue throughput (M tasks/s, higher is better) ===\n";
+  std::cout << std::left << std::setw(12) << "shape" << std::setw(18)
+            << "ThreadSafeQueue" << "BoundedMPMCQueue\n";
+
+  for (const auto &shape : shapes) {
+    ThreadSafeQueue<std::function<void()>> locked;
+    BoundedMPMCQueue<std::function<void()>> lockFree(4096);
+
+    double lockedRate = run(locked, shape.producers, shape.consumers);
+    double lockFreeRate = run(lockFree, shape.producers, shape.consumers);
+
+    std::string label = std::to_string(shape.producers) + "p/" +
+                        std::to_string(shape.consumers) + "c";
+    std::cout << std::left << std::setw(12) << label << std::setw(18)
+              << std::fixed << std::setprecision(2) << lockedRate
+              << lockFreeRate << "\n";
+  }
+
+  return 0;
+}
@@ -1,18 +1,26 @@
 #ifndef BYTEPACKETBUFFER_HPP
 #define BYTEPACKETBUFFER_HPP
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <optional>
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "StringUtils.hpp"
+#include "names/DnsName.hpp"
+#include "names/NameKernels.hpp"
 
 class BytePacketBuffer {
 public:
+  // names remembered for compression, a 512 byte message rarely has more
+  static constexpr size_t MAX_COMPRESSION_OFFSETS = 32;
+
   uint8_t buf[512];
   size_t currPos;
 
@@ -43,8 +51,12 @@ public:
   // read four bytes stepping four steps ahead
   std::optional<uint32_t> readU32();
 
-  // read a qname
-  void readQName(std::string &);
+  // read a qname, into any std::basic_string (std::string, std::pmr::string)
+  template <typename String> void readQName(String &);
+
+  // read a name in uncompressed wire form (terminator included) into
+  // `out`, which needs MAX_NAME_WIRE bytes. Returns its length
+  size_t readWireName(uint8_t *out);
 
   // write 8 bits into buffer
   void write(uint8_t);
@@ -58,14 +70,38 @@ public:
   // write 32 bits into buffer
   void writeU32(uint32_t);
 
-  // write a qname
-  void writeQName(std::string &);
+  // write `length` raw bytes into buffer
+  void writeBytes(const uint8_t *, size_t length);
+
+  // write a qname, as a pointer to an earlier copy of its longest suffix
+  // already in this message when there is one
+  void writeQName(std::string_view);
+
+  // same, for a name that is already in wire form
+  void writeName(const DnsName &);
 
   // sets value at position
   void set(size_t, uint8_t);
 
   // sets a 16 bit value at position
   void setU16(size_t, uint16_t);
+
+private:
+  // per-message suffix table: where each name (and every suffix of it)
+  // written so far starts. entries at or past currPos belong to an older
+  // message written into this buffer and are skipped
+  std::array<uint16_t, MAX_COMPRESSION_OFFSETS> nameOffsets{};
+  size_t nameCount = 0;
+
+  // offset of an earlier name that is exactly the `length` bytes of
+  // `labels`, 0 if none
+  uint16_t findSuffix(const uint8_t *labels, size_t length) const;
+
+  // does the (possibly compressed) name at `pos` match `labels`
+  bool nameMatches(size_t pos, const uint8_t *labels, size_t length) const;
+
+  // write `length` bytes of labels (no terminator), compressed
+  void writeLabels(const uint8_t *labels, size_t length);
 };
 
 inline size_t BytePacketBuffer::currentPosition() { return this->currPos; };
@@ -148,6 +184,15 @@ inline void BytePacketBuffer::writeU32(uint32_t value) {
   this->write(static_cast<uint8_t>(value & 0xFF));
 }
 
+inline void BytePacketBuffer::writeBytes(const uint8_t *data, size_t length) {
+  if (this->currPos + length > 512) {
+    throw std::out_of_range("end of buffer");
+  }
+
+  std::memcpy(&this->buf[this->currPos], data, length);
+  this->currPos += length;
+}
+
 inline std::optional<uint32_t> BytePacketBuffer::readU32() {
   auto byte1 = this->read();
   auto byte2 = this->read();
@@ -164,80 +209,217 @@ inline std::optional<uint32_t> BytePacketBuffer::readU32() {
           static_cast<uint32_t>(*byte4);
 }
 
-inline void BytePacketBuffer::writeQName(std::string &qname) {
-  char delim = '.';
-  std::vector<std::string> labels = stringutils::splitString(qname, delim);
+// https://datatracker.ietf.org/doc/html/rfc1035#section-4.1.4
+inline void BytePacketBuffer::writeQName(std::string_view qname) {
+  uint8_t labels[namekernels::MAX_NAME_WIRE];
+  size_t length = namekernels::textToLabels(qname, labels);
+  this->writeLabels(labels, length);
+}
+
+inline void BytePacketBuffer::writeName(const DnsName &name) {
+  this->writeLabels(reinterpret_cast<const uint8_t *>(name.wire().data()),
+                    name.wire().size() - 1);
+}
 
-  for (const auto &label : labels) {
-    auto len = label.size();
+inline void BytePacketBuffer::writeLabels(const uint8_t *labels,
+                                          size_t length) {
+  // the buffer was rewound for a new message, forget what came after
+  while (this->nameCount > 0 &&
+         this->nameOffsets[this->nameCount - 1] >= this->currPos) {
+    this->nameCount--;
+  }
 
-    // https://datatracker.ietf.org/doc/html/rfc1035#section-2.3.1
-    if (len > 63) {
-      throw std::runtime_error("single label exceeds 63 characters of length");
+  // longest suffix already in the message, checked from the full name down
+  size_t prefix = 0;
+  uint16_t earlier = 0;
+  while (prefix < length) {
+    earlier = this->findSuffix(labels + prefix, length - prefix);
+    if (earlier != 0) {
+      break;
     }
+    prefix += labels[prefix] + 1;
+  }
 
-    // write the length byte
-    this->writeU8(static_cast<uint8_t>(len));
+  // remember where each label we write out in full starts, pointers only
+  // have 14 bits of offset
+  for (size_t at = 0; at < prefix; at += labels[at] + 1) {
+    size_t offset = this->currPos + at;
+    if (this->nameCount < MAX_COMPRESSION_OFFSETS && offset < 0x4000) {
+      this->nameOffsets[this->nameCount++] = static_cast<uint16_t>(offset);
+    }
+  }
 
-    // write the label
-    for (char c : label) {
-      this->writeU8(static_cast<uint8_t>(c));
+  this->writeBytes(labels, prefix);
+  if (earlier != 0) {
+    this->writeU16(0xC000 | earlier);
+  } else {
+    // write the null ptr
+    this->writeU8(0);
+  }
+}
+
+inline uint16_t BytePacketBuffer::findSuffix(const uint8_t *labels,
+                                             size_t length) const {
+  for (size_t i = 0; i < this->nameCount; i++) {
+    uint16_t offset = this->nameOffsets[i];
+    if (offset < this->currPos && this->nameMatches(offset, labels, length)) {
+      return offset;
     }
   }
+  return 0;
+}
+
+inline bool BytePacketBuffer::nameMatches(size_t pos, const uint8_t *labels,
+                                          size_t length) const {
+  const size_t maxJumps = 5;
+  size_t jumpsPerformed = 0;
+  size_t at = 0;
+
+  while (true) {
+    if (pos >= this->currPos) {
+      return false;
+    }
+
+    uint8_t len = this->buf[pos];
+    if ((len & 0xC0) == 0xC0) {
+      if (pos + 1 >= this->currPos || ++jumpsPerformed > maxJumps) {
+        return false;
+      }
+      pos = ((len & 0x3F) << 8) | this->buf[pos + 1];
+      continue;
+    }
+
+    if (len == 0) {
+      return at == length;
+    }
 
-  // write the null ptr
-  this->writeU8(0);
+    // labels compare byte for byte so the reader gets back the same case
+    if (at >= length || labels[at] != len || pos + 1 + len > this->currPos ||
+        std::memcmp(&this->buf[pos + 1], &labels[at + 1], len) != 0) {
+      return false;
+    }
+
+    at += 1 + len;
+    pos += 1 + len;
+  }
 }
 
-inline void BytePacketBuffer::readQName(std::string &outstr) {
+template <typename String>
+inline void BytePacketBuffer::readQName(String &outstr) {
   auto pos = this->currPos;
 
   const size_t maxJumps = 5;
   auto jumped = false;
   size_t jumpsPerformed = 0;
 
-  auto delim = "";
+  bool first = true;
   while (true) {
-    if (jumpsPerformed > maxJumps) {
-      throw std::runtime_error("limit of jumps exceeded maximum jumps");
+    // find the run of plain labels up to the next pointer or the end, and
+    // convert it in one go
+    size_t runStart = pos;
+    uint8_t len = *this->get(pos);
+    while (len != 0 && (len & 0xC0) == 0) {
+      pos += 1 + len;
+      len = *this->get(pos);
     }
 
-    auto len = this->get(pos);
+    if (pos > runStart) {
+      size_t at = outstr.size();
+      size_t extra = pos - runStart - (first ? 1 : 0);
+      outstr.resize(at + extra);
+
+      char *out = outstr.data() + at;
+      if (!first) {
+        *out++ = '.';
+      }
+      if (!namekernels::labelsToText(&this->buf[runStart], pos - runStart,
+                                     out)) {
+        throw std::runtime_error("label holds a byte that needs escaping");
+      }
+      first = false;
+    }
+
+    if (len == 0) {
+      pos += 1;
+      break;
+    }
 
     // if two MSB are set then its a jump
-    if ((*len & 0xC0) == 0xC0) {
-      if (!jumped) {
-        this->seek(pos + 2);
+    if ((len & 0xC0) != 0xC0) {
+      throw std::runtime_error("unsupported label type");
+    }
+    if (++jumpsPerformed > maxJumps) {
+      throw std::runtime_error("limit of jumps exceeded maximum jumps");
+    }
+
+    auto nextByte = static_cast<uint16_t>(*this->get(pos + 1));
+    if (!jumped) {
+      this->seek(pos + 2);
+    }
+
+    pos = static_cast<size_t>(((len & 0x3F) << 8) | nextByte);
+    jumped = true;
+  }
+
+  if (!jumped) {
+    this->seek(pos);
+  }
+}
+
+inline size_t BytePacketBuffer::readWireName(uint8_t *out) {
+  auto pos = this->currPos;
+
+  const size_t maxJumps = 5;
+  auto jumped = false;
+  size_t jumpsPerformed = 0;
+  size_t length = 0;
+
+  while (true) {
+    uint8_t len = *this->get(pos);
+
+    if ((len & 0xC0) == 0xC0) {
+      if (++jumpsPerformed > maxJumps) {
+        throw std::runtime_error("limit of jumps exceeded maximum jumps");
       }
 
       auto nextByte = static_cast<uint16_t>(*this->get(pos + 1));
-      auto offset = ((static_cast<uint16_t>(*len) ^ 0xC0) << 8) | nextByte;
-      pos = static_cast<size_t>(offset);
+      if (!jumped) {
+        this->seek(pos + 2);
+      }
 
+      pos = static_cast<size_t>(((len & 0x3F) << 8) | nextByte);
       jumped = true;
-      jumpsPerformed += 1;
-
       continue;
-    } else {
-      pos += 1;
-      if (len == 0) {
-        break;
-      }
+    }
 
-      outstr.append(delim);
+    if ((len & 0xC0) != 0) {
+      throw std::runtime_error("unsupported label type");
+    }
 
-      auto stringBuffer = this->getRange(pos, *len);
-      outstr.append(reinterpret_cast<const char *>(stringBuffer.data()),
-                    stringBuffer.size());
+    if (length + 1 + len > namekernels::MAX_NAME_WIRE) {
+      throw std::runtime_error("name exceeds 255 bytes");
+    }
+
+    out[length++] = len;
+    pos += 1;
+    if (len == 0) {
+      break;
+    }
 
-      delim = ".";
-      pos += static_cast<size_t>(*len);
+    auto label = this->getRange(pos, len);
+    if (!namekernels::labelBytesValid(
+            reinterpret_cast<const char *>(label.data()), len)) {
+      throw std::runtime_error("label holds a byte that needs escaping");
     }
+    std::memcpy(out + length, label.data(), len);
+    length += len;
+    pos += len;
   }
 
   if (!jumped) {
     this->seek(pos);
   }
+  return length;
 }
 
 #endif // BYTEPACKETBUFFER_HPP
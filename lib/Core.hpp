@@ -6,6 +6,9 @@
 #include <chrono>
 #include <cstddef>
 #include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
 #include <netinet/in.h>
 #include <stdexcept>
 #include <string>
@@ -14,6 +17,8 @@
 #include <unordered_set>
 
 #include "BytePacketBuffer.hpp"
+#include "DnsHeader.hpp"
+#include "DnsPacketView.hpp"
 #include "DnsPacket.hpp"
 #include "DnsQuestion.hpp"
 #include "QueryType.hpp"
@@ -22,159 +27,110 @@
 #include "RootServers.hpp"
 #include "StringUtils.hpp"
 #include "cache/ThreadSafeCache.hpp"
-#include "cache/ThreadSafeCache.hpp"
 #include "common/ServerConfig.hpp"
 #include "config/NetworkConfig.hpp"
+#include "config/OverloadConfig.hpp"
+#include "config/ResolverConfig.hpp"
 #include "errors/errors.hpp"
+#include "metrics/LatencyHistogram.hpp"
+#include "io/ResponseBatcher.hpp"
+#include "io/UpstreamSocketPool.hpp"
+#include "memory/QueryArena.hpp"
+#include "names/DnsName.hpp"
+#include "overload/CoDelShedder.hpp"
+#include "resolver/AsyncResolver.hpp"
+#include "resolver/Awaitables.hpp"
+#include "resolver/EventLoop.hpp"
+#include "resolver/Task.hpp"
 #include "security/RateLimiter.hpp"
 #include "security/SecurityUtils.hpp"
 #include "tracking/TransactionTracker.hpp"
 
-// Max recursion depth allowed in recursive queries
-const size_t MAX_RECURSION_DEPTH = 10;
-
-inline DnsPacket lookup(std::string &qname, QueryType qtype, Server serverConf,
-                        TransactionTracker &tracker,
-                        NetworkConfig config = NetworkConfig{}) {
-  // create udp socket
-  int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-
-  // bind to local address
-  struct sockaddr_in local_addr;
-  local_addr.sin_family = AF_INET;
-  local_addr.sin_addr.s_addr = INADDR_ANY;
-  local_addr.sin_port = htons(0);
-  if (bind(sockfd, (const struct sockaddr *)&local_addr, sizeof(local_addr)) <
-      0) {
-    close(sockfd);
-    throw std::runtime_error("udp socket failed to bind");
-  }
-
-  // set timeout for socket
-  struct timeval tv;
-  tv.tv_sec = config.recvTimeoutMs / 1000;
-  tv.tv_usec = (config.recvTimeoutMs % 1000) * 1000;
-  if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-    std::cerr << "Warning: failed to set socket send timeout" << std::endl;
-  }
-
-  tv.tv_sec = config.sendTimeoutMs / 1000;
-  tv.tv_usec = (config.sendTimeoutMs % 1000) * 1000;
-  if (setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
-    std::cerr << "Warning: failed to set socket send timeout" << std::endl;
-  }
-
+/**
+ * Send one query to `serverConf` and return its raw reply. Callers parse it
+ * with a DnsPacketView so referrals never get materialized
+ **/
+inline BytePacketBuffer lookup(const DnsName &qname, QueryType qtype,
+                               Server serverConf, TransactionTracker &tracker,
+                               UpstreamSocketPool &upstream,
+                               NetworkConfig config = NetworkConfig{}) {
   // generate a new transaction id
   auto txnId = SecurityUtils::generateTransactionId(tracker);
 
-  // track this transaction
-  tracker.registerTxn(txnId, qname, qtype, serverConf);
-
-  // build a dns packet
-  DnsPacket packet;
-  packet.header.id = txnId;
-  packet.header.questions = 1;
-  packet.header.recursionDesired = true;
-  packet.questions.push_back(DnsQuestion(qname, qtype));
-
-  // write into buffer
   BytePacketBuffer reqBuffer;
-  packet.write(reqBuffer);
-
-  // create a server pointing to dns resolver
-  struct sockaddr_in serverAddr;
-  serverAddr.sin_family = AF_INET;
-  serverAddr.sin_port = htons(serverConf.s_port);
-  serverAddr.sin_addr.s_addr =
-      htonl((static_cast<uint32_t>(serverConf.s_addr[0]) << 24) |
-            (static_cast<uint32_t>(serverConf.s_addr[1]) << 16) |
-            (static_cast<uint32_t>(serverConf.s_addr[2]) << 8) |
-            static_cast<uint32_t>(serverConf.s_addr[3]));
-
-  // send this to DNS resolver
-  sendto(sockfd, reqBuffer.buf, reqBuffer.currentPosition(), 0,
-         (struct sockaddr *)&serverAddr, sizeof(serverAddr));
-
-  // receive response
-  struct sockaddr_in srcAddr;
-  socklen_t srcAddrLen = sizeof(srcAddr);
-  BytePacketBuffer resBuffer;
-  ssize_t bytesRecv = recvfrom(sockfd, resBuffer.buf, 512, 0,
-                               (struct sockaddr *)&srcAddr, &srcAddrLen);
-  if (bytesRecv < 0) {
-    close(sockfd);
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-      throw TimeoutException("DNS query timed out");
-    }
-    throw std::runtime_error("recvfrom failed: " +
-                             std::string(strerror(errno)));
-  }
+  writeQuery(reqBuffer, txnId, qname, qtype);
 
-  // parse and print
-  DnsPacket resPacket = DnsPacket::fromBuffer(resBuffer);
-
-  // validate response
-  if (resPacket.header.id != txnId) {
-    throw SecurityException("Transaction ID mismatch! Possible attack!");
-  }
-
-  // validate source and server address and port
-  if (srcAddr.sin_addr.s_addr != serverAddr.sin_addr.s_addr ||
-      srcAddr.sin_port != serverAddr.sin_port) {
-    throw SecurityException("Response from unexpected source!");
-  }
+  // we're about to block on upstream, don't hold finished responses hostage
+  ResponseBatcher::flush();
 
-  // validate that we got response instead of a new query
-  if (!resPacket.header.response) {
-    throw SecurityException("Received query instead of response!");
-  }
-
-  // txn succeeded
-  tracker.removeTxn(txnId);
-
-  close(sockfd);
-  return resPacket;
+  // send it over the shared pool, the tracker only hands us a reply that
+  // matches the server, port, txn id and question we sent
+  return upstream.exchange(txnId, qname, qtype, serverConf, reqBuffer,
+                           config.recvTimeoutMs);
 }
 
-inline DnsPacket
-recursiveLookup(std::string &qname, QueryType qtype, ThreadSafeCache &cache,
-                NetworkConfig &netConf, TransactionTracker &tracker,
-                size_t depth = 0,
-                std::unordered_set<std::string> *visited = nullptr) {
+/**
+ * Walk from the root (or the closest cached nameserver) down to an answer
+ * for `qname`. Packets and the visited set come from the calling thread's
+ * QueryArena when one is open
+ **/
+using VisitedNames =
+    std::pmr::unordered_set<DnsName, DnsNameHash, DnsNameEqual>;
+
+// whether a lookup may be answered from the cache. A prefetch refreshes the
+// cached answer so it goes upstream, nameservers still come from the cache
+enum class CacheUse {
+  Answer,
+  Refresh,
+};
+
+inline DnsPacket recursiveLookup(const DnsName &qname, QueryType qtype,
+                                 ThreadSafeCache &cache,
+                                 NetworkConfig &netConf,
+                                 TransactionTracker &tracker,
+                                 UpstreamSocketPool &upstream,
+                                 size_t depth = 0,
+                                 VisitedNames *visited = nullptr,
+                                 CacheUse use = CacheUse::Answer) {
+  std::pmr::memory_resource *arena = QueryArena::resource();
+
   // init a set to track domains we're visiting
-  std::unordered_set<std::string> visitedSet;
+  VisitedNames visitedSet(arena);
   if (visited == nullptr) {
     visited = &visitedSet;
   }
 
-  if (visited->count(qname) > 0) {
+  // copied into the set's (arena) memory
+  if (!visited->insert(qname).second) {
     std::cerr << "Circular reference detected: " << qname << std::endl;
-    DnsPacket error_response;
+    DnsPacket error_response(arena);
     error_response.header.rescode = ResultCode::SERVFAIL;
     return error_response;
   }
 
-  visited->insert(qname);
-
   // if we exceed maximum depth we'll return out
   if (depth >= MAX_RECURSION_DEPTH) {
     std::cerr << "Max recursion depth (" << MAX_RECURSION_DEPTH
               << ") exceeded for " << qname << std::endl;
-    DnsPacket error_response;
+    DnsPacket error_response(arena);
     error_response.header.rescode = ResultCode::SERVFAIL;
     return error_response;
   }
 
   // check main cache
-  auto cached = cache.lookup(qname, qtype);
+  std::optional<std::vector<DnsRecord>> cached;
+  if (use == CacheUse::Answer) {
+    cached = cache.lookup(qname, qtype);
+  }
   if (cached.has_value()) {
     std::cout << "Cache HIT: " << qname << std::endl;
-    DnsPacket response;
+    DnsPacket response(arena);
 
     if (cached->empty()) {
       response.header.rescode = ResultCode::NXDOMAIN;
     } else {
-      response.answers = *cached;
+      response.answers.assign(std::make_move_iterator(cached->begin()),
+                              std::make_move_iterator(cached->end()));
       response.header.rescode = ResultCode::NOERROR;
     }
 
@@ -183,23 +139,17 @@ recursiveLookup(std::string &qname, QueryType qtype, ThreadSafeCache &cache,
 
   std::cout << "Cache MISS: " << qname << std::endl;
 
-  // try to find cached ns for this domain
+  // try to find cached ns for this domain, then each parent domain up to
+  // the tld
   std::optional<std::array<uint8_t, 4>> ns = std::nullopt;
-  std::string domain = qname;
-  while (true) {
+  for (DnsNameView domain = qname; !domain.isRoot();
+       domain = domain.parent()) {
     ns = cache.lookupNS(domain);
     if (ns.has_value()) {
       std::cout << "NS Cache HIT for domain " << domain << " -> "
                 << stringutils::ipv4ToString(*ns) << std::endl;
       break;
     }
-
-    // move to parent domain
-    size_t dot = domain.find('.');
-    if (dot == std::string::npos) {
-      break;
-    }
-    domain = domain.substr(dot + 1);
   }
 
   std::cout << "[Depth " << depth << "] Looking up " << qname << std::endl;
@@ -231,11 +181,11 @@ recursiveLookup(std::string &qname, QueryType qtype, ThreadSafeCache &cache,
       auto start = std::chrono::steady_clock::now();
 
       RetryPolicy retry{NetworkConfig{}};
-      DnsPacket response;
+      BytePacketBuffer resBuffer;
       try {
-        response = retry.executeWithRetry(
-            [&qname, &qtype, &server, &tracker, &netConf]() {
-              return lookup(qname, qtype, server, tracker, netConf);
+        resBuffer = retry.executeWithRetry(
+            [&qname, &qtype, &server, &tracker, &upstream, &netConf]() {
+              return lookup(qname, qtype, server, tracker, upstream, netConf);
             });
 
         auto end = std::chrono::steady_clock::now();
@@ -253,66 +203,287 @@ recursiveLookup(std::string &qname, QueryType qtype, ThreadSafeCache &cache,
         break;
       }
 
+      DnsPacketView response = parseUpstreamReply(resBuffer);
+
       // if entries in answer section and no errors we are done
-      if (!response.answers.empty() &&
-          response.header.rescode == ResultCode::NOERROR) {
-        cache.insert(qname, qtype, response.answers);
-        return response;
+      if (response.answerCount() > 0 &&
+          response.rescode() == ResultCode::NOERROR) {
+        DnsPacket result = response.toPacket(arena);
+        cache.insert(qname, qtype, result.answers);
+        return result;
       }
 
       // exit if NXDOMAIN
-      if (response.header.rescode == ResultCode::NXDOMAIN) {
+      if (response.rescode() == ResultCode::NXDOMAIN) {
         cache.insertNegative(qname, qtype, ResultCode::NXDOMAIN, 300);
-        return response;
+        return response.toPacket(arena);
       }
 
-      // exit if SERVFAIL
-      if (response.header.rescode == ResultCode::SERVFAIL) {
-        cache.insertNegative(qname, qtype, ResultCode::SERVFAIL, 300);
-        return response;
+      // exit if SERVFAIL. a failed refresh leaves the answer it was
+      // refreshing in place
+      if (response.rescode() == ResultCode::SERVFAIL) {
+        if (use == CacheUse::Answer) {
+          cache.insertNegative(qname, qtype, ResultCode::SERVFAIL, 300);
+        }
+        return response.toPacket(arena);
       }
 
-      // cache NS records from authority section
-      auto nameservers = response.getNs(qname);
-      for (const auto &[domain, host] : nameservers) {
-        // look for glue records (a records for ns in addtional section)
-        for (const auto &resource : response.resources) {
-          if (auto *arecord = std::get_if<ARecord>(&resource)) {
-            if (arecord->domain == host) {
-              // cache this ns
-              std::string domainStr(domain);
-              cache.insertNS(domainStr, arecord->addr, arecord->ttl);
-              std::cout << "Cached NS: " << domainStr << " -> "
-                        << stringutils::ipv4ToString(arecord->addr)
-                        << std::endl;
-            }
+      // cache NS records from authority section that came with glue (a
+      // records for the ns in the additional section)
+      response.forEachGlue(
+          qname, [&cache](const NameView &domain, const RecordView &glue) {
+            DnsName zone = domain.toName();
+            cache.insertNS(zone, glue.ipv4(), glue.ttl);
+            std::cout << "Cached NS: " << zone << " -> "
+                      << stringutils::ipv4ToString(glue.ipv4()) << std::endl;
+          });
+
+      auto resolvedNs = response.getResolvedNs(qname);
+      if (resolvedNs.has_value()) {
+        ns = resolvedNs;
+        continue;
+      }
+
+      auto unresolvedNs = response.getUnresolvedNs(qname);
+      if (!unresolvedNs.has_value()) {
+        return response.toPacket(arena);
+      }
+
+      DnsPacket recursiveResponse =
+          recursiveLookup(*unresolvedNs, A{}, cache, netConf, tracker,
+                          upstream, depth + 1, visited);
+
+      auto newNs = recursiveResponse.getRandomA();
+      if (newNs.has_value()) {
+        ns = newNs;
+        continue;
+      } else {
+        return response.toPacket(arena);
+      }
+    }
+  }
+
+  throw std::runtime_error("all root servers failed");
+}
+
+/**
+ * Coroutine flavour of lookup(), suspends on the upstream exchange instead
+ * of blocking the thread. Runs on `loop`
+ **/
+inline Task<BytePacketBuffer>
+lookupCo(DnsName qname, QueryType qtype, Server serverConf,
+         TransactionTracker &tracker, UpstreamSocketPool &upstream,
+         EventLoop &loop, NetworkConfig config = NetworkConfig{}) {
+  // generate a new transaction id
+  auto txnId = SecurityUtils::generateTransactionId(tracker);
+
+  BytePacketBuffer reqBuffer;
+  writeQuery(reqBuffer, txnId, qname, qtype);
+
+  // suspended until the tracker hands us the matching reply or we time out
+  co_return co_await UpstreamExchange(loop, upstream, txnId, qname, qtype,
+                                      serverConf, reqBuffer,
+                                      config.recvTimeoutMs);
+}
+
+/**
+ * Coroutine flavour of recursiveLookup(), same walk, same cache inserts and
+ * referral handling. Arguments are taken by value where the frame has to
+ * own them, a suspended lookup outlives its caller's temporaries. A timeout
+ * past `deadline` isn't retried, the lookup throws instead
+ **/
+inline Task<DnsPacket> recursiveLookupCo(
+    DnsName qname, QueryType qtype, ThreadSafeCache &cache,
+    NetworkConfig &netConf, TransactionTracker &tracker,
+    UpstreamSocketPool &upstream, EventLoop &loop, size_t depth = 0,
+    std::shared_ptr<VisitedNames> visited = nullptr,
+    CacheUse use = CacheUse::Answer,
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max()) {
+  // init a set to track domains we're visiting
+  if (visited == nullptr) {
+    visited = std::make_shared<VisitedNames>();
+  }
+
+  if (!visited->insert(qname).second) {
+    std::cerr << "Circular reference detected: " << qname << std::endl;
+    DnsPacket error_response;
+    error_response.header.rescode = ResultCode::SERVFAIL;
+    co_return error_response;
+  }
+
+  // if we exceed maximum depth we'll return out
+  if (depth >= MAX_RECURSION_DEPTH) {
+    std::cerr << "Max recursion depth (" << MAX_RECURSION_DEPTH
+              << ") exceeded for " << qname << std::endl;
+    DnsPacket error_response;
+    error_response.header.rescode = ResultCode::SERVFAIL;
+    co_return error_response;
+  }
+
+  // check main cache
+  std::optional<std::vector<DnsRecord>> cached;
+  if (use == CacheUse::Answer) {
+    cached = cache.lookup(qname, qtype);
+  }
+  if (cached.has_value()) {
+    std::cout << "Cache HIT: " << qname << std::endl;
+    DnsPacket response;
+
+    if (cached->empty()) {
+      response.header.rescode = ResultCode::NXDOMAIN;
+    } else {
+      response.answers.assign(std::make_move_iterator(cached->begin()),
+                              std::make_move_iterator(cached->end()));
+      response.header.rescode = ResultCode::NOERROR;
+    }
+
+    co_return response;
+  }
+
+  std::cout << "Cache MISS: " << qname << std::endl;
+
+  // try to find cached ns for this domain, then each parent domain up to
+  // the tld
+  std::optional<std::array<uint8_t, 4>> ns = std::nullopt;
+  for (DnsNameView domain = qname; !domain.isRoot();
+       domain = domain.parent()) {
+    ns = cache.lookupNS(domain);
+    if (ns.has_value()) {
+      std::cout << "NS Cache HIT for domain " << domain << " -> "
+                << stringutils::ipv4ToString(*ns) << std::endl;
+      break;
+    }
+  }
+
+  std::cout << "[Depth " << depth << "] Looking up " << qname << std::endl;
+
+  bool prevNSTimedOut = false;
+
+  // loop and try every possible root server
+  for (auto &rs : RootServerRepository::servers) {
+    // if no cached ns found start from root
+    if (!ns.has_value() || prevNSTimedOut) {
+      // pick a root server
+      ns = rs.ipv4address;
+      std::cout << "=== Using root server: " << rs.hostname << " ("
+                << stringutils::ipv4ToString(rs.ipv4address) << ")"
+                << " [hits: " << rs.hits << ", timeouts: " << rs.timeoutCounts
+                << "]" << std::endl;
+    }
+
+    while (true) {
+      std::cout << "attempting lookup of " << fromQueryTypeToNumber(qtype)
+                << " " << qname << " with ns " << stringutils::ipv4ToString(*ns)
+                << "\n";
+
+      Server server{*ns, 53};
+
+      // start counter for tracking latency
+      auto start = std::chrono::steady_clock::now();
+
+      // same backoff as RetryPolicy, but the wait suspends instead of
+      // sleeping (no co_await allowed inside a catch block, hence the flag)
+      BytePacketBuffer resBuffer;
+      bool timedOut = true;
+      auto delayMs = netConf.initialRetryDelayMs;
+      for (int attempt = 0; attempt < netConf.maxRetries; attempt++) {
+        try {
+          resBuffer = co_await lookupCo(qname, qtype, server, tracker,
+                                        upstream, loop, netConf);
+          timedOut = false;
+          break;
+        } catch (const TimeoutException &e) {
+          // the client has stopped waiting, don't keep an upstream busy
+          // for it
+          if (std::chrono::steady_clock::now() >= deadline) {
+            throw std::runtime_error("client stopped waiting");
+          }
+          if (attempt == netConf.maxRetries - 1) {
+            break; // last attempt failed
           }
         }
+
+        std::cerr << "Attempt " << (attempt + 1) << " timed out, retrying in "
+                  << delayMs << "ms..." << std::endl;
+
+        co_await SleepFor{loop, std::chrono::milliseconds(delayMs)};
+        delayMs *= netConf.backoffMultiplier;
       }
 
+      if (timedOut) {
+        rs.timeoutCounts++;
+        std::cerr << "Root server " << rs.hostname << " timed out after retries"
+                  << std::endl;
+        prevNSTimedOut = true;
+        break;
+      }
+
+      auto end = std::chrono::steady_clock::now();
+      auto latency =
+          std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+              .count();
+
+      rs.avgLatency = (rs.avgLatency * rs.hits + latency) / (rs.hits + 1);
+      rs.hits++;
+
+      DnsPacketView response = parseUpstreamReply(resBuffer);
+
+      // if entries in answer section and no errors we are done
+      if (response.answerCount() > 0 &&
+          response.rescode() == ResultCode::NOERROR) {
+        DnsPacket result = response.toPacket();
+        cache.insert(qname, qtype, result.answers);
+        co_return result;
+      }
+
+      // exit if NXDOMAIN
+      if (response.rescode() == ResultCode::NXDOMAIN) {
+        cache.insertNegative(qname, qtype, ResultCode::NXDOMAIN, 300);
+        co_return response.toPacket();
+      }
+
+      // exit if SERVFAIL. a failed refresh leaves the answer it was
+      // refreshing in place
+      if (response.rescode() == ResultCode::SERVFAIL) {
+        if (use == CacheUse::Answer) {
+          cache.insertNegative(qname, qtype, ResultCode::SERVFAIL, 300);
+        }
+        co_return response.toPacket();
+      }
+
+      // cache NS records from authority section that came with glue (a
+      // records for the ns in the additional section)
+      response.forEachGlue(
+          qname, [&cache](const NameView &domain, const RecordView &glue) {
+            DnsName zone = domain.toName();
+            cache.insertNS(zone, glue.ipv4(), glue.ttl);
+            std::cout << "Cached NS: " << zone << " -> "
+                      << stringutils::ipv4ToString(glue.ipv4()) << std::endl;
+          });
+
       auto resolvedNs = response.getResolvedNs(qname);
       if (resolvedNs.has_value()) {
         ns = resolvedNs;
         continue;
       }
 
-      std::string newNsServer;
       auto unresolvedNs = response.getUnresolvedNs(qname);
       if (!unresolvedNs.has_value()) {
-        return response;
+        co_return response.toPacket();
       }
 
-      std::string newNsName = *unresolvedNs;
-
-      DnsPacket recursiveResponse = recursiveLookup(
-          newNsName, A{}, cache, netConf, tracker, depth + 1, visited);
+      DnsPacket recursiveResponse =
+          co_await recursiveLookupCo(*unresolvedNs, A{}, cache, netConf,
+                                     tracker, upstream, loop, depth + 1,
+                                     visited, CacheUse::Answer, deadline);
 
       auto newNs = recursiveResponse.getRandomA();
       if (newNs.has_value()) {
         ns = newNs;
         continue;
       } else {
-        return response;
+        co_return response.toPacket();
       }
     }
   }
@@ -323,7 +494,7 @@ recursiveLookup(std::string &qname, QueryType qtype, ThreadSafeCache &cache,
 inline void returnRefusedBecauseRateLimited(int sockfd,
                                             std::string &clientIpString,
                                             struct sockaddr_in srcAddr,
-                                            DnsPacket request) {
+                                            const DnsPacket &request) {
   std::cout << "Rate limited: " << clientIpString << std::endl;
 
   // send refused
@@ -334,72 +505,252 @@ inline void returnRefusedBecauseRateLimited(int sockfd,
 
   BytePacketBuffer resBuffer;
   response.write(resBuffer);
-  sendto(sockfd, resBuffer.buf, resBuffer.currentPosition(), 0,
-         (struct sockaddr *)&srcAddr, sizeof(srcAddr));
+  ResponseBatcher::send(sockfd, resBuffer.buf, resBuffer.currentPosition(),
+                        srcAddr);
+}
+
+/**
+ * Send `response`, with nothing but its header, as the answer to a query we
+ * decided not to work on, according to `policy`
+ **/
+inline void shedResponse(int sockfd, DnsPacket &response,
+                         const struct sockaddr_in &srcAddr,
+                         ShedPolicy policy) {
+  if (policy == ShedPolicy::Drop) {
+    return;
+  }
+
+  // write() zeroes the section counts
+  response.header.response = true;
+  response.header.recursionAvailable = true;
+  response.header.rescode = policy == ShedPolicy::Refused
+                                ? ResultCode::REFUSED
+                                : ResultCode::SERVFAIL;
+
+  BytePacketBuffer resBuffer;
+  response.write(resBuffer);
+  ResponseBatcher::send(sockfd, resBuffer.buf, resBuffer.currentPosition(),
+                        srcAddr);
+}
+
+/**
+ * Answer a query we decided not to work on, according to `policy`. Only
+ * the header is parsed, an overloaded server shouldn't spend more than that
+ **/
+inline void shedQuery(int sockfd, BytePacketBuffer &reqBuffer,
+                      const struct sockaddr_in &srcAddr, ShedPolicy policy) {
+  if (policy == ShedPolicy::Drop) {
+    return;
+  }
+
+  // echo the id and flags
+  DnsPacket response;
+  try {
+    reqBuffer.seek(0);
+    response.header.read(reqBuffer);
+  } catch (const std::exception &e) {
+    return;
+  }
+
+  shedResponse(sockfd, response, srcAddr, policy);
+}
+
+// response skeleton for `request`, rescode and sections are filled in later.
+// allocates from the same resource as the request
+inline DnsPacket makeResponse(const DnsPacket &request) {
+  DnsPacket response(request.get_allocator());
+  response.header.id = request.header.id;
+  response.header.recursionDesired = request.header.recursionDesired;
+  response.header.recursionAvailable = true;
+  response.header.response = true;
+  return response;
+}
+
+// move the outcome of a lookup for `question` into the client's response
+inline void fillResponse(DnsPacket &response, const DnsQuestion &question,
+                         DnsPacket &result) {
+  response.questions.push_back(question);
+  response.header.rescode = result.header.rescode;
+
+  // answers
+  for (auto &rec : result.answers) {
+    std::cout << "Answer: ";
+    std::visit([](const auto &r) { std::cout << r << std::endl; }, rec);
+    response.answers.push_back(std::move(rec));
+  }
+
+  // authorities
+  for (auto &rec : result.authorities) {
+    std::cout << "Authority: ";
+    std::visit([](const auto &r) { std::cout << r << std::endl; }, rec);
+    response.authorities.push_back(std::move(rec));
+  }
+
+  // resources
+  for (auto &rec : result.resources) {
+    std::cout << "Resource: ";
+    std::visit([](const auto &r) { std::cout << r << std::endl; }, rec);
+    response.resources.push_back(std::move(rec));
+  }
+}
+
+/**
+ * Make an encoded cached response (see WireAnswer) the answer to `query`:
+ * its id, its RD bit and the name spelled the way the client did. The name
+ * is the same one in a different case, so it takes up the same bytes
+ **/
+inline void patchCachedResponse(uint8_t *response, const DnsHeader &query,
+                                const NameView &qname) {
+  response[0] = static_cast<uint8_t>(query.id >> 8);
+  response[1] = static_cast<uint8_t>(query.id & 0xFF);
+  uint8_t rd = query.recursionDesired ? 1 : 0;
+  response[2] = static_cast<uint8_t>((response[2] & ~1u) | rd);
+  qname.copyWire(response + WireAnswer::QUESTION_OFFSET);
+}
+
+inline void sendResponse(int sockfd, DnsPacket &response,
+                         const struct sockaddr_in &srcAddr) {
+  BytePacketBuffer resBuffer;
+  response.write(resBuffer);
+
+  // coalesced with other responses from this thread into one sendmmsg
+  ResponseBatcher::send(sockfd, resBuffer.buf, resBuffer.currentPosition(),
+                        srcAddr);
 }
 
-inline void handleQueryThreaded(int sockfd, BytePacketBuffer reqBuffer,
+enum class FastPathResult {
+  // answered (or refused) on the spot, nothing left to do
+  Answered,
+  // cache miss, already charged to the rate limiter
+  Miss,
+  // not something the fast path deals with, untouched
+  NotHandled,
+};
+
+/**
+ * Fast path run on the receive thread before a query is dispatched. Reads
+ * the header and question through a DnsPacketView, applies the rate limit
+ * and answers straight from the cache. Only misses (and anything odd) go on
+ * to the workers. `reqBuffer` itself is never moved
+ **/
+inline FastPathResult answerFromCache(int sockfd, BytePacketBuffer &reqBuffer,
+                                      const struct sockaddr_in &srcAddr,
+                                      ThreadSafeCache &cache,
+                                      RateLimiter &rateLimiter,
+                                      QueryTimer timer) {
+  QueryArena::Scope arena;
+  DnsPacket request(QueryArena::resource());
+  QuestionView questionView{};
+  std::optional<DnsName> qname;
+  try {
+    DnsPacketView view(reqBuffer);
+
+    // multi question and malformed queries keep the slow path semantics
+    if (view.questionCount() != 1) {
+      return FastPathResult::NotHandled;
+    }
+
+    request.header = view.header();
+    questionView = view.question();
+    qname = questionView.name.toName(request.get_allocator());
+  } catch (const std::exception &e) {
+    return FastPathResult::NotHandled;
+  }
+
+  // get client ip
+  char clientIp[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &srcAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
+  std::string clientIpString(clientIp);
+
+  // check rate limits
+  if (!rateLimiter.allowQuery(clientIpString)) {
+    returnRefusedBecauseRateLimited(sockfd, clientIpString, srcAddr, request);
+    timer.record();
+    return FastPathResult::Answered;
+  }
+
+  // the cached response as is, only what differs between queries patched
+  uint8_t wire[sizeof(reqBuffer.buf)];
+  size_t length = cache.lookupWire(*qname, questionView.queryType(), wire);
+  if (length > 0) {
+    patchCachedResponse(wire, request.header, questionView.name);
+    ResponseBatcher::send(sockfd, wire, length, srcAddr);
+    timer.record();
+    return FastPathResult::Answered;
+  }
+
+  auto cached = cache.lookup(*qname, questionView.queryType());
+  if (!cached.has_value()) {
+    return FastPathResult::Miss;
+  }
+
+  // same answer the recursive lookup builds for a cache hit
+  DnsPacket response = makeResponse(request);
+  response.questions.push_back(
+      questionView.toQuestion(request.get_allocator()));
+  if (cached->empty()) {
+    response.header.rescode = ResultCode::NXDOMAIN;
+  } else {
+    response.answers.assign(std::make_move_iterator(cached->begin()),
+                            std::make_move_iterator(cached->end()));
+    response.header.rescode = ResultCode::NOERROR;
+  }
+
+  sendResponse(sockfd, response, srcAddr);
+  timer.record();
+  return FastPathResult::Answered;
+}
+
+/**
+ * Handle one query on a worker. `admitted` means the receive thread already
+ * charged it to the rate limiter, `timer` is recorded once the response is
+ * out
+ **/
+inline void handleQueryThreaded(int sockfd, BytePacketBuffer &reqBuffer,
                                 struct sockaddr_in srcAddr,
                                 ThreadSafeCache &cache,
                                 RateLimiter &rateLimiter,
                                 TransactionTracker &tracker,
-                                NetworkConfig &netConf) {
+                                UpstreamSocketPool &upstream,
+                                NetworkConfig &netConf, bool admitted = false,
+                                QueryTimer timer = {}) {
+  // everything the query builds is dropped in one go when this returns
+  QueryArena::Scope arena;
+
   try {
     // get client ip
     char clientIp[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &srcAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
     std::string clientIpString(clientIp);
 
-    DnsPacket request = DnsPacket::fromBuffer(reqBuffer);
+    DnsPacketView view(reqBuffer);
+    DnsPacket request = view.toPacket(QueryArena::resource());
 
     // check rate limits
-    if (!rateLimiter.allowQuery(clientIpString)) {
+    if (!admitted && !rateLimiter.allowQuery(clientIpString)) {
       returnRefusedBecauseRateLimited(sockfd, clientIpString, srcAddr, request);
+      timer.record();
       return;
     }
 
     // create response packet
-    DnsPacket response;
-    response.header.id = request.header.id;
-    response.header.recursionDesired = true;
-    response.header.recursionAvailable = true;
-    response.header.response = true;
+    DnsPacket response = makeResponse(request);
 
     // handle question
     if (!request.questions.empty()) {
-      DnsQuestion question = request.questions.back();
+      DnsQuestion question(std::move(request.questions.back()),
+                           request.get_allocator());
       request.questions.pop_back();
 
       std::cout << "Received query: " << question << std::endl;
 
       // forward query and handle response
       try {
-        DnsPacket result = recursiveLookup(question.name, question.qtype, cache,
-                                           netConf, tracker);
-
-        response.questions.push_back(question);
-        response.header.rescode = result.header.rescode;
-
-        // answers
-        for (const auto &rec : result.answers) {
-          std::cout << "Answer: ";
-          std::visit([](const auto &r) { std::cout << r << std::endl; }, rec);
-          response.answers.push_back(rec);
-        }
-
-        // authorities
-        for (const auto &rec : result.authorities) {
-          std::cout << "Authority: ";
-          std::visit([](const auto &r) { std::cout << r << std::endl; }, rec);
-          response.authorities.push_back(rec);
-        }
-
-        // resources
-        for (const auto &rec : result.resources) {
-          std::cout << "Resource: ";
-          std::visit([](const auto &r) { std::cout << r << std::endl; }, rec);
-          response.resources.push_back(rec);
-        }
+        DnsName qname = view.question(view.questionCount() - 1)
+                            .name.toName(request.get_allocator());
+        DnsPacket result = recursiveLookup(qname, question.qtype, cache,
+                                           netConf, tracker, upstream);
+        fillResponse(response, question, result);
       } catch (const std::exception &e) {
         std::cerr << "Lookup failed: " << e.what() << std::endl;
         response.header.rescode = ResultCode::SERVFAIL;
@@ -408,15 +759,82 @@ inline void handleQueryThreaded(int sockfd, BytePacketBuffer reqBuffer,
       response.header.rescode = ResultCode::FORMERR;
     }
 
-    BytePacketBuffer resBuffer;
-    response.write(resBuffer);
+    sendResponse(sockfd, response, srcAddr);
+    timer.record();
+  } catch (const std::exception &e) {
+    std::cerr << "Query handling error: " << e.what() << std::endl;
+  }
+}
+
+/**
+ * Same as handleQueryThreaded but the recursion is handed to `resolver`
+ * (AsyncResolver or CoroResolver), the worker returns as soon as the query
+ * is parsed and the response goes out from the resolver's loop thread when
+ * the lookup finishes. With a `shedder`, a query the resolver has no room
+ * for and an answer its client stopped waiting for are shed
+ **/
+template <typename Resolver>
+void handleQueryAsync(int sockfd, BytePacketBuffer &reqBuffer,
+                      struct sockaddr_in srcAddr, RateLimiter &rateLimiter,
+                      Resolver &resolver, bool admitted = false,
+                      QueryTimer timer = {}, CoDelShedder *shedder = nullptr) {
+  try {
+    // get client ip
+    char clientIp[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &srcAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
+    std::string clientIpString(clientIp);
+
+    DnsPacketView view(reqBuffer);
+    DnsPacket request = view.toPacket();
+
+    // check rate limits
+    if (!admitted && !rateLimiter.allowQuery(clientIpString)) {
+      returnRefusedBecauseRateLimited(sockfd, clientIpString, srcAddr, request);
+      timer.record();
+      return;
+    }
+
+    // create response packet
+    DnsPacket response = makeResponse(request);
+
+    if (request.questions.empty()) {
+      response.header.rescode = ResultCode::FORMERR;
+      sendResponse(sockfd, response, srcAddr);
+      timer.record();
+      return;
+    }
+
+    DnsQuestion question = request.questions.back();
+    std::cout << "Received query: " << question << std::endl;
+
+    bool started = resolver.resolve(
+        view.question(view.questionCount() - 1).name.toName(), question.qtype,
+        [sockfd, srcAddr, response, question, timer,
+         shedder](DnsPacket &result, std::exception_ptr error) mutable {
+          if (shedder != nullptr && shedder->shouldShedLate(timer.start)) {
+            shedResponse(sockfd, response, srcAddr, shedder->policy());
+            return;
+          }
+
+          if (error) {
+            try {
+              std::rethrow_exception(error);
+            } catch (const std::exception &e) {
+              std::cerr << "Lookup failed: " << e.what() << std::endl;
+            }
+            response.header.rescode = ResultCode::SERVFAIL;
+          } else {
+            fillResponse(response, question, result);
+          }
 
-    ssize_t bytesSent =
-        sendto(sockfd, resBuffer.buf, resBuffer.currentPosition(), 0,
-               (struct sockaddr *)&srcAddr, sizeof(srcAddr));
+          sendResponse(sockfd, response, srcAddr);
+          timer.record();
+        },
+        timer.start);
 
-    if (bytesSent < 0) {
-      throw std::runtime_error("failed to send response");
+    // the resolver only turns a query away when it has a shedder
+    if (!started) {
+      shedResponse(sockfd, response, srcAddr, shedder->policy());
     }
   } catch (const std::exception &e) {
     std::cerr << "Query handling error: " << e.what() << std::endl;
@@ -40,6 +40,9 @@ public:
 
   void read(BytePacketBuffer &);
 
+  // decode the 12 header bytes at `wire`, the caller checks they exist
+  void decode(const uint8_t *wire);
+
   void write(BytePacketBuffer &);
 
   friend std::ostream &operator<<(std::ostream &stream,
@@ -66,15 +69,21 @@ public:
 };
 
 inline void DnsHeader::read(BytePacketBuffer &buffer) {
-  this->id = *buffer.readU16();
+  // one bounds check for the whole fixed size header
+  auto wire = buffer.getRange(buffer.currentPosition(), 12);
+  this->decode(wire.data());
+  buffer.step(12);
+}
 
-  auto flags = buffer.readU16();
-  if (!flags.has_value()) {
-    throw std::runtime_error("failed to read flags");
-  }
+inline void DnsHeader::decode(const uint8_t *wire) {
+  auto u16 = [wire](size_t at) {
+    return static_cast<uint16_t>((wire[at] << 8) | wire[at + 1]);
+  };
+
+  this->id = u16(0);
 
-  uint8_t a = (*flags >> 8);
-  uint8_t b = (*flags & 0xFF);
+  uint8_t a = wire[2];
+  uint8_t b = wire[3];
 
   this->recursionDesired = (a & (1 << 0)) > 0;
   this->truncatedMessage = (a & (1 << 1)) > 0;
@@ -88,10 +97,10 @@ inline void DnsHeader::read(BytePacketBuffer &buffer) {
   this->z = (b & (1 << 6)) > 0;
   this->recursionAvailable = (b & (1 << 7)) > 0;
 
-  this->questions = *buffer.readU16();
-  this->answers = *buffer.readU16();
-  this->authoritativeEntries = *buffer.readU16();
-  this->resourceEntries = *buffer.readU16();
+  this->questions = u16(4);
+  this->answers = u16(6);
+  this->authoritativeEntries = u16(8);
+  this->resourceEntries = u16(10);
 }
 
 inline void DnsHeader::write(BytePacketBuffer &buffer) {
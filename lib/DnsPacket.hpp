@@ -3,40 +3,46 @@
 
 #include <array>
 #include <iostream>
+#include <memory_resource>
 #include <optional>
-#include <string_view>
-#include <utility>
 #include <vector>
 
 #include "BytePacketBuffer.hpp"
 #include "DnsHeader.hpp"
 #include "DnsQuestion.hpp"
 #include "DnsRecord.hpp"
+#include "QueryType.hpp"
+#include "names/DnsName.hpp"
 
 class DnsPacket {
 public:
+  // sections (and, through them, every name) allocate from this, the
+  // default heap resource unless the packet is built in a QueryArena
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
   DnsHeader header;
-  std::vector<DnsQuestion> questions;
-  std::vector<DnsRecord> answers;
-  std::vector<DnsRecord> authorities;
-  std::vector<DnsRecord> resources;
+  std::pmr::vector<DnsQuestion> questions;
+  std::pmr::vector<DnsRecord> answers;
+  std::pmr::vector<DnsRecord> authorities;
+  std::pmr::vector<DnsRecord> resources;
 
   DnsPacket() = default;
 
-  static DnsPacket fromBuffer(BytePacketBuffer &buffer);
+  explicit DnsPacket(allocator_type alloc)
+      : questions(alloc), answers(alloc), authorities(alloc),
+        resources(alloc) {}
+
+  allocator_type get_allocator() const {
+    return this->questions.get_allocator();
+  }
 
-  std::vector<std::pair<std::string_view, std::string_view>>
-  getNs(const std::string &qname) const;
+  static DnsPacket fromBuffer(BytePacketBuffer &buffer,
+                              allocator_type alloc = {});
 
   void write(BytePacketBuffer &);
 
   std::optional<std::array<uint8_t, 4>> getRandomA();
 
-  std::optional<std::array<uint8_t, 4>>
-  getResolvedNs(const std::string &qname) const;
-
-  std::optional<std::string> getUnresolvedNs(const std::string &qname) const;
-
   friend std::ostream &operator<<(std::ostream &stream,
                                   const DnsPacket &packet) {
     // print header
@@ -67,55 +73,6 @@ inline std::optional<std::array<uint8_t, 4>> DnsPacket::getRandomA() {
   return std::nullopt;
 }
 
-inline std::vector<std::pair<std::string_view, std::string_view>>
-DnsPacket::getNs(const std::string &qname) const {
-  std::vector<std::pair<std::string_view, std::string_view>> result;
-
-  for (const auto &record : this->authorities) {
-    if (auto *nsrecord = std::get_if<NSRecord>(&record)) {
-      // only includes if qname ends with domain
-      // domain = google.com; qname = www.google.com
-      if (qname.ends_with(nsrecord->domain)) {
-        result.emplace_back(nsrecord->domain, nsrecord->host);
-      }
-    }
-  }
-
-  return result;
-}
-
-inline std::optional<std::array<uint8_t, 4>>
-DnsPacket::getResolvedNs(const std::string &qname) const {
-  // get ns for this query
-  auto nameservers = this->getNs(qname);
-
-  // pull domain and host and look for a records
-  for (const auto &[domain, host] : nameservers) {
-    // search resources for an A Record matching this host
-    for (const auto &resource : this->resources) {
-      // check if its an A record with matching domain
-      if (auto *arecord = std::get_if<ARecord>(&resource)) {
-        // check if the domain matches
-        if (arecord->domain == host) {
-          return arecord->addr;
-        }
-      }
-    }
-  }
-
-  return std::nullopt;
-}
-
-inline std::optional<std::string>
-DnsPacket::getUnresolvedNs(const std::string &qname) const {
-  auto nameservers = this->getNs(qname);
-  if (!nameservers.empty()) {
-    return std::string(nameservers[0].second);
-  }
-
-  return std::nullopt;
-}
-
 inline void DnsPacket::write(BytePacketBuffer &buffer) {
   this->header.questions = static_cast<uint16_t>(this->questions.size());
   this->header.answers = static_cast<uint16_t>(this->answers.size());
@@ -125,48 +82,66 @@ inline void DnsPacket::write(BytePacketBuffer &buffer) {
 
   this->header.write(buffer);
 
-  for (auto &question : this->questions) {
+  for (const auto &question : this->questions) {
     question.write(buffer);
   }
 
-  for (auto &rec : this->answers) {
+  for (const auto &rec : this->answers) {
     writeDnsRecord(rec, buffer);
   }
 
-  for (auto &rec : this->authorities) {
+  for (const auto &rec : this->authorities) {
     writeDnsRecord(rec, buffer);
   }
 
-  for (auto &rec : this->resources) {
+  for (const auto &rec : this->resources) {
     writeDnsRecord(rec, buffer);
   }
 }
 
-inline DnsPacket DnsPacket::fromBuffer(BytePacketBuffer &buffer) {
-  DnsPacket result;
+inline DnsPacket DnsPacket::fromBuffer(BytePacketBuffer &buffer,
+                                       allocator_type alloc) {
+  DnsPacket result(alloc);
   result.header.read(buffer);
 
   // read questions
   for (size_t i = 0; i < result.header.questions; i++) {
-    result.questions.push_back(DnsQuestion::read(buffer));
+    result.questions.push_back(DnsQuestion::read(buffer, alloc));
   }
 
   // read answers
   for (size_t i = 0; i < result.header.answers; i++) {
-    result.answers.push_back(readDnsRecord(buffer));
+    result.answers.push_back(readDnsRecord(buffer, alloc));
   }
 
   // read authorities
   for (size_t i = 0; i < result.header.authoritativeEntries; i++) {
-    result.authorities.push_back(readDnsRecord(buffer));
+    result.authorities.push_back(readDnsRecord(buffer, alloc));
   }
 
   // read resources
   for (size_t i = 0; i < result.header.resourceEntries; i++) {
-    result.resources.push_back(readDnsRecord(buffer));
+    result.resources.push_back(readDnsRecord(buffer, alloc));
   }
 
   return result;
 }
 
+/**
+ * Write a recursion-desired query for `qname` into `buffer`, the name goes
+ * out in the wire form it's already in. What every upstream lookup sends
+ **/
+inline void writeQuery(BytePacketBuffer &buffer, uint16_t id,
+                       const DnsName &qname, QueryType qtype) {
+  DnsHeader header;
+  header.id = id;
+  header.questions = 1;
+  header.recursionDesired = true;
+  header.write(buffer);
+
+  buffer.writeName(qname);
+  buffer.writeU16(fromQueryTypeToNumber(qtype));
+  buffer.writeU16(1);
+}
+
 #endif // DNSPACKET_HPP
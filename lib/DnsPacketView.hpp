@@ -0,0 +1,634 @@
+#ifndef DNSPACKETVIEW_HPP
+#define DNSPACKETVIEW_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "BytePacketBuffer.hpp"
+#include "DnsHeader.hpp"
+#include "DnsPacket.hpp"
+#include "DnsQuestion.hpp"
+#include "DnsRecord.hpp"
+#include "QueryType.hpp"
+#include "ResultCode.hpp"
+#include "errors/errors.hpp"
+#include "names/DnsName.hpp"
+#include "names/NameKernels.hpp"
+
+/**
+ * A (possibly compressed) name inside a validated message. Nothing is
+ * copied, labels are read straight out of the wire bytes on demand
+ **/
+class NameView {
+private:
+  const uint8_t *data = nullptr;
+  size_t offset = 0;
+
+  // label at `pos` (following pointers), `pos` moves past it. empty at the
+  // end of the name
+  std::string_view nextLabel(size_t &pos) const;
+
+public:
+  NameView() = default;
+  NameView(const uint8_t *data_, size_t offset_)
+      : data(data_), offset(offset_) {}
+
+  // length of the dotted form, "www.google.com" is 14
+  size_t dottedLength() const;
+
+  // same dotted form readQName produces
+  template <typename String> void appendTo(String &out) const;
+  std::string toString() const;
+  std::pmr::string toString(std::pmr::polymorphic_allocator<> alloc) const;
+
+  // uncompressed wire form (terminator included) into `out`, which holds
+  // `capacity` bytes. Returns its length, throws if it doesn't fit
+  size_t copyWire(uint8_t *out,
+                  size_t capacity = namekernels::MAX_NAME_WIRE) const;
+
+  // the name as a DnsName, straight from the wire bytes
+  DnsName toName(DnsName::allocator_type alloc = {}) const;
+
+  bool operator==(std::string_view dotted) const;
+  bool operator==(const NameView &other) const;
+
+  // zone match: `name` is this name or falls under it, label by label and
+  // ignoring case
+  bool isSuffixOf(const DnsName &name) const;
+};
+
+struct QuestionView {
+  NameView name;
+  uint16_t qtype;
+
+  QueryType queryType() const { return fromNumberToQueryType(this->qtype); }
+
+  DnsQuestion toQuestion(DnsQuestion::allocator_type alloc = {}) const {
+    DnsQuestion question("", fromNumberToQueryType(this->qtype), alloc);
+    question.name.reserve(this->name.dottedLength());
+    this->name.appendTo(question.name);
+    return question;
+  }
+};
+
+/**
+ * One resource record, fixed fields decoded, rdata left where it is
+ **/
+struct RecordView {
+  NameView name;
+  uint16_t type;
+  uint32_t ttl;
+  uint16_t dataLength;
+
+  const uint8_t *data;
+  size_t dataOffset;
+
+  QueryType qtype() const { return fromNumberToQueryType(this->type); }
+
+  // A record address
+  std::array<uint8_t, 4> ipv4() const;
+
+  // NS / CNAME target, MX exchange
+  NameView host() const;
+
+  DnsRecord toRecord(std::pmr::polymorphic_allocator<> alloc = {}) const;
+};
+
+/**
+ * DnsPacketView - non-owning, read-only view of a DNS message.
+ *
+ * The constructor walks the message once and checks every name, pointer
+ * and record length against the buffer, throwing on anything malformed.
+ * After that sections and names are decoded lazily straight from the wire
+ * bytes, so a referral can be inspected without building DnsRecords or
+ * strings for records that are never used. toPacket() materializes the
+ * whole thing when an owning DnsPacket is needed after all.
+ *
+ * The viewed buffer has to outlive the view.
+ **/
+class DnsPacketView {
+public:
+  static constexpr size_t HEADER_SIZE = 12;
+
+  class RecordIterator {
+  private:
+    const uint8_t *data = nullptr;
+    size_t pos = 0;
+    size_t remaining = 0;
+
+  public:
+    RecordIterator() = default;
+    RecordIterator(const uint8_t *data_, size_t pos_, size_t remaining_)
+        : data(data_), pos(pos_), remaining(remaining_) {}
+
+    RecordView operator*() const;
+    RecordIterator &operator++();
+
+    bool operator==(const RecordIterator &other) const {
+      return this->remaining == other.remaining;
+    }
+  };
+
+  struct RecordRange {
+    RecordIterator first;
+
+    RecordIterator begin() const { return this->first; }
+    RecordIterator end() const { return RecordIterator(); }
+  };
+
+private:
+  static constexpr size_t MAX_JUMPS = 5;
+
+  const uint8_t *data;
+  size_t length;
+
+  // where each section starts, [answers, authorities, resources]
+  std::array<size_t, 3> sectionStart{};
+  size_t messageEnd = 0;
+
+  uint16_t count(size_t at) const {
+    return static_cast<uint16_t>((this->data[at] << 8) | this->data[at + 1]);
+  }
+
+  // check the name at `pos` and return where it ends in place
+  size_t validateName(size_t pos) const;
+  size_t validateRecord(size_t pos) const;
+
+public:
+  explicit DnsPacketView(const BytePacketBuffer &buffer)
+      : DnsPacketView(buffer.buf, sizeof(buffer.buf)) {}
+
+  DnsPacketView(const uint8_t *data_, size_t length_);
+
+  uint16_t id() const { return this->count(0); }
+  bool response() const { return (this->data[2] & 0x80) != 0; }
+  ResultCode rescode() const {
+    return resultCodeFromNum(this->data[3] & 0x0F);
+  }
+
+  uint16_t questionCount() const { return this->count(4); }
+  uint16_t answerCount() const { return this->count(6); }
+  uint16_t authorityCount() const { return this->count(8); }
+  uint16_t resourceCount() const { return this->count(10); }
+
+  DnsHeader header() const;
+
+  // question `index`, callers check questionCount() first
+  QuestionView question(size_t index = 0) const;
+
+  RecordRange answers() const {
+    return {{this->data, this->sectionStart[0], this->answerCount()}};
+  }
+  RecordRange authorities() const {
+    return {{this->data, this->sectionStart[1], this->authorityCount()}};
+  }
+  RecordRange resources() const {
+    return {{this->data, this->sectionStart[2], this->resourceCount()}};
+  }
+
+  // bytes the message takes up in the buffer
+  size_t size() const { return this->messageEnd; }
+
+  /**
+   * Calls fn(domain, host) for every authority NS record whose zone `qname`
+   * falls under, same matching as DnsPacket::getNs
+   **/
+  template <typename Fn>
+  void forEachNs(const DnsName &qname, Fn &&fn) const;
+
+  /**
+   * Calls fn(domain, glue) for every additional A record that gives the
+   * address of one of those nameservers
+   **/
+  template <typename Fn>
+  void forEachGlue(const DnsName &qname, Fn &&fn) const;
+
+  std::optional<std::array<uint8_t, 4>>
+  getResolvedNs(const DnsName &qname) const;
+
+  std::optional<DnsName> getUnresolvedNs(const DnsName &qname) const;
+
+  DnsPacket toPacket(DnsPacket::allocator_type alloc = {}) const;
+};
+
+inline std::string_view NameView::nextLabel(size_t &pos) const {
+  while ((this->data[pos] & 0xC0) == 0xC0) {
+    pos = ((this->data[pos] & 0x3F) << 8) | this->data[pos + 1];
+  }
+
+  size_t len = this->data[pos];
+  if (len == 0) {
+    return {};
+  }
+
+  std::string_view label(reinterpret_cast<const char *>(this->data + pos + 1),
+                         len);
+  pos += 1 + len;
+  return label;
+}
+
+inline size_t NameView::dottedLength() const {
+  size_t pos = this->offset;
+  size_t total = 0;
+  for (auto label = this->nextLabel(pos); !label.empty();
+       label = this->nextLabel(pos)) {
+    total += (total == 0 ? 0 : 1) + label.size();
+  }
+  return total;
+}
+
+template <typename String>
+inline void NameView::appendTo(String &out) const {
+  size_t pos = this->offset;
+  auto delim = "";
+  for (auto label = this->nextLabel(pos); !label.empty();
+       label = this->nextLabel(pos)) {
+    out.append(delim);
+    out.append(label);
+    delim = ".";
+  }
+}
+
+inline std::string NameView::toString() const {
+  std::string out;
+  out.reserve(this->dottedLength());
+  this->appendTo(out);
+  return out;
+}
+
+inline std::pmr::string
+NameView::toString(std::pmr::polymorphic_allocator<> alloc) const {
+  std::pmr::string out(alloc);
+  out.reserve(this->dottedLength());
+  this->appendTo(out);
+  return out;
+}
+
+inline size_t NameView::copyWire(uint8_t *out, size_t capacity) const {
+  size_t pos = this->offset;
+  size_t length = 0;
+  for (auto label = this->nextLabel(pos); !label.empty();
+       label = this->nextLabel(pos)) {
+    // room for the terminator kept
+    if (length + 1 + label.size() + 1 > capacity) {
+      throw std::runtime_error("name exceeds 255 bytes");
+    }
+    out[length] = static_cast<uint8_t>(label.size());
+    std::memcpy(out + length + 1, label.data(), label.size());
+    length += 1 + label.size();
+  }
+  if (length + 1 > capacity) {
+    throw std::runtime_error("name exceeds 255 bytes");
+  }
+  out[length++] = 0;
+  return length;
+}
+
+inline DnsName NameView::toName(DnsName::allocator_type alloc) const {
+  uint8_t wire[namekernels::MAX_NAME_WIRE];
+  size_t length = this->copyWire(wire, sizeof(wire));
+  return DnsName::fromLabels(wire, length - 1, alloc);
+}
+
+inline bool NameView::operator==(std::string_view dotted) const {
+  size_t pos = this->offset;
+  size_t at = 0;
+  for (auto label = this->nextLabel(pos); !label.empty();
+       label = this->nextLabel(pos)) {
+    if (at > 0) {
+      if (at >= dotted.size() || dotted[at] != '.') {
+        return false;
+      }
+      at++;
+    }
+
+    if (dotted.substr(at, label.size()) != label) {
+      return false;
+    }
+    at += label.size();
+  }
+  return at == dotted.size();
+}
+
+inline bool NameView::operator==(const NameView &other) const {
+  size_t pos = this->offset;
+  size_t otherPos = other.offset;
+  while (true) {
+    auto label = this->nextLabel(pos);
+    auto otherLabel = other.nextLabel(otherPos);
+    if (label != otherLabel) {
+      return false;
+    }
+    if (label.empty()) {
+      return true;
+    }
+  }
+}
+
+inline bool NameView::isSuffixOf(const DnsName &name) const {
+  uint8_t wire[namekernels::MAX_NAME_WIRE];
+  size_t length = this->copyWire(wire, sizeof(wire));
+  return name.isSubdomainOf(
+      std::string_view(reinterpret_cast<const char *>(wire), length));
+}
+
+inline std::array<uint8_t, 4> RecordView::ipv4() const {
+  const uint8_t *rdata = this->data + this->dataOffset;
+  return {rdata[0], rdata[1], rdata[2], rdata[3]};
+}
+
+inline NameView RecordView::host() const {
+  size_t at = this->dataOffset;
+  if (this->type == fromQueryTypeToNumber(MX{})) {
+    at += 2; // preference
+  }
+  return NameView(this->data, at);
+}
+
+inline DnsRecord
+RecordView::toRecord(std::pmr::polymorphic_allocator<> alloc) const {
+  std::pmr::string domain = this->name.toString(alloc);
+  const uint8_t *rdata = this->data + this->dataOffset;
+
+  return std::visit(
+      [&](auto &&arg) -> DnsRecord {
+        using T = std::decay_t<decltype(arg)>;
+
+        if constexpr (std::is_same_v<T, A>) {
+          return ARecord{std::move(domain), this->ipv4(), this->ttl};
+        } else if constexpr (std::is_same_v<T, NS>) {
+          return NSRecord{std::move(domain), this->host().toString(alloc),
+                          this->ttl};
+        } else if constexpr (std::is_same_v<T, CNAME>) {
+          return CNAMERecord{std::move(domain), this->host().toString(alloc),
+                             this->ttl};
+        } else if constexpr (std::is_same_v<T, MX>) {
+          auto priority = static_cast<uint16_t>((rdata[0] << 8) | rdata[1]);
+          return MXRecord{std::move(domain), priority,
+                          this->host().toString(alloc), this->ttl};
+        } else if constexpr (std::is_same_v<T, AAAA>) {
+          std::array<uint8_t, 16> addr;
+          std::copy(rdata, rdata + 16, addr.begin());
+          return AAAARecord{std::move(domain), addr, this->ttl};
+        } else {
+          return UnknownRecord{std::move(domain), this->type, this->dataLength,
+                               this->ttl};
+        }
+      },
+      this->qtype());
+}
+
+inline RecordView DnsPacketView::RecordIterator::operator*() const {
+  // names were checked up front, just find where this one ends
+  size_t at = this->pos;
+  while (this->data[at] != 0 && (this->data[at] & 0xC0) != 0xC0) {
+    at += 1 + this->data[at];
+  }
+  at += this->data[at] == 0 ? 1 : 2;
+
+  auto u16 = [this](size_t i) {
+    return static_cast<uint16_t>((this->data[i] << 8) | this->data[i + 1]);
+  };
+
+  RecordView record;
+  record.name = NameView(this->data, this->pos);
+  record.type = u16(at);
+  record.ttl = (static_cast<uint32_t>(u16(at + 4)) << 16) | u16(at + 6);
+  record.dataLength = u16(at + 8);
+  record.data = this->data;
+  record.dataOffset = at + 10;
+  return record;
+}
+
+inline DnsPacketView::RecordIterator &
+DnsPacketView::RecordIterator::operator++() {
+  RecordView record = **this;
+  this->pos = record.dataOffset + record.dataLength;
+  this->remaining--;
+  return *this;
+}
+
+inline size_t DnsPacketView::validateName(size_t pos) const {
+  size_t end = 0;
+  size_t jumps = 0;
+  // uncompressed length so far, labels reached through pointers included
+  size_t wireLength = 0;
+  while (true) {
+    if (pos >= this->length) {
+      throw std::out_of_range("name runs past the end of the message");
+    }
+
+    uint8_t len = this->data[pos];
+    if ((len & 0xC0) == 0xC0) {
+      if (pos + 1 >= this->length) {
+        throw std::out_of_range("name runs past the end of the message");
+      }
+      if (++jumps > MAX_JUMPS) {
+        throw std::runtime_error("limit of jumps exceeded maximum jumps");
+      }
+      if (end == 0) {
+        end = pos + 2;
+      }
+
+      pos = ((len & 0x3F) << 8) | this->data[pos + 1];
+      continue;
+    }
+
+    if ((len & 0xC0) != 0) {
+      throw std::runtime_error("unsupported label type");
+    }
+
+    if (len == 0) {
+      return end == 0 ? pos + 1 : end;
+    }
+
+    if (pos + 1 + len > this->length) {
+      throw std::out_of_range("label runs past the end of the message");
+    }
+    // the terminator has to fit as well
+    wireLength += 1 + len;
+    if (wireLength + 1 > namekernels::MAX_NAME_WIRE) {
+      throw std::runtime_error("name exceeds 255 bytes");
+    }
+    // same rule readQName applies, a '.' in a label would read back as two
+    if (!namekernels::labelBytesValid(
+            reinterpret_cast<const char *>(this->data + pos + 1), len)) {
+      throw std::runtime_error("label holds a byte that needs escaping");
+    }
+    pos += 1 + len;
+  }
+}
+
+inline size_t DnsPacketView::validateRecord(size_t pos) const {
+  size_t at = this->validateName(pos);
+  if (at + 10 > this->length) {
+    throw std::out_of_range("record runs past the end of the message");
+  }
+
+  uint16_t type = this->count(at);
+  uint16_t dataLength = this->count(at + 8);
+  size_t rdata = at + 10;
+  size_t end = rdata + dataLength;
+  if (end > this->length) {
+    throw std::out_of_range("rdata runs past the end of the message");
+  }
+
+  // anything toRecord() or host() reads has to be inside the rdata
+  QueryType qtype = fromNumberToQueryType(type);
+  if (std::holds_alternative<A>(qtype) && dataLength < 4) {
+    throw std::runtime_error("short A record");
+  } else if (std::holds_alternative<AAAA>(qtype) && dataLength < 16) {
+    throw std::runtime_error("short AAAA record");
+  } else if (std::holds_alternative<NS>(qtype) ||
+             std::holds_alternative<CNAME>(qtype)) {
+    this->validateName(rdata);
+  } else if (std::holds_alternative<MX>(qtype)) {
+    if (dataLength < 3) {
+      throw std::runtime_error("short MX record");
+    }
+    this->validateName(rdata + 2);
+  }
+
+  return end;
+}
+
+inline DnsPacketView::DnsPacketView(const uint8_t *data_, size_t length_)
+    : data(data_), length(length_) {
+  if (this->length < HEADER_SIZE) {
+    throw std::out_of_range("message shorter than a header");
+  }
+
+  size_t pos = HEADER_SIZE;
+  for (size_t i = 0; i < this->questionCount(); i++) {
+    pos = this->validateName(pos) + 4;
+    if (pos > this->length) {
+      throw std::out_of_range("question runs past the end of the message");
+    }
+  }
+
+  const uint16_t counts[] = {this->answerCount(), this->authorityCount(),
+                             this->resourceCount()};
+  for (size_t section = 0; section < 3; section++) {
+    this->sectionStart[section] = pos;
+    for (size_t i = 0; i < counts[section]; i++) {
+      pos = this->validateRecord(pos);
+    }
+  }
+
+  this->messageEnd = pos;
+}
+
+inline DnsHeader DnsPacketView::header() const {
+  DnsHeader header;
+  header.decode(this->data);
+  return header;
+}
+
+inline QuestionView DnsPacketView::question(size_t index) const {
+  size_t pos = HEADER_SIZE;
+  for (size_t i = 0; i < index; i++) {
+    pos = this->validateName(pos) + 4;
+  }
+
+  size_t at = this->validateName(pos);
+  return QuestionView{NameView(this->data, pos), this->count(at)};
+}
+
+template <typename Fn>
+inline void DnsPacketView::forEachNs(const DnsName &qname, Fn &&fn) const {
+  for (const RecordView &record : this->authorities()) {
+    if (record.type != fromQueryTypeToNumber(NS{})) {
+      continue;
+    }
+
+    // only includes if qname ends with domain
+    // domain = google.com; qname = www.google.com
+    if (record.name.isSuffixOf(qname)) {
+      fn(record.name, record.host());
+    }
+  }
+}
+
+template <typename Fn>
+inline void DnsPacketView::forEachGlue(const DnsName &qname,
+                                       Fn &&fn) const {
+  this->forEachNs(qname, [this, &fn](const NameView &domain,
+                                     const NameView &host) {
+    for (const RecordView &resource : this->resources()) {
+      if (resource.type == fromQueryTypeToNumber(A{}) &&
+          resource.name == host) {
+        fn(domain, resource);
+      }
+    }
+  });
+}
+
+inline std::optional<std::array<uint8_t, 4>>
+DnsPacketView::getResolvedNs(const DnsName &qname) const {
+  std::optional<std::array<uint8_t, 4>> resolved;
+  this->forEachGlue(qname, [&resolved](const NameView &,
+                                       const RecordView &glue) {
+    if (!resolved.has_value()) {
+      resolved = glue.ipv4();
+    }
+  });
+  return resolved;
+}
+
+inline std::optional<DnsName>
+DnsPacketView::getUnresolvedNs(const DnsName &qname) const {
+  std::optional<DnsName> unresolved;
+  this->forEachNs(qname, [&unresolved, &qname](const NameView &,
+                                               const NameView &host) {
+    if (!unresolved.has_value()) {
+      unresolved = host.toName(qname.get_allocator());
+    }
+  });
+  return unresolved;
+}
+
+inline DnsPacket
+DnsPacketView::toPacket(DnsPacket::allocator_type alloc) const {
+  DnsPacket packet(alloc);
+  packet.header = this->header();
+
+  size_t pos = HEADER_SIZE;
+  for (size_t i = 0; i < this->questionCount(); i++) {
+    size_t at = this->validateName(pos);
+    QuestionView question{NameView(this->data, pos), this->count(at)};
+    packet.questions.push_back(question.toQuestion(alloc));
+    pos = at + 4;
+  }
+
+  for (const RecordView &record : this->answers()) {
+    packet.answers.push_back(record.toRecord(alloc));
+  }
+  for (const RecordView &record : this->authorities()) {
+    packet.authorities.push_back(record.toRecord(alloc));
+  }
+  for (const RecordView &record : this->resources()) {
+    packet.resources.push_back(record.toRecord(alloc));
+  }
+
+  return packet;
+}
+
+/**
+ * Validate an upstream reply once and check it is a response rather than a
+ * new query
+ **/
+inline DnsPacketView parseUpstreamReply(const BytePacketBuffer &resBuffer) {
+  DnsPacketView reply(resBuffer);
+  if (!reply.response()) {
+    throw SecurityException("Received query instead of response!");
+  }
+  return reply;
+}
+
+#endif // DNSPACKETVIEW_HPP
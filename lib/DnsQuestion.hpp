@@ -3,23 +3,42 @@
 
 #include <cstddef>
 #include <iostream>
+#include <memory_resource>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 
 #include "BytePacketBuffer.hpp"
 #include "QueryType.hpp"
 
 class DnsQuestion {
 public:
-  std::string name;
+  // allocator-aware, a std::pmr::vector<DnsQuestion> hands its memory
+  // resource down to the name
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  std::pmr::string name;
   QueryType qtype;
 
-  DnsQuestion(std::string name, QueryType qtype)
-      : name(std::move(name)), qtype(qtype) {}
+  DnsQuestion(std::string_view name, QueryType qtype,
+              allocator_type alloc = {})
+      : name(name, alloc), qtype(qtype) {}
+
+  DnsQuestion(const DnsQuestion &) = default;
+  DnsQuestion(DnsQuestion &&) = default;
+  DnsQuestion &operator=(const DnsQuestion &) = default;
+  DnsQuestion &operator=(DnsQuestion &&) = default;
+
+  DnsQuestion(const DnsQuestion &other, allocator_type alloc)
+      : name(other.name, alloc), qtype(other.qtype) {}
+  DnsQuestion(DnsQuestion &&other, allocator_type alloc)
+      : name(std::move(other.name), alloc), qtype(other.qtype) {}
 
-  static DnsQuestion read(BytePacketBuffer &buffer);
+  static DnsQuestion read(BytePacketBuffer &buffer,
+                          allocator_type alloc = {});
 
-  void write(BytePacketBuffer &);
+  void write(BytePacketBuffer &) const;
 
   friend std::ostream &operator<<(std::ostream &stream,
                                   const DnsQuestion &question) {
@@ -31,7 +50,7 @@ public:
   }
 };
 
-inline void DnsQuestion::write(BytePacketBuffer &buffer) {
+inline void DnsQuestion::write(BytePacketBuffer &buffer) const {
   buffer.writeQName(this->name);
 
   auto typenum = fromQueryTypeToNumber(this->qtype);
@@ -39,14 +58,15 @@ inline void DnsQuestion::write(BytePacketBuffer &buffer) {
   buffer.writeU16(1);
 }
 
-inline DnsQuestion DnsQuestion::read(BytePacketBuffer &buffer) {
-  std::string name;
-  buffer.readQName(name);
+inline DnsQuestion DnsQuestion::read(BytePacketBuffer &buffer,
+                                     allocator_type alloc) {
+  DnsQuestion question("", Unknown{}, alloc);
+  buffer.readQName(question.name);
 
-  QueryType qtype = fromNumberToQueryType(*buffer.readU16());
+  question.qtype = fromNumberToQueryType(*buffer.readU16());
   auto _ = *buffer.readU16();
 
-  return DnsQuestion(std::move(name), qtype);
+  return question;
 }
 
 #endif // DNSQUESTION_HPP
@@ -4,6 +4,7 @@
 #include <array>
 #include <cstdint>
 #include <iostream>
+#include <memory_resource>
 #include <stdexcept>
 #include <string>
 #include <variant>
@@ -14,7 +15,7 @@
 
 // ----- UNKNOWN RECORD ------
 struct UnknownRecord {
-  std::string domain;
+  std::pmr::string domain;
   uint16_t qtype;
   uint16_t dataLength;
   uint32_t ttl;
@@ -30,7 +31,7 @@ inline std::ostream &operator<<(std::ostream &stream,
 
 // ----- A RECORD ------
 struct ARecord {
-  std::string domain;
+  std::pmr::string domain;
   std::array<uint8_t, 4> addr;
   uint32_t ttl;
 };
@@ -44,8 +45,8 @@ inline std::ostream &operator<<(std::ostream &stream, const ARecord &record) {
 
 // ----- NS RECORD ------
 struct NSRecord {
-  std::string domain;
-  std::string host;
+  std::pmr::string domain;
+  std::pmr::string host;
   uint32_t ttl;
 };
 
@@ -57,8 +58,8 @@ inline std::ostream &operator<<(std::ostream &stream, const NSRecord &record) {
 
 // ----- CNAME RECORD ------
 struct CNAMERecord {
-  std::string domain;
-  std::string host;
+  std::pmr::string domain;
+  std::pmr::string host;
   uint32_t ttl;
 };
 
@@ -71,9 +72,9 @@ inline std::ostream &operator<<(std::ostream &stream,
 
 // ----- MX RECORD ------
 struct MXRecord {
-  std::string domain;
+  std::pmr::string domain;
   uint16_t priority;
-  std::string host;
+  std::pmr::string host;
   uint32_t ttl;
 };
 
@@ -86,7 +87,7 @@ inline std::ostream &operator<<(std::ostream &stream, const MXRecord &record) {
 
 // ----- AAAA RECORD ------
 struct AAAARecord {
-  std::string domain;
+  std::pmr::string domain;
   std::array<uint8_t, 16> addr;
   uint32_t ttl;
 };
@@ -99,6 +100,10 @@ inline std::ostream &operator<<(std::ostream &stream,
   return stream;
 }
 
+// record names are std::pmr::strings so a whole packet can be built in a
+// per-query arena (see QueryArena). copying a record always lands it back on
+// the default resource, so copies (the cache's, for one) never point into
+// an arena. moving one keeps whatever resource it was built on
 using DnsRecord = std::variant<UnknownRecord, ARecord, NSRecord, CNAMERecord,
                                MXRecord, AAAARecord>;
 
@@ -109,96 +114,114 @@ inline std::array<uint8_t, 4> ipv4FromUInt32(uint32_t rawAddr) {
           static_cast<uint8_t>(rawAddr & 0xFF)};
 }
 
-inline size_t writeDnsRecord(DnsRecord record, BytePacketBuffer &buffer) {
+// ----- RR METADATA ------
+// what the writer needs to know about each record type, fixed at compile
+// time. `rdataLength` is 0 when the rdata holds a name, those are measured
+// after writing since compression makes their size unknown up front
+template <typename Record> struct RecordTraits;
+
+template <> struct RecordTraits<ARecord> {
+  using Type = A;
+  static constexpr uint16_t qtype = 1;
+  static constexpr uint16_t rdataLength = 4;
+};
+
+template <> struct RecordTraits<NSRecord> {
+  using Type = NS;
+  static constexpr uint16_t qtype = 2;
+  static constexpr uint16_t rdataLength = 0;
+};
+
+template <> struct RecordTraits<CNAMERecord> {
+  using Type = CNAME;
+  static constexpr uint16_t qtype = 5;
+  static constexpr uint16_t rdataLength = 0;
+};
+
+template <> struct RecordTraits<MXRecord> {
+  using Type = MX;
+  static constexpr uint16_t qtype = 15;
+  static constexpr uint16_t rdataLength = 0;
+};
+
+template <> struct RecordTraits<AAAARecord> {
+  using Type = AAAA;
+  static constexpr uint16_t qtype = 28;
+  static constexpr uint16_t rdataLength = 16;
+};
+
+// https://datatracker.ietf.org/doc/html/rfc1035#section-3.2.4
+constexpr uint16_t CLASS_IN = 1;
+
+inline void writeRData(const ARecord &record, BytePacketBuffer &buffer) {
+  buffer.writeBytes(record.addr.data(), record.addr.size());
+}
+
+inline void writeRData(const NSRecord &record, BytePacketBuffer &buffer) {
+  buffer.writeQName(record.host);
+}
+
+inline void writeRData(const CNAMERecord &record, BytePacketBuffer &buffer) {
+  buffer.writeQName(record.host);
+}
+
+inline void writeRData(const MXRecord &record, BytePacketBuffer &buffer) {
+  buffer.writeU16(record.priority);
+  buffer.writeQName(record.host);
+}
+
+inline void writeRData(const AAAARecord &record, BytePacketBuffer &buffer) {
+  buffer.writeBytes(record.addr.data(), record.addr.size());
+}
+
+/**
+ * Write one resource record straight from `record`, nothing is copied on
+ * the way. Returns the number of bytes written
+ **/
+template <typename Record>
+inline size_t writeDnsRecord(const Record &record, BytePacketBuffer &buffer) {
+  using Traits = RecordTraits<Record>;
   auto startPos = buffer.currentPosition();
 
-  std::visit(
-      [&](auto &&arg) {
-        using T = std::decay_t<decltype(arg)>;
+  buffer.writeQName(record.domain);
+  buffer.writeU16(Traits::qtype);
+  buffer.writeU16(CLASS_IN);
+  buffer.writeU32(record.ttl);
+
+  if constexpr (Traits::rdataLength != 0) {
+    buffer.writeU16(Traits::rdataLength);
+    writeRData(record, buffer);
+  } else {
+    // patch the length in once the rdata is out
+    auto pos = buffer.currentPosition();
+    buffer.writeU16(0);
+    writeRData(record, buffer);
+    buffer.setU16(pos,
+                  static_cast<uint16_t>(buffer.currentPosition() - (pos + 2)));
+  }
 
-        if constexpr (std::is_same_v<T, ARecord>) {
-          auto arecord = std::get<ARecord>(record);
-
-          buffer.writeQName(arecord.domain);
-          buffer.writeU16(fromQueryTypeToNumber(A{}));
-          buffer.writeU16(1); // class
-          buffer.writeU32(arecord.ttl);
-          buffer.writeU16(4);
-
-          // write the address
-          buffer.writeU8(arecord.addr[0]);
-          buffer.writeU8(arecord.addr[1]);
-          buffer.writeU8(arecord.addr[2]);
-          buffer.writeU8(arecord.addr[3]);
-        } else if constexpr (std::is_same_v<T, NSRecord>) {
-          auto nsrecord = std::get<NSRecord>(record);
-
-          buffer.writeQName(nsrecord.domain);
-          buffer.writeU16(fromQueryTypeToNumber(NS{}));
-          buffer.writeU16(1);
-          buffer.writeU32(nsrecord.ttl);
-
-          auto pos = buffer.currentPosition();
-          buffer.writeU16(0);
-
-          buffer.writeQName(nsrecord.host);
-
-          auto size = buffer.currentPosition() - (pos + 2);
-          buffer.setU16(pos, static_cast<uint16_t>(size));
-        } else if constexpr (std::is_same_v<T, CNAMERecord>) {
-          auto cnamerecord = std::get<CNAMERecord>(record);
-
-          buffer.writeQName(cnamerecord.domain);
-          buffer.writeU16(fromQueryTypeToNumber(CNAME{}));
-          buffer.writeU16(1);
-          buffer.writeU32(cnamerecord.ttl);
-
-          auto pos = buffer.currentPosition();
-          buffer.writeU16(0);
-
-          buffer.writeQName(cnamerecord.host);
-
-          auto size = buffer.currentPosition() - (pos + 2);
-          buffer.setU16(pos, static_cast<uint16_t>(size));
-        } else if constexpr (std::is_same_v<T, MXRecord>) {
-          auto mxrecord = std::get<MXRecord>(record);
-
-          buffer.writeQName(mxrecord.domain);
-          buffer.writeU16(fromQueryTypeToNumber(MX{}));
-          buffer.writeU16(1);
-          buffer.writeU32(mxrecord.ttl);
-
-          auto pos = buffer.currentPosition();
-          buffer.writeU16(0);
-
-          buffer.writeU16(mxrecord.priority);
-          buffer.writeQName(mxrecord.host);
-
-          auto size = buffer.currentPosition() - (pos + 2);
-          buffer.setU16(pos, static_cast<uint16_t>(size));
-        } else if constexpr (std::is_same_v<T, AAAARecord>) {
-          auto aaaarecord = std::get<AAAARecord>(record);
-
-          buffer.writeQName(aaaarecord.domain);
-          buffer.writeU16(fromQueryTypeToNumber(AAAA{}));
-          buffer.writeU16(1);
-          buffer.writeU32(aaaarecord.ttl);
-          buffer.writeU16(16);
-
-          for (auto octet : aaaarecord.addr) {
-            buffer.writeU8(octet);
-          }
-        } else if constexpr (std::is_same_v<T, UnknownRecord>) {
+  return buffer.currentPosition() - startPos;
+}
+
+inline size_t writeDnsRecord(const DnsRecord &record,
+                             BytePacketBuffer &buffer) {
+  return std::visit(
+      [&buffer](const auto &rec) -> size_t {
+        using T = std::decay_t<decltype(rec)>;
+        if constexpr (std::is_same_v<T, UnknownRecord>) {
           std::cout << "Skipping record of type Unknown";
-        };
+          return 0;
+        } else {
+          return writeDnsRecord(rec, buffer);
+        }
       },
       record);
-
-  return buffer.currentPosition() - startPos;
 }
 
-inline DnsRecord readDnsRecord(BytePacketBuffer &buffer) {
-  std::string domain;
+inline DnsRecord
+readDnsRecord(BytePacketBuffer &buffer,
+              std::pmr::polymorphic_allocator<> alloc = {}) {
+  std::pmr::string domain(alloc);
   buffer.readQName(domain);
 
   uint16_t qtypeNum = *buffer.readU16();
@@ -220,16 +243,16 @@ inline DnsRecord readDnsRecord(BytePacketBuffer &buffer) {
           std::array<uint8_t, 4> addr = ipv4FromUInt32(rawAddr);
           return ARecord{std::move(domain), addr, ttl};
         } else if constexpr (std::is_same_v<T, NS>) {
-          std::string ns;
+          std::pmr::string ns(alloc);
           buffer.readQName(ns);
           return NSRecord{std::move(domain), std::move(ns), ttl};
         } else if constexpr (std::is_same_v<T, CNAME>) {
-          std::string cname;
+          std::pmr::string cname(alloc);
           buffer.readQName(cname);
           return CNAMERecord{std::move(domain), std::move(cname), ttl};
         } else if constexpr (std::is_same_v<T, MX>) {
           auto priority = *buffer.readU16();
-          std::string mx;
+          std::pmr::string mx(alloc);
           buffer.readQName(mx);
           return MXRecord{std::move(domain), priority, std::move(mx), ttl};
         } else if constexpr (std::is_same_v<T, AAAA>) {
@@ -0,0 +1,93 @@
+#ifndef DNSPUP_INLINE_TASK_HPP
+#define DNSPUP_INLINE_TASK_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Move-only `void()` callable stored inline in a fixed `Capacity` bytes.
+ *
+ * Stands in for std::function on the dispatch path: std::function copies
+ * its target and heap allocates anything bigger than a couple of pointers,
+ * this never allocates. A callable that doesn't fit is a compile error
+ * rather than a silent fallback to the heap, so keep captures small (pass
+ * big things by handle, see PacketPool).
+ **/
+template <size_t Capacity> class InlineTask {
+private:
+  struct Ops {
+    void (*invoke)(void *);
+    // move-construct into `dst` and destroy the source
+    void (*relocate)(void *dst, void *src);
+    void (*destroy)(void *);
+  };
+
+  template <typename Fn> static constexpr Ops opsFor{
+      [](void *self) { (*static_cast<Fn *>(self))(); },
+      [](void *dst, void *src) {
+        ::new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+        static_cast<Fn *>(src)->~Fn();
+      },
+      [](void *self) { static_cast<Fn *>(self)->~Fn(); },
+  };
+
+  alignas(std::max_align_t) unsigned char storage[Capacity];
+  const Ops *ops = nullptr;
+
+  void reset() {
+    if (this->ops != nullptr) {
+      this->ops->destroy(this->storage);
+      this->ops = nullptr;
+    }
+  }
+
+public:
+  InlineTask() = default;
+
+  template <typename Func,
+            typename Fn = std::decay_t<Func>,
+            typename = std::enable_if_t<!std::is_same_v<Fn, InlineTask>>>
+  InlineTask(Func &&func) {
+    static_assert(sizeof(Fn) <= Capacity,
+                  "callable too big for InlineTask, shrink its captures");
+    static_assert(alignof(Fn) <= alignof(std::max_align_t),
+                  "callable is over-aligned for InlineTask");
+    static_assert(std::is_nothrow_move_constructible_v<Fn>,
+                  "InlineTask callables must be nothrow movable");
+
+    ::new (this->storage) Fn(std::forward<Func>(func));
+    this->ops = &opsFor<Fn>;
+  }
+
+  InlineTask(InlineTask &&other) noexcept : ops(other.ops) {
+    if (this->ops != nullptr) {
+      this->ops->relocate(this->storage, other.storage);
+      other.ops = nullptr;
+    }
+  }
+
+  InlineTask &operator=(InlineTask &&other) noexcept {
+    if (this != &other) {
+      this->reset();
+      if (other.ops != nullptr) {
+        other.ops->relocate(this->storage, other.storage);
+        this->ops = other.ops;
+        other.ops = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  InlineTask(const InlineTask &) = delete;
+  InlineTask &operator=(const InlineTask &) = delete;
+
+  ~InlineTask() { this->reset(); }
+
+  explicit operator bool() const { return this->ops != nullptr; }
+
+  void operator()() { this->ops->invoke(this->storage); }
+};
+
+#endif // DNSPUP_INLINE_TASK_HPP
@@ -1,7 +1,11 @@
 #ifndef STRING_UTILS_HPP
 #define STRING_UTILS_HPP
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <iomanip>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -65,6 +69,17 @@ inline std::string ipv6ToString(const std::array<uint8_t, 16> &addr) {
 
   return ss.str();
 }
+
+// heap bytes behind a string, 0 while it's short enough to live in place
+template <typename CharT, typename Traits, typename Alloc>
+inline size_t heapBytes(const std::basic_string<CharT, Traits, Alloc> &str) {
+  const char *data = reinterpret_cast<const char *>(str.data());
+  const char *self = reinterpret_cast<const char *>(&str);
+  if (data >= self && data < self + sizeof(str)) {
+    return 0;
+  }
+  return (str.capacity() + 1) * sizeof(CharT);
+}
 } // namespace stringutils
 
 #endif // STRING_UTILS_HPP
@@ -2,52 +2,264 @@
 #define DNSPUP_THREAD_POOL_HPP
 
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
+#include "InlineTask.hpp"
 #include "WorkQueue.hpp"
 
+enum class SchedulingMode {
+  // every worker pops from the one shared ring
+  SharedQueue,
+  // per-worker deques, LIFO locally, idle workers steal FIFO from others.
+  // the shared ring only takes work submitted from outside the pool
+  WorkStealing,
+};
+
 class ThreadPool {
+public:
+  // bytes of captures a task may carry, see InlineTask
+  static constexpr size_t TASK_CAPACITY = 64;
+
 private:
+  using Task = InlineTask<TASK_CAPACITY>;
+
+  // one per worker in WorkStealing mode. the owner pushes and pops at the
+  // back, thieves take from the front, so the oldest (coldest) task is the
+  // one that moves to another core
+  struct alignas(64) WorkerDeque {
+    std::mutex mtx;
+    std::deque<Task> tasks;
+    std::atomic<size_t> size{0};
+  };
+
   std::vector<std::jthread> workers;
-  ThreadSafeQueue<std::function<void()>> workQueue;
+  // lock-free ring, workers spin briefly then park when it runs dry
+  BoundedMPMCQueue<Task> workQueue;
   std::atomic<bool> __is_thread_running__{true};
   std::atomic<uint64_t> currentActiveTasks{0};
 
+  SchedulingMode mode;
+  std::vector<std::unique_ptr<WorkerDeque>> deques;
+
+  // WorkStealing workers park here instead of inside workQueue, so a push to
+  // any deque or to the ring can wake them. same single in-flight wakeup
+  // scheme as BoundedMPMCQueue
+  std::atomic<uint32_t> workEpoch{0};
+  std::atomic<uint32_t> sleepers{0};
+  std::atomic<bool> wakePending{false};
+
+  // which pool and deque the current thread works for
+  static inline thread_local ThreadPool *currentPool = nullptr;
+  static inline thread_local size_t currentWorker = 0;
+
+  // runs on a worker right before it blocks waiting for more work
+  std::function<void()> onIdle;
+
+  void runTask(Task &task) {
+    currentActiveTasks++;
+    try {
+      task();
+    } catch (const std::exception &e) {
+      std::cerr << "Task exception: " << e.what() << std::endl;
+    }
+    currentActiveTasks--;
+  }
+
   void workerThread() {
     while (this->__is_thread_running__) {
-      std::function<void()> task;
-      if (workQueue.pop(task)) {
-        currentActiveTasks++;
-        try {
-          task();
-        } catch (const std::exception &e) {
-          std::cerr << "Task exception: " << e.what() << std::endl;
+      Task task;
+      bool hasTask = workQueue.tryPop(task);
+      if (!hasTask) {
+        if (this->onIdle) {
+          this->onIdle();
         }
-        currentActiveTasks--;
+        hasTask = workQueue.pop(task);
+      }
+
+      if (hasTask) {
+        this->runTask(task);
+      }
+    }
+
+    if (this->onIdle) {
+      this->onIdle();
+    }
+  }
+
+  bool popLocal(size_t self, Task &task) {
+    WorkerDeque &deque = *this->deques[self];
+    if (deque.size.load(std::memory_order_relaxed) == 0) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(deque.mtx);
+    if (deque.tasks.empty()) {
+      return false;
+    }
+    task = std::move(deque.tasks.back());
+    deque.tasks.pop_back();
+    deque.size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool steal(size_t self, Task &task) {
+    size_t numDeques = this->deques.size();
+    for (size_t i = 1; i < numDeques; i++) {
+      WorkerDeque &victim = *this->deques[(self + i) % numDeques];
+      if (victim.size.load(std::memory_order_relaxed) == 0) {
+        continue;
+      }
+
+      std::lock_guard<std::mutex> lock(victim.mtx);
+      if (victim.tasks.empty()) {
+        continue;
+      }
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      victim.size.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  bool findWork(size_t self, Task &task) {
+    return this->popLocal(self, task) || this->workQueue.tryPop(task) ||
+           this->steal(self, task);
+  }
+
+  void wakeWorker() {
+    this->workEpoch.fetch_add(1);
+    if (this->sleepers.load() > 0 && !this->wakePending.exchange(true)) {
+      this->workEpoch.notify_one();
+    }
+  }
+
+  void stealingWorkerThread(size_t self) {
+    currentPool = this;
+    currentWorker = self;
+
+    while (this->__is_thread_running__) {
+      Task task;
+      if (this->findWork(self, task)) {
+        this->runTask(task);
+        continue;
+      }
+
+      if (this->onIdle) {
+        this->onIdle();
+      }
+
+      // read the epoch first so work showing up after findWork wakes us
+      uint32_t epoch = this->workEpoch.load();
+      if (this->findWork(self, task)) {
+        this->runTask(task);
+        continue;
+      }
+      if (!this->__is_thread_running__) {
+        break;
+      }
+
+      this->sleepers.fetch_add(1);
+      this->wakePending = false;
+      this->workEpoch.wait(epoch);
+      this->sleepers.fetch_sub(1);
+      this->wakePending = false;
+
+      // pass the wakeup on if there is more than one worker's worth
+      if (this->queueSize() > 1) {
+        this->wakeWorker();
       }
     }
+
+    if (this->onIdle) {
+      this->onIdle();
+    }
   }
 
 public:
-  ThreadPool(size_t numThreads) {
+  ThreadPool(size_t numThreads, std::function<void()> onIdle_ = nullptr,
+             size_t queueCapacity = 4096,
+             SchedulingMode mode_ = SchedulingMode::SharedQueue)
+      : workQueue(queueCapacity), mode(mode_), onIdle(std::move(onIdle_)) {
+    if (this->mode == SchedulingMode::WorkStealing) {
+      for (size_t i = 0; i < numThreads; i++) {
+        this->deques.push_back(std::make_unique<WorkerDeque>());
+      }
+    }
+
     for (size_t i = 0; i < numThreads; i++) {
-      workers.emplace_back(&ThreadPool::workerThread, this);
+      if (this->mode == SchedulingMode::WorkStealing) {
+        workers.emplace_back(&ThreadPool::stealingWorkerThread, this, i);
+      } else {
+        workers.emplace_back(&ThreadPool::workerThread, this);
+      }
     }
   }
 
   ~ThreadPool() { shutdown(); }
 
+  /**
+   * Queue a task. In WorkStealing mode a task enqueued from one of our own
+   * workers stays on that worker's deque (and runs next, LIFO) unless an
+   * idle worker steals it, everything else goes through the shared ring
+   **/
   template <typename Func> void enqueue(Func &&task) {
-    this->workQueue.push(std::forward<Func>(task));
+    if (this->mode == SchedulingMode::SharedQueue) {
+      this->workQueue.push(std::forward<Func>(task));
+      return;
+    }
+
+    if (currentPool == this) {
+      WorkerDeque &deque = *this->deques[currentWorker];
+      {
+        std::lock_guard<std::mutex> lock(deque.mtx);
+        deque.tasks.emplace_back(std::forward<Func>(task));
+      }
+      deque.size.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      this->workQueue.push(std::forward<Func>(task));
+    }
+
+    this->wakeWorker();
+  }
+
+  /**
+   * Like enqueue() but never waits for room, returns false if the shared
+   * ring is full. Tasks a worker queues to its own deque always fit
+   **/
+  template <typename Func> bool tryEnqueue(Func &&task) {
+    if (this->mode == SchedulingMode::WorkStealing && currentPool == this) {
+      this->enqueue(std::forward<Func>(task));
+      return true;
+    }
+
+    Task item(std::forward<Func>(task));
+    if (!this->workQueue.tryPush(item)) {
+      return false;
+    }
+
+    if (this->mode == SchedulingMode::WorkStealing) {
+      this->wakeWorker();
+    }
+    return true;
   }
 
   void shutdown() {
     this->__is_thread_running__ = false;
     workQueue.shutdownQueue();
 
+    this->workEpoch.fetch_add(1);
+    this->workEpoch.notify_all();
+
     for (auto &worker : this->workers) {
       if (worker.joinable()) {
         worker.join();
@@ -55,7 +267,16 @@ public:
     }
   }
 
-  size_t queueSize() const { return this->workQueue.size(); }
+  /**
+   * Tasks waiting to run, the shared ring plus every worker's deque
+   **/
+  size_t queueSize() const {
+    size_t queued = this->workQueue.size();
+    for (const auto &deque : this->deques) {
+      queued += deque->size.load(std::memory_order_relaxed);
+    }
+    return queued;
+  }
 
   uint64_t activeTasks() const {
     return this->currentActiveTasks.load();
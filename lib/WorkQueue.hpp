@@ -1,9 +1,18 @@
 #ifndef DNSPUP_WORKQUEUE_HPP
 #define DNSPUP_WORKQUEUE_HPP
 
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 template <typename T> class ThreadSafeQueue {
 private:
@@ -36,6 +45,18 @@ public:
     return true;
   }
 
+  // non-blocking pop, returns false if there is nothing queued right now
+  bool tryPop(T &item) {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if (queue.empty()) {
+      return false;
+    }
+
+    item = std::move(queue.front());
+    queue.pop();
+    return true;
+  }
+
   void shutdownQueue() {
     {
       std::lock_guard<std::mutex> lock(this->mtx);
@@ -51,4 +72,236 @@ public:
   }
 };
 
+// tell the cpu we're in a spin-wait loop
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#else
+  std::this_thread::yield();
+#endif
+}
+
+/**
+ * Bounded lock-free multi-producer multi-consumer ring (Dmitry Vyukov's
+ * design). Every cell carries a sequence number that tells producers and
+ * consumers whose turn it is, so a push or pop is one CAS on the shared
+ * index plus a store to the cell, with no lock anywhere.
+ *
+ * Same interface as ThreadSafeQueue. A consumer that finds the ring empty
+ * spins for a bit and then parks on a futex (std::atomic::wait); producers
+ * only pay for a wakeup when somebody is actually parked. push() on a full
+ * ring waits the same way for a consumer to make room, tryPush() doesn't.
+ **/
+template <typename T> class BoundedMPMCQueue {
+private:
+  static constexpr size_t CACHE_LINE = 64;
+  static constexpr int SPIN_LIMIT = 256;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  const size_t mask;
+  std::unique_ptr<Cell[]> cells;
+
+  alignas(CACHE_LINE) std::atomic<size_t> enqueuePos{0};
+  alignas(CACHE_LINE) std::atomic<size_t> dequeuePos{0};
+
+  // bumped on every push/pop, parked threads wait for them to move.
+  //
+  // Only one wakeup per side is in flight at a time: until the woken thread
+  // runs, further pushes skip the futex syscall (otherwise a producer racing
+  // a not-yet-scheduled consumer pays a syscall per item). The flag is
+  // cleared by every thread right before it parks and right after it wakes,
+  // and a woken thread that finds more work queued wakes the next one, so
+  // nothing is left sitting in the ring with everyone asleep
+  alignas(CACHE_LINE) std::atomic<uint32_t> pushEpoch{0};
+  std::atomic<uint32_t> popWaiters{0};
+  std::atomic<bool> popWakePending{false};
+  alignas(CACHE_LINE) std::atomic<uint32_t> popEpoch{0};
+  std::atomic<uint32_t> pushWaiters{0};
+  std::atomic<bool> pushWakePending{false};
+
+  std::atomic<bool> shutdown{false};
+
+  void wakeConsumer() {
+    if (this->popWaiters.load() > 0 && !this->popWakePending.exchange(true)) {
+      this->pushEpoch.notify_one();
+    }
+  }
+
+  void wakeProducer() {
+    if (this->pushWaiters.load() > 0 && !this->pushWakePending.exchange(true)) {
+      this->popEpoch.notify_one();
+    }
+  }
+
+  bool popOrPark(T &item) {
+    for (int spin = 0; spin < SPIN_LIMIT; spin++) {
+      if (this->tryPop(item)) {
+        return true;
+      }
+      if (this->shutdown.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      cpuRelax();
+    }
+
+    while (true) {
+      // read the epoch first so a push landing after tryPop wakes us
+      uint32_t epoch = this->pushEpoch.load();
+      if (this->tryPop(item)) {
+        return true;
+      }
+      if (this->shutdown.load()) {
+        return false;
+      }
+
+      this->popWaiters.fetch_add(1);
+      this->popWakePending = false;
+      this->pushEpoch.wait(epoch);
+      this->popWaiters.fetch_sub(1);
+      this->popWakePending = false;
+    }
+  }
+
+  static size_t roundUpPow2(size_t n) {
+    size_t capacity = 2;
+    while (capacity < n) {
+      capacity <<= 1;
+    }
+    return capacity;
+  }
+
+public:
+  explicit BoundedMPMCQueue(size_t capacity = 4096)
+      : mask(roundUpPow2(capacity) - 1), cells(new Cell[mask + 1]) {
+    for (size_t i = 0; i <= this->mask; i++) {
+      this->cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedMPMCQueue(const BoundedMPMCQueue &) = delete;
+  BoundedMPMCQueue &operator=(const BoundedMPMCQueue &) = delete;
+
+  // non-blocking push, returns false if the ring is full
+  bool tryPush(T &item) {
+    Cell *cell;
+    size_t pos = this->enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &this->cells[pos & this->mask];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (this->enqueuePos.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = this->enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->data = std::move(item);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    this->pushEpoch.fetch_add(1);
+    this->wakeConsumer();
+    return true;
+  }
+
+  void push(T item) {
+    for (int spin = 0; !this->tryPush(item); spin++) {
+      if (this->shutdown.load(std::memory_order_relaxed)) {
+        return;
+      }
+
+      if (spin < SPIN_LIMIT) {
+        cpuRelax();
+        continue;
+      }
+
+      // full, park until a consumer pops something
+      uint32_t epoch = this->popEpoch.load();
+      if (this->tryPush(item)) {
+        break;
+      }
+      this->pushWaiters.fetch_add(1);
+      this->pushWakePending = false;
+      this->popEpoch.wait(epoch);
+      this->pushWaiters.fetch_sub(1);
+      this->pushWakePending = false;
+    }
+
+    // pass the wakeup on if there is still room
+    if (this->size() < this->capacity()) {
+      this->wakeProducer();
+    }
+  }
+
+  // non-blocking pop, returns false if there is nothing queued right now
+  bool tryPop(T &item) {
+    Cell *cell;
+    size_t pos = this->dequeuePos.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &this->cells[pos & this->mask];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (this->dequeuePos.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = this->dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+
+    item = std::move(cell->data);
+    cell->data = T();
+    cell->sequence.store(pos + this->mask + 1, std::memory_order_release);
+
+    this->popEpoch.fetch_add(1);
+    this->wakeProducer();
+    return true;
+  }
+
+  bool pop(T &item) {
+    if (!this->popOrPark(item)) {
+      return false;
+    }
+
+    // pass the wakeup on if there is more work than we can take
+    if (this->size() > 0) {
+      this->wakeConsumer();
+    }
+    return true;
+  }
+
+  void shutdownQueue() {
+    this->shutdown = true;
+
+    this->pushEpoch.fetch_add(1);
+    this->pushEpoch.notify_all();
+    this->popEpoch.fetch_add(1);
+    this->popEpoch.notify_all();
+  }
+
+  size_t size() const {
+    size_t head = this->dequeuePos.load(std::memory_order_relaxed);
+    size_t tail = this->enqueuePos.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  size_t capacity() const { return this->mask + 1; }
+};
+
 #endif // DNSPUP_WORKQUEUE_HPP
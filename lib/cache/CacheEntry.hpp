@@ -7,12 +7,37 @@
 #ifndef CACHE_ENTRY_HPP
 #define CACHE_ENTRY_HPP
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 
 #include "../DnsRecord.hpp"
 #include "../ResultCode.hpp"
 
+/**
+ * HitCounter - a hit count lookups bump while holding only a shared lock.
+ * A relaxed atomic that still copies like a plain number (a copy is a
+ * snapshot), so entries holding one stay copyable
+ **/
+class HitCounter {
+private:
+  std::atomic<uint32_t> value{0};
+
+public:
+  HitCounter(uint32_t value_ = 0) : value(value_) {}
+  HitCounter(const HitCounter &other) noexcept : value(other.load()) {}
+
+  HitCounter &operator=(const HitCounter &other) noexcept {
+    this->value.store(other.load(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  void bump() { this->value.fetch_add(1, std::memory_order_relaxed); }
+  uint32_t load() const { return this->value.load(std::memory_order_relaxed); }
+  operator uint32_t() const { return this->load(); }
+};
+
 /**
  * CacheEntry represents a cache entry that supports all the general
  * querytype ie. A, AAAA, CNAME and other set of records supported by
@@ -25,17 +50,19 @@ struct CacheEntry {
   std::chrono::time_point<std::chrono::steady_clock> insertedAt;
   std::chrono::time_point<std::chrono::steady_clock> expiresAt;
   uint32_t originalTTL;
-  uint32_t hitCount;
+  HitCounter hitCount;
 
   /**
    * Returns true if `this` cache entry is expired
    **/
-  bool isExpired() const;
+  bool isExpired(std::chrono::time_point<std::chrono::steady_clock> now =
+                     std::chrono::steady_clock::now()) const;
 
   /**
    * Returns the remaining TTL for this entry
    **/
-  uint32_t remainingTTL() const;
+  uint32_t remainingTTL(std::chrono::time_point<std::chrono::steady_clock>
+                            now = std::chrono::steady_clock::now()) const;
 
   friend std::ostream &operator<<(std::ostream &stream, const CacheEntry ce) {
     std::cout << "[[CacheEntry]]\n" << "\tTTL: " << ce.remainingTTL() << "\n";
@@ -43,13 +70,13 @@ struct CacheEntry {
   }
 };
 
-inline bool CacheEntry::isExpired() const {
-  auto now = std::chrono::steady_clock::now();
+inline bool CacheEntry::isExpired(
+    std::chrono::time_point<std::chrono::steady_clock> now) const {
   return now >= this->expiresAt;
 }
 
-inline uint32_t CacheEntry::remainingTTL() const {
-  auto now = std::chrono::steady_clock::now();
+inline uint32_t CacheEntry::remainingTTL(
+    std::chrono::time_point<std::chrono::steady_clock> now) const {
   if (now >= this->expiresAt) {
     return 0;
   }
@@ -72,26 +99,28 @@ struct NSCacheEntry {
   std::chrono::time_point<std::chrono::steady_clock> insertedAt;
   std::chrono::time_point<std::chrono::steady_clock> expiresAt;
   uint32_t originalTTL;
-  uint32_t hitCount;
+  HitCounter hitCount;
 
   /**
    * Returns true if `this` cache entry is expired
    **/
-  bool isExpired() const;
+  bool isExpired(std::chrono::time_point<std::chrono::steady_clock> now =
+                     std::chrono::steady_clock::now()) const;
 
   /**
    * Returns the remaining TTL for this entry
    **/
-  uint32_t remainingTTL() const;
+  uint32_t remainingTTL(std::chrono::time_point<std::chrono::steady_clock>
+                            now = std::chrono::steady_clock::now()) const;
 };
 
-inline bool NSCacheEntry::isExpired() const {
-  auto now = std::chrono::steady_clock::now();
+inline bool NSCacheEntry::isExpired(
+    std::chrono::time_point<std::chrono::steady_clock> now) const {
   return now >= this->expiresAt;
 }
 
-inline uint32_t NSCacheEntry::remainingTTL() const {
-  auto now = std::chrono::steady_clock::now();
+inline uint32_t NSCacheEntry::remainingTTL(
+    std::chrono::time_point<std::chrono::steady_clock> now) const {
   if (now >= this->expiresAt) {
     return 0;
   }
@@ -114,16 +143,17 @@ struct NegativeCacheEntry {
   std::chrono::time_point<std::chrono::steady_clock> insertedAt;
   std::chrono::time_point<std::chrono::steady_clock> expiresAt;
   uint32_t originalTTL;
-  uint32_t hitCount;
+  HitCounter hitCount;
 
   /**
    * Returns true if `this` cache entry is expired
    **/
-  bool isExpired() const;
+  bool isExpired(std::chrono::time_point<std::chrono::steady_clock> now =
+                     std::chrono::steady_clock::now()) const;
 };
 
-inline bool NegativeCacheEntry::isExpired() const {
-  auto now = std::chrono::steady_clock::now();
+inline bool NegativeCacheEntry::isExpired(
+    std::chrono::time_point<std::chrono::steady_clock> now) const {
   return now >= this->expiresAt;
 }
 
@@ -0,0 +1,54 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the key the answer and negative caches are stored
+ * under
+ **/
+
+#ifndef CACHE_KEY_HPP
+#define CACHE_KEY_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../names/DnsName.hpp"
+
+/**
+ * CacheKey is the question a cache entry answers: the owner name and the
+ * numeric qtype
+ **/
+struct CacheKey {
+  DnsName name;
+  uint16_t qtype;
+};
+
+// what lookups search with, the name isn't copied
+struct CacheKeyView {
+  DnsNameView name;
+  uint16_t qtype;
+
+  CacheKeyView(DnsNameView name_, uint16_t qtype_)
+      : name(name_), qtype(qtype_) {}
+  CacheKeyView(const CacheKey &key) : name(key.name), qtype(key.qtype) {}
+
+  bool operator==(const CacheKeyView &other) const {
+    return this->qtype == other.qtype && this->name == other.name;
+  }
+};
+
+// transparent like DnsNameHash, the name's hash is reused as is
+struct CacheKeyHash {
+  using is_transparent = void;
+  size_t operator()(const CacheKeyView &key) const {
+    return key.name.hash() ^ (key.qtype * 0x9E3779B97F4A7C15ull);
+  }
+};
+
+struct CacheKeyEqual {
+  using is_transparent = void;
+  bool operator()(const CacheKeyView &a, const CacheKeyView &b) const {
+    return a == b;
+  }
+};
+
+#endif // CACHE_KEY_HPP
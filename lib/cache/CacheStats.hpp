@@ -7,6 +7,7 @@
 #ifndef CACHE_STATS_HPP
 #define CACHE_STATS_HPP
 
+#include <atomic>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
@@ -24,6 +25,14 @@ struct CacheStats {
   uint64_t evictions = 0;
   uint64_t expirations = 0;
 
+  // hits served from an encoded response, counted in hits as well
+  uint64_t wireHits = 0;
+
+  // refresh-ahead: answers re-resolved before they expired, and the misses
+  // that saved (the first hit once the replaced answer would have expired)
+  uint64_t prefetches = 0;
+  uint64_t prefetchSavedMisses = 0;
+
   // ns cache stats
   uint64_t nsHits = 0;
   uint64_t nsMisses = 0;
@@ -37,6 +46,14 @@ struct CacheStats {
   size_t currentEntries = 0;
   size_t maxEntries = 0;
 
+  // memory gauges, what each cache holds against the shared budget
+  size_t answerBytes = 0;
+  size_t nsBytes = 0;
+  size_t negBytes = 0;
+  size_t maxBytes = 0;
+
+  size_t usedBytes() const { return answerBytes + nsBytes + negBytes; }
+
   /**
    * Calculate cache hit rate as a percentage
    **/
@@ -52,6 +69,11 @@ struct CacheStats {
    **/
   double negHitRate() const;
 
+  /**
+   * Calculate the share of hits that started a prefetch as a percentage
+   **/
+  double prefetchRate() const;
+
   /**
    * Print cache statistics to stdout
    **/
@@ -61,8 +83,50 @@ struct CacheStats {
    * Reset all statistics to zero
    **/
   void reset();
+
+  /**
+   * Add `other`'s counters to these, to sum up the stats of several shards
+   **/
+  CacheStats &operator+=(const CacheStats &other);
+};
+
+/**
+ * LookupCounters - the counters lookups bump. Lookups run concurrently
+ * under a shared lock, so these are relaxed atomics kept apart from the
+ * writer side counters and added into a CacheStats snapshot on demand
+ **/
+struct LookupCounters {
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> wireHits{0};
+  std::atomic<uint64_t> nsHits{0};
+  std::atomic<uint64_t> nsMisses{0};
+  std::atomic<uint64_t> negHits{0};
+  std::atomic<uint64_t> prefetches{0};
+  std::atomic<uint64_t> prefetchSavedMisses{0};
+
+  static void bump(std::atomic<uint64_t> &counter) {
+    counter.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Add the current counts to `stats`
+   **/
+  void addTo(CacheStats &stats) const;
 };
 
+inline void LookupCounters::addTo(CacheStats &stats) const {
+  stats.hits += hits.load(std::memory_order_relaxed);
+  stats.misses += misses.load(std::memory_order_relaxed);
+  stats.wireHits += wireHits.load(std::memory_order_relaxed);
+  stats.nsHits += nsHits.load(std::memory_order_relaxed);
+  stats.nsMisses += nsMisses.load(std::memory_order_relaxed);
+  stats.negHits += negHits.load(std::memory_order_relaxed);
+  stats.prefetches += prefetches.load(std::memory_order_relaxed);
+  stats.prefetchSavedMisses +=
+      prefetchSavedMisses.load(std::memory_order_relaxed);
+}
+
 inline double CacheStats::hitRate() const {
   uint64_t total = hits + misses;
   if (total == 0)
@@ -84,36 +148,77 @@ inline double CacheStats::negHitRate() const {
   return (static_cast<double>(negHits) / total) * 100.0;
 }
 
+inline double CacheStats::prefetchRate() const {
+  if (hits == 0)
+    return 0.0;
+  return (static_cast<double>(prefetches) / hits) * 100.0;
+}
+
 inline void CacheStats::reset() {
   hits = 0;
   misses = 0;
   inserts = 0;
   evictions = 0;
   expirations = 0;
+  wireHits = 0;
+  prefetches = 0;
+  prefetchSavedMisses = 0;
   currentEntries = 0;
 }
 
+inline CacheStats &CacheStats::operator+=(const CacheStats &other) {
+  hits += other.hits;
+  misses += other.misses;
+  inserts += other.inserts;
+  evictions += other.evictions;
+  expirations += other.expirations;
+  wireHits += other.wireHits;
+  prefetches += other.prefetches;
+  prefetchSavedMisses += other.prefetchSavedMisses;
+  nsHits += other.nsHits;
+  nsMisses += other.nsMisses;
+  nsInserts += other.nsInserts;
+  negHits += other.negHits;
+  negMisses += other.negMisses;
+  negInserts += other.negInserts;
+  currentEntries += other.currentEntries;
+  maxEntries += other.maxEntries;
+  answerBytes += other.answerBytes;
+  nsBytes += other.nsBytes;
+  negBytes += other.negBytes;
+  maxBytes += other.maxBytes;
+  return *this;
+}
+
 inline void CacheStats::print() const {
   std::cout << "\n=== Cache Statistics ===\n";
   std::cout << "Hits: " << hits << "\n";
   std::cout << "Misses: " << misses << "\n";
   std::cout << "Hit Rate: " << hitRate() << "%\n";
+  std::cout << "Wire Hits: " << wireHits << "\n";
+  std::cout << "Prefetches: " << prefetches << "\n";
+  std::cout << "Prefetch Rate: " << prefetchRate() << "%\n";
+  std::cout << "Prefetch Saved Misses: " << prefetchSavedMisses << "\n";
   std::cout << "Inserts: " << inserts << "\n";
   std::cout << "Evictions: " << evictions << "\n";
   std::cout << "Expirations: " << expirations << "\n";
   std::cout << "Current Entries: " << currentEntries << "\n";
   std::cout << "Max Entries: " << maxEntries << "\n";
+  std::cout << "Bytes Used: " << usedBytes() << " of " << maxBytes << "\n";
+  std::cout << "Answer Bytes: " << answerBytes << "\n";
   std::cout << "\n---- NS Cache --\n";
   std::cout << "NS Hits: " << nsHits << "\n";
   std::cout << "NS Misses: " << nsMisses << "\n";
   std::cout << "NS Inserts: " << nsInserts << "\n";
   std::cout << "NS Hit Rate: " << nsHitRate() << "%\n";
+  std::cout << "NS Bytes: " << nsBytes << "\n";
   std::cout << "\n--- Negative Cache ---\n";
   std::cout << "Negative Hits: " << negHits << "\n";
   std::cout << "Negative Misses: " << negMisses << "\n";
   std::cout << "Negative Inserts: " << negInserts << "\n";
   std::cout << "Negative Hit Rate: " << std::fixed << std::setprecision(2)
             << negHitRate() << "%\n";
+  std::cout << "Negative Bytes: " << negBytes << "\n";
   std::cout << "========================\n\n";
 }
 
@@ -11,18 +11,130 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
-#include <list>
 #include <optional>
 #include <shared_mutex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <thread>
-#include <unordered_map>
+#include <variant>
 #include <vector>
 
 #include "../QueryType.hpp"
+#include "../config/CacheConfig.hpp"
+#include "../names/DnsName.hpp"
 #include "CacheEntry.hpp"
+#include "CacheKey.hpp"
 #include "CacheStats.hpp"
+#include "EvictionEngine.hpp"
+#include "FlatIndex.hpp"
+#include "TimerWheel.hpp"
+#include "WireAnswer.hpp"
 
+/**
+ * AnswerFlags - flags lookups set on an answer while holding only a shared
+ * lock, each set once by whichever hit gets there first. Copies like
+ * HitCounter does
+ **/
+class AnswerFlags {
+private:
+  std::atomic<uint8_t> bits{0};
+
+public:
+  // a refresh of the answer has been started
+  static constexpr uint8_t PREFETCHING = 1;
+  // the first hit a refresh saved from missing has been counted
+  static constexpr uint8_t SAVED = 2;
+
+  AnswerFlags() = default;
+  AnswerFlags(const AnswerFlags &other) noexcept : bits(other.load()) {}
+
+  AnswerFlags &operator=(const AnswerFlags &other) noexcept {
+    this->bits.store(other.load(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  uint8_t load() const { return this->bits.load(std::memory_order_relaxed); }
+  bool test(uint8_t flag) const { return (this->load() & flag) != 0; }
+
+  // set `flag`, true for the one caller that set it
+  bool claim(uint8_t flag) {
+    return !this->test(flag) &&
+           (this->bits.fetch_or(flag, std::memory_order_relaxed) & flag) == 0;
+  }
+
+  // let `flag` be claimed again
+  void release(uint8_t flag) {
+    this->bits.fetch_and(static_cast<uint8_t>(~flag),
+                         std::memory_order_relaxed);
+  }
+};
+
+// what an answer key holds: its records and their encoded response
+struct CachedAnswer {
+  using time_point = std::chrono::steady_clock::time_point;
+
+  std::vector<CacheEntry> entries;
+  std::optional<WireAnswer> wire;
+
+  // hits from here on are in the last prefetchPercent of the earliest
+  // record's TTL
+  time_point prefetchAt = time_point::max();
+
+  // when the answer a prefetch replaced would have expired
+  time_point refreshedFrom = time_point::max();
+
+  AnswerFlags flags;
+};
+
+/**
+ * One slot of the cache: a key and what is cached under it, an answer, a
+ * negative answer or a nameserver address. NS addresses are keyed on the
+ * zone with qtype 0 and only ever match NS lookups
+ **/
+struct CacheSlot {
+  CacheKey key;
+  std::variant<CachedAnswer, NegativeCacheEntry, NSCacheEntry> value;
+
+  // fires when the entry (an answer's earliest record) expires
+  uint32_t expiryTimer = UINT32_MAX;
+
+  // what the slot is charged against the byte budget
+  size_t bytes = 0;
+
+  bool isNameserver() const {
+    return std::holds_alternative<NSCacheEntry>(this->value);
+  }
+};
+
+/**
+ * DnsCache - answer, nameserver and negative caches behind one
+ * reader-writer lock.
+ *
+ * Lookups hold the lock shared and only read: they skip expired entries
+ * rather than erase them, count hits in relaxed atomics and set the key's
+ * visited bit in the EvictionEngine. Writers, which hold the lock
+ * exclusively, do the rest: the cleanup thread drops what expired and a
+ * full cache asks the engine for a victim.
+ *
+ * All three caches share one table: slots indexed by their eviction slot
+ * and found through a FlatIndex over their keys' hashes. A key has either
+ * an answer or a negative entry, caching one replaces the other.
+ *
+ * Every slot is charged its footprint (the slot, heap bytes of its name,
+ * records and encoded answer, and its share of the index, engine and
+ * timer) and the three caches share `maxBytes`. An insert that goes over
+ * it evicts whatever the engine picks, of any kind, until it fits.
+ *
+ * Every slot has a timer in a TimerWheel for when it (or an answer's
+ * earliest record) expires. Expiring takes the lock for at most
+ * `expirySlice` entries at a time and never scans the table.
+ *
+ * A popular answer close to expiring is refreshed ahead of time: the first
+ * hit in the last `prefetchPercent` of its TTL (once it has had
+ * `prefetchMinHits`) tells the caller to re-resolve it, and the insert that
+ * follows replaces it before any client sees a miss
+ **/
 class DnsCache {
 private:
   // reader-writer lock
@@ -37,20 +149,24 @@ private:
   // cleanup loop
   void _thread__cleanup();
 
-  // Storage: map<cacheKey, vector<CacheEntry>>
-  std::unordered_map<std::string, std::vector<CacheEntry>> cache;
-  std::unordered_map<std::string, NSCacheEntry> nsCache;
-  std::unordered_map<std::string, NegativeCacheEntry> negativeCache;
+  // Storage: slots[slot], found by index, grown as slots are first used
+  std::vector<CacheSlot> slots;
+  FlatIndex index;
 
   // config
   uint32_t minTTL = 60;
   uint32_t maxTTL = 86400;
+  bool wireAnswers = true;
+  uint32_t prefetchPercent = 10;
+  uint32_t prefetchMinHits = 8;
 
-  // stats
+  // stats, writers count in `stats` under the exclusive lock, lookups in
+  // `lookups`
   CacheStats stats;
+  LookupCounters lookups;
 
   // Helper: generate cache key
-  std::string makeCacheKey(const std::string &qname, QueryType qtype);
+  CacheKeyView makeCacheKey(const DnsName &qname, QueryType qtype);
 
   // Helper: extract TTL from DnsRecord variant
   uint32_t extractTTL(const DnsRecord &record);
@@ -59,18 +175,83 @@ private:
   uint32_t enforceTTLBounds(uint32_t ttl);
 
   // Helper: remove expired entries from a bucket
-  void removeExpiredEntries(std::vector<CacheEntry> &entries);
+  void removeExpiredEntries(std::vector<CacheEntry> &entries,
+                            std::chrono::steady_clock::time_point now);
+
+  // Helper: when the earliest of `entries` expires, they mustn't be empty
+  static std::chrono::steady_clock::time_point
+  earliestExpiry(const std::vector<CacheEntry> &entries);
+
+  // Helper: the slot `key` is cached in, FlatIndex::NONE if it isn't. NS
+  // addresses and answers (or negative ones) are told apart by `nameserver`
+  uint32_t findSlot(const CacheKeyView &key, bool nameserver) const;
+
+  // Helper: the slot for `key`, a fresh one if it isn't cached, writers only
+  uint32_t acquireSlot(const DnsName &name, uint16_t qtype, bool nameserver);
+
+  // Helper: drop whatever is in `slot` and free it, writers only
+  void dropSlot(uint32_t slot);
+
+  // Helper: (re)arm the slot's expiry timer
+  void expireAt(uint32_t slot, std::chrono::steady_clock::time_point at);
+
+  // -------- PREFETCH --------
+  // when hits on `entries` start asking for a refresh
+  std::chrono::steady_clock::time_point
+  prefetchPoint(const std::vector<CacheEntry> &entries) const;
+
+  /**
+   * Refresh-ahead bookkeeping for a hit on `answer`, lookups only. Counts
+   * the miss a refresh saved, and sets `*prefetch` for the one hit that
+   * should start a refresh (nothing is claimed when `prefetch` is null)
+   **/
+  void onAnswerHit(CachedAnswer &answer,
+                   std::chrono::steady_clock::time_point now,
+                   bool *prefetch);
 
-  // -------- LRU TRACKING --------
-  std::list<std::string> lruList; // dll
-  std::unordered_map<std::string, std::list<std::string>::iterator>
-      lruMap; // quick lookup
-  size_t maxEntries = 10000;
-  size_t maxNsEntries = 1000;
+  size_t maxEntries = 262144;
+  size_t maxBytes = size_t{64} << 20;
+
+  // -------- MEMORY --------
+  // bytes `slot` takes up, see the class comment
+  static size_t footprintOf(const CacheSlot &slot);
+
+  // the gauge of the cache `slot` belongs to
+  size_t &gaugeFor(const CacheSlot &slot);
+
+  // take the slot's bytes off / put its current footprint on its gauge
+  void uncharge(uint32_t slot);
+  void charge(uint32_t slot);
+
+  // evict until the caches fit the budget again, never `keep`
+  void trimToBudget(uint32_t keep);
+
+  // -------- EVICTION --------
+  // one slot per key, sized for maxEntries
+  EvictionEngine eviction;
+
+  // -------- EXPIRY --------
+  TimerWheel<uint32_t> expiry;
+  size_t expirySlice = 256;
+
+  // what to do when a slot's timer fires, writers only
+  void expireSlot(uint32_t slot, std::chrono::steady_clock::time_point now);
 
 public:
+  explicit DnsCache(const CacheConfig &config)
+      : minTTL(config.minTTL), maxTTL(config.maxTTL),
+        wireAnswers(config.wireAnswers),
+        prefetchPercent(std::min<uint32_t>(config.prefetchPercent, 100)),
+        prefetchMinHits(config.prefetchMinHits), maxEntries(config.maxEntries),
+        maxBytes(config.maxBytes),
+        eviction(config.eviction, config.maxEntries),
+        expirySlice(std::max<size_t>(config.expirySlice, 1)) {
+    this->stats.maxEntries = this->maxEntries;
+    this->stats.maxBytes = this->maxBytes;
+  }
+
   DnsCache(uint32_t minTTL_ = 60, uint32_t maxTTL_ = 86400)
-      : minTTL(minTTL_), maxTTL(maxTTL_) {}
+      : DnsCache(CacheConfig(minTTL_, maxTTL_)) {}
 
   // stop the thread
   ~DnsCache() { this->stopCleanup(); }
@@ -101,84 +282,257 @@ public:
     std::cout << "[Cache] Cleanup thread stopped" << std::endl;
   }
 
-  // Lookup cache records
-  std::optional<std::vector<DnsRecord>> lookup(const std::string &qname,
-                                               QueryType qtype);
-  std::optional<std::array<uint8_t, 4>> lookupNS(const std::string &domain);
+  /**
+   * Lookup cache records. When `prefetch` is given it is set if the answer
+   * is due a refresh and the caller should re-resolve it, see
+   * CacheConfig::prefetchPercent. Only one hit per answer gets that
+   **/
+  std::optional<std::vector<DnsRecord>>
+  lookup(const DnsName &qname, QueryType qtype, bool *prefetch = nullptr);
+  std::optional<std::array<uint8_t, 4>> lookupNS(const DnsNameView &domain);
+
+  /**
+   * Lookup the encoded response for an answer, see WireAnswer. It's copied
+   * into `out` (room for a full datagram) with the TTLs patched and its
+   * length returned, 0 if there is none and the records have to be used.
+   * `prefetch` as for lookup()
+   **/
+  size_t lookupWire(const DnsName &qname, QueryType qtype, uint8_t *out,
+                    bool *prefetch = nullptr);
+
+  /**
+   * The refresh a lookup asked for didn't replace the answer (it wasn't
+   * started, failed or came back empty), let a later hit ask again
+   **/
+  void cancelPrefetch(const DnsName &qname, QueryType qtype);
 
   // Insert records into cache
-  void insert(const std::string &qname, QueryType qtype,
-              const std::vector<DnsRecord> &records);
-  void insertNS(const std::string &domain, const std::array<uint8_t, 4> &ip,
+  void insert(const DnsName &qname, QueryType qtype,
+              std::span<const DnsRecord> records);
+  void insertNS(const DnsName &domain, const std::array<uint8_t, 4> &ip,
                 uint32_t ttl);
-  void insertNegative(const std::string &qname, QueryType qtype,
+  void insertNegative(const DnsName &qname, QueryType qtype,
                       ResultCode rescode, uint32_t ttl);
 
-  // Manual cleanup
+  /**
+   * Expire what is due, at most `budget` entries under one hold of the
+   * lock. Returns how many went, `budget` means there may be more
+   **/
+  size_t expireDue(size_t budget);
+
+  // Manual cleanup: everything due, `expirySlice` entries at a time
   void cleanupExpired();
 
-  // Stats access
-  const CacheStats &getStats() const;
+  // Stats access, a snapshot
+  CacheStats getStats() const;
   void printStats() const;
 
-  // -------- LRU OPS --------
-  void evictLRU();
-  void updateLRU(const std::string &key);
+  // -------- EVICTION OPS --------
+  // drop the key the engine picks, whatever it holds, writers only
+  void evictOne();
 };
 
 inline void DnsCache::_thread__cleanup() {
   while (this->_thread__cleanup_running) {
     std::unique_lock<std::mutex> lock(cvMtx);
-    cv.wait_for(lock, std::chrono::seconds(60),
+    cv.wait_for(lock, std::chrono::seconds(1),
                 [this]() { return !this->_thread__cleanup_running; });
     if (!this->_thread__cleanup_running) {
       break;
     }
 
-    // clean up expired entries
+    // expire what came due in the last tick
     this->cleanupExpired();
+  }
+}
+
+inline void DnsCache::evictOne() {
+  this->dropSlot(this->eviction.victim());
+  this->stats.evictions++;
+}
+
+inline size_t DnsCache::footprintOf(const CacheSlot &slot) {
+  // index control byte and id, engine links and bit, and a timer
+  constexpr size_t BOOKKEEPING = 5 + 9 + 32;
+
+  size_t bytes = sizeof(CacheSlot) + BOOKKEEPING + slot.key.name.heapBytes();
+  if (const auto *answer = std::get_if<CachedAnswer>(&slot.value)) {
+    bytes += answer->entries.capacity() * sizeof(CacheEntry);
+    for (const auto &entry : answer->entries) {
+      bytes += std::visit(
+          [](const auto &r) {
+            size_t heap = stringutils::heapBytes(r.domain);
+            if constexpr (requires { r.host; }) {
+              heap += stringutils::heapBytes(r.host);
+            }
+            return heap;
+          },
+          entry.record);
+    }
+
+    if (answer->wire.has_value()) {
+      bytes += answer->wire->bytes.capacity() +
+               answer->wire->ttls.capacity() * sizeof(WireAnswer::TtlSlot);
+    }
+  }
+  return bytes;
+}
+
+inline size_t &DnsCache::gaugeFor(const CacheSlot &slot) {
+  switch (slot.value.index()) {
+  case 0:
+    return this->stats.answerBytes;
+  case 1:
+    return this->stats.negBytes;
+  default:
+    return this->stats.nsBytes;
+  }
+}
+
+inline void DnsCache::uncharge(uint32_t slot) {
+  CacheSlot &entry = this->slots[slot];
+  this->gaugeFor(entry) -= entry.bytes;
+  entry.bytes = 0;
+}
+
+inline void DnsCache::charge(uint32_t slot) {
+  CacheSlot &entry = this->slots[slot];
+  entry.bytes = this->footprintOf(entry);
+  this->gaugeFor(entry) += entry.bytes;
+}
 
-    std::cout << "[Cache] Cleanup Completed. "
-              << "Current entries: " << this->cache.size() << std::endl;
+inline void DnsCache::trimToBudget(uint32_t keep) {
+  while (this->stats.usedBytes() > this->maxBytes &&
+         this->eviction.size() > 1) {
+    uint32_t victim = this->eviction.victim();
+    if (victim == keep) {
+      // the hand moves past it on the next try
+      this->eviction.touch(keep);
+      continue;
+    }
+    this->dropSlot(victim);
+    this->stats.evictions++;
   }
 }
 
-inline void DnsCache::updateLRU(const std::string &key) {
-  auto node = this->lruMap.find(key);
+inline uint32_t DnsCache::findSlot(const CacheKeyView &key,
+                                   bool nameserver) const {
+  return this->index.find(CacheKeyHash{}(key), [&](uint32_t slot) {
+    const CacheSlot &entry = this->slots[slot];
+    return entry.isNameserver() == nameserver &&
+           CacheKeyView(entry.key) == key;
+  });
+}
 
-  // Remove if the key exists
-  if (node != this->lruMap.end()) {
-    this->lruList.erase(node->second);
+inline uint32_t DnsCache::acquireSlot(const DnsName &name, uint16_t qtype,
+                                      bool nameserver) {
+  CacheKeyView key(name, qtype);
+  uint32_t slot = this->findSlot(key, nameserver);
+  if (slot != FlatIndex::NONE) {
+    return slot;
   }
 
-  this->lruList.push_front(key);
-  this->lruMap[key] = this->lruList.begin();
-};
+  while (this->eviction.full()) {
+    this->evictOne();
+  }
+  slot = this->eviction.add();
+  if (slot >= this->slots.size()) {
+    this->slots.resize(slot + 1);
+  }
 
-inline void DnsCache::evictLRU() {
-  if (lruList.empty()) {
-    return;
+  CacheSlot &fresh = this->slots[slot];
+  fresh.key.name = name;
+  fresh.key.qtype = qtype;
+  if (nameserver) {
+    fresh.value = NSCacheEntry{};
   }
+  this->index.insert(CacheKeyHash{}(key), slot, [this](uint32_t id) {
+    return CacheKeyHash{}(this->slots[id].key);
+  });
+  return slot;
+}
 
-  auto node = this->lruList.back();
+inline void DnsCache::dropSlot(uint32_t slot) {
+  CacheSlot &entry = this->slots[slot];
+  this->uncharge(slot);
+  this->index.erase(CacheKeyHash{}(entry.key), slot);
+  this->eviction.remove(slot);
+  if (entry.expiryTimer != UINT32_MAX) {
+    this->expiry.cancel(entry.expiryTimer);
+    entry.expiryTimer = UINT32_MAX;
+  }
 
-  // remove from the cache map
-  size_t numRecords = this->cache[node].size();
-  this->cache.erase(node);
-  this->lruList.pop_back();
-  this->lruMap.erase(node);
+  if (auto *answer = std::get_if<CachedAnswer>(&entry.value)) {
+    this->stats.currentEntries -= answer->entries.size();
+  }
+  entry.value = CachedAnswer{};
+}
 
-  this->stats.evictions++;
-  this->stats.currentEntries -= numRecords;
+inline void DnsCache::expireAt(uint32_t slot,
+                               std::chrono::steady_clock::time_point at) {
+  CacheSlot &entry = this->slots[slot];
+  if (entry.expiryTimer == UINT32_MAX) {
+    entry.expiryTimer = this->expiry.schedule(at, slot);
+  } else {
+    this->expiry.reschedule(entry.expiryTimer, at);
+  }
 }
 
-inline void DnsCache::removeExpiredEntries(std::vector<CacheEntry> &entries) {
+inline std::chrono::steady_clock::time_point
+DnsCache::prefetchPoint(const std::vector<CacheEntry> &entries) const {
+  auto at = std::chrono::steady_clock::time_point::max();
+  if (this->prefetchPercent == 0) {
+    return at;
+  }
+
+  for (const auto &entry : entries) {
+    auto window = std::chrono::milliseconds(uint64_t{entry.originalTTL} *
+                                            this->prefetchPercent * 10);
+    at = std::min(at, entry.expiresAt - window);
+  }
+  return at;
+}
+
+inline void DnsCache::onAnswerHit(CachedAnswer &answer,
+                                  std::chrono::steady_clock::time_point now,
+                                  bool *prefetch) {
+  // without the refresh this answer's predecessor would have expired by
+  // now, and the first hit since would have been a miss
+  if (now >= answer.refreshedFrom &&
+      answer.flags.claim(AnswerFlags::SAVED)) {
+    LookupCounters::bump(this->lookups.prefetchSavedMisses);
+  }
+
+  if (prefetch == nullptr || now < answer.prefetchAt ||
+      answer.flags.test(AnswerFlags::PREFETCHING)) {
+    return;
+  }
+
+  // hits through either path
+  uint32_t hits = answer.entries.front().hitCount;
+  if (answer.wire.has_value()) {
+    hits += answer.wire->hitCount;
+  }
+  if (hits < this->prefetchMinHits) {
+    return;
+  }
+
+  if (answer.flags.claim(AnswerFlags::PREFETCHING)) {
+    LookupCounters::bump(this->lookups.prefetches);
+    *prefetch = true;
+  }
+}
+
+inline void
+DnsCache::removeExpiredEntries(std::vector<CacheEntry> &entries,
+                               std::chrono::steady_clock::time_point now) {
   auto origSize = entries.size();
 
-  entries.erase(
-      std::remove_if(entries.begin(), entries.end(),
-                     [](const CacheEntry &entry) { return entry.isExpired(); }),
-      entries.end());
+  entries.erase(std::remove_if(entries.begin(), entries.end(),
+                               [now](const CacheEntry &entry) {
+                                 return entry.isExpired(now);
+                               }),
+                entries.end());
 
   size_t removed = origSize - entries.size();
   if (removed > 0) {
@@ -187,20 +541,19 @@ inline void DnsCache::removeExpiredEntries(std::vector<CacheEntry> &entries) {
   }
 }
 
-inline std::string DnsCache::makeCacheKey(const std::string &qname,
-                                          QueryType qtype) {
-  auto qtypenum = fromQueryTypeToNumber(qtype);
-
-  std::string result;
-  result.reserve(qname.size() + 1 + 10);
-
-  for (char c : qname) {
-    result += std::tolower(static_cast<unsigned char>(c));
+inline std::chrono::steady_clock::time_point
+DnsCache::earliestExpiry(const std::vector<CacheEntry> &entries) {
+  auto earliest = entries.front().expiresAt;
+  for (const auto &entry : entries) {
+    earliest = std::min(earliest, entry.expiresAt);
   }
+  return earliest;
+}
 
-  result += ':';
-  result += std::to_string(qtypenum);
-  return result;
+inline CacheKeyView DnsCache::makeCacheKey(const DnsName &qname,
+                                           QueryType qtype) {
+  // the name is lowercase and hashed already
+  return CacheKeyView(qname, fromQueryTypeToNumber(qtype));
 }
 
 inline uint32_t DnsCache::enforceTTLBounds(uint32_t ttl) {
@@ -218,94 +571,143 @@ inline uint32_t DnsCache::extractTTL(const DnsRecord &record) {
 }
 
 inline std::optional<std::vector<DnsRecord>>
-DnsCache::lookup(const std::string &qname, QueryType qtype) {
+DnsCache::lookup(const DnsName &qname, QueryType qtype, bool *prefetch) {
   std::shared_lock<std::shared_mutex> lock(this->mtx);
 
-  const std::string key = this->makeCacheKey(qname, qtype);
-
-  // perform lookup on -ve cache
-  auto negIt = this->negativeCache.find(key);
-  if (negIt != this->negativeCache.end()) {
-    if (!negIt->second.isExpired()) {
-      this->stats.negHits++;
-      return std::vector<DnsRecord>{}; // empty to signal cached negative
-                                       // response
-    }
-    negativeCache.erase(negIt);
-  }
+  const CacheKeyView key = this->makeCacheKey(qname, qtype);
+  auto now = std::chrono::steady_clock::now();
 
   // perform lookup on cache
-  auto it = this->cache.find(key);
-  if (it == this->cache.end()) {
+  uint32_t slot = this->findSlot(key, false);
+  if (slot == FlatIndex::NONE) {
     // cache miss
-    stats.misses++;
+    LookupCounters::bump(this->lookups.misses);
     return std::nullopt;
   }
 
-  // remove expired entires
-  this->removeExpiredEntries(it->second);
+  // a -ve entry, expired ones are left for the cleanup
+  auto *answer = std::get_if<CachedAnswer>(&this->slots[slot].value);
+  if (answer == nullptr) {
+    if (std::get<NegativeCacheEntry>(this->slots[slot].value).isExpired(now)) {
+      LookupCounters::bump(this->lookups.misses);
+      return std::nullopt;
+    }
 
-  // if all entries expired remove the bucket (key)
-  if (it->second.empty()) {
-    this->cache.erase(it);
-    stats.misses++;
-    return std::nullopt;
+    this->eviction.touch(slot);
+    LookupCounters::bump(this->lookups.negHits);
+    return std::vector<DnsRecord>{}; // empty to signal cached negative
+                                     // response
   }
 
-  // cache hit!
-  // update lru
-  this->updateLRU(key);
+  // cache hit on whatever hasn't expired yet
   std::vector<DnsRecord> records;
-  for (auto &entry : it->second) {
-    entry.hitCount++;
+  for (auto &entry : answer->entries) {
+    if (entry.isExpired(now)) {
+      continue;
+    }
+
+    entry.hitCount.bump();
 
     DnsRecord recordCopy = entry.record;
-    uint32_t remainingTTL = entry.remainingTTL();
+    uint32_t remainingTTL = entry.remainingTTL(now);
 
     std::visit([remainingTTL](auto &r) { r.ttl = remainingTTL; }, recordCopy);
 
-    records.push_back(recordCopy);
+    records.push_back(std::move(recordCopy));
   }
 
-  stats.hits++;
+  // all entries expired, a writer removes the bucket (key)
+  if (records.empty()) {
+    LookupCounters::bump(this->lookups.misses);
+    return std::nullopt;
+  }
+
+  this->eviction.touch(slot);
+  LookupCounters::bump(this->lookups.hits);
+  this->onAnswerHit(*answer, now, prefetch);
   return records;
 }
 
+inline size_t DnsCache::lookupWire(const DnsName &qname, QueryType qtype,
+                                  uint8_t *out, bool *prefetch) {
+  if (!this->wireAnswers) {
+    return 0;
+  }
+
+  std::shared_lock<std::shared_mutex> lock(this->mtx);
+
+  const CacheKeyView key = this->makeCacheKey(qname, qtype);
+  auto now = std::chrono::steady_clock::now();
+
+  uint32_t slot = this->findSlot(key, false);
+  if (slot == FlatIndex::NONE) {
+    return 0;
+  }
+
+  // a negative entry goes through the records path
+  auto *answer = std::get_if<CachedAnswer>(&this->slots[slot].value);
+  if (answer == nullptr || !answer->wire.has_value() ||
+      answer->wire->isExpired(now)) {
+    return 0;
+  }
+
+  // cache hit!
+  this->eviction.touch(slot);
+  answer->wire->hitCount.bump();
+  LookupCounters::bump(this->lookups.hits);
+  LookupCounters::bump(this->lookups.wireHits);
+  this->onAnswerHit(*answer, now, prefetch);
+  return answer->wire->copyTo(out, now);
+}
+
+inline void DnsCache::cancelPrefetch(const DnsName &qname, QueryType qtype) {
+  std::shared_lock<std::shared_mutex> lock(this->mtx);
+
+  uint32_t slot = this->findSlot(this->makeCacheKey(qname, qtype), false);
+  if (slot == FlatIndex::NONE) {
+    return;
+  }
+
+  // replaced by now, whatever is cached has flags of its own
+  if (auto *answer = std::get_if<CachedAnswer>(&this->slots[slot].value)) {
+    answer->flags.release(AnswerFlags::PREFETCHING);
+  }
+}
+
 inline std::optional<std::array<uint8_t, 4>>
-DnsCache::lookupNS(const std::string &domain) {
+DnsCache::lookupNS(const DnsNameView &domain) {
   std::shared_lock<std::shared_mutex> lock(this->mtx);
 
-  auto it = this->nsCache.find(domain);
-  if (it == this->nsCache.end()) {
-    // ns cache miss
-    this->stats.nsMisses++;
+  uint32_t slot = this->findSlot(CacheKeyView(domain, 0), true);
+
+  // ns cache miss, expired ones are left for the cleanup
+  if (slot == FlatIndex::NONE) {
+    LookupCounters::bump(this->lookups.nsMisses);
     return std::nullopt;
   }
 
-  NSCacheEntry &entry = it->second;
-
-  // check if expired
+  auto &entry = std::get<NSCacheEntry>(this->slots[slot].value);
   if (entry.isExpired()) {
-    this->nsCache.erase(it);
-    this->stats.nsMisses++;
+    LookupCounters::bump(this->lookups.nsMisses);
     return std::nullopt;
   }
 
   // NS cache hit
-  entry.hitCount++;
-  this->stats.nsHits++;
+  this->eviction.touch(slot);
+  entry.hitCount.bump();
+  LookupCounters::bump(this->lookups.nsHits);
   return entry.ip;
 }
 
-inline void DnsCache::insert(const std::string &qname, QueryType qtype,
-                             const std::vector<DnsRecord> &records) {
+inline void DnsCache::insert(const DnsName &qname, QueryType qtype,
+                             std::span<const DnsRecord> records) {
   std::unique_lock<std::shared_mutex> lock(this->mtx);
 
   if (records.empty()) {
     return;
   }
 
-  std::string key = this->makeCacheKey(qname, qtype);
+  CacheKeyView key = this->makeCacheKey(qname, qtype);
   auto now = std::chrono::steady_clock::now();
 
   std::vector<CacheEntry> entries;
@@ -328,19 +730,46 @@ inline void DnsCache::insert(const std::string &qname, QueryType qtype,
     entries.push_back(entry);
   }
 
-  while (this->cache.size() >= this->maxEntries && !this->cache.empty()) {
-    evictLRU();
+  if (entries.empty()) {
+    return;
   }
 
-  if (!entries.empty()) {
-    cache[key] = std::move(entries);
-    stats.inserts++;
-    stats.currentEntries += entries.size();
-    this->updateLRU(key);
+  uint32_t slot = this->acquireSlot(qname, key.qtype, false);
+  this->uncharge(slot);
+  CacheSlot &entry = this->slots[slot];
+
+  // the answer replaces whatever was cached, a negative answer included.
+  // counted before the move, a replaced bucket's records leave with it
+  CachedAnswer answer;
+  stats.currentEntries += entries.size();
+  if (auto *previous = std::get_if<CachedAnswer>(&entry.value)) {
+    stats.currentEntries -= previous->entries.size();
+
+    // a prefetch landing in time, see onAnswerHit
+    if (previous->flags.test(AnswerFlags::PREFETCHING)) {
+      auto expiredAt = this->earliestExpiry(previous->entries);
+      if (expiredAt > now) {
+        answer.refreshedFrom = expiredAt;
+      }
+    }
   }
+  answer.entries = std::move(entries);
+  answer.prefetchAt = this->prefetchPoint(answer.entries);
+  stats.inserts++;
+
+  if (this->wireAnswers) {
+    answer.wire = WireAnswer::encode(qname, key.qtype, answer.entries);
+  }
+
+  auto expiresAt = this->earliestExpiry(answer.entries);
+  entry.value = std::move(answer);
+  this->expireAt(slot, expiresAt);
+
+  this->charge(slot);
+  this->trimToBudget(slot);
 }
 
-inline void DnsCache::insertNS(const std::string &domain,
+inline void DnsCache::insertNS(const DnsName &domain,
                                const std::array<uint8_t, 4> &ip, uint32_t ttl) {
   std::unique_lock<std::shared_mutex> lock(this->mtx);
 
@@ -358,22 +787,24 @@ inline void DnsCache::insertNS(const std::string &domain,
   entry.originalTTL = enforcedTTL;
   entry.hitCount = 0;
 
-  if (this->nsCache.size() >= this->maxNsEntries) {
-    return;
-  }
-
-  nsCache[domain] = entry;
+  uint32_t slot = this->acquireSlot(domain, 0, true);
+  this->uncharge(slot);
+  this->slots[slot].value = entry;
+  this->expireAt(slot, entry.expiresAt);
+  this->charge(slot);
   this->stats.nsInserts++;
+
+  this->trimToBudget(slot);
 }
 
-inline void DnsCache::insertNegative(const std::string &qname, QueryType qtype,
+inline void DnsCache::insertNegative(const DnsName &qname, QueryType qtype,
                                      ResultCode rescode, uint32_t ttl) {
   std::unique_lock<std::shared_mutex> lock(this->mtx);
 
   uint32_t enforcedTTL = std::min(ttl, 600u);
   enforcedTTL = std::max(enforcedTTL, 60u);
 
-  std::string key = this->makeCacheKey(qname, qtype);
+  CacheKeyView key = this->makeCacheKey(qname, qtype);
   auto now = std::chrono::steady_clock::now();
 
   NegativeCacheEntry entry;
@@ -383,54 +814,68 @@ inline void DnsCache::insertNegative(const std::string &qname, QueryType qtype,
   entry.originalTTL = enforcedTTL;
   entry.hitCount = 0;
 
-  negativeCache[key] = entry;
-  this->stats.negInserts++;
-}
+  // and a negative answer replaces a cached one
+  uint32_t slot = this->acquireSlot(qname, key.qtype, false);
+  this->uncharge(slot);
+  CacheSlot &cached = this->slots[slot];
+  if (auto *previous = std::get_if<CachedAnswer>(&cached.value)) {
+    this->stats.currentEntries -= previous->entries.size();
+  }
 
-inline void DnsCache::cleanupExpired() {
-  std::unique_lock<std::shared_mutex> lock(this->mtx);
+  cached.value = entry;
+  this->expireAt(slot, entry.expiresAt);
+  this->charge(slot);
+  this->stats.negInserts++;
 
-  for (auto it = cache.begin(); it != cache.end();) {
-    this->removeExpiredEntries(it->second);
-    if (it->second.empty()) {
-      auto node = this->lruMap.find(it->first);
+  this->trimToBudget(slot);
+}
 
-      // Remove if the key exists
-      if (node != this->lruMap.end()) {
-        this->lruList.erase(node->second);
-      }
+inline void DnsCache::expireSlot(uint32_t slot,
+                                 std::chrono::steady_clock::time_point now) {
+  CacheSlot &entry = this->slots[slot];
+  entry.expiryTimer = UINT32_MAX;
 
-      this->lruMap.erase(it->first);
-      it = cache.erase(it);
-    } else {
-      ++it;
-    }
+  auto *answer = std::get_if<CachedAnswer>(&entry.value);
+  if (answer == nullptr) {
+    this->dropSlot(slot);
+    return;
   }
 
-  // Cleanup NS Cache
-  for (auto it = nsCache.begin(); it != nsCache.end();) {
-    if (it->second.isExpired()) {
-      it = nsCache.erase(it);
-    } else {
-      ++it;
-    }
+  // the wire answer went with the earliest record
+  this->uncharge(slot);
+  this->removeExpiredEntries(answer->entries, now);
+  answer->wire.reset();
+
+  if (answer->entries.empty()) {
+    this->dropSlot(slot);
+  } else {
+    this->expireAt(slot, this->earliestExpiry(answer->entries));
+    answer->prefetchAt = this->prefetchPoint(answer->entries);
+    this->charge(slot);
   }
+}
 
-  // Cleanup -tive Cache
-  for (auto it = negativeCache.begin(); it != negativeCache.end();) {
-    if (it->second.isExpired()) {
-      it = negativeCache.erase(it);
-    } else {
-      ++it;
-    }
+inline size_t DnsCache::expireDue(size_t budget) {
+  std::unique_lock<std::shared_mutex> lock(this->mtx);
+  auto now = std::chrono::steady_clock::now();
+
+  return this->expiry.advance(
+      now, budget, [&](uint32_t slot) { this->expireSlot(slot, now); });
+}
+
+inline void DnsCache::cleanupExpired() {
+  // the lock is let go between slices, lookups get in between
+  while (this->expireDue(this->expirySlice) == this->expirySlice) {
   }
 }
 
-inline const CacheStats &DnsCache::getStats() const {
+inline CacheStats DnsCache::getStats() const {
   std::shared_lock<std::shared_mutex> lock(this->mtx);
-  return this->stats;
+  CacheStats snapshot = this->stats;
+  this->lookups.addTo(snapshot);
+  return snapshot;
 }
 
-inline void DnsCache::printStats() const { stats.print(); }
+inline void DnsCache::printStats() const { this->getStats().print(); }
 
 #endif // DNS_CACHE_HPP
@@ -0,0 +1,182 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the CLOCK / SIEVE eviction engine the answer cache
+ * picks its victims with
+ **/
+
+#ifndef EVICTION_ENGINE_HPP
+#define EVICTION_ENGINE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../config/CacheConfig.hpp"
+
+/**
+ * EvictionEngine - decides which cached key goes when the cache is full.
+ *
+ * Every key gets a slot in flat, index linked arrays sized for the whole
+ * capacity up front, nothing is allocated per key. A hit only sets the
+ * slot's visited bit (a relaxed atomic, so lookups under a shared lock can
+ * do it), all the reordering happens in victim(), called by a writer.
+ *
+ * Slots sit in one queue, newest at the head. A hand walks from the tail
+ * towards the head and wraps around: a visited slot has its bit cleared
+ * and is passed over, the first unvisited one is the victim. The two
+ * policies differ in where a new key goes:
+ *  - Sieve puts it at the head, so keys that were never hit since they
+ *    came in are found quickly and survivors keep their place
+ *  - Clock puts it right behind the hand, making the queue a ring that
+ *    every key gets a full turn in
+ *
+ * Slots are plain ids below the capacity, the owner keeps what a slot
+ * stands for in its own array indexed by slot
+ **/
+class EvictionEngine {
+public:
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+private:
+  EvictionPolicy policy;
+  size_t capacity;
+  size_t used = 0;
+
+  // per slot metadata, `older` / `newer` link the queue
+  std::vector<uint32_t> older;
+  std::vector<uint32_t> newer;
+  std::unique_ptr<std::atomic<uint8_t>[]> visited;
+
+  uint32_t head = NONE;
+  uint32_t tail = NONE;
+  uint32_t hand = NONE;
+
+  // free slots chained through `older`
+  uint32_t freeList = NONE;
+
+  void linkBefore(uint32_t slot, uint32_t next);
+  void unlink(uint32_t slot);
+
+public:
+  EvictionEngine(EvictionPolicy policy_, size_t capacity_);
+
+  EvictionEngine(const EvictionEngine &) = delete;
+  EvictionEngine &operator=(const EvictionEngine &) = delete;
+
+  bool full() const { return this->used >= this->capacity; }
+  size_t size() const { return this->used; }
+
+  /**
+   * Track a new key, the engine must not be full. Returns its slot, the
+   * owner files the key under it and uses it for touch() and remove()
+   **/
+  uint32_t add();
+
+  // a hit, safe to call concurrently with other touches
+  void touch(uint32_t slot) const {
+    if (this->visited[slot].load(std::memory_order_relaxed) == 0) {
+      this->visited[slot].store(1, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * The slot to evict next, the engine must not be empty. The owner drops
+   * the key filed under it and then calls remove() on it
+   **/
+  uint32_t victim();
+
+  // stop tracking `slot`, it's free for the next add()
+  void remove(uint32_t slot);
+};
+
+inline EvictionEngine::EvictionEngine(EvictionPolicy policy_, size_t capacity_)
+    : policy(policy_), capacity(capacity_ == 0 ? 1 : capacity_),
+      older(this->capacity, NONE),
+      newer(this->capacity, NONE),
+      visited(std::make_unique<std::atomic<uint8_t>[]>(this->capacity)) {
+  for (size_t i = 0; i < this->capacity; i++) {
+    this->older[i] = i + 1 < this->capacity ? static_cast<uint32_t>(i + 1)
+                                            : NONE;
+  }
+  this->freeList = 0;
+}
+
+inline void EvictionEngine::linkBefore(uint32_t slot, uint32_t next) {
+  // `next` is the neighbour on the newer side, NONE links in at the head
+  uint32_t prev = next == NONE ? this->head : this->older[next];
+
+  this->newer[slot] = next;
+  this->older[slot] = prev;
+
+  if (next == NONE) {
+    this->head = slot;
+  } else {
+    this->older[next] = slot;
+  }
+
+  if (prev == NONE) {
+    this->tail = slot;
+  } else {
+    this->newer[prev] = slot;
+  }
+}
+
+inline void EvictionEngine::unlink(uint32_t slot) {
+  uint32_t prev = this->older[slot];
+  uint32_t next = this->newer[slot];
+
+  if (prev == NONE) {
+    this->tail = next;
+  } else {
+    this->newer[prev] = next;
+  }
+
+  if (next == NONE) {
+    this->head = prev;
+  } else {
+    this->older[next] = prev;
+  }
+}
+
+inline uint32_t EvictionEngine::add() {
+  uint32_t slot = this->freeList;
+  this->freeList = this->older[slot];
+
+  this->visited[slot].store(0, std::memory_order_relaxed);
+
+  // right behind the hand it's the last key the hand reaches, with no hand
+  // (about to wrap to the tail) that's the head
+  this->linkBefore(slot,
+                   this->policy == EvictionPolicy::Clock ? this->hand : NONE);
+
+  this->used++;
+  return slot;
+}
+
+inline uint32_t EvictionEngine::victim() {
+  uint32_t slot = this->hand == NONE ? this->tail : this->hand;
+  while (this->visited[slot].load(std::memory_order_relaxed) != 0) {
+    this->visited[slot].store(0, std::memory_order_relaxed);
+    slot = this->newer[slot] == NONE ? this->tail : this->newer[slot];
+  }
+
+  this->hand = slot;
+  return slot;
+}
+
+inline void EvictionEngine::remove(uint32_t slot) {
+  if (this->hand == slot) {
+    this->hand = this->newer[slot];
+  }
+
+  this->unlink(slot);
+  this->older[slot] = this->freeList;
+  this->newer[slot] = NONE;
+  this->freeList = slot;
+  this->used--;
+}
+
+#endif // EVICTION_ENGINE_HPP
@@ -0,0 +1,223 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains FlatIndex, the open addressing hash index the answer
+ * cache finds its slots with
+ **/
+
+#ifndef FLAT_INDEX_HPP
+#define FLAT_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * FlatIndex - a Swiss table style index from a precomputed hash to a
+ * uint32_t id.
+ *
+ * It holds no keys: ids point into a slab the owner keeps, and find()
+ * takes a `matches(id)` callback that compares against the slab. Slots
+ * come in groups of 16, each slot with a control byte holding 7 bits of
+ * the hash (or empty / deleted). A probe loads a group's control bytes and
+ * compares all 16 at once (SSE2, or a plain loop without it), so the slab
+ * is only touched for candidates whose 7 bits already matched, and the
+ * ids of a group share a cache line.
+ *
+ * Groups are probed quadratically until one with an empty slot. Erased
+ * slots become tombstones unless their group has an empty slot anyway,
+ * when tombstones and live slots reach 7/8 of the table it is rebuilt
+ * (larger if it is mostly live), which needs the owner's `hashOf(id)`
+ **/
+class FlatIndex {
+public:
+  static constexpr uint32_t NONE = UINT32_MAX;
+  static constexpr size_t GROUP = 16;
+
+private:
+  static constexpr int8_t EMPTY = -128;
+  static constexpr int8_t DELETED = -2;
+
+  std::vector<int8_t> ctrl;
+  std::vector<uint32_t> ids;
+  size_t groupMask = 0;
+  size_t used = 0;
+  size_t deleted = 0;
+
+  static int8_t h2(size_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+  size_t firstGroup(size_t hash) const { return (hash >> 7) & this->groupMask; }
+
+  // bit i set if control byte i of `group` equals `byte`
+  uint32_t matchByte(size_t group, int8_t byte) const;
+
+  size_t capacity() const { return this->ctrl.size(); }
+  void reset(size_t groups);
+
+  template <typename HashOf> void rehash(size_t groups, HashOf &&hashOf);
+
+  // store `id` in the first free slot of its probe sequence
+  void place(size_t hash, uint32_t id);
+
+public:
+  // sized so `expected` ids fit without a rebuild
+  explicit FlatIndex(size_t expected = 0);
+
+  size_t size() const { return this->used; }
+
+  /**
+   * The id stored under `hash` that `matches(id)` accepts, NONE if there
+   * is none
+   **/
+  template <typename Matches>
+  uint32_t find(size_t hash, Matches &&matches) const;
+
+  /**
+   * Add `id` under `hash`, the caller has checked it isn't there yet.
+   * `hashOf(id)` gives the hash of any stored id, for rebuilds
+   **/
+  template <typename HashOf>
+  void insert(size_t hash, uint32_t id, HashOf &&hashOf);
+
+  // remove `id`, stored under `hash`
+  void erase(size_t hash, uint32_t id);
+};
+
+inline FlatIndex::FlatIndex(size_t expected) {
+  size_t groups = 1;
+  while (groups * GROUP * 7 / 8 < expected) {
+    groups <<= 1;
+  }
+  this->reset(groups);
+}
+
+inline void FlatIndex::reset(size_t groups) {
+  this->ctrl.assign(groups * GROUP, EMPTY);
+  this->ids.assign(groups * GROUP, NONE);
+  this->groupMask = groups - 1;
+  this->used = 0;
+  this->deleted = 0;
+}
+
+inline uint32_t FlatIndex::matchByte(size_t group, int8_t byte) const {
+  const int8_t *bytes = this->ctrl.data() + group * GROUP;
+#if defined(__SSE2__)
+  __m128i control =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+  return static_cast<uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(byte))));
+#else
+  uint32_t mask = 0;
+  for (size_t i = 0; i < GROUP; i++) {
+    mask |= static_cast<uint32_t>(bytes[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+template <typename Matches>
+inline uint32_t FlatIndex::find(size_t hash, Matches &&matches) const {
+  int8_t tag = h2(hash);
+  size_t group = this->firstGroup(hash);
+
+  for (size_t step = 1; step <= this->groupMask + 1; step++) {
+    for (uint32_t mask = this->matchByte(group, tag); mask != 0;
+         mask &= mask - 1) {
+      uint32_t id = this->ids[group * GROUP + __builtin_ctz(mask)];
+      if (matches(id)) {
+        return id;
+      }
+    }
+
+    if (this->matchByte(group, EMPTY) != 0) {
+      return NONE;
+    }
+    group = (group + step) & this->groupMask;
+  }
+  return NONE;
+}
+
+inline void FlatIndex::place(size_t hash, uint32_t id) {
+  size_t group = this->firstGroup(hash);
+  for (size_t step = 1;; step++) {
+    uint32_t free =
+        this->matchByte(group, EMPTY) | this->matchByte(group, DELETED);
+    if (free != 0) {
+      size_t slot = group * GROUP + __builtin_ctz(free);
+      if (this->ctrl[slot] == DELETED) {
+        this->deleted--;
+      }
+      this->ctrl[slot] = h2(hash);
+      this->ids[slot] = id;
+      this->used++;
+      return;
+    }
+    group = (group + step) & this->groupMask;
+  }
+}
+
+template <typename HashOf>
+inline void FlatIndex::rehash(size_t groups, HashOf &&hashOf) {
+  std::vector<uint32_t> live;
+  live.reserve(this->used);
+  for (size_t slot = 0; slot < this->capacity(); slot++) {
+    if (this->ctrl[slot] >= 0) {
+      live.push_back(this->ids[slot]);
+    }
+  }
+
+  this->reset(groups);
+  for (uint32_t id : live) {
+    this->place(hashOf(id), id);
+  }
+}
+
+template <typename HashOf>
+inline void FlatIndex::insert(size_t hash, uint32_t id, HashOf &&hashOf) {
+  if ((this->used + this->deleted + 1) * 8 > this->capacity() * 7) {
+    // mostly tombstones: rebuild in place, mostly live: grow
+    size_t groups = this->groupMask + 1;
+    if ((this->used + 1) * 16 > this->capacity() * 7) {
+      groups <<= 1;
+    }
+    this->rehash(groups, hashOf);
+  }
+  this->place(hash, id);
+}
+
+inline void FlatIndex::erase(size_t hash, uint32_t id) {
+  int8_t tag = h2(hash);
+  size_t group = this->firstGroup(hash);
+
+  for (size_t step = 1; step <= this->groupMask + 1; step++) {
+    for (uint32_t mask = this->matchByte(group, tag); mask != 0;
+         mask &= mask - 1) {
+      size_t slot = group * GROUP + __builtin_ctz(mask);
+      if (this->ids[slot] != id) {
+        continue;
+      }
+
+      // a probe never continues past a group with an empty slot, so this
+      // one can go back to empty instead of leaving a tombstone
+      if (this->matchByte(group, EMPTY) != 0) {
+        this->ctrl[slot] = EMPTY;
+      } else {
+        this->ctrl[slot] = DELETED;
+        this->deleted++;
+      }
+      this->ids[slot] = NONE;
+      this->used--;
+      return;
+    }
+
+    if (this->matchByte(group, EMPTY) != 0) {
+      return;
+    }
+    group = (group + step) & this->groupMask;
+  }
+}
+
+#endif // FLAT_INDEX_HPP
@@ -4,8 +4,10 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include "ThreadSafeCache.hpp"
 
@@ -20,6 +22,9 @@ private:
   ThreadSafeCache &dnsCache;
   size_t interval;
 
+  // extra stats printers that run after the cache stats
+  std::vector<std::function<void()>> reporters;
+
   void printStats();
 
 public:
@@ -28,6 +33,11 @@ public:
 
   ~StatsLogger() { stopLogger(); }
 
+  // must be called before startLogger
+  void addReporter(std::function<void()> reporter) {
+    this->reporters.push_back(std::move(reporter));
+  }
+
   void startLogger() {
     if (this->_thread__running) {
       return;
@@ -64,6 +74,9 @@ inline void StatsLogger::printStats() {
     }
 
     this->dnsCache.printStats();
+    for (const auto &reporter : this->reporters) {
+      reporter();
+    }
   }
 }
 
@@ -1,56 +1,206 @@
 #ifndef THREAD_SAFE_CACHE_HPP
 #define THREAD_SAFE_CACHE_HPP
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <shared_mutex>
+#include <span>
+#include <thread>
 #include <vector>
 
+#include "../config/CacheConfig.hpp"
+#include "../names/DnsName.hpp"
 #include "DnsCache.hpp"
 
+/**
+ * ThreadSafeCache - the cache shared by every worker and resolver thread.
+ *
+ * Split into independent DnsCache shards, a name always lands in the shard
+ * its hash picks. Each shard has its own lock, eviction and stats, so threads
+ * only contend when they hit the same shard and there is no lock around
+ * the whole thing. A NS lookup for a parent zone view hashes the same as
+ * the DnsName it was inserted with, so it finds the same shard.
+ *
+ * Capacity is split evenly, eviction is per shard. Once a second one
+ * cleanup thread expires what came due in each shard in turn, a slice at
+ * a time under that shard's lock.
+ *
+ * With a prefetcher set, a hit that makes a shard ask for an answer to be
+ * refreshed hands it the key once the shard's lock is let go
+ **/
 class ThreadSafeCache {
+public:
+  /**
+   * Starts re-resolving a key in the background, whatever it finds is
+   * inserted over the cached answer. Called on the thread whose lookup hit,
+   * returns false if the refresh wasn't started. One that fails later
+   * calls cancelPrefetch()
+   **/
+  using Prefetcher = std::function<bool(const DnsName &, QueryType)>;
+
 private:
-  DnsCache cache;
-  mutable std::shared_mutex mtx;
+  std::vector<std::unique_ptr<DnsCache>> shards;
+  size_t shardMask = 0;
+
+  Prefetcher prefetcher;
+
+  // thread mgmt
+  std::jthread cleanupThread;
+  std::atomic<bool> _thread__cleanup_running{false};
+  std::condition_variable cv;
+  std::mutex cvMtx;
+
+  // cleanup loop
+  void _thread__cleanup();
+
+  DnsCache &shardFor(size_t hash) const {
+    // the shard comes from the high bits, the maps inside use the low ones
+    return *this->shards[((hash * 0x9E3779B97F4A7C15ull) >> 40) &
+                         this->shardMask];
+  }
 
 public:
+  explicit ThreadSafeCache(const CacheConfig &config = {});
+
   // stop the thread
   ~ThreadSafeCache() { this->stopCleanup(); }
 
-  std::optional<std::vector<DnsRecord>> lookup(const std::string &qname,
+  // set before the cache is shared, lookups read it unlocked
+  void setPrefetcher(Prefetcher prefetcher_) {
+    this->prefetcher = std::move(prefetcher_);
+  }
+
+  std::optional<std::vector<DnsRecord>> lookup(const DnsName &qname,
                                                QueryType qtype) {
-    std::shared_lock<std::shared_mutex> lock(this->mtx);
-    return this->cache.lookup(qname, qtype);
+    bool prefetch = false;
+    auto records = this->shardFor(qname.hash())
+                       .lookup(qname, qtype,
+                               this->prefetcher ? &prefetch : nullptr);
+    if (prefetch && !this->prefetcher(qname, qtype)) {
+      this->cancelPrefetch(qname, qtype);
+    }
+    return records;
+  }
+
+  std::optional<std::array<uint8_t, 4>> lookupNS(const DnsNameView &domain) {
+    return this->shardFor(domain.hash()).lookupNS(domain);
+  }
+
+  size_t lookupWire(const DnsName &qname, QueryType qtype, uint8_t *out) {
+    bool prefetch = false;
+    size_t length = this->shardFor(qname.hash())
+                        .lookupWire(qname, qtype, out,
+                                    this->prefetcher ? &prefetch : nullptr);
+    if (prefetch && !this->prefetcher(qname, qtype)) {
+      this->cancelPrefetch(qname, qtype);
+    }
+    return length;
   }
 
-  std::optional<std::array<uint8_t, 4>> lookupNS(const std::string &domain) {
-    std::shared_lock<std::shared_mutex> lock(this->mtx);
-    return this->cache.lookupNS(domain);
+  // a refresh didn't replace the answer, see DnsCache::cancelPrefetch
+  void cancelPrefetch(const DnsName &qname, QueryType qtype) {
+    this->shardFor(qname.hash()).cancelPrefetch(qname, qtype);
   }
 
-  void insert(const std::string &qname, QueryType qtype,
-              const std::vector<DnsRecord> &records) {
-    std::unique_lock<std::shared_mutex> lock(this->mtx);
-    this->cache.insert(qname, qtype, records);
+  void insert(const DnsName &qname, QueryType qtype,
+              std::span<const DnsRecord> records) {
+    this->shardFor(qname.hash()).insert(qname, qtype, records);
   }
 
-  void insertNS(const std::string &domain, const std::array<uint8_t, 4> &ip,
+  void insertNS(const DnsName &domain, const std::array<uint8_t, 4> &ip,
                 uint32_t ttl) {
-    std::unique_lock<std::shared_mutex> lock(this->mtx);
-    this->cache.insertNS(domain, ip, ttl);
+    this->shardFor(domain.hash()).insertNS(domain, ip, ttl);
   }
 
-  void insertNegative(const std::string &qname, QueryType qtype,
+  void insertNegative(const DnsName &qname, QueryType qtype,
                       ResultCode rescode, uint32_t ttl) {
-    std::unique_lock<std::shared_mutex> lock(this->mtx);
-    this->cache.insertNegative(qname, qtype, rescode, ttl);
+    this->shardFor(qname.hash()).insertNegative(qname, qtype, rescode, ttl);
   }
 
-  void startCleanup() { this->cache.startCleanup(); }
+  size_t shardCount() const { return this->shards.size(); }
+
+  // Manual cleanup, one shard and one slice at a time
+  void cleanupExpired() {
+    for (auto &shard : this->shards) {
+      shard->cleanupExpired();
+    }
+  }
 
-  void stopCleanup() { this->cache.stopCleanup(); }
+  void startCleanup();
+  void stopCleanup();
 
-  void printStats() { this->cache.printStats(); }
+  // Stats summed over the shards
+  CacheStats getStats() const;
+  void printStats() const { this->getStats().print(); }
 };
 
+inline ThreadSafeCache::ThreadSafeCache(const CacheConfig &config) {
+  size_t count = 1;
+  while (count < config.shards) {
+    count <<= 1;
+  }
+  this->shardMask = count - 1;
+
+  CacheConfig shardConfig = config;
+  shardConfig.maxEntries = (config.maxEntries + count - 1) / count;
+  shardConfig.maxBytes = (config.maxBytes + count - 1) / count;
+
+  this->shards.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    this->shards.push_back(std::make_unique<DnsCache>(shardConfig));
+  }
+}
+
+inline void ThreadSafeCache::startCleanup() {
+  if (this->_thread__cleanup_running) {
+    return;
+  }
+
+  this->_thread__cleanup_running = true;
+  this->cleanupThread = std::jthread(&ThreadSafeCache::_thread__cleanup, this);
+  std::cout << "[Cache] Cleanup thread started (" << this->shards.size()
+            << " shards)" << std::endl;
+}
+
+inline void ThreadSafeCache::stopCleanup() {
+  if (!this->_thread__cleanup_running) {
+    return;
+  }
+
+  this->_thread__cleanup_running = false;
+  cv.notify_all();
+  if (this->cleanupThread.joinable()) {
+    this->cleanupThread.join();
+  }
+
+  std::cout << "[Cache] Cleanup thread stopped" << std::endl;
+}
+
+inline void ThreadSafeCache::_thread__cleanup() {
+  while (this->_thread__cleanup_running) {
+    std::unique_lock<std::mutex> lock(cvMtx);
+    cv.wait_for(lock, std::chrono::seconds(1),
+                [this]() { return !this->_thread__cleanup_running; });
+    if (!this->_thread__cleanup_running) {
+      break;
+    }
+
+    // expire what came due in the last tick
+    this->cleanupExpired();
+  }
+}
+
+inline CacheStats ThreadSafeCache::getStats() const {
+  CacheStats total;
+  for (const auto &shard : this->shards) {
+    total += shard->getStats();
+  }
+  return total;
+}
+
 #endif // THREAD_SAFE_CACHE_HPP
@@ -0,0 +1,237 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains TimerWheel, the hierarchical timing wheel cached
+ * entries expire through
+ **/
+
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * TimerWheel - timers at one second resolution, each carrying a `Payload`
+ * the owner gets back when it fires.
+ *
+ * Four levels of 64 slots: level 0 holds the timers of the current 64 s
+ * period one slot per second, level 1 those of the current ~68 min period
+ * one slot per 64 s, and so on, level 3 reaching ~194 days ahead (later
+ * ones wait there and are placed again when their slot comes round).
+ * Whenever time enters a new period, the level above hands down the slot
+ * for it. Scheduling, rescheduling and cancelling only link or unlink a
+ * timer, O(1), and timers sit in one index linked array reused through a
+ * free list.
+ *
+ * advance() fires at most `budget` timers per call and carries on where
+ * it stopped next time, so a backlog of expiries is worked off in slices.
+ * Timers fire once their second has fully passed, never early
+ **/
+template <typename Payload> class TimerWheel {
+public:
+  using time_point = std::chrono::time_point<std::chrono::steady_clock>;
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+private:
+  static constexpr unsigned SLOT_BITS = 6;
+  static constexpr size_t SLOTS = size_t{1} << SLOT_BITS;
+  static constexpr size_t LEVELS = 4;
+  static constexpr uint16_t UNLINKED = UINT16_MAX;
+
+  struct Timer {
+    uint64_t when = 0;
+    uint32_t prev = NONE;
+    uint32_t next = NONE;
+    uint16_t slot = UNLINKED;
+    Payload payload{};
+  };
+
+  time_point epoch;
+  // the tick being drained, everything before it has fired
+  uint64_t current = 0;
+
+  std::array<uint32_t, LEVELS * SLOTS> heads;
+  std::vector<Timer> timers;
+  uint32_t freeList = NONE;
+  size_t active = 0;
+
+  // seconds since the epoch, rounded up so a timer never fires early
+  uint64_t tickOf(time_point at) const;
+
+  void link(uint32_t id);
+  void unlink(uint32_t id);
+
+public:
+  explicit TimerWheel(time_point start = std::chrono::steady_clock::now());
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  size_t size() const { return this->active; }
+
+  // a timer firing at `at` (right away if that has passed), returns its id
+  uint32_t schedule(time_point at, Payload payload);
+
+  // move a pending timer to `at`
+  void reschedule(uint32_t id, time_point at);
+
+  // drop a pending timer, its id is free for reuse
+  void cancel(uint32_t id);
+
+  /**
+   * Fire the timers due by `now` in order, at most `budget` of them,
+   * calling `fire(payload)` for each after its id is freed (so it may
+   * schedule again). Returns how many fired
+   **/
+  template <typename Fire>
+  size_t advance(time_point now, size_t budget, Fire &&fire);
+};
+
+template <typename Payload>
+inline TimerWheel<Payload>::TimerWheel(time_point start) : epoch(start) {
+  this->heads.fill(NONE);
+}
+
+template <typename Payload>
+inline uint64_t TimerWheel<Payload>::tickOf(time_point at) const {
+  if (at <= this->epoch) {
+    return 0;
+  }
+  return std::chrono::ceil<std::chrono::seconds>(at - this->epoch).count();
+}
+
+template <typename Payload> inline void TimerWheel<Payload>::link(uint32_t id) {
+  Timer &timer = this->timers[id];
+  uint64_t when = std::max(timer.when, this->current);
+
+  // the lowest level whose period `when` shares with now. The top level
+  // takes anything less than a full turn ahead, later timers wait in the
+  // slot that comes round last and are placed again from there
+  constexpr unsigned TOP = SLOT_BITS * (LEVELS - 1);
+  size_t slot = (LEVELS - 1) * SLOTS;
+  if ((when >> TOP) - (this->current >> TOP) < SLOTS) {
+    slot += (when >> TOP) & (SLOTS - 1);
+  } else {
+    slot += ((this->current >> TOP) - 1) & (SLOTS - 1);
+  }
+
+  for (size_t level = 0; level + 1 < LEVELS; level++) {
+    unsigned shift = SLOT_BITS * (level + 1);
+    if ((when >> shift) == (this->current >> shift)) {
+      slot = level * SLOTS + ((when >> (SLOT_BITS * level)) & (SLOTS - 1));
+      break;
+    }
+  }
+
+  timer.slot = static_cast<uint16_t>(slot);
+  timer.prev = NONE;
+  timer.next = this->heads[slot];
+  if (timer.next != NONE) {
+    this->timers[timer.next].prev = id;
+  }
+  this->heads[slot] = id;
+}
+
+template <typename Payload>
+inline void TimerWheel<Payload>::unlink(uint32_t id) {
+  Timer &timer = this->timers[id];
+  if (timer.prev == NONE) {
+    this->heads[timer.slot] = timer.next;
+  } else {
+    this->timers[timer.prev].next = timer.next;
+  }
+  if (timer.next != NONE) {
+    this->timers[timer.next].prev = timer.prev;
+  }
+  timer.slot = UNLINKED;
+}
+
+template <typename Payload>
+inline uint32_t TimerWheel<Payload>::schedule(time_point at,
+                                              Payload payload) {
+  uint32_t id = this->freeList;
+  if (id == NONE) {
+    id = static_cast<uint32_t>(this->timers.size());
+    this->timers.emplace_back();
+  } else {
+    this->freeList = this->timers[id].next;
+  }
+
+  this->timers[id].when = this->tickOf(at);
+  this->timers[id].payload = payload;
+  this->link(id);
+  this->active++;
+  return id;
+}
+
+template <typename Payload>
+inline void TimerWheel<Payload>::reschedule(uint32_t id, time_point at) {
+  this->unlink(id);
+  this->timers[id].when = this->tickOf(at);
+  this->link(id);
+}
+
+template <typename Payload>
+inline void TimerWheel<Payload>::cancel(uint32_t id) {
+  this->unlink(id);
+  this->timers[id].next = this->freeList;
+  this->freeList = id;
+  this->active--;
+}
+
+template <typename Payload>
+template <typename Fire>
+inline size_t TimerWheel<Payload>::advance(time_point now, size_t budget,
+                                           Fire &&fire) {
+  uint64_t until = 0;
+  if (now > this->epoch) {
+    until = std::chrono::floor<std::chrono::seconds>(now - this->epoch).count();
+  }
+
+  size_t fired = 0;
+  while (true) {
+    // level 0's slot for this tick only holds timers due by now
+    uint32_t &head = this->heads[this->current & (SLOTS - 1)];
+    while (head != NONE) {
+      if (fired == budget) {
+        return fired;
+      }
+
+      uint32_t id = head;
+      Payload payload = this->timers[id].payload;
+      this->cancel(id);
+      fire(payload);
+      fired++;
+    }
+
+    if (this->current >= until) {
+      return fired;
+    }
+    this->current++;
+
+    // entering a new period, top level first so its timers can land in a
+    // lower level's slot that is handed down next
+    for (size_t level = LEVELS - 1; level > 0; level--) {
+      unsigned shift = SLOT_BITS * level;
+      if ((this->current & ((uint64_t{1} << shift) - 1)) != 0) {
+        continue;
+      }
+
+      size_t slot = level * SLOTS + ((this->current >> shift) & (SLOTS - 1));
+      uint32_t id = this->heads[slot];
+      this->heads[slot] = NONE;
+      while (id != NONE) {
+        uint32_t next = this->timers[id].next;
+        this->link(id);
+        id = next;
+      }
+    }
+  }
+}
+
+#endif // TIMER_WHEEL_HPP
@@ -0,0 +1,153 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains WireAnswer, a cached answer kept as the response it
+ * goes out as
+ **/
+
+#ifndef WIRE_ANSWER_HPP
+#define WIRE_ANSWER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "../BytePacketBuffer.hpp"
+#include "../DnsHeader.hpp"
+#include "../DnsRecord.hpp"
+#include "../names/DnsName.hpp"
+#include "CacheEntry.hpp"
+
+/**
+ * WireAnswer - the encoded response for one cached answer.
+ *
+ * Header, question and answer records laid out exactly as they go on the
+ * wire, names compressed. Serving a hit is a memcpy of `bytes` followed by
+ * a few patches: every TTL is rewritten from its record's expiry, and the
+ * caller puts the query's id, RD bit and spelling of the name in.
+ *
+ * The whole answer expires with its earliest record, after that lookups go
+ * back to the records, which drop expired ones individually
+ **/
+struct WireAnswer {
+  using time_point = std::chrono::time_point<std::chrono::steady_clock>;
+
+  // where a TTL sits in `bytes` and when its record expires
+  struct TtlSlot {
+    uint16_t offset;
+    time_point expiresAt;
+  };
+
+  std::vector<uint8_t> bytes;
+  std::vector<TtlSlot> ttls;
+
+  time_point expiresAt;
+  HitCounter hitCount;
+
+  // the question starts right after the header
+  static constexpr size_t QUESTION_OFFSET = 12;
+
+  /**
+   * Encode `entries` as the NOERROR response to `qname`/`qtype`. Empty if
+   * there is nothing to encode, a record type we can't write or an answer
+   * too large for one datagram
+   **/
+  static std::optional<WireAnswer> encode(const DnsName &qname, uint16_t qtype,
+                                          std::span<const CacheEntry> entries);
+
+  bool isExpired(time_point now = std::chrono::steady_clock::now()) const {
+    return now >= this->expiresAt;
+  }
+
+  /**
+   * Copy the response into `out` (at least bytes.size() long) with every
+   * TTL counting down from `now`. Returns its length
+   **/
+  size_t copyTo(uint8_t *out,
+                time_point now = std::chrono::steady_clock::now()) const;
+
+private:
+  // offset just past the (possibly compressed) name at `pos`
+  static size_t skipName(const uint8_t *buf, size_t pos);
+};
+
+inline size_t WireAnswer::skipName(const uint8_t *buf, size_t pos) {
+  while (buf[pos] != 0 && (buf[pos] & 0xC0) != 0xC0) {
+    pos += buf[pos] + 1;
+  }
+  return pos + (buf[pos] == 0 ? 1 : 2);
+}
+
+inline std::optional<WireAnswer>
+WireAnswer::encode(const DnsName &qname, uint16_t qtype,
+                   std::span<const CacheEntry> entries) {
+  if (entries.empty()) {
+    return std::nullopt;
+  }
+
+  WireAnswer answer;
+  answer.expiresAt = entries.front().expiresAt;
+
+  BytePacketBuffer buffer;
+  try {
+    // the flags makeResponse sets, the RD bit is the query's
+    DnsHeader header;
+    header.response = true;
+    header.recursionDesired = true;
+    header.recursionAvailable = true;
+    header.rescode = ResultCode::NOERROR;
+    header.questions = 1;
+    header.answers = static_cast<uint16_t>(entries.size());
+    header.write(buffer);
+
+    buffer.writeName(qname);
+    buffer.writeU16(qtype);
+    buffer.writeU16(CLASS_IN);
+
+    for (const auto &entry : entries) {
+      size_t start = buffer.currentPosition();
+      if (writeDnsRecord(entry.record, buffer) == 0) {
+        return std::nullopt;
+      }
+
+      // name, then type and class ahead of the TTL
+      size_t ttlOffset = skipName(buffer.buf, start) + 4;
+      answer.ttls.push_back(
+          TtlSlot{static_cast<uint16_t>(ttlOffset), entry.expiresAt});
+      answer.expiresAt = std::min(answer.expiresAt, entry.expiresAt);
+    }
+  } catch (const std::exception &e) {
+    return std::nullopt;
+  }
+
+  answer.bytes.assign(buffer.buf, buffer.buf + buffer.currentPosition());
+  return answer;
+}
+
+inline size_t WireAnswer::copyTo(uint8_t *out, time_point now) const {
+  std::memcpy(out, this->bytes.data(), this->bytes.size());
+
+  for (const auto &slot : this->ttls) {
+    uint32_t ttl = 0;
+    if (now < slot.expiresAt) {
+      ttl = std::chrono::duration_cast<std::chrono::seconds>(slot.expiresAt -
+                                                             now)
+                .count();
+    }
+
+    uint8_t *at = out + slot.offset;
+    at[0] = static_cast<uint8_t>(ttl >> 24);
+    at[1] = static_cast<uint8_t>(ttl >> 16);
+    at[2] = static_cast<uint8_t>(ttl >> 8);
+    at[3] = static_cast<uint8_t>(ttl);
+  }
+
+  return this->bytes.size();
+}
+
+#endif // WIRE_ANSWER_HPP
@@ -1,12 +1,35 @@
 #ifndef SERVER_CONFIG_HPP
 #define SERVER_CONFIG_HPP
 
+#include <arpa/inet.h>
 #include <array>
 #include <cstdint>
+#include <netinet/in.h>
 
 struct Server {
   std::array<uint8_t, 4> s_addr;
   uint16_t s_port;
 };
 
+inline struct sockaddr_in serverToSockaddr(const Server &server) {
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(server.s_port);
+  addr.sin_addr.s_addr =
+      htonl((static_cast<uint32_t>(server.s_addr[0]) << 24) |
+            (static_cast<uint32_t>(server.s_addr[1]) << 16) |
+            (static_cast<uint32_t>(server.s_addr[2]) << 8) |
+            static_cast<uint32_t>(server.s_addr[3]));
+  return addr;
+}
+
+inline Server serverFromSockaddr(const struct sockaddr_in &addr) {
+  uint32_t ip = ntohl(addr.sin_addr.s_addr);
+  return Server{{static_cast<uint8_t>((ip >> 24) & 0xFF),
+                 static_cast<uint8_t>((ip >> 16) & 0xFF),
+                 static_cast<uint8_t>((ip >> 8) & 0xFF),
+                 static_cast<uint8_t>(ip & 0xFF)},
+                ntohs(addr.sin_port)};
+}
+
 #endif // SERVER_CONFIG_HPP
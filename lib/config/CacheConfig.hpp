@@ -0,0 +1,62 @@
+#ifndef CACHE_CONFIG_HPP
+#define CACHE_CONFIG_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+enum class EvictionPolicy {
+  // second chance over a ring, new keys go in right behind the hand
+  Clock,
+  // new keys go in at the head, keys never hit since are evicted first
+  Sieve,
+};
+
+class CacheConfig {
+public:
+  // Bounds every cached record's TTL is clamped to, a TTL of 0 isn't cached
+  uint32_t minTTL = 60;
+  uint32_t maxTTL = 86400;
+
+  // Keys kept over the answer, NS and negative caches together, a hard cap
+  // next to the byte budget
+  size_t maxEntries = 262144;
+
+  // Bytes the answer, NS and negative caches hold together: names, records,
+  // encoded answers and per key bookkeeping. Past it the eviction policy
+  // drops keys of any of the three
+  size_t maxBytes = size_t{64} << 20;
+
+  // Also keep every answer as the response it goes out as, a hit is then a
+  // copy plus the id, flags and TTLs patched in
+  bool wireAnswers = true;
+
+  // Independently locked shards ThreadSafeCache splits names over (rounded
+  // up to a power of two), the limits above are split between them
+  size_t shards = 16;
+
+  // How a full cache picks the key to drop
+  EvictionPolicy eviction = EvictionPolicy::Sieve;
+
+  // Entries expired per hold of a shard's lock, the cleanup thread works
+  // off a backlog in slices this size with lookups getting in between
+  size_t expirySlice = 256;
+
+  // Refresh-ahead: a hit on an answer in the last `prefetchPercent` of its
+  // TTL, once it has been hit `prefetchMinHits` times, re-resolves it in
+  // the background so it is replaced before it expires. 0 turns it off
+  uint32_t prefetchPercent = 10;
+  uint32_t prefetchMinHits = 8;
+
+  CacheConfig(uint32_t minTTL_ = 60, uint32_t maxTTL_ = 86400,
+              size_t maxEntries_ = 262144, size_t maxBytes_ = size_t{64} << 20,
+              bool wireAnswers_ = true, size_t shards_ = 16,
+              EvictionPolicy eviction_ = EvictionPolicy::Sieve,
+              size_t expirySlice_ = 256, uint32_t prefetchPercent_ = 10,
+              uint32_t prefetchMinHits_ = 8)
+      : minTTL(minTTL_), maxTTL(maxTTL_), maxEntries(maxEntries_),
+        maxBytes(maxBytes_), wireAnswers(wireAnswers_),
+        shards(shards_), eviction(eviction_), expirySlice(expirySlice_),
+        prefetchPercent(prefetchPercent_), prefetchMinHits(prefetchMinHits_) {}
+};
+
+#endif // CACHE_CONFIG_HPP
@@ -0,0 +1,56 @@
+#ifndef LISTENER_CONFIG_HPP
+#define LISTENER_CONFIG_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+enum class IoBackend {
+  // recvmmsg/sendmmsg on plain sockets
+  Sockets,
+  // multishot recvmsg + provided buffer ring, falls back to Sockets when
+  // the kernel doesn't support it
+  IoUring,
+};
+
+class ListenerConfig {
+public:
+  // Listening port
+  uint16_t port = 2053;
+
+  // Max datagrams pulled per recvmmsg and coalesced per sendmmsg,
+  // 1 falls back to a plain recvfrom/sendto per packet
+  size_t batchSize = 32;
+
+  // Number of SO_REUSEPORT sockets, each drained by its own thread.
+  // 1 keeps the single listener on the main thread, 0 means one per core
+  size_t listeners = 1;
+
+  // Pin listener thread i to cpu i
+  bool pinListeners = true;
+
+  // Keep a flow on the core that received it (SO_INCOMING_CPU + a reuseport
+  // CBPF program), only meaningful with one pinned listener per core
+  bool steerByCpu = false;
+
+  // How datagrams get in and out of the listening sockets
+  IoBackend ioBackend = IoBackend::Sockets;
+
+  // io_uring provided buffer ring size (rounded up to a power of two)
+  unsigned uringBufferSlots = 1024;
+
+  // Answer cache hits on the receiving thread, only misses reach the pool
+  bool answerHitsInline = true;
+
+  ListenerConfig(uint16_t port_ = 2053, size_t batchSize_ = 32,
+                 size_t listeners_ = 1, bool pinListeners_ = true,
+                 bool steerByCpu_ = false,
+                 IoBackend ioBackend_ = IoBackend::Sockets,
+                 unsigned uringBufferSlots_ = 1024,
+                 bool answerHitsInline_ = true)
+      : port(port_), batchSize(batchSize_), listeners(listeners_),
+        pinListeners(pinListeners_), steerByCpu(steerByCpu_),
+        ioBackend(ioBackend_), uringBufferSlots(uringBufferSlots_),
+        answerHitsInline(answerHitsInline_) {}
+};
+
+#endif // LISTENER_CONFIG_HPP
@@ -1,6 +1,7 @@
 #ifndef NETWORK_CONFIG_HPP
 #define NETWORK_CONFIG_HPP
 
+#include <cstddef>
 #include <cstdint>
 
 class NetworkConfig {
@@ -15,16 +16,31 @@ public:
   uint32_t initialRetryDelayMs = 100;
   double backoffMultiplier = 2.0;
 
+  // Upstream sockets kept open at any one time
+  size_t upstreamSockets = 16;
+
+  // An upstream socket moves to a new random source port after this many
+  // queries or this long, whichever comes first
+  size_t upstreamRotateQueries = 100;
+  uint32_t upstreamRotateMs = 5000;
+
   NetworkConfig(uint32_t recvTimeoutMs_ = 2000, uint32_t sendTimeoutMs_ = 1000,
                 uint32_t connectTimeoutMs_ = 5000, int maxRetries_ = 3,
-                uint32_t initialRetryDelayMs_ = 100, double backoffMultiplier_ = 2.0)
+                uint32_t initialRetryDelayMs_ = 100, double backoffMultiplier_ = 2.0,
+                size_t upstreamSockets_ = 16, size_t upstreamRotateQueries_ = 100,
+                uint32_t upstreamRotateMs_ = 5000)
       : // Socket
         recvTimeoutMs(recvTimeoutMs_), sendTimeoutMs(sendTimeoutMs_),
         connectTimeoutMs(connectTimeoutMs_),
 
         // Retries
         maxRetries(maxRetries_), initialRetryDelayMs(initialRetryDelayMs_),
-        backoffMultiplier(backoffMultiplier_) {}
+        backoffMultiplier(backoffMultiplier_),
+
+        // Upstream
+        upstreamSockets(upstreamSockets_),
+        upstreamRotateQueries(upstreamRotateQueries_),
+        upstreamRotateMs(upstreamRotateMs_) {}
 };
 
 #endif // NETWORK_CONFIG_HPP
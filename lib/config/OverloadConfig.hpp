@@ -0,0 +1,47 @@
+#ifndef OVERLOAD_CONFIG_HPP
+#define OVERLOAD_CONFIG_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+enum class ShedPolicy {
+  // say nothing, the client retries or gives up
+  Drop,
+  // tell the client we couldn't resolve it
+  ServFail,
+  // tell the client to go elsewhere
+  Refused,
+};
+
+class OverloadConfig {
+public:
+  // Queue delay a query may see without counting as standing backlog
+  uint32_t targetSojournMs = 20;
+
+  // How long the delay has to stay above target before we start shedding
+  uint32_t intervalMs = 100;
+
+  // Past this the client has long given up, always shed
+  uint32_t maxSojournMs = 1000;
+
+  // What a shed query gets back
+  ShedPolicy policy = ShedPolicy::ServFail;
+
+  // Recursions the event loop may have outstanding at once, past this new
+  // queries are shed instead of piling up behind a stalled upstream
+  size_t maxInFlight = 4096;
+
+  // How long a client waits for a recursion before asking again. Longer
+  // than maxSojournMs, an upstream timeout and its retry alone take seconds
+  uint32_t maxResolveMs = 5000;
+
+  OverloadConfig(uint32_t targetSojournMs_ = 20, uint32_t intervalMs_ = 100,
+                 uint32_t maxSojournMs_ = 1000,
+                 ShedPolicy policy_ = ShedPolicy::ServFail,
+                 size_t maxInFlight_ = 4096, uint32_t maxResolveMs_ = 5000)
+      : targetSojournMs(targetSojournMs_), intervalMs(intervalMs_),
+        maxSojournMs(maxSojournMs_), policy(policy_),
+        maxInFlight(maxInFlight_), maxResolveMs(maxResolveMs_) {}
+};
+
+#endif // OVERLOAD_CONFIG_HPP
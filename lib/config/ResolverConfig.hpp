@@ -0,0 +1,28 @@
+#ifndef RESOLVER_CONFIG_HPP
+#define RESOLVER_CONFIG_HPP
+
+#include <cstddef>
+
+// Max recursion depth allowed in recursive queries
+const size_t MAX_RECURSION_DEPTH = 10;
+
+enum class ResolverMode {
+  // each query holds a worker thread for the whole recursion
+  Threaded,
+  // workers only parse and hand off, recursions are state machines driven
+  // by a single event loop thread
+  EventDriven,
+  // same hand off, recursions are coroutines suspended on the event loop
+  Coroutine,
+};
+
+class ResolverConfig {
+public:
+  // How recursive lookups are executed
+  ResolverMode mode = ResolverMode::EventDriven;
+
+  ResolverConfig(ResolverMode mode_ = ResolverMode::EventDriven)
+      : mode(mode_) {}
+};
+
+#endif // RESOLVER_CONFIG_HPP
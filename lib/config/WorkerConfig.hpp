@@ -0,0 +1,25 @@
+#ifndef WORKER_CONFIG_HPP
+#define WORKER_CONFIG_HPP
+
+#include <cstddef>
+
+#include "../ThreadPool.hpp"
+
+class WorkerConfig {
+public:
+  // Worker threads, 0 means one per core
+  size_t numThreads = 0;
+
+  // Tasks the shared dispatch ring holds, queries past that are shed
+  size_t queueCapacity = 4096;
+
+  // How tasks are spread over the workers
+  SchedulingMode scheduling = SchedulingMode::SharedQueue;
+
+  WorkerConfig(size_t numThreads_ = 0, size_t queueCapacity_ = 4096,
+               SchedulingMode scheduling_ = SchedulingMode::SharedQueue)
+      : numThreads(numThreads_), queueCapacity(queueCapacity_),
+        scheduling(scheduling_) {}
+};
+
+#endif // WORKER_CONFIG_HPP
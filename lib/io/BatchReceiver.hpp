@@ -0,0 +1,140 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the batched receive side of the listener
+ **/
+
+#ifndef BATCH_RECEIVER_HPP
+#define BATCH_RECEIVER_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+#include "../BytePacketBuffer.hpp"
+#include "IoStats.hpp"
+
+/**
+ * BatchReceiver pulls up to `batchSize` datagrams out of a socket with a
+ * single recvmmsg call. Buffers are owned by the receiver and reused between
+ * calls so callers have to copy out whatever they want to keep.
+ *
+ * On platforms without recvmmsg (or with a batch size of 1) this degrades to
+ * one recvfrom per call.
+ **/
+class BatchReceiver {
+private:
+  size_t batchSize;
+  IoStats &stats;
+
+  std::vector<BytePacketBuffer> buffers;
+  std::vector<struct sockaddr_in> sources;
+  std::vector<size_t> lengths;
+
+#ifdef __linux__
+  std::vector<struct iovec> iovecs;
+  std::vector<struct mmsghdr> msgs;
+#endif
+
+  int receiveOne(int sockfd);
+
+public:
+  BatchReceiver(size_t batchSize_, IoStats &stats_);
+
+  /**
+   * Blocks until at least one datagram is available (or the socket receive
+   * timeout fires) and then drains whatever else is already queued, up to
+   * the batch size. Returns the number of datagrams received or -1 on error
+   **/
+  int receive(int sockfd);
+
+  BytePacketBuffer &buffer(size_t i) { return this->buffers[i]; }
+
+  const struct sockaddr_in &source(size_t i) const { return this->sources[i]; }
+
+  size_t length(size_t i) const { return this->lengths[i]; }
+};
+
+inline BatchReceiver::BatchReceiver(size_t batchSize_, IoStats &stats_)
+    : batchSize(batchSize_ == 0 ? 1 : batchSize_), stats(stats_),
+      buffers(batchSize), sources(batchSize), lengths(batchSize, 0) {
+#ifdef __linux__
+  this->iovecs.resize(this->batchSize);
+  this->msgs.resize(this->batchSize);
+
+  for (size_t i = 0; i < this->batchSize; i++) {
+    this->iovecs[i].iov_base = this->buffers[i].buf;
+    this->iovecs[i].iov_len = sizeof(this->buffers[i].buf);
+
+    std::memset(&this->msgs[i], 0, sizeof(this->msgs[i]));
+    this->msgs[i].msg_hdr.msg_iov = &this->iovecs[i];
+    this->msgs[i].msg_hdr.msg_iovlen = 1;
+    this->msgs[i].msg_hdr.msg_name = &this->sources[i];
+  }
+#endif
+}
+
+inline int BatchReceiver::receiveOne(int sockfd) {
+  BytePacketBuffer &buffer = this->buffers[0];
+  socklen_t srcAddrLen = sizeof(this->sources[0]);
+
+  ssize_t bytesReceived =
+      recvfrom(sockfd, buffer.buf, sizeof(buffer.buf), 0,
+               (struct sockaddr *)&this->sources[0], &srcAddrLen);
+  if (bytesReceived < 0) {
+    return -1;
+  }
+
+  this->stats.recvCalls.fetch_add(1, std::memory_order_relaxed);
+  this->stats.recvDatagrams.fetch_add(1, std::memory_order_relaxed);
+
+  this->lengths[0] = static_cast<size_t>(bytesReceived);
+  std::memset(buffer.buf + bytesReceived, 0,
+              sizeof(buffer.buf) - bytesReceived);
+  buffer.seek(0);
+  return 1;
+}
+
+inline int BatchReceiver::receive(int sockfd) {
+#ifdef __linux__
+  if (this->batchSize == 1) {
+    return this->receiveOne(sockfd);
+  }
+
+  // msg_namelen is in/out so it has to be reset before every call
+  for (size_t i = 0; i < this->batchSize; i++) {
+    this->msgs[i].msg_hdr.msg_namelen = sizeof(this->sources[i]);
+  }
+
+  // MSG_WAITFORONE blocks for the first datagram only, the rest of the batch
+  // is whatever is already sitting in the socket buffer
+  int received = recvmmsg(sockfd, this->msgs.data(),
+                          static_cast<unsigned int>(this->batchSize),
+                          MSG_WAITFORONE, nullptr);
+  if (received <= 0) {
+    return -1;
+  }
+
+  this->stats.recvCalls.fetch_add(1, std::memory_order_relaxed);
+  this->stats.recvDatagrams.fetch_add(received, std::memory_order_relaxed);
+
+  for (int i = 0; i < received; i++) {
+    size_t len = this->msgs[i].msg_len;
+    this->lengths[i] = len;
+
+    // buffers are reused, don't let a short packet see the previous tail
+    std::memset(this->buffers[i].buf + len, 0,
+                sizeof(this->buffers[i].buf) - len);
+    this->buffers[i].seek(0);
+  }
+
+  return received;
+#else
+  return this->receiveOne(sockfd);
+#endif
+}
+
+#endif // BATCH_RECEIVER_HPP
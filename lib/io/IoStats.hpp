@@ -0,0 +1,71 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the counters for the batched socket I/O paths
+ **/
+
+#ifndef IO_STATS_HPP
+#define IO_STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+/**
+ * IoStats - Tracks how many syscalls we make and how many datagrams each
+ * one moves, so we can see how full the recvmmsg/sendmmsg batches are
+ **/
+struct IoStats {
+  std::atomic<uint64_t> recvCalls{0};
+  std::atomic<uint64_t> recvDatagrams{0};
+  std::atomic<uint64_t> sendCalls{0};
+  std::atomic<uint64_t> sendDatagrams{0};
+  std::atomic<uint64_t> sendFailures{0};
+
+  /**
+   * Average datagrams received per receive syscall
+   **/
+  double avgRecvBatch() const;
+
+  /**
+   * Average datagrams sent per send syscall
+   **/
+  double avgSendBatch() const;
+
+  /**
+   * Print I/O statistics to stdout
+   **/
+  void print() const;
+};
+
+inline double IoStats::avgRecvBatch() const {
+  uint64_t calls = recvCalls.load(std::memory_order_relaxed);
+  if (calls == 0)
+    return 0.0;
+  return static_cast<double>(recvDatagrams.load(std::memory_order_relaxed)) /
+         calls;
+}
+
+inline double IoStats::avgSendBatch() const {
+  uint64_t calls = sendCalls.load(std::memory_order_relaxed);
+  if (calls == 0)
+    return 0.0;
+  return static_cast<double>(sendDatagrams.load(std::memory_order_relaxed)) /
+         calls;
+}
+
+inline void IoStats::print() const {
+  std::cout << "\n=== I/O Statistics ===\n";
+  std::cout << "Receive Calls: " << recvCalls << "\n";
+  std::cout << "Datagrams Received: " << recvDatagrams << "\n";
+  std::cout << "Avg Receive Batch: " << std::fixed << std::setprecision(2)
+            << avgRecvBatch() << "\n";
+  std::cout << "Send Calls: " << sendCalls << "\n";
+  std::cout << "Datagrams Sent: " << sendDatagrams << "\n";
+  std::cout << "Avg Send Batch: " << avgSendBatch() << "\n";
+  std::cout << "Send Failures: " << sendFailures << "\n";
+  std::cout << "======================\n\n";
+}
+
+#endif // IO_STATS_HPP
@@ -0,0 +1,147 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains helpers to set up the listening sockets and the
+ * threads that drain them
+ **/
+
+#ifndef LISTENER_HPP
+#define LISTENER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * Create a UDP socket bound to 0.0.0.0:port with a 1s receive timeout so the
+ * receive loop can notice shutdown. With `reusePort` set several sockets can
+ * be bound to the same port and the kernel spreads datagrams across them.
+ *
+ * Returns the socket or -1 on failure
+ **/
+inline int openUdpListener(uint16_t port, bool reusePort) {
+  int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sockfd < 0) {
+    std::cerr << "Failed to create socket" << std::endl;
+    return -1;
+  }
+
+  if (reusePort) {
+    int one = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+      std::cerr << "Failed to set SO_REUSEPORT" << std::endl;
+      close(sockfd);
+      return -1;
+    }
+  }
+
+  struct sockaddr_in serverAddr;
+  serverAddr.sin_family = AF_INET;
+  serverAddr.sin_addr.s_addr = INADDR_ANY;
+  serverAddr.sin_port = htons(port);
+
+  if (bind(sockfd, (const struct sockaddr *)&serverAddr, sizeof(serverAddr)) <
+      0) {
+    std::cerr << "Failed to bind socket" << std::endl;
+    close(sockfd);
+    return -1;
+  }
+
+  struct timeval tv;
+  tv.tv_sec = 1;
+  tv.tv_usec = 0;
+
+  // Set socket recieve timeout
+  if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+    std::cerr << "Warning: Failed to set socket timeout" << std::endl;
+  }
+
+  return sockfd;
+}
+
+/**
+ * Steer datagrams of a SO_REUSEPORT group to the socket matching the CPU
+ * that received them, so a flow stays on the core whose softirq handled it.
+ *
+ * `sockfd` can be any member of the group, the classic BPF program applies
+ * to the whole group and returns `cpu % groupSize` as the socket index
+ * (sockets are indexed in the order they were bound). Every socket also gets
+ * SO_INCOMING_CPU set as a hint for kernels that use it for selection.
+ *
+ * Returns false if the kernel refused the program
+ **/
+inline bool attachCpuSteering(int sockfd, size_t cpu, size_t groupSize,
+                              bool attachProgram) {
+#ifdef __linux__
+  int incomingCpu = static_cast<int>(cpu);
+  if (setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &incomingCpu,
+                 sizeof(incomingCpu)) < 0) {
+    std::cerr << "Warning: failed to set SO_INCOMING_CPU" << std::endl;
+  }
+
+  if (!attachProgram) {
+    return true;
+  }
+
+  struct sock_filter code[] = {
+      // A = current cpu
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0,
+       static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+      // A = A % groupSize
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>(groupSize)},
+      // return A as the socket index
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+
+  struct sock_fprog prog;
+  prog.len = sizeof(code) / sizeof(code[0]);
+  prog.filter = code;
+
+  if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                 sizeof(prog)) < 0) {
+    std::cerr << "Warning: failed to attach reuseport cpu steering"
+              << std::endl;
+    return false;
+  }
+
+  return true;
+#else
+  (void)sockfd;
+  (void)cpu;
+  (void)groupSize;
+  (void)attachProgram;
+  return false;
+#endif
+}
+
+/**
+ * Pin a thread to a single cpu, returns false if the platform does not
+ * support it or the call failed
+ **/
+inline bool pinThreadToCpu(std::jthread &thread, size_t cpu) {
+#ifdef __linux__
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+
+  return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t),
+                                &cpuset) == 0;
+#else
+  (void)thread;
+  (void)cpu;
+  return false;
+#endif
+}
+
+#endif // LISTENER_HPP
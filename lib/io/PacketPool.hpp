@@ -0,0 +1,132 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the recyclable request buffers handed to the workers
+ **/
+
+#ifndef PACKET_POOL_HPP
+#define PACKET_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "../BytePacketBuffer.hpp"
+#include "../WorkQueue.hpp"
+
+class PacketPool;
+
+/**
+ * PacketHandle owns one slot of a PacketPool until it is destroyed, at which
+ * point the slot goes back to the pool. Move-only so exactly one owner (the
+ * receive thread, then the worker task) holds a given packet.
+ **/
+class PacketHandle {
+private:
+  PacketPool *pool = nullptr;
+  uint32_t slot = 0;
+
+  friend class PacketPool;
+
+  PacketHandle(PacketPool *pool_, uint32_t slot_) : pool(pool_), slot(slot_) {}
+
+  void release();
+
+public:
+  PacketHandle() = default;
+
+  PacketHandle(PacketHandle &&other) noexcept
+      : pool(std::exchange(other.pool, nullptr)), slot(other.slot) {}
+
+  PacketHandle &operator=(PacketHandle &&other) noexcept {
+    if (this != &other) {
+      this->release();
+      this->pool = std::exchange(other.pool, nullptr);
+      this->slot = other.slot;
+    }
+    return *this;
+  }
+
+  PacketHandle(const PacketHandle &) = delete;
+  PacketHandle &operator=(const PacketHandle &) = delete;
+
+  ~PacketHandle() { this->release(); }
+
+  explicit operator bool() const { return this->pool != nullptr; }
+
+  BytePacketBuffer &operator*() const;
+  BytePacketBuffer *operator->() const { return &**this; }
+};
+
+/**
+ * PacketPool - fixed set of BytePacketBuffer slots allocated up front.
+ *
+ * Free slot indices sit in a lock-free ring, so taking and returning a
+ * buffer is a single CAS each and never touches the allocator. An empty
+ * pool means every buffer is queued or being worked on, which the caller
+ * treats the same as a full dispatch queue.
+ **/
+class PacketPool {
+private:
+  std::vector<BytePacketBuffer> slots;
+  BoundedMPMCQueue<uint32_t> freeSlots;
+
+  friend class PacketHandle;
+
+public:
+  explicit PacketPool(size_t capacity);
+
+  /**
+   * Take a free buffer, the returned handle is empty if there is none
+   **/
+  PacketHandle acquire();
+
+  /**
+   * Take a free buffer and fill it with `packet`, rewound to the start
+   **/
+  PacketHandle copyOf(const BytePacketBuffer &packet);
+
+  size_t capacity() const { return this->slots.size(); }
+
+  size_t available() const { return this->freeSlots.size(); }
+};
+
+inline PacketPool::PacketPool(size_t capacity)
+    : slots(capacity), freeSlots(capacity) {
+  for (uint32_t i = 0; i < capacity; i++) {
+    this->freeSlots.tryPush(i);
+  }
+}
+
+inline PacketHandle PacketPool::acquire() {
+  uint32_t slot;
+  if (!this->freeSlots.tryPop(slot)) {
+    return PacketHandle();
+  }
+  return PacketHandle(this, slot);
+}
+
+inline PacketHandle PacketPool::copyOf(const BytePacketBuffer &packet) {
+  PacketHandle handle = this->acquire();
+  if (handle) {
+    std::memcpy(handle->buf, packet.buf, sizeof(packet.buf));
+    handle->seek(0);
+  }
+  return handle;
+}
+
+inline void PacketHandle::release() {
+  if (this->pool != nullptr) {
+    // can't fail, the ring has room for every slot
+    this->pool->freeSlots.tryPush(this->slot);
+    this->pool = nullptr;
+  }
+}
+
+inline BytePacketBuffer &PacketHandle::operator*() const {
+  return this->pool->slots[this->slot];
+}
+
+#endif // PACKET_POOL_HPP
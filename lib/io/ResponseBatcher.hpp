@@ -0,0 +1,205 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the batched send side of the listener
+ **/
+
+#ifndef RESPONSE_BATCHER_HPP
+#define RESPONSE_BATCHER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+#include "IoStats.hpp"
+
+/**
+ * ResponseBatcher coalesces outgoing responses into sendmmsg batches.
+ *
+ * Every worker thread gets its own pending batch so there is no locking on
+ * the send path. A batch is flushed when it is full, when the datagram is
+ * headed for a different socket, or explicitly via flush() -- the thread
+ * pool calls it right before a worker goes idle and the resolver calls it
+ * before blocking on an upstream server, so a response never waits behind
+ * a slow lookup.
+ *
+ * A listener that owns its own send path (io_uring) can claim a socket's
+ * responses with routeTo(), those skip the batch entirely.
+ **/
+class ResponseBatcher {
+public:
+  // returns true if it took care of the datagram
+  using Sink = std::function<bool(int sockfd, const uint8_t *data, size_t len,
+                                  const struct sockaddr_in &dest)>;
+
+private:
+  static inline std::atomic<size_t> batchSize{1};
+  static inline IoStats *stats = nullptr;
+  static inline Sink sink;
+
+  struct PendingBatch {
+    int sockfd = -1;
+    size_t count = 0;
+
+    std::vector<uint8_t> data;
+    std::vector<size_t> lengths;
+    std::vector<struct sockaddr_in> destinations;
+
+#ifdef __linux__
+    std::vector<struct iovec> iovecs;
+    std::vector<struct mmsghdr> msgs;
+#endif
+
+    void ensureCapacity(size_t n) {
+      if (this->lengths.size() >= n) {
+        return;
+      }
+
+      this->data.resize(n * 512);
+      this->lengths.resize(n);
+      this->destinations.resize(n);
+#ifdef __linux__
+      this->iovecs.resize(n);
+      this->msgs.resize(n);
+#endif
+    }
+  };
+
+  static PendingBatch &pending() {
+    static thread_local PendingBatch batch;
+    return batch;
+  }
+
+  static void sendOne(int sockfd, const uint8_t *data, size_t len,
+                      const struct sockaddr_in &dest) {
+    ssize_t n = sendto(sockfd, data, len, 0, (const struct sockaddr *)&dest,
+                       sizeof(dest));
+
+    if (stats == nullptr) {
+      return;
+    }
+
+    stats->sendCalls.fetch_add(1, std::memory_order_relaxed);
+    if (n < 0) {
+      stats->sendFailures.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      stats->sendDatagrams.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+public:
+  /**
+   * Set the batch size used by every thread and where to record counters.
+   * A batch size of 1 disables coalescing altogether
+   **/
+  static void configure(size_t batchSize_, IoStats &stats_) {
+    stats = &stats_;
+    batchSize = batchSize_ == 0 ? 1 : batchSize_;
+  }
+
+  /**
+   * Hand responses to `sink_` before they reach the batch. Has to be set
+   * before any worker starts sending
+   **/
+  static void routeTo(Sink sink_) { sink = std::move(sink_); }
+
+  /**
+   * Queue a response datagram (at most 512 bytes) on this thread's batch
+   **/
+  static void send(int sockfd, const uint8_t *data, size_t len,
+                   const struct sockaddr_in &dest) {
+    if (sink && sink(sockfd, data, len, dest)) {
+      return;
+    }
+
+    size_t limit = batchSize.load(std::memory_order_relaxed);
+
+#ifdef __linux__
+    if (limit > 1 && len <= 512) {
+      PendingBatch &batch = pending();
+
+      if (batch.count > 0 && batch.sockfd != sockfd) {
+        flush();
+      }
+
+      batch.ensureCapacity(limit);
+      batch.sockfd = sockfd;
+      std::memcpy(&batch.data[batch.count * 512], data, len);
+      batch.lengths[batch.count] = len;
+      batch.destinations[batch.count] = dest;
+      batch.count++;
+
+      if (batch.count >= limit) {
+        flush();
+      }
+      return;
+    }
+#endif
+
+    (void)limit;
+    sendOne(sockfd, data, len, dest);
+  }
+
+  /**
+   * Push out everything pending on the calling thread
+   **/
+  static void flush() {
+    PendingBatch &batch = pending();
+    if (batch.count == 0) {
+      return;
+    }
+
+#ifdef __linux__
+    struct mmsghdr *msgs = batch.msgs.data();
+
+    for (size_t i = 0; i < batch.count; i++) {
+      batch.iovecs[i].iov_base = &batch.data[i * 512];
+      batch.iovecs[i].iov_len = batch.lengths[i];
+
+      std::memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_iov = &batch.iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &batch.destinations[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(batch.destinations[i]);
+    }
+
+    size_t sent = 0;
+    while (sent < batch.count) {
+      int n = sendmmsg(batch.sockfd, msgs + sent,
+                       static_cast<unsigned int>(batch.count - sent), 0);
+      if (stats != nullptr) {
+        stats->sendCalls.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      if (n <= 0) {
+        // skip the datagram the kernel choked on, same as a failed sendto
+        if (stats != nullptr) {
+          stats->sendFailures.fetch_add(1, std::memory_order_relaxed);
+        }
+        sent++;
+        continue;
+      }
+
+      if (stats != nullptr) {
+        stats->sendDatagrams.fetch_add(n, std::memory_order_relaxed);
+      }
+      sent += static_cast<size_t>(n);
+    }
+#else
+    for (size_t i = 0; i < batch.count; i++) {
+      sendOne(batch.sockfd, &batch.data[i * 512], batch.lengths[i],
+              batch.destinations[i]);
+    }
+#endif
+
+    batch.count = 0;
+  }
+};
+
+#endif // RESPONSE_BATCHER_HPP
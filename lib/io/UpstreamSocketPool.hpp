@@ -0,0 +1,459 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the shared pool of sockets used to talk to upstream
+ * nameservers
+ **/
+
+#ifndef UPSTREAM_SOCKET_POOL_HPP
+#define UPSTREAM_SOCKET_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../BytePacketBuffer.hpp"
+#include "../QueryType.hpp"
+#include "../common/ServerConfig.hpp"
+#include "../errors/errors.hpp"
+#include "../names/DnsName.hpp"
+#include "../tracking/TransactionTracker.hpp"
+
+/**
+ * UpstreamStats - what happened to the datagrams we got back from upstream
+ **/
+struct UpstreamStats {
+  std::atomic<uint64_t> queriesSent{0};
+  std::atomic<uint64_t> sendFailures{0};
+  // submitted with an id another query already had in flight
+  std::atomic<uint64_t> idCollisions{0};
+  std::atomic<uint64_t> responsesMatched{0};
+  std::atomic<uint64_t> responsesUnknown{0};
+  std::atomic<uint64_t> responsesMismatched{0};
+  // sockets swapped for a fresh one on a new random port
+  std::atomic<uint64_t> portRotations{0};
+
+  void print() const {
+    std::cout << "\n=== Upstream Statistics ===\n";
+    std::cout << "Queries Sent: " << queriesSent << "\n";
+    std::cout << "Send Failures: " << sendFailures << "\n";
+    std::cout << "Id Collisions: " << idCollisions << "\n";
+    std::cout << "Responses Matched: " << responsesMatched << "\n";
+    std::cout << "Responses Unknown: " << responsesUnknown << "\n";
+    std::cout << "Responses Mismatched: " << responsesMismatched << "\n";
+    std::cout << "Port Rotations: " << portRotations << "\n";
+    std::cout << "===========================\n\n";
+  }
+};
+
+/**
+ * UpstreamSocketPool keeps a small set of UDP sockets bound to random ports
+ * instead of opening, binding and closing a socket for every upstream
+ * query.
+ *
+ * A fixed set of ports would leave a spoofer guessing one of a handful of
+ * ports plus the txn id, so each socket is swapped for one on a new random
+ * port after `rotateAfterQueries` queries or `rotateAfterMs`, whichever
+ * comes first. The old socket takes no more queries but is still read for
+ * `drainMs`, longer than any query waits for its reply, and closed once
+ * nothing can be in flight on it. At most a few draining sockets per slot
+ * are kept, past that rotation waits for some to close.
+ *
+ * Queries go out round-robin over the pool and a single receiver thread
+ * reads every reply, handing it to TransactionTracker which matches it by
+ * (server, port, txn id, question) and runs the waiting query's callback.
+ * Replies that don't match anything in flight are dropped and counted. The
+ * receiver thread also does the rotating.
+ **/
+class UpstreamSocketPool {
+private:
+  struct Slot {
+    std::atomic<int> fd{-1};
+    // queries sent since it was bound
+    std::atomic<size_t> queries{0};
+    // receiver thread only
+    std::chrono::steady_clock::time_point boundAt;
+  };
+
+  struct Draining {
+    int fd;
+    std::chrono::steady_clock::time_point closeAt;
+  };
+
+  // draining sockets allowed per slot
+  static constexpr size_t MAX_DRAINING_PER_SLOT = 8;
+
+  TransactionTracker &tracker;
+  std::vector<Slot> slots;
+  std::atomic<size_t> nextSocket{0};
+
+  size_t rotateAfterQueries;
+  std::chrono::milliseconds rotateAfter;
+  std::chrono::milliseconds drainFor;
+
+  // receiver thread only, once it is running
+  std::vector<Draining> draining;
+  std::mt19937 gen;
+
+  // written to on shutdown, or when a socket is due for rotation, to kick
+  // the receiver out of poll()
+  int wakePipe[2] = {-1, -1};
+
+  std::jthread receiverThread;
+  std::atomic<bool> _thread__running{false};
+
+  UpstreamStats stats;
+
+  int openSocket();
+  void wake();
+  // swap worn sockets for fresh ones and close drained ones, true if the
+  // set of sockets to read changed
+  bool rotateSockets();
+  void _thread__receive();
+
+public:
+  explicit UpstreamSocketPool(TransactionTracker &tracker_,
+                              size_t numSockets = 16,
+                              size_t rotateAfterQueries_ = 100,
+                              uint32_t rotateAfterMs = 5000,
+                              uint32_t drainMs = 3000);
+  ~UpstreamSocketPool();
+
+  UpstreamSocketPool(const UpstreamSocketPool &) = delete;
+  UpstreamSocketPool &operator=(const UpstreamSocketPool &) = delete;
+
+  /**
+   * Register `txnId` with the tracker and send `request` to `server`.
+   * `onResponse` runs on the receiver thread once the matching reply shows
+   * up. Returns false if the datagram could not be sent, in which case the
+   * transaction is not left behind in the tracker, or if another query has
+   * `txnId` in flight (errno is EEXIST then), which is left alone. Ids from
+   * SecurityUtils::generateTransactionId are reserved and never collide
+   **/
+  bool submit(uint16_t txnId, const DnsName &qname, QueryType qtype,
+              const Server &server, BytePacketBuffer &request,
+              TxnCallback onResponse);
+
+  /**
+   * Drop a transaction we stopped waiting for
+   **/
+  void cancel(uint16_t txnId) { this->tracker.removeTxn(txnId); }
+
+  /**
+   * Send `request` and block the calling thread until the matching reply
+   * arrives. Throws TimeoutException after `timeoutMs`
+   **/
+  BytePacketBuffer exchange(uint16_t txnId, const DnsName &qname,
+                            QueryType qtype, const Server &server,
+                            BytePacketBuffer &request, uint32_t timeoutMs);
+
+  const UpstreamStats &getStats() const { return this->stats; }
+
+  void printStats() const { this->stats.print(); }
+};
+
+inline UpstreamSocketPool::UpstreamSocketPool(TransactionTracker &tracker_,
+                                              size_t numSockets,
+                                              size_t rotateAfterQueries_,
+                                              uint32_t rotateAfterMs,
+                                              uint32_t drainMs)
+    : tracker(tracker_), slots(std::max<size_t>(numSockets, 1)),
+      rotateAfterQueries(std::max<size_t>(rotateAfterQueries_, 1)),
+      rotateAfter(rotateAfterMs), drainFor(drainMs),
+      gen(std::random_device{}()) {
+  bool opened = true;
+  for (Slot &slot : this->slots) {
+    slot.fd = this->openSocket();
+    slot.boundAt = std::chrono::steady_clock::now();
+    opened = opened && slot.fd >= 0;
+  }
+
+  if (!opened || pipe(this->wakePipe) < 0) {
+    for (Slot &slot : this->slots) {
+      if (slot.fd >= 0) {
+        close(slot.fd);
+      }
+    }
+    throw std::runtime_error("failed to set up upstream sockets");
+  }
+
+  // the receiver only ever blocks on the pipe when told to wake up
+  int flags = fcntl(this->wakePipe[1], F_GETFL, 0);
+  fcntl(this->wakePipe[1], F_SETFL, flags | O_NONBLOCK);
+  flags = fcntl(this->wakePipe[0], F_GETFL, 0);
+  fcntl(this->wakePipe[0], F_SETFL, flags | O_NONBLOCK);
+
+  this->_thread__running = true;
+  this->receiverThread =
+      std::jthread(&UpstreamSocketPool::_thread__receive, this);
+}
+
+inline UpstreamSocketPool::~UpstreamSocketPool() {
+  this->_thread__running = false;
+  this->wake();
+
+  if (this->receiverThread.joinable()) {
+    this->receiverThread.join();
+  }
+
+  for (Slot &slot : this->slots) {
+    close(slot.fd);
+  }
+  for (const Draining &old : this->draining) {
+    close(old.fd);
+  }
+  close(this->wakePipe[0]);
+  close(this->wakePipe[1]);
+}
+
+inline void UpstreamSocketPool::wake() {
+  char byte = 0;
+  ssize_t _ = write(this->wakePipe[1], &byte, 1);
+  (void)_;
+}
+
+inline int UpstreamSocketPool::openSocket() {
+  int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sockfd < 0) {
+    return -1;
+  }
+
+  // the receiver drains sockets until EAGAIN
+  int flags = fcntl(sockfd, F_GETFL, 0);
+  fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+
+  struct sockaddr_in localAddr = {};
+  localAddr.sin_family = AF_INET;
+  localAddr.sin_addr.s_addr = INADDR_ANY;
+
+  // pick our own random source port rather than trusting the kernel's
+  // ephemeral allocator, a few tries before letting the kernel choose
+  std::uniform_int_distribution<uint16_t> portDist(1024, 65535);
+  for (int attempt = 0; attempt < 8; attempt++) {
+    localAddr.sin_port = htons(portDist(this->gen));
+    if (bind(sockfd, (const struct sockaddr *)&localAddr, sizeof(localAddr)) ==
+        0) {
+      return sockfd;
+    }
+  }
+
+  localAddr.sin_port = htons(0);
+  if (bind(sockfd, (const struct sockaddr *)&localAddr, sizeof(localAddr)) ==
+      0) {
+    return sockfd;
+  }
+
+  close(sockfd);
+  return -1;
+}
+
+inline bool UpstreamSocketPool::submit(uint16_t txnId, const DnsName &qname,
+                                       QueryType qtype, const Server &server,
+                                       BytePacketBuffer &request,
+                                       TxnCallback onResponse) {
+  // registered before sending so a fast reply can't beat us to the tracker
+  if (!this->tracker.registerTxn(txnId, qname, qtype, server,
+                                 std::move(onResponse))) {
+    this->stats.idCollisions.fetch_add(1, std::memory_order_relaxed);
+    errno = EEXIST;
+    return false;
+  }
+
+  size_t index = this->nextSocket.fetch_add(1, std::memory_order_relaxed) %
+                 this->slots.size();
+  Slot &slot = this->slots[index];
+  struct sockaddr_in serverAddr = serverToSockaddr(server);
+
+  // a socket swapped out under us is still open for another drainMs
+  ssize_t sent = sendto(slot.fd.load(std::memory_order_acquire), request.buf,
+                        request.currentPosition(), 0,
+                        (struct sockaddr *)&serverAddr, sizeof(serverAddr));
+
+  // worn out, have the receiver swap it rather than wait for its next poll
+  if (slot.queries.fetch_add(1, std::memory_order_relaxed) + 1 ==
+      this->rotateAfterQueries) {
+    this->wake();
+  }
+
+  if (sent < 0) {
+    this->tracker.removeTxn(txnId);
+    this->stats.sendFailures.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  this->stats.queriesSent.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+inline BytePacketBuffer
+UpstreamSocketPool::exchange(uint16_t txnId, const DnsName &qname,
+                             QueryType qtype, const Server &server,
+                             BytePacketBuffer &request, uint32_t timeoutMs) {
+  // shared with the callback so a late reply never writes into a dead frame
+  struct Waiter {
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+    BytePacketBuffer response;
+  };
+  auto waiter = std::make_shared<Waiter>();
+
+  bool sent = this->submit(txnId, qname, qtype, server, request,
+                           [waiter](BytePacketBuffer &response) {
+                             {
+                               std::lock_guard<std::mutex> lock(waiter->mtx);
+                               waiter->response = response;
+                               waiter->done = true;
+                             }
+                             waiter->cv.notify_one();
+                           });
+  if (!sent) {
+    throw std::runtime_error("sendto failed: " + std::string(strerror(errno)));
+  }
+
+  std::unique_lock<std::mutex> lock(waiter->mtx);
+  if (!waiter->cv.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                           [&waiter] { return waiter->done; })) {
+    lock.unlock();
+    this->cancel(txnId);
+    throw TimeoutException("DNS query timed out");
+  }
+
+  waiter->response.seek(0);
+  return waiter->response;
+}
+
+inline bool UpstreamSocketPool::rotateSockets() {
+  auto now = std::chrono::steady_clock::now();
+  bool changed = false;
+
+  // nothing can still be waiting on these
+  auto drained = std::remove_if(
+      this->draining.begin(), this->draining.end(),
+      [now](const Draining &old) { return old.closeAt <= now; });
+  for (auto it = drained; it != this->draining.end(); ++it) {
+    close(it->fd);
+    changed = true;
+  }
+  this->draining.erase(drained, this->draining.end());
+
+  for (Slot &slot : this->slots) {
+    if (slot.queries.load(std::memory_order_relaxed) <
+            this->rotateAfterQueries &&
+        now - slot.boundAt < this->rotateAfter) {
+      continue;
+    }
+
+    if (this->draining.size() >=
+        MAX_DRAINING_PER_SLOT * this->slots.size()) {
+      break;
+    }
+
+    // keep the old one for now if no new one can be had
+    int fresh = this->openSocket();
+    if (fresh < 0) {
+      break;
+    }
+
+    int old = slot.fd.exchange(fresh, std::memory_order_acq_rel);
+    slot.queries.store(0, std::memory_order_relaxed);
+    slot.boundAt = now;
+    this->draining.push_back(Draining{old, now + this->drainFor});
+    this->stats.portRotations.fetch_add(1, std::memory_order_relaxed);
+    changed = true;
+  }
+
+  return changed;
+}
+
+inline void UpstreamSocketPool::_thread__receive() {
+  // every slot's socket, then the draining ones, then the wake pipe
+  std::vector<struct pollfd> fds;
+  auto watch = [this, &fds] {
+    fds.clear();
+    for (const Slot &slot : this->slots) {
+      fds.push_back({slot.fd.load(std::memory_order_relaxed), POLLIN, 0});
+    }
+    for (const Draining &old : this->draining) {
+      fds.push_back({old.fd, POLLIN, 0});
+    }
+    fds.push_back({this->wakePipe[0], POLLIN, 0});
+  };
+  watch();
+
+  BytePacketBuffer resBuffer;
+  while (this->_thread__running) {
+    // between polls, so no socket is closed while we're about to read it
+    if (this->rotateSockets()) {
+      watch();
+    }
+
+    int ready = poll(fds.data(), fds.size(), 1000);
+    if (ready <= 0) {
+      continue;
+    }
+
+    if (fds.back().revents & POLLIN) {
+      char bytes[64];
+      while (read(this->wakePipe[0], bytes, sizeof(bytes)) > 0) {
+      }
+    }
+
+    for (size_t i = 0; i + 1 < fds.size(); i++) {
+      if (!(fds[i].revents & POLLIN)) {
+        continue;
+      }
+
+      // drain everything queued on this socket
+      while (true) {
+        struct sockaddr_in srcAddr;
+        socklen_t srcAddrLen = sizeof(srcAddr);
+        ssize_t bytesRecv =
+            recvfrom(fds[i].fd, resBuffer.buf, sizeof(resBuffer.buf), 0,
+                     (struct sockaddr *)&srcAddr, &srcAddrLen);
+        if (bytesRecv < 0) {
+          break;
+        }
+
+        std::memset(resBuffer.buf + bytesRecv, 0,
+                    sizeof(resBuffer.buf) - bytesRecv);
+
+        switch (this->tracker.completeTxn(serverFromSockaddr(srcAddr),
+                                          resBuffer)) {
+        case TxnMatch::Matched:
+          this->stats.responsesMatched.fetch_add(1, std::memory_order_relaxed);
+          break;
+        case TxnMatch::Unknown:
+          this->stats.responsesUnknown.fetch_add(1, std::memory_order_relaxed);
+          break;
+        case TxnMatch::Mismatched:
+          std::cerr << "Dropped upstream response that doesn't match its "
+                       "transaction, possible spoofing attempt"
+                    << std::endl;
+          this->stats.responsesMismatched.fetch_add(1,
+                                                    std::memory_order_relaxed);
+          break;
+        }
+      }
+    }
+  }
+}
+
+#endif // UPSTREAM_SOCKET_POOL_HPP
@@ -0,0 +1,597 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the io_uring front end for a listening socket
+ **/
+
+#ifndef URING_LISTENER_HPP
+#define URING_LISTENER_HPP
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define DNSPUP_HAS_IO_URING 1
+#endif
+
+#ifdef DNSPUP_HAS_IO_URING
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../BytePacketBuffer.hpp"
+#include "IoStats.hpp"
+
+/**
+ * UringListener drives one UDP socket through io_uring.
+ *
+ * Receiving is a single multishot recvmsg armed against a provided buffer
+ * ring, so the kernel keeps filling slots without a syscall per datagram and
+ * we only hand slots back once the datagram has been copied out. Responses
+ * from the workers are queued with send() and turned into sendmsg SQEs by the
+ * ring thread, which gets woken through an eventfd only when it isn't
+ * already awake.
+ *
+ * All ring access happens on the thread that calls run(), send() is the only
+ * method that is safe to call from other threads.
+ **/
+class UringListener {
+public:
+  using DatagramHandler =
+      std::function<void(BytePacketBuffer &, const struct sockaddr_in &)>;
+
+private:
+  // user_data tags, send slots use their index
+  static constexpr uint64_t TAG_RECV = ~0ULL;
+  static constexpr uint64_t TAG_WAKE = ~0ULL - 1;
+
+  static constexpr uint16_t BUFFER_GROUP = 0;
+  static constexpr size_t SEND_SLOTS = 256;
+
+  // a slot has to fit the recvmsg header, the source address and the payload
+  static constexpr size_t SLOT_HEADROOM =
+      sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in);
+
+  int sockfd;
+  IoStats &stats;
+  int ringFd = -1;
+  int wakeFd = -1;
+
+  // sq ring
+  void *sqRingPtr = nullptr;
+  size_t sqRingSize = 0;
+  unsigned *sqHead = nullptr;
+  unsigned *sqTail = nullptr;
+  unsigned *sqMask = nullptr;
+  unsigned *sqArray = nullptr;
+  struct io_uring_sqe *sqes = nullptr;
+  size_t sqesSize = 0;
+  unsigned sqEntries = 0;
+  unsigned sqLocalTail = 0;
+  unsigned toSubmit = 0;
+
+  // cq ring
+  void *cqRingPtr = nullptr;
+  size_t cqRingSize = 0;
+  unsigned *cqHead = nullptr;
+  unsigned *cqTail = nullptr;
+  unsigned *cqMask = nullptr;
+  struct io_uring_cqe *cqes = nullptr;
+
+  // provided buffer ring
+  struct io_uring_buf_ring *bufRing = nullptr;
+  size_t bufRingSize = 0;
+  std::vector<uint8_t> slots;
+  unsigned numSlots;
+  size_t slotSize;
+  unsigned bufMask;
+  uint16_t bufTail = 0;
+
+  // multishot recvmsg template, must stay alive while the request is armed
+  struct msghdr recvTemplate;
+
+  // outgoing responses
+  struct SendSlot {
+    uint8_t data[512];
+    size_t len;
+    struct sockaddr_in dest;
+    struct iovec iov;
+    struct msghdr msg;
+  };
+
+  struct QueuedSend {
+    uint8_t data[512];
+    size_t len;
+    struct sockaddr_in dest;
+  };
+
+  std::vector<SendSlot> sendSlots;
+  std::vector<size_t> freeSendSlots;
+  std::deque<QueuedSend> backlog;
+
+  std::mutex sendMtx;
+  std::vector<QueuedSend> sendQueue;
+  std::atomic<bool> wakePending{false};
+
+  uint64_t wakeValue = 0;
+
+  // send SQEs prepared since the last io_uring_enter
+  unsigned sendsQueued = 0;
+
+  bool setup(unsigned entries);
+  void teardown();
+
+  struct io_uring_sqe *nextSqe();
+  int enter(unsigned minComplete, bool wait);
+
+  void armRecv();
+  void armWake();
+  void recycleSlot(uint16_t bid);
+  void drainSendQueue();
+  void prepSends();
+
+public:
+  UringListener(int sockfd_, IoStats &stats_, unsigned numSlots_ = 1024,
+                size_t payloadSize = 512);
+  ~UringListener() { this->teardown(); }
+
+  UringListener(const UringListener &) = delete;
+  UringListener &operator=(const UringListener &) = delete;
+
+  // false if the kernel refused any part of the setup
+  bool ready() const { return this->ringFd >= 0; }
+
+  /**
+   * Run the ring until `stop` turns true, handing each datagram to `handler`
+   * on this thread. The buffer passed to the handler is only valid for the
+   * duration of the call
+   **/
+  void run(const std::atomic<bool> &stop, const DatagramHandler &handler);
+
+  /**
+   * Queue a response on the ring, safe to call from any thread
+   **/
+  void send(const uint8_t *data, size_t len, const struct sockaddr_in &dest);
+};
+
+inline UringListener::UringListener(int sockfd_, IoStats &stats_,
+                                    unsigned numSlots_, size_t payloadSize)
+    : sockfd(sockfd_), stats(stats_), numSlots(1), slotSize(0), bufMask(0) {
+  // buffer rings must be a power of two
+  while (this->numSlots < numSlots_ && this->numSlots < 32768) {
+    this->numSlots <<= 1;
+  }
+  this->bufMask = this->numSlots - 1;
+  this->slotSize = SLOT_HEADROOM + std::min<size_t>(payloadSize, 512);
+
+  if (!this->setup(this->numSlots + SEND_SLOTS)) {
+    this->teardown();
+  }
+}
+
+inline bool UringListener::setup(unsigned entries) {
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = entries * 2;
+
+  this->ringFd =
+      static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (this->ringFd < 0) {
+    std::cerr << "io_uring_setup failed: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  if (!(params.features & IORING_FEAT_EXT_ARG)) {
+    std::cerr << "io_uring: kernel lacks IORING_FEAT_EXT_ARG" << std::endl;
+    return false;
+  }
+
+  // map the rings, the cq ring shares the sq mapping on FEAT_SINGLE_MMAP
+  this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  this->cqRingSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) {
+    this->sqRingSize = this->cqRingSize =
+        std::max(this->sqRingSize, this->cqRingSize);
+  }
+
+  this->sqRingPtr =
+      mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, this->ringFd, IORING_OFF_SQ_RING);
+  if (this->sqRingPtr == MAP_FAILED) {
+    this->sqRingPtr = nullptr;
+    return false;
+  }
+
+  if (singleMmap) {
+    this->cqRingPtr = this->sqRingPtr;
+  } else {
+    this->cqRingPtr =
+        mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, this->ringFd, IORING_OFF_CQ_RING);
+    if (this->cqRingPtr == MAP_FAILED) {
+      this->cqRingPtr = nullptr;
+      return false;
+    }
+  }
+
+  this->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqesPtr = mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, this->ringFd, IORING_OFF_SQES);
+  if (sqesPtr == MAP_FAILED) {
+    return false;
+  }
+  this->sqes = static_cast<struct io_uring_sqe *>(sqesPtr);
+
+  auto *sq = static_cast<uint8_t *>(this->sqRingPtr);
+  this->sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  this->sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  this->sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  this->sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  this->sqEntries = params.sq_entries;
+  this->sqLocalTail = *this->sqTail;
+
+  auto *cq = static_cast<uint8_t *>(this->cqRingPtr);
+  this->cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  this->cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  this->cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  this->cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  // provided buffer ring: the ring itself is page aligned anonymous memory
+  this->bufRingSize = this->numSlots * sizeof(struct io_uring_buf);
+  void *ringMem = mmap(nullptr, this->bufRingSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ringMem == MAP_FAILED) {
+    return false;
+  }
+  this->bufRing = static_cast<struct io_uring_buf_ring *>(ringMem);
+
+  struct io_uring_buf_reg reg;
+  std::memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(this->bufRing);
+  reg.ring_entries = this->numSlots;
+  reg.bgid = BUFFER_GROUP;
+  if (syscall(__NR_io_uring_register, this->ringFd, IORING_REGISTER_PBUF_RING,
+              &reg, 1) < 0) {
+    std::cerr << "io_uring: failed to register buffer ring: "
+              << strerror(errno) << std::endl;
+    munmap(this->bufRing, this->bufRingSize);
+    this->bufRing = nullptr;
+    return false;
+  }
+
+  this->slots.resize(this->numSlots * this->slotSize);
+  for (unsigned i = 0; i < this->numSlots; i++) {
+    this->recycleSlot(static_cast<uint16_t>(i));
+  }
+
+  this->wakeFd = eventfd(0, EFD_CLOEXEC);
+  if (this->wakeFd < 0) {
+    return false;
+  }
+
+  this->sendSlots.resize(SEND_SLOTS);
+  for (size_t i = 0; i < SEND_SLOTS; i++) {
+    this->freeSendSlots.push_back(SEND_SLOTS - 1 - i);
+  }
+
+  std::memset(&this->recvTemplate, 0, sizeof(this->recvTemplate));
+  this->recvTemplate.msg_namelen = sizeof(struct sockaddr_in);
+
+  return true;
+}
+
+inline void UringListener::teardown() {
+  if (this->bufRing != nullptr) {
+    munmap(this->bufRing, this->bufRingSize);
+    this->bufRing = nullptr;
+  }
+  if (this->sqes != nullptr) {
+    munmap(this->sqes, this->sqesSize);
+    this->sqes = nullptr;
+  }
+  if (this->cqRingPtr != nullptr && this->cqRingPtr != this->sqRingPtr) {
+    munmap(this->cqRingPtr, this->cqRingSize);
+  }
+  this->cqRingPtr = nullptr;
+  if (this->sqRingPtr != nullptr) {
+    munmap(this->sqRingPtr, this->sqRingSize);
+    this->sqRingPtr = nullptr;
+  }
+  if (this->wakeFd >= 0) {
+    close(this->wakeFd);
+    this->wakeFd = -1;
+  }
+  if (this->ringFd >= 0) {
+    close(this->ringFd);
+    this->ringFd = -1;
+  }
+}
+
+inline struct io_uring_sqe *UringListener::nextSqe() {
+  unsigned head = std::atomic_ref<unsigned>(*this->sqHead).load(
+      std::memory_order_acquire);
+  if (this->sqLocalTail - head >= this->sqEntries) {
+    // sq full, push what we have to the kernel first
+    this->enter(0, false);
+    head = std::atomic_ref<unsigned>(*this->sqHead).load(
+        std::memory_order_acquire);
+    if (this->sqLocalTail - head >= this->sqEntries) {
+      return nullptr;
+    }
+  }
+
+  unsigned index = this->sqLocalTail & *this->sqMask;
+  struct io_uring_sqe *sqe = &this->sqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+
+  this->sqArray[index] = index;
+  this->sqLocalTail++;
+  std::atomic_ref<unsigned>(*this->sqTail).store(this->sqLocalTail,
+                                                 std::memory_order_release);
+  this->toSubmit++;
+  return sqe;
+}
+
+inline int UringListener::enter(unsigned minComplete, bool wait) {
+  unsigned flags = 0;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  void *argp = nullptr;
+  size_t argSize = 0;
+
+  if (wait) {
+    // wake up every second to notice shutdown
+    flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    ts.tv_sec = 1;
+    ts.tv_nsec = 0;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    argp = &arg;
+    argSize = sizeof(arg);
+  }
+
+  unsigned submitting = this->toSubmit;
+  this->toSubmit = 0;
+
+  int ret = static_cast<int>(syscall(__NR_io_uring_enter, this->ringFd,
+                                     submitting, minComplete, flags, argp,
+                                     argSize));
+  if (ret < 0 && errno != ETIME && errno != EINTR) {
+    std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+  }
+  return ret;
+}
+
+inline void UringListener::armRecv() {
+  struct io_uring_sqe *sqe = this->nextSqe();
+  if (sqe == nullptr) {
+    return;
+  }
+
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = this->sockfd;
+  sqe->addr = reinterpret_cast<uint64_t>(&this->recvTemplate);
+  sqe->len = 0;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BUFFER_GROUP;
+  sqe->user_data = TAG_RECV;
+}
+
+inline void UringListener::armWake() {
+  struct io_uring_sqe *sqe = this->nextSqe();
+  if (sqe == nullptr) {
+    return;
+  }
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = this->wakeFd;
+  sqe->addr = reinterpret_cast<uint64_t>(&this->wakeValue);
+  sqe->len = sizeof(this->wakeValue);
+  sqe->user_data = TAG_WAKE;
+}
+
+inline void UringListener::recycleSlot(uint16_t bid) {
+  // index the entries by hand, in C++ the uapi flex array member sits behind
+  // an empty struct and ends up at the wrong offset
+  struct io_uring_buf *buf =
+      reinterpret_cast<struct io_uring_buf *>(this->bufRing) +
+      (this->bufTail & this->bufMask);
+  buf->addr = reinterpret_cast<uint64_t>(&this->slots[bid * this->slotSize]);
+  buf->len = static_cast<uint32_t>(this->slotSize);
+  buf->bid = bid;
+
+  this->bufTail++;
+  std::atomic_ref<uint16_t>(this->bufRing->tail)
+      .store(this->bufTail, std::memory_order_release);
+}
+
+inline void UringListener::send(const uint8_t *data, size_t len,
+                                const struct sockaddr_in &dest) {
+  if (len > 512) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->sendMtx);
+    QueuedSend &queued = this->sendQueue.emplace_back();
+    std::memcpy(queued.data, data, len);
+    queued.len = len;
+    queued.dest = dest;
+  }
+
+  // only the first sender since the last drain pays for the wakeup
+  if (!this->wakePending.exchange(true, std::memory_order_acq_rel)) {
+    uint64_t one = 1;
+    ssize_t _ = write(this->wakeFd, &one, sizeof(one));
+    (void)_;
+  }
+}
+
+inline void UringListener::drainSendQueue() {
+  this->wakePending.store(false, std::memory_order_release);
+
+  std::vector<QueuedSend> drained;
+  {
+    std::lock_guard<std::mutex> lock(this->sendMtx);
+    drained.swap(this->sendQueue);
+  }
+
+  for (auto &queued : drained) {
+    this->backlog.push_back(queued);
+  }
+}
+
+inline void UringListener::prepSends() {
+  while (!this->backlog.empty() && !this->freeSendSlots.empty()) {
+    size_t index = this->freeSendSlots.back();
+    SendSlot &slot = this->sendSlots[index];
+
+    const QueuedSend &queued = this->backlog.front();
+    std::memcpy(slot.data, queued.data, queued.len);
+    slot.len = queued.len;
+    slot.dest = queued.dest;
+
+    slot.iov.iov_base = slot.data;
+    slot.iov.iov_len = slot.len;
+    std::memset(&slot.msg, 0, sizeof(slot.msg));
+    slot.msg.msg_name = &slot.dest;
+    slot.msg.msg_namelen = sizeof(slot.dest);
+    slot.msg.msg_iov = &slot.iov;
+    slot.msg.msg_iovlen = 1;
+
+    struct io_uring_sqe *sqe = this->nextSqe();
+    if (sqe == nullptr) {
+      return;
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = this->sockfd;
+    sqe->addr = reinterpret_cast<uint64_t>(&slot.msg);
+    sqe->len = 1;
+    sqe->user_data = index;
+
+    this->freeSendSlots.pop_back();
+    this->backlog.pop_front();
+    this->sendsQueued++;
+  }
+}
+
+inline void UringListener::run(const std::atomic<bool> &stop,
+                               const DatagramHandler &handler) {
+  if (!this->ready()) {
+    return;
+  }
+
+  this->armRecv();
+  this->armWake();
+
+  BytePacketBuffer reqBuffer;
+  while (!stop) {
+    // one enter submits every queued send and reaps every completion
+    if (this->sendsQueued > 0) {
+      this->stats.sendCalls.fetch_add(1, std::memory_order_relaxed);
+      this->stats.sendDatagrams.fetch_add(this->sendsQueued,
+                                          std::memory_order_relaxed);
+      this->sendsQueued = 0;
+    }
+    this->enter(1, true);
+
+    unsigned head = *this->cqHead;
+    unsigned tail =
+        std::atomic_ref<unsigned>(*this->cqTail).load(std::memory_order_acquire);
+
+    bool rearmRecv = false;
+    bool rearmWake = false;
+
+    bool receivedAny = false;
+    for (; head != tail; head++) {
+      struct io_uring_cqe *cqe = &this->cqes[head & *this->cqMask];
+
+      if (cqe->user_data == TAG_RECV) {
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+          rearmRecv = true;
+        }
+        if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+          continue;
+        }
+
+        auto bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        uint8_t *slot = &this->slots[bid * this->slotSize];
+
+        auto *out = reinterpret_cast<struct io_uring_recvmsg_out *>(slot);
+        if (out->namelen >= sizeof(struct sockaddr_in) &&
+            !(out->flags & MSG_TRUNC)) {
+          struct sockaddr_in srcAddr;
+          std::memcpy(&srcAddr, slot + sizeof(*out), sizeof(srcAddr));
+
+          const uint8_t *payload = slot + sizeof(*out) +
+                                   this->recvTemplate.msg_namelen +
+                                   this->recvTemplate.msg_controllen;
+          size_t len = std::min<size_t>(out->payloadlen, sizeof(reqBuffer.buf));
+
+          std::memcpy(reqBuffer.buf, payload, len);
+          std::memset(reqBuffer.buf + len, 0, sizeof(reqBuffer.buf) - len);
+          reqBuffer.seek(0);
+
+          // the slot goes straight back to the kernel, the handler works on
+          // the copy
+          this->recycleSlot(bid);
+          this->stats.recvDatagrams.fetch_add(1, std::memory_order_relaxed);
+          receivedAny = true;
+
+          try {
+            handler(reqBuffer, srcAddr);
+          } catch (const std::exception &e) {
+            std::cerr << "io_uring datagram handler error: " << e.what()
+                      << std::endl;
+          }
+        } else {
+          this->recycleSlot(bid);
+        }
+      } else if (cqe->user_data == TAG_WAKE) {
+        rearmWake = true;
+        this->drainSendQueue();
+      } else if (cqe->user_data < SEND_SLOTS) {
+        this->freeSendSlots.push_back(static_cast<size_t>(cqe->user_data));
+      }
+    }
+
+    std::atomic_ref<unsigned>(*this->cqHead).store(head,
+                                                   std::memory_order_release);
+
+    if (receivedAny) {
+      this->stats.recvCalls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (rearmRecv) {
+      this->armRecv();
+    }
+    if (rearmWake) {
+      this->armWake();
+    }
+
+    this->prepSends();
+  }
+}
+
+#endif // DNSPUP_HAS_IO_URING
+
+#endif // URING_LISTENER_HPP
@@ -1,20 +1,40 @@
+#include <algorithm>
 #include <arpa/inet.h>
 #include <atomic>
 #include <csignal>
 #include <cstring>
 #include <exception>
 #include <iostream>
+#include <memory>
 #include <netinet/in.h>
-#include <sys/_types/_socklen_t.h>
 #include <sys/socket.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 #include "BytePacketBuffer.hpp"
 #include "Core.hpp"
 #include "ThreadPool.hpp"
 #include "cache/StatsLogger.hpp"
 #include "cache/ThreadSafeCache.hpp"
+#include "config/CacheConfig.hpp"
+#include "config/ListenerConfig.hpp"
 #include "config/NetworkConfig.hpp"
+#include "config/OverloadConfig.hpp"
+#include "config/ResolverConfig.hpp"
+#include "config/WorkerConfig.hpp"
+#include "io/BatchReceiver.hpp"
+#include "io/IoStats.hpp"
+#include "io/Listener.hpp"
+#include "io/PacketPool.hpp"
+#include "io/ResponseBatcher.hpp"
+#include "io/UpstreamSocketPool.hpp"
+#include "io/UringListener.hpp"
+#include "metrics/LatencyHistogram.hpp"
+#include "overload/CoDelShedder.hpp"
+#include "resolver/AsyncResolver.hpp"
+#include "resolver/CoroResolver.hpp"
+#include "resolver/EventLoop.hpp"
 #include "security/RateLimiter.hpp"
 #include "tracking/TransactionTracker.hpp"
 
@@ -25,6 +45,123 @@ void signalHandler(int signum) {
   g_shutdown_requested = true;
 }
 
+// everything a receive loop needs to hand a query off to the workers
+struct ServerContext {
+  ThreadPool &threadPool;
+  PacketPool &packets;
+  ThreadSafeCache &cache;
+  RateLimiter &rateLimiter;
+  TransactionTracker &tracker;
+  UpstreamSocketPool &upstream;
+  NetworkConfig &networkConfig;
+  IoStats &ioStats;
+  QueryLatencyStats &latency;
+  CoDelShedder &shedder;
+
+  // answer cache hits before dispatching
+  bool answerHitsInline;
+
+  // at most one is set, when recursions run on the event loop instead of
+  // the workers
+  AsyncResolver *resolver;
+  CoroResolver *coroResolver;
+};
+
+// answer one received query from the cache, or hand it to the thread pool
+void dispatchQuery(int sockfd, BytePacketBuffer &reqBuffer,
+                   const struct sockaddr_in &srcAddr, ServerContext &ctx) {
+  QueryTimer timer{&ctx.latency.hitPath};
+
+  bool admitted = false;
+  if (ctx.answerHitsInline) {
+    FastPathResult fast = answerFromCache(sockfd, reqBuffer, srcAddr,
+                                          ctx.cache, ctx.rateLimiter, timer);
+    if (fast == FastPathResult::Answered) {
+      return;
+    }
+    admitted = fast == FastPathResult::Miss;
+  }
+
+  timer.histogram = &ctx.latency.missPath;
+
+  // receive buffers are reused, the worker gets the packet in a pooled slot
+  // that goes back to the pool when the task is done with it
+  PacketHandle packet = ctx.packets.copyOf(reqBuffer);
+  bool hasSlot = static_cast<bool>(packet);
+
+  // captures widest first so the closure packs into ThreadPool::TASK_CAPACITY
+  auto task = [packet = std::move(packet), timer, &ctx, srcAddr, sockfd,
+               admitted]() mutable {
+    try {
+      BytePacketBuffer &request = *packet;
+
+      // waited too long in the queue, the client has likely given up
+      if (ctx.shedder.shouldShed(timer.start)) {
+        shedQuery(sockfd, request, srcAddr, ctx.shedder.policy());
+        return;
+      }
+
+      if (ctx.resolver != nullptr) {
+        handleQueryAsync(sockfd, request, srcAddr, ctx.rateLimiter,
+                         *ctx.resolver, admitted, timer, &ctx.shedder);
+        return;
+      }
+
+      if (ctx.coroResolver != nullptr) {
+        handleQueryAsync(sockfd, request, srcAddr, ctx.rateLimiter,
+                         *ctx.coroResolver, admitted, timer, &ctx.shedder);
+        return;
+      }
+
+      handleQueryThreaded(sockfd, request, srcAddr, ctx.cache,
+                          ctx.rateLimiter, ctx.tracker, ctx.upstream,
+                          ctx.networkConfig, admitted, timer);
+    } catch (const std::exception &e) {
+      std::cerr << "Query handling error: " << e.what() << std::endl;
+    }
+  };
+
+  if (!hasSlot || !ctx.threadPool.tryEnqueue(std::move(task))) {
+    ctx.shedder.recordQueueFull();
+    shedQuery(sockfd, reqBuffer, srcAddr, ctx.shedder.policy());
+  }
+}
+
+// drain one listening socket until shutdown, dispatching to the thread pool
+void receiveLoop(int sockfd, size_t batchSize, ServerContext &ctx) {
+  BatchReceiver receiver(batchSize, ctx.ioStats);
+  while (!g_shutdown_requested) {
+    try {
+      int received = receiver.receive(sockfd);
+      if (received < 0) {
+        continue;
+      }
+
+      // dispatch every datagram of the batch to thread pool
+      for (int i = 0; i < received; i++) {
+        dispatchQuery(sockfd, receiver.buffer(i), receiver.source(i), ctx);
+      }
+
+      // cache hits answered on this thread go out as one batch
+      ResponseBatcher::flush();
+
+    } catch (const std::exception &e) {
+      std::cerr << "An exception occured: " << e.what() << std::endl;
+    }
+  }
+}
+
+#ifdef DNSPUP_HAS_IO_URING
+// same as receiveLoop but the socket is driven by an io_uring
+void uringLoop(int sockfd, UringListener &ring, ServerContext &ctx) {
+  ring.run(g_shutdown_requested,
+           [sockfd, &ctx](BytePacketBuffer &reqBuffer,
+                          const struct sockaddr_in &srcAddr) {
+             dispatchQuery(sockfd, reqBuffer, srcAddr, ctx);
+           });
+}
+#endif
+
 int main() {
   try {
     signal(SIGINT, signalHandler);
@@ -32,103 +169,266 @@ int main() {
 
     // create network config
     NetworkConfig networkConfig;
+    ListenerConfig listenerConfig;
+    ResolverConfig resolverConfig;
+    WorkerConfig workerConfig;
+    OverloadConfig overloadConfig;
+    CacheConfig cacheConfig;
 
-    // bind udp socket to 2053
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-      std::cerr << "Failed to create socket" << std::endl;
-      return 1;
-    }
+    // batched socket I/O
+    IoStats ioStats;
+    ResponseBatcher::configure(listenerConfig.batchSize, ioStats);
 
-    struct sockaddr_in serverAddr;
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(2053);
+    // receive-to-send latency, fast path vs dispatched
+    QueryLatencyStats latencyStats;
 
-    if (bind(sockfd, (const struct sockaddr *)&serverAddr, sizeof(serverAddr)) <
-        0) {
-      std::cerr << "Failed to bind socket" << std::endl;
-      close(sockfd);
-      return 1;
+    // sheds queries that sat in the dispatch queue past their budget, and
+    // recursions the event loop has no room for or whose client gave up
+    CoDelShedder shedder(overloadConfig);
+
+    // bind udp socket(s) to 2053, one SO_REUSEPORT socket per listener
+    size_t numListeners = listenerConfig.listeners;
+    if (numListeners == 0) {
+      numListeners = std::max(1u, std::thread::hardware_concurrency());
     }
 
-    struct timeval tv;
-    tv.tv_sec = 1;
-    tv.tv_usec = 0;
+    std::vector<int> sockets;
+    for (size_t i = 0; i < numListeners; i++) {
+      int sockfd = openUdpListener(listenerConfig.port, numListeners > 1);
+      if (sockfd < 0) {
+        for (int fd : sockets) {
+          close(fd);
+        }
+        return 1;
+      }
 
-    // Set socket recieve timeout
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-      std::cerr << "Warning: Failed to set socket timeout" << std::endl;
+      if (numListeners > 1 && listenerConfig.steerByCpu) {
+        attachCpuSteering(sockfd, i, numListeners, i == 0);
+      }
+      sockets.push_back(sockfd);
     }
 
-    // thread pool
-    size_t numThreads = std::thread::hardware_concurrency();
-    ThreadPool threadPool(numThreads);
+    // optional io_uring front end, one ring per listening socket
+#ifdef DNSPUP_HAS_IO_URING
+    std::vector<std::unique_ptr<UringListener>> rings;
+    if (listenerConfig.ioBackend == IoBackend::IoUring) {
+      for (int sockfd : sockets) {
+        rings.push_back(std::make_unique<UringListener>(
+            sockfd, ioStats, listenerConfig.uringBufferSlots));
+        if (!rings.back()->ready()) {
+          std::cerr << "Warning: io_uring unavailable, using sockets"
+                    << std::endl;
+          rings.clear();
+          break;
+        }
+      }
+    }
 
-    std::cout << "DNS Server with " << numThreads << " worker threads "
-              << std::endl;
+    // responses for a ring-driven socket go back out through its ring
+    if (!rings.empty()) {
+      std::cout << "Using io_uring front end" << std::endl;
+
+      std::vector<UringListener *> ringBySocket;
+      for (size_t i = 0; i < sockets.size(); i++) {
+        if (ringBySocket.size() <= static_cast<size_t>(sockets[i])) {
+          ringBySocket.resize(sockets[i] + 1, nullptr);
+        }
+        ringBySocket[sockets[i]] = rings[i].get();
+      }
+
+      ResponseBatcher::routeTo(
+          [ringBySocket](int sockfd, const uint8_t *data, size_t len,
+                         const struct sockaddr_in &dest) {
+            if (sockfd < 0 ||
+                static_cast<size_t>(sockfd) >= ringBySocket.size() ||
+                ringBySocket[sockfd] == nullptr) {
+              return false;
+            }
+            ringBySocket[sockfd]->send(data, len, dest);
+            return true;
+          });
+    }
+#else
+    if (listenerConfig.ioBackend == IoBackend::IoUring) {
+      std::cerr << "Warning: built without io_uring, using sockets"
+                << std::endl;
+    }
+#endif
 
     // create cache
-    ThreadSafeCache cache;
+    ThreadSafeCache cache(cacheConfig);
 
     // DnsCache cache(60, 86400); // runs every minute
     cache.startCleanup();
 
     StatsLogger cacheStatsLogger(120, cache); // runs every 2 mins
-    cacheStatsLogger.startLogger();
+
+    // event loop for the non-blocking resolver, created before the upstream
+    // pool because late replies are still posted to it during shutdown
+    std::unique_ptr<EventLoop> eventLoop;
+    if (resolverConfig.mode != ResolverMode::Threaded) {
+      eventLoop =
+          std::make_unique<EventLoop>([] { ResponseBatcher::flush(); });
+    }
 
     // transaction tracker
     TransactionTracker tracker;
 
+    // upstream sockets on rotating random ports, replies are matched through
+    // the tracker. a retired socket is read a little past the longest a
+    // query waits
+    UpstreamSocketPool upstream(tracker, networkConfig.upstreamSockets,
+                                networkConfig.upstreamRotateQueries,
+                                networkConfig.upstreamRotateMs,
+                                networkConfig.recvTimeoutMs + 1000);
+
+    std::unique_ptr<AsyncResolver> resolver;
+    std::unique_ptr<CoroResolver> coroResolver;
+    if (resolverConfig.mode == ResolverMode::EventDriven) {
+      resolver = std::make_unique<AsyncResolver>(
+          *eventLoop, cache, tracker, upstream, networkConfig, &shedder);
+    } else if (resolverConfig.mode == ResolverMode::Coroutine) {
+      coroResolver = std::make_unique<CoroResolver>(
+          *eventLoop, cache, tracker, upstream, networkConfig, &shedder);
+    }
+
+    cacheStatsLogger.addReporter([&ioStats] { ioStats.print(); });
+    cacheStatsLogger.addReporter([&upstream] { upstream.printStats(); });
+    cacheStatsLogger.addReporter([&latencyStats] { latencyStats.print(); });
+    cacheStatsLogger.addReporter([&shedder] { shedder.printStats(); });
+    cacheStatsLogger.startLogger();
+
     // create rate limiter
     RateLimitConfig rateLimiterCfg;
     rateLimiterCfg.maxQueriesPerWindow = 250;
     rateLimiterCfg.windowSeconds = 1;
     RateLimiter rateLimiter{rateLimiterCfg};
 
-    std::cout << "DNS Server listening on 0.0.0.0:2053" << std::endl;
+    // thread pool, declared last so workers are joined before anything
+    // they reference goes away
+    size_t numThreads = workerConfig.numThreads;
+    if (numThreads == 0) {
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // one request buffer for every task the ring can hold plus the ones
+    // being worked on, declared before the pool so queued tasks can still
+    // hand their buffers back while it shuts down
+    PacketPool packetPool(workerConfig.queueCapacity + numThreads);
+
+    ThreadPool threadPool(
+        numThreads, [] { ResponseBatcher::flush(); },
+        workerConfig.queueCapacity, workerConfig.scheduling);
+
+    std::cout << "DNS Server with " << numThreads << " worker threads "
+              << std::endl;
+    if (resolver) {
+      std::cout << "Recursive lookups run on the event loop" << std::endl;
+    } else if (coroResolver) {
+      std::cout << "Recursive lookups run as coroutines on the event loop"
+                << std::endl;
+    }
+
+    std::cout << "DNS Server listening on 0.0.0.0:" << listenerConfig.port
+              << " (" << numListeners << " listener(s), batch size "
+              << listenerConfig.batchSize << ")" << std::endl;
     std::cout << "Background threads started" << std::endl;
     std::cout << "Press Ctrl+C to shutdown" << std::endl;
 
+    ServerContext ctx{threadPool,
+                      packetPool,
+                      cache,
+                      rateLimiter,
+                      tracker,
+                      upstream,
+                      networkConfig,
+                      ioStats,
+                      latencyStats,
+                      shedder,
+                      listenerConfig.answerHitsInline,
+                      resolver.get(),
+                      coroResolver.get()};
+
+    // refresh-ahead, a hot answer about to expire is re-resolved by whatever
+    // resolves misses. none are started once we're shutting down, and one
+    // that finds the queue (or the loop) full isn't, a later hit asks again
+    cache.setPrefetcher([&ctx](const DnsName &qname, QueryType qtype) {
+      if (g_shutdown_requested) {
+        return false;
+      }
+
+      if (ctx.resolver != nullptr) {
+        return ctx.resolver->refresh(qname, qtype);
+      }
+
+      if (ctx.coroResolver != nullptr) {
+        return ctx.coroResolver->refresh(qname, qtype);
+      }
+
+      // the name goes on the heap so the task fits ThreadPool::TASK_CAPACITY
+      auto name = std::make_unique<DnsName>(qname);
+      return ctx.threadPool.tryEnqueue([name = std::move(name), qtype, &ctx] {
+        QueryArena::Scope arena;
+        DnsPacket result(QueryArena::resource());
+        std::exception_ptr error;
+        try {
+          result = recursiveLookup(*name, qtype, ctx.cache, ctx.networkConfig,
+                                   ctx.tracker, ctx.upstream, 0, nullptr,
+                                   CacheUse::Refresh);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        finishPrefetch(ctx.cache, *name, qtype, result, error);
+      });
+    });
+
+    // pick the loop for listener i based on the backend that came up
+    auto runListener = [&](size_t i) {
+#ifdef DNSPUP_HAS_IO_URING
+      if (!rings.empty()) {
+        uringLoop(sockets[i], *rings[i], ctx);
+        return;
+      }
+#endif
+      receiveLoop(sockets[i], listenerConfig.batchSize, ctx);
+    };
+
     // handle queries
-    while (!g_shutdown_requested) {
-      try {
-        BytePacketBuffer reqBuffer;
-        struct sockaddr_in srcAddr;
-        socklen_t srcAddrLen = sizeof(srcAddr);
-
-        ssize_t bytesReceived =
-            recvfrom(sockfd, reqBuffer.buf, 512, 0, (struct sockaddr *)&srcAddr,
-                     &srcAddrLen);
-        if (bytesReceived < 0) {
-          continue;
+    if (numListeners == 1) {
+      runListener(0);
+    } else {
+      // one reactor per socket, each pinned to its own core
+      size_t numCpus = std::max(1u, std::thread::hardware_concurrency());
+      std::vector<std::jthread> listenerThreads;
+      for (size_t i = 0; i < numListeners; i++) {
+        listenerThreads.emplace_back(runListener, i);
+
+        if (listenerConfig.pinListeners &&
+            !pinThreadToCpu(listenerThreads.back(), i % numCpus)) {
+          std::cerr << "Warning: failed to pin listener " << i << " to cpu "
+                    << (i % numCpus) << std::endl;
         }
+      }
 
-        // dispatch to thread pool
-        threadPool.enqueue([sockfd, reqBuffer, srcAddr, &cache, &rateLimiter,
-                            &tracker, &networkConfig]() mutable {
-          try {
-            handleQueryThreaded(sockfd, reqBuffer, srcAddr, cache, rateLimiter,
-                                tracker, networkConfig);
-          } catch (const std::exception &e) {
-            std::cerr << "Query handling error: " << e.what() << std::endl;
-          }
-        });
-
-      } catch (const std::exception &e) {
-        std::cerr << "An exception occured: " << e.what() << std::endl;
+      for (auto &thread : listenerThreads) {
+        thread.join();
       }
     }
 
     // stats
     std::cout << "\nShutting down...\n";
     cache.printStats();
+    ioStats.print();
+    upstream.printStats();
+    latencyStats.print();
+    shedder.printStats();
 
     // cleanup
     cache.stopCleanup();
     cacheStatsLogger.stopLogger();
 
-    close(sockfd);
+    for (int fd : sockets) {
+      close(fd);
+    }
   } catch (const std::exception &e) {
     std::cerr << "Fatal error: " << e.what() << std::endl;
     return 1;
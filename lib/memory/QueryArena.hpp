@@ -0,0 +1,83 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the per-thread arena a query's packets allocate from
+ **/
+
+#ifndef QUERY_ARENA_HPP
+#define QUERY_ARENA_HPP
+
+#include <cstddef>
+#include <memory_resource>
+
+/**
+ * QueryArena - one monotonic arena per thread for everything a query
+ * builds while it is being handled: the request and response DnsPackets,
+ * their questions and records, and the names inside them.
+ *
+ * Allocation is a pointer bump into a buffer the thread owns, frees are
+ * no-ops, and when the outermost Scope closes the whole arena is reset in
+ * one shot. The first INITIAL_BYTES come from a thread-local buffer so a
+ * typical query never touches the heap, bigger ones spill into chunks from
+ * the default resource that are handed back at the same reset.
+ *
+ * Only code that asks for resource() inside an open Scope uses the arena.
+ * Anything that has to outlive the query (cache entries, work handed to
+ * another thread) must be copied out, copy-constructing a pmr container or
+ * a DnsRecord puts the copy back on the default resource.
+ **/
+class QueryArena {
+public:
+  static constexpr size_t INITIAL_BYTES = 16 * 1024;
+
+  /**
+   * Opens the arena on this thread. Scopes nest, only the outermost one
+   * resets the arena when it closes
+   **/
+  class Scope {
+  public:
+    Scope();
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+  /**
+   * This thread's arena while a Scope is open, otherwise the default
+   * (heap) resource
+   **/
+  static std::pmr::memory_resource *resource();
+
+private:
+  struct State {
+    alignas(std::max_align_t) std::byte initial[INITIAL_BYTES];
+    std::pmr::monotonic_buffer_resource arena{
+        initial, sizeof(initial), std::pmr::get_default_resource()};
+    size_t depth = 0;
+  };
+
+  static State &state() {
+    static thread_local State local;
+    return local;
+  }
+};
+
+inline QueryArena::Scope::Scope() { QueryArena::state().depth++; }
+
+inline QueryArena::Scope::~Scope() {
+  State &local = QueryArena::state();
+  if (--local.depth == 0) {
+    local.arena.release();
+  }
+}
+
+inline std::pmr::memory_resource *QueryArena::resource() {
+  State &local = QueryArena::state();
+  if (local.depth == 0) {
+    return std::pmr::get_default_resource();
+  }
+  return &local.arena;
+}
+
+#endif // QUERY_ARENA_HPP
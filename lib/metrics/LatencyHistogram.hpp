@@ -0,0 +1,130 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the lock-free latency histograms for query handling
+ **/
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/**
+ * LatencyHistogram - power of two microsecond buckets, bucket i holds
+ * samples below 2^i us. Recording is a couple of relaxed atomic adds so it
+ * can sit on the receive path, percentiles are reported as the upper bound
+ * of the bucket they fall in
+ **/
+class LatencyHistogram {
+private:
+  static constexpr size_t NUM_BUCKETS = 32;
+
+  std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets{};
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> totalMicros{0};
+  std::atomic<uint64_t> maxMicros{0};
+
+public:
+  void record(std::chrono::steady_clock::duration elapsed);
+
+  uint64_t samples() const { return this->count.load(); }
+
+  double meanMicros() const;
+
+  /**
+   * Upper bound (us) of the bucket holding the `pct` percentile
+   **/
+  uint64_t percentileMicros(double pct) const;
+
+  void print(const std::string &name) const;
+};
+
+inline void
+LatencyHistogram::record(std::chrono::steady_clock::duration elapsed) {
+  auto micros = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+
+  size_t bucket = std::min<size_t>(std::bit_width(micros), NUM_BUCKETS - 1);
+  this->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  this->count.fetch_add(1, std::memory_order_relaxed);
+  this->totalMicros.fetch_add(micros, std::memory_order_relaxed);
+
+  uint64_t seen = this->maxMicros.load(std::memory_order_relaxed);
+  while (micros > seen && !this->maxMicros.compare_exchange_weak(
+                              seen, micros, std::memory_order_relaxed)) {
+  }
+}
+
+inline double LatencyHistogram::meanMicros() const {
+  uint64_t n = this->count.load();
+  return n == 0 ? 0.0 : static_cast<double>(this->totalMicros.load()) / n;
+}
+
+inline uint64_t LatencyHistogram::percentileMicros(double pct) const {
+  uint64_t n = this->count.load();
+  if (n == 0) {
+    return 0;
+  }
+
+  auto target = static_cast<uint64_t>(pct / 100.0 * n);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    seen += this->buckets[i].load(std::memory_order_relaxed);
+    if (seen > target) {
+      return uint64_t{1} << i;
+    }
+  }
+
+  return this->maxMicros.load();
+}
+
+inline void LatencyHistogram::print(const std::string &name) const {
+  std::cout << name << ": " << this->samples() << " queries, mean "
+            << static_cast<uint64_t>(this->meanMicros()) << "us, p50 <"
+            << this->percentileMicros(50) << "us, p90 <"
+            << this->percentileMicros(90) << "us, p99 <"
+            << this->percentileMicros(99) << "us, max " << this->maxMicros
+            << "us\n";
+}
+
+/**
+ * QueryLatencyStats - receive-to-send latency, split between queries
+ * answered inline from the cache and queries that went through the workers
+ **/
+struct QueryLatencyStats {
+  LatencyHistogram hitPath;
+  LatencyHistogram missPath;
+
+  void print() const {
+    std::cout << "\n=== Query Latency ===\n";
+    this->hitPath.print("Fast path (cache hit)");
+    this->missPath.print("Slow path (dispatched)");
+    std::cout << "=====================\n\n";
+  }
+};
+
+/**
+ * Started when a query comes off the socket and carried along with it,
+ * record() files the time taken into `histogram` once the response is out
+ **/
+struct QueryTimer {
+  LatencyHistogram *histogram = nullptr;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  void record() const {
+    if (this->histogram != nullptr) {
+      this->histogram->record(std::chrono::steady_clock::now() - this->start);
+    }
+  }
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,271 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains DnsName, the case-normalized wire form of a domain name
+ * that the cache, the transaction tracker and the resolvers key on
+ **/
+
+#ifndef DNS_NAME_HPP
+#define DNS_NAME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#include "../StringUtils.hpp"
+#include "NameKernels.hpp"
+
+namespace dnsname {
+
+inline size_t hashWire(std::string_view wire) {
+  return std::hash<std::string_view>{}(wire);
+}
+
+// dotted text for an uncompressed wire name, root is ""
+inline std::string wireToText(std::string_view wire) {
+  if (wire.size() <= 1) {
+    return {};
+  }
+
+  std::string text(wire.data() + 1, wire.size() - 2);
+  for (size_t pos = static_cast<uint8_t>(wire[0]) + 1; pos + 1 < wire.size();
+       pos += static_cast<uint8_t>(wire[pos]) + 1) {
+    text[pos - 1] = '.';
+  }
+  return text;
+}
+
+} // namespace dnsname
+
+/**
+ * A name (or a suffix of one) in DnsName's wire form along with its hash.
+ * Doesn't own the bytes, walking up the tree with parent() never copies
+ **/
+class DnsNameView {
+private:
+  std::string_view bytes;
+  size_t hashValue;
+
+public:
+  DnsNameView(std::string_view wire_, size_t hash_)
+      : bytes(wire_), hashValue(hash_) {}
+
+  explicit DnsNameView(std::string_view wire_)
+      : DnsNameView(wire_, dnsname::hashWire(wire_)) {}
+
+  // labels and the terminating zero
+  std::string_view wire() const { return this->bytes; }
+  size_t hash() const { return this->hashValue; }
+  bool isRoot() const { return this->bytes.size() <= 1; }
+
+  // the name with its first label dropped, the root stays the root
+  DnsNameView parent() const {
+    if (this->isRoot()) {
+      return *this;
+    }
+    return DnsNameView(
+        this->bytes.substr(static_cast<uint8_t>(this->bytes[0]) + 1));
+  }
+
+  std::string toString() const { return dnsname::wireToText(this->bytes); }
+
+  bool operator==(const DnsNameView &other) const {
+    return this->hashValue == other.hashValue && this->bytes == other.bytes;
+  }
+
+  friend std::ostream &operator<<(std::ostream &stream,
+                                  const DnsNameView &name) {
+    return stream << name.toString();
+  }
+};
+
+/**
+ * DnsName - a domain name in lowercase wire format.
+ *
+ * Built once, from the message it arrived in or from dotted text, and then
+ * used as is: the hash is computed up front and a label offset table gives
+ * any label or suffix without scanning. Equality is a hash check plus a
+ * memcmp, names are compared the way DNS compares them (ASCII
+ * case-insensitively) because both sides were lowercased on the way in.
+ *
+ * Allocator-aware like DnsQuestion, a name inside a QueryArena scope can
+ * live in the arena. Copies without an allocator land on the heap.
+ **/
+class DnsName {
+public:
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+private:
+  // the wire form followed by one offset byte per label
+  std::pmr::string bytes;
+  uint8_t wireLength = 1;
+  uint8_t labels = 0;
+  size_t hashValue = 0;
+
+  // `length` bytes of labels, no terminator, lengths already checked
+  void assign(const uint8_t *labels_, size_t length);
+
+public:
+  // the root
+  DnsName() : DnsName(allocator_type{}) {}
+  explicit DnsName(allocator_type alloc) : bytes(alloc) {
+    this->assign(nullptr, 0);
+  }
+
+  // from dotted text, throws on an empty or oversized label or name
+  explicit DnsName(std::string_view text, allocator_type alloc = {})
+      : bytes(alloc) {
+    uint8_t wire[namekernels::MAX_NAME_WIRE];
+    this->assign(wire, namekernels::textToLabels(text, wire));
+  }
+
+  // from a view of another DnsName (or a suffix of one)
+  explicit DnsName(const DnsNameView &view, allocator_type alloc = {})
+      : bytes(alloc) {
+    this->assign(reinterpret_cast<const uint8_t *>(view.wire().data()),
+                 view.wire().size() - 1);
+  }
+
+  DnsName(const DnsName &) = default;
+  DnsName(DnsName &&) = default;
+  DnsName &operator=(const DnsName &) = default;
+  DnsName &operator=(DnsName &&) = default;
+
+  DnsName(const DnsName &other, allocator_type alloc)
+      : bytes(other.bytes, alloc), wireLength(other.wireLength),
+        labels(other.labels), hashValue(other.hashValue) {}
+  DnsName(DnsName &&other, allocator_type alloc)
+      : bytes(std::move(other.bytes), alloc), wireLength(other.wireLength),
+        labels(other.labels), hashValue(other.hashValue) {}
+
+  /**
+   * From uncompressed wire labels as they sit in a message, `length` bytes
+   * with no terminator. The caller has checked the label lengths add up
+   **/
+  static DnsName fromLabels(const uint8_t *labels, size_t length,
+                            allocator_type alloc = {}) {
+    DnsName name(alloc);
+    name.assign(labels, length);
+    return name;
+  }
+
+  allocator_type get_allocator() const { return this->bytes.get_allocator(); }
+
+  // labels and the terminating zero
+  std::string_view wire() const {
+    return std::string_view(this->bytes.data(), this->wireLength);
+  }
+
+  size_t hash() const { return this->hashValue; }
+  size_t labelCount() const { return this->labels; }
+
+  // bytes kept outside the object, for memory accounting
+  size_t heapBytes() const { return stringutils::heapBytes(this->bytes); }
+  bool isRoot() const { return this->labels == 0; }
+
+  // label `index` without its length byte, "www" for 0 in "www.google.com"
+  std::string_view label(size_t index) const {
+    size_t at = static_cast<uint8_t>(this->bytes[this->wireLength + index]);
+    return std::string_view(this->bytes.data() + at + 1,
+                            static_cast<uint8_t>(this->bytes[at]));
+  }
+
+  // the name without its first `index` labels, the root past the last one
+  DnsNameView suffix(size_t index) const {
+    if (index == 0) {
+      return this->view();
+    }
+    size_t at = this->wireLength - 1u;
+    if (index < this->labels) {
+      at = static_cast<uint8_t>(this->bytes[this->wireLength + index]);
+    }
+    return DnsNameView(this->wire().substr(at));
+  }
+
+  DnsNameView view() const {
+    return DnsNameView(this->wire(), this->hashValue);
+  }
+  operator DnsNameView() const { return this->view(); }
+
+  /**
+   * True if `zoneWire` (an uncompressed wire name, any case) is this name
+   * or one of its suffixes on a label boundary. google.com is a suffix of
+   * www.google.com, gle.com isn't
+   **/
+  bool isSubdomainOf(std::string_view zoneWire) const;
+
+  std::string toString() const { return dnsname::wireToText(this->wire()); }
+
+  bool operator==(const DnsName &other) const {
+    return this->view() == other.view();
+  }
+
+  friend std::ostream &operator<<(std::ostream &stream, const DnsName &name) {
+    return stream << name.toString();
+  }
+};
+
+inline void DnsName::assign(const uint8_t *labels_, size_t length) {
+  this->labels = 0;
+  for (size_t at = 0; at < length; at += labels_[at] + 1) {
+    this->labels++;
+  }
+
+  this->wireLength = static_cast<uint8_t>(length + 1);
+  this->bytes.resize(this->wireLength + this->labels);
+
+  char *out = this->bytes.data();
+  // length bytes are all below 'A', lowercasing the whole run leaves them be
+  namekernels::toLower(reinterpret_cast<const char *>(labels_), out, length);
+  out[length] = 0;
+
+  size_t index = 0;
+  for (size_t at = 0; at < length; at += labels_[at] + 1) {
+    out[this->wireLength + index++] = static_cast<char>(at);
+  }
+
+  this->hashValue = dnsname::hashWire(this->wire());
+}
+
+inline bool DnsName::isSubdomainOf(std::string_view zoneWire) const {
+  if (zoneWire.size() > this->wireLength) {
+    return false;
+  }
+
+  size_t at = this->wireLength - zoneWire.size();
+  if (at != 0) {
+    // has to start right on one of our labels
+    bool boundary = false;
+    for (size_t i = 1; i < this->labels && !boundary; i++) {
+      boundary =
+          static_cast<uint8_t>(this->bytes[this->wireLength + i]) == at;
+    }
+    if (!boundary && at != this->wireLength - 1u) {
+      return false;
+    }
+  }
+
+  return namekernels::equalsIgnoreCase(this->wire().substr(at), zoneWire);
+}
+
+// hash and equality functors for unordered containers keyed on DnsName.
+// transparent, so a DnsNameView (a parent zone, say) finds its key without
+// building a DnsName
+struct DnsNameHash {
+  using is_transparent = void;
+  size_t operator()(const DnsNameView &name) const { return name.hash(); }
+};
+
+struct DnsNameEqual {
+  using is_transparent = void;
+  bool operator()(const DnsNameView &a, const DnsNameView &b) const {
+    return a == b;
+  }
+};
+
+#endif // DNS_NAME_HPP
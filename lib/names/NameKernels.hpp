@@ -0,0 +1,383 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the vectorized byte kernels behind name handling:
+ * case folding, label validation and wire <-> text conversion
+ **/
+
+#ifndef NAME_KERNELS_HPP
+#define NAME_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define DNSPUP_NAME_KERNELS_X86 1
+#endif
+
+namespace namekernels {
+
+// names are at most 255 bytes on the wire, terminator included
+// https://datatracker.ietf.org/doc/html/rfc1035#section-2.3.4
+constexpr size_t MAX_NAME_WIRE = 255;
+constexpr size_t MAX_LABEL = 63;
+
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+/**
+ * One implementation of every kernel. All of them take unaligned input of
+ * any length. The vector versions finish with one more full block that
+ * overlaps the previous one, anything shorter than a block goes to the
+ * next narrower version
+ **/
+struct Kernels {
+  SimdLevel level;
+
+  // ASCII-only lowercase of `len` bytes, `dst` may be `src`
+  void (*toLower)(const char *src, char *dst, size_t len);
+
+  // ASCII case-insensitive equality of two `len` byte ranges
+  bool (*equalsIgnoreCase)(const char *a, const char *b, size_t len);
+
+  // every byte printable ASCII that the text form can hold unescaped:
+  // 0x21-0x7E except '.' and '\'
+  bool (*labelBytesValid)(const char *data, size_t len);
+};
+
+// ----- SCALAR ------
+namespace scalar {
+
+inline char lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+inline bool labelByteValid(char c) {
+  auto byte = static_cast<uint8_t>(c);
+  return byte > 0x20 && byte < 0x7F && c != '.' && c != '\\';
+}
+
+inline void toLower(const char *src, char *dst, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    dst[i] = lower(src[i]);
+  }
+}
+
+inline bool equalsIgnoreCase(const char *a, const char *b, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (lower(a[i]) != lower(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool labelBytesValid(const char *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (!labelByteValid(data[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace scalar
+
+#ifdef DNSPUP_NAME_KERNELS_X86
+// ----- SSE2 (every x86-64 has it) ------
+// bytes >= 0x80 are negative to the signed compares, so they never count as
+// letters and always fail the printable range
+namespace sse2 {
+
+inline __m128i lower(__m128i v) {
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  return _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+inline void toLower(const char *src, char *dst, size_t len) {
+  if (len < 16) {
+    scalar::toLower(src, dst, len);
+    return;
+  }
+
+  // the last block overlaps the one before it instead of a scalar tail.
+  // loaded before anything is stored so it works in place too
+  __m128i last =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + len - 16));
+  for (size_t i = 0; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), lower(v));
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + len - 16), lower(last));
+}
+
+inline bool blockEqualsIgnoreCase(const char *a, const char *b) {
+  __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+  __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(lower(va), lower(vb))) == 0xFFFF;
+}
+
+inline bool equalsIgnoreCase(const char *a, const char *b, size_t len) {
+  if (len < 16) {
+    return scalar::equalsIgnoreCase(a, b, len);
+  }
+
+  for (size_t i = 0; i + 16 <= len; i += 16) {
+    if (!blockEqualsIgnoreCase(a + i, b + i)) {
+      return false;
+    }
+  }
+  return blockEqualsIgnoreCase(a + len - 16, b + len - 16);
+}
+
+inline bool blockValid(const char *data) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+  __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x20)),
+                                    _mm_cmplt_epi8(v, _mm_set1_epi8(0x7F)));
+  __m128i escaped = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+  return _mm_movemask_epi8(_mm_andnot_si128(escaped, printable)) == 0xFFFF;
+}
+
+inline bool labelBytesValid(const char *data, size_t len) {
+  if (len < 16) {
+    return scalar::labelBytesValid(data, len);
+  }
+
+  for (size_t i = 0; i + 16 <= len; i += 16) {
+    if (!blockValid(data + i)) {
+      return false;
+    }
+  }
+  return blockValid(data + len - 16);
+}
+
+} // namespace sse2
+
+// ----- AVX2 (picked at runtime, built without -mavx2) ------
+namespace avx2 {
+
+__attribute__((target("avx2"))) inline __m256i lower(__m256i v) {
+  __m256i upper =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+  return _mm256_add_epi8(v,
+                         _mm256_and_si256(upper, _mm256_set1_epi8('a' - 'A')));
+}
+
+__attribute__((target("avx2"))) inline void toLower(const char *src,
+                                                     char *dst, size_t len) {
+  if (len < 32) {
+    sse2::toLower(src, dst, len);
+    return;
+  }
+
+  __m256i last =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + len - 32));
+  for (size_t i = 0; i + 32 <= len; i += 32) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), lower(v));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + len - 32),
+                      lower(last));
+}
+
+__attribute__((target("avx2"))) inline bool
+blockEqualsIgnoreCase(const char *a, const char *b) {
+  __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+  __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(lower(va), lower(vb))) == -1;
+}
+
+__attribute__((target("avx2"))) inline bool
+equalsIgnoreCase(const char *a, const char *b, size_t len) {
+  if (len < 32) {
+    return sse2::equalsIgnoreCase(a, b, len);
+  }
+
+  for (size_t i = 0; i + 32 <= len; i += 32) {
+    if (!blockEqualsIgnoreCase(a + i, b + i)) {
+      return false;
+    }
+  }
+  return blockEqualsIgnoreCase(a + len - 32, b + len - 32);
+}
+
+__attribute__((target("avx2"))) inline bool blockValid(const char *data) {
+  __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+  __m256i printable =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x20)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7F), v));
+  __m256i escaped =
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+  return _mm256_movemask_epi8(_mm256_andnot_si256(escaped, printable)) == -1;
+}
+
+__attribute__((target("avx2"))) inline bool labelBytesValid(const char *data,
+                                                             size_t len) {
+  if (len < 32) {
+    return sse2::labelBytesValid(data, len);
+  }
+
+  for (size_t i = 0; i + 32 <= len; i += 32) {
+    if (!blockValid(data + i)) {
+      return false;
+    }
+  }
+  return blockValid(data + len - 32);
+}
+
+} // namespace avx2
+#endif // DNSPUP_NAME_KERNELS_X86
+
+// ----- DISPATCH ------
+inline bool supported(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Scalar:
+    return true;
+#ifdef DNSPUP_NAME_KERNELS_X86
+  case SimdLevel::SSE2:
+    return true;
+  case SimdLevel::AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+/**
+ * The kernels for `level`, the scalar ones if this CPU can't run it
+ **/
+inline const Kernels &kernelsFor(SimdLevel level) {
+  static const Kernels scalarKernels{SimdLevel::Scalar, scalar::toLower,
+                                     scalar::equalsIgnoreCase,
+                                     scalar::labelBytesValid};
+#ifdef DNSPUP_NAME_KERNELS_X86
+  static const Kernels sse2Kernels{SimdLevel::SSE2, sse2::toLower,
+                                   sse2::equalsIgnoreCase,
+                                   sse2::labelBytesValid};
+  static const Kernels avx2Kernels{SimdLevel::AVX2, avx2::toLower,
+                                   avx2::equalsIgnoreCase,
+                                   avx2::labelBytesValid};
+
+  if (supported(level)) {
+    if (level == SimdLevel::AVX2) {
+      return avx2Kernels;
+    }
+    if (level == SimdLevel::SSE2) {
+      return sse2Kernels;
+    }
+  }
+#endif
+  return scalarKernels;
+}
+
+/**
+ * Best kernels for this CPU, picked once on first use
+ **/
+inline const Kernels &kernels() {
+  static const Kernels &best = kernelsFor(
+      supported(SimdLevel::AVX2)
+          ? SimdLevel::AVX2
+          : (supported(SimdLevel::SSE2) ? SimdLevel::SSE2 : SimdLevel::Scalar));
+  return best;
+}
+
+inline void toLower(const char *src, char *dst, size_t len) {
+  kernels().toLower(src, dst, len);
+}
+
+inline bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         kernels().equalsIgnoreCase(a.data(), b.data(), a.size());
+}
+
+inline bool labelBytesValid(const char *data, size_t len) {
+  return kernels().labelBytesValid(data, len);
+}
+
+/**
+ * Dotted text for a run of uncompressed labels (length bytes included, no
+ * terminator), the caller has checked the lengths add up to `len`. Writes
+ * `len - 1` bytes to `out`. False if a label holds a byte the text form
+ * would have to escape, a '.' inside a label would otherwise read back as
+ * two labels
+ **/
+inline bool labelsToText(const uint8_t *labels, size_t len, char *out) {
+  if (len == 0) {
+    return true;
+  }
+
+  // the length bytes land where the dots go, park a byte that passes
+  // validation there so the whole run is checked in one call
+  std::memcpy(out, labels + 1, len - 1);
+  for (size_t pos = labels[0] + 1; pos < len; pos += labels[pos] + 1) {
+    out[pos - 1] = '-';
+  }
+
+  if (!labelBytesValid(out, len - 1)) {
+    return false;
+  }
+
+  for (size_t pos = labels[0] + 1; pos < len; pos += labels[pos] + 1) {
+    out[pos - 1] = '.';
+  }
+  return true;
+}
+
+/**
+ * Labels (length bytes included, no terminator) for dotted `name`, one
+ * trailing dot is allowed. `out` needs MAX_NAME_WIRE bytes. Returns the
+ * bytes written, throws on an empty or oversized label or name
+ **/
+inline size_t textToLabels(std::string_view name, uint8_t *out) {
+  if (name.ends_with('.')) {
+    name.remove_suffix(1);
+  }
+  if (name.empty()) {
+    return 0;
+  }
+
+  // labels plus the root's terminator
+  if (name.size() + 2 > MAX_NAME_WIRE) {
+    throw std::runtime_error("name exceeds 255 bytes");
+  }
+
+  // same trick the other way: copy once, then turn dots into lengths
+  std::memcpy(out + 1, name.data(), name.size());
+  size_t labelStart = 0;
+  while (true) {
+    const void *dot = std::memchr(name.data() + labelStart, '.',
+                                  name.size() - labelStart);
+    size_t labelEnd = dot == nullptr
+                          ? name.size()
+                          : static_cast<const char *>(dot) - name.data();
+
+    size_t len = labelEnd - labelStart;
+    if (len == 0) {
+      throw std::runtime_error("empty label in name");
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc1035#section-2.3.1
+    if (len > MAX_LABEL) {
+      throw std::runtime_error("single label exceeds 63 characters of length");
+    }
+
+    out[labelStart] = static_cast<uint8_t>(len);
+    if (dot == nullptr) {
+      return name.size() + 1;
+    }
+    labelStart = labelEnd + 1;
+  }
+}
+
+} // namespace namekernels
+
+#endif // NAME_KERNELS_HPP
@@ -0,0 +1,216 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the CoDel style load shedder for the dispatch queue
+ * and the event loop
+ **/
+
+#ifndef CODEL_SHEDDER_HPP
+#define CODEL_SHEDDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+
+#include "../config/OverloadConfig.hpp"
+#include "../metrics/LatencyHistogram.hpp"
+
+/**
+ * OverloadStats - what the shedder let through and what it threw away
+ **/
+struct OverloadStats {
+  std::atomic<uint64_t> admitted{0};
+  std::atomic<uint64_t> shedStanding{0};
+  std::atomic<uint64_t> shedDeadline{0};
+  std::atomic<uint64_t> shedQueueFull{0};
+  std::atomic<uint64_t> shedInFlight{0};
+  std::atomic<uint64_t> shedLate{0};
+
+  // time spent in the dispatch queue by every query a worker picked up
+  LatencyHistogram sojourn;
+
+  void print() const {
+    std::cout << "\n=== Overload Control ===\n";
+    std::cout << "Admitted: " << admitted << "\n";
+    std::cout << "Shed (standing queue): " << shedStanding << "\n";
+    std::cout << "Shed (past deadline): " << shedDeadline << "\n";
+    std::cout << "Shed (queue full): " << shedQueueFull << "\n";
+    std::cout << "Shed (too many in flight): " << shedInFlight << "\n";
+    std::cout << "Shed (answered too late): " << shedLate << "\n";
+    this->sojourn.print("Queue sojourn");
+    std::cout << "========================\n\n";
+  }
+};
+
+/**
+ * CoDelShedder decides, when a worker dequeues a query, whether it is still
+ * worth answering. It follows CoDel: a queue whose minimum delay stays above
+ * `targetSojournMs` for a whole `intervalMs` has a standing backlog, from
+ * then on queries are shed at a rate that grows with the square root of the
+ * number shed so far until the delay drops under target again. Queries
+ * older than `maxSojournMs` are shed regardless.
+ *
+ * The below-target path, which is every query on a healthy server, only
+ * touches a couple of atomics; the state machine takes a lock only while
+ * the queue is above target.
+ *
+ * With an event driven resolver the dispatch queue drains right away and
+ * the backlog builds up on the loop instead, as recursions waiting on
+ * upstream. Those are capped at `maxInFlight`, and one whose client asked
+ * more than `maxResolveMs` ago stops retrying and has its answer shed. A
+ * recursion routinely outlasts `targetSojournMs`, so there is no standing
+ * queue detection on that side.
+ **/
+class CoDelShedder {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  OverloadConfig config;
+  OverloadStats stats;
+
+  std::mutex mtx;
+  // set while above target, checked without the lock on the fast path
+  std::atomic<bool> aboveTarget{false};
+  Clock::time_point firstAboveTime{};
+  Clock::time_point dropNext{};
+  uint32_t dropCount = 0;
+  bool dropping = false;
+
+  // recursions started on the event loop and not finished yet
+  std::atomic<size_t> inFlight{0};
+
+  // gap until the next shed, interval / sqrt(dropCount)
+  Clock::duration controlLaw() const;
+
+public:
+  explicit CoDelShedder(const OverloadConfig &config_) : config(config_) {}
+
+  /**
+   * Called as a worker picks up a query queued at `enqueuedAt`, true means
+   * shed it
+   **/
+  bool shouldShed(Clock::time_point enqueuedAt);
+
+  /**
+   * The dispatch queue was full and the query never got in
+   **/
+  void recordQueueFull() {
+    this->stats.shedQueueFull.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * A recursion is about to start on the event loop, false means there are
+   * `maxInFlight` outstanding already and it should be shed. Every admitted
+   * one is handed back with finishResolution()
+   **/
+  bool admitResolution();
+
+  void finishResolution() {
+    this->inFlight.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Past this a recursion for a query received at `receivedAt` isn't worth
+   * retrying, its client has given up on it
+   **/
+  Clock::time_point resolveDeadline(Clock::time_point receivedAt) const {
+    return receivedAt + std::chrono::milliseconds(this->config.maxResolveMs);
+  }
+
+  /**
+   * Called as a recursion's answer is about to go out, true means the
+   * client stopped waiting for it and it should be shed
+   **/
+  bool shouldShedLate(Clock::time_point receivedAt);
+
+  ShedPolicy policy() const { return this->config.policy; }
+
+  const OverloadStats &getStats() const { return this->stats; }
+
+  void printStats() const { this->stats.print(); }
+};
+
+inline CoDelShedder::Clock::duration CoDelShedder::controlLaw() const {
+  auto interval = std::chrono::milliseconds(this->config.intervalMs);
+  return std::chrono::duration_cast<Clock::duration>(
+      interval / std::sqrt(static_cast<double>(this->dropCount)));
+}
+
+inline bool CoDelShedder::shouldShed(Clock::time_point enqueuedAt) {
+  auto now = Clock::now();
+  auto sojourn = now - enqueuedAt;
+  this->stats.sojourn.record(sojourn);
+
+  if (sojourn > std::chrono::milliseconds(this->config.maxSojournMs)) {
+    this->stats.shedDeadline.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  auto interval = std::chrono::milliseconds(this->config.intervalMs);
+  bool below =
+      sojourn < std::chrono::milliseconds(this->config.targetSojournMs);
+  if (below && !this->aboveTarget.load(std::memory_order_relaxed)) {
+    this->stats.admitted.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  bool shed = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if (below) {
+      // backlog drained, leave dropping state
+      this->aboveTarget = false;
+      this->dropping = false;
+    } else if (!this->aboveTarget) {
+      // start the clock, one interval of grace before we call it standing
+      this->aboveTarget = true;
+      this->firstAboveTime = now + interval;
+    } else if (!this->dropping) {
+      if (now >= this->firstAboveTime) {
+        // back in trouble soon after the last episode, pick up close to the
+        // rate that worked then instead of starting over
+        bool recent = now - this->dropNext < 16 * interval;
+        this->dropCount =
+            recent && this->dropCount > 2 ? this->dropCount - 2 : 1;
+        this->dropping = true;
+        this->dropNext = now + this->controlLaw();
+        shed = true;
+      }
+    } else if (now >= this->dropNext) {
+      this->dropCount++;
+      this->dropNext = now + this->controlLaw();
+      shed = true;
+    }
+  }
+
+  if (shed) {
+    this->stats.shedStanding.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    this->stats.admitted.fetch_add(1, std::memory_order_relaxed);
+  }
+  return shed;
+}
+
+inline bool CoDelShedder::admitResolution() {
+  if (this->inFlight.fetch_add(1, std::memory_order_relaxed) >=
+      this->config.maxInFlight) {
+    this->inFlight.fetch_sub(1, std::memory_order_relaxed);
+    this->stats.shedInFlight.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+inline bool CoDelShedder::shouldShedLate(Clock::time_point receivedAt) {
+  if (Clock::now() < this->resolveDeadline(receivedAt)) {
+    return false;
+  }
+  this->stats.shedLate.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+#endif // CODEL_SHEDDER_HPP
@@ -0,0 +1,537 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the non-blocking recursive resolver, every recursion is
+ * an explicit state machine driven by an EventLoop
+ **/
+
+#ifndef ASYNC_RESOLVER_HPP
+#define ASYNC_RESOLVER_HPP
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+
+#include "../BytePacketBuffer.hpp"
+#include "../DnsPacket.hpp"
+#include "../DnsPacketView.hpp"
+#include "../DnsQuestion.hpp"
+#include "../QueryType.hpp"
+#include "../ResultCode.hpp"
+#include "../RootServers.hpp"
+#include "../StringUtils.hpp"
+#include "../cache/ThreadSafeCache.hpp"
+#include "../common/ServerConfig.hpp"
+#include "../config/NetworkConfig.hpp"
+#include "../config/ResolverConfig.hpp"
+#include "../errors/errors.hpp"
+#include "../names/DnsName.hpp"
+#include "../io/UpstreamSocketPool.hpp"
+#include "../overload/CoDelShedder.hpp"
+#include "../security/SecurityUtils.hpp"
+#include "../tracking/TransactionTracker.hpp"
+#include "EventLoop.hpp"
+
+/**
+ * Called on the loop thread once a resolution finishes. `error` is set when
+ * the lookup failed the same way recursiveLookup would have thrown
+ **/
+using ResolveCallback =
+    std::function<void(DnsPacket &result, std::exception_ptr error)>;
+
+/**
+ * What a prefetch does once it finishes: an answer is in the cache by then,
+ * otherwise the cached one is left to be refreshed by a later hit
+ **/
+inline void finishPrefetch(ThreadSafeCache &cache, const DnsName &qname,
+                           QueryType qtype, const DnsPacket &result,
+                           std::exception_ptr error) {
+  if (error) {
+    try {
+      std::rethrow_exception(error);
+    } catch (const std::exception &e) {
+      std::cerr << "Prefetch failed: " << e.what() << std::endl;
+    }
+  }
+
+  if (error || result.header.rescode != ResultCode::NOERROR ||
+      result.answers.empty()) {
+    cache.cancelPrefetch(qname, qtype);
+  }
+}
+
+/**
+ * AsyncResolver runs the same algorithm as recursiveLookup() but never
+ * blocks: each recursion is a Resolution whose position in the algorithm
+ * (which root server, which nameserver, which retry) lives in the struct
+ * instead of on a worker's stack.
+ *
+ * Upstream replies come in on the UpstreamSocketPool receiver and are posted
+ * to the loop, timeouts and retry backoff are loop timers. A single loop
+ * thread can therefore hold as many outstanding recursions as memory allows.
+ *
+ * Cache inserts, referral handling, retries and root server metrics match
+ * recursiveLookup() step for step.
+ *
+ * Given a CoDelShedder, at most its `maxInFlight` resolutions are
+ * outstanding at once and one whose client has given up stops retrying.
+ *
+ * The loop has to outlive the UpstreamSocketPool's receiver (late replies
+ * are still posted to it), the resolver stops the loop on destruction.
+ **/
+class AsyncResolver {
+private:
+  using VisitedNames = std::unordered_set<DnsName, DnsNameHash, DnsNameEqual>;
+
+  struct Resolution {
+    DnsName qname;
+    QueryType qtype;
+    size_t depth;
+
+    // shared by a resolution and the nameserver lookups it spawns
+    std::shared_ptr<VisitedNames> visited;
+    ResolveCallback onDone;
+
+    // where we are in the root server / referral walk
+    std::optional<std::array<uint8_t, 4>> ns;
+    size_t rootIndex = 0;
+    bool prevNSTimedOut = false;
+
+    // current query to `ns` and its retries
+    int attempt = 0;
+    uint32_t retryDelayMs = 0;
+    uint16_t txnId = 0;
+    EventLoop::TimerId timer = 0;
+    std::chrono::steady_clock::time_point queryStart;
+
+    // referral we fall back to when its nameserver doesn't resolve, kept
+    // raw and only parsed if it ends up being the answer
+    BytePacketBuffer referral;
+    bool finished = false;
+
+    // a prefetch, the cached answer is what it replaces so it isn't used
+    bool refresh = false;
+
+    // holds one of the shedder's in-flight slots until it finishes
+    bool admitted = false;
+
+    // no retries past this, the client has stopped waiting. nameserver
+    // lookups inherit it
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+
+    Resolution(DnsName qname_, QueryType qtype_, size_t depth_,
+               std::shared_ptr<VisitedNames> visited_, ResolveCallback onDone_)
+        : qname(std::move(qname_)), qtype(qtype_), depth(depth_),
+          visited(std::move(visited_)), onDone(std::move(onDone_)) {}
+  };
+
+  using ResolutionPtr = std::shared_ptr<Resolution>;
+
+  EventLoop &loop;
+  ThreadSafeCache &cache;
+  TransactionTracker &tracker;
+  UpstreamSocketPool &upstream;
+  NetworkConfig &netConf;
+  CoDelShedder *shedder;
+
+  void start(const ResolutionPtr &res);
+  void nextRootServer(const ResolutionPtr &res);
+  void beginQuery(const ResolutionPtr &res);
+  void sendQuery(const ResolutionPtr &res);
+  void onTimeout(const ResolutionPtr &res, uint16_t txnId);
+  void onResponse(const ResolutionPtr &res, uint16_t txnId,
+                  BytePacketBuffer &resBuffer);
+  void handleResponse(const ResolutionPtr &res, const DnsPacketView &response,
+                      BytePacketBuffer &resBuffer);
+  void finish(const ResolutionPtr &res, DnsPacket &result);
+  void fail(const ResolutionPtr &res, std::exception_ptr error);
+
+public:
+  AsyncResolver(EventLoop &loop_, ThreadSafeCache &cache_,
+                TransactionTracker &tracker_, UpstreamSocketPool &upstream_,
+                NetworkConfig &netConf_, CoDelShedder *shedder_ = nullptr)
+      : loop(loop_), cache(cache_), tracker(tracker_), upstream(upstream_),
+        netConf(netConf_), shedder(shedder_) {}
+
+  // loop callbacks point back at us, nothing may run once we're gone
+  ~AsyncResolver() { this->loop.stop(); }
+
+  AsyncResolver(const AsyncResolver &) = delete;
+  AsyncResolver &operator=(const AsyncResolver &) = delete;
+
+  /**
+   * Start resolving `qname` for a query received at `receivedAt`, returns
+   * immediately. `onDone` runs on the loop thread. False means too many
+   * resolutions are in flight, the query should be shed and `onDone` never
+   * runs. Safe to call from any thread
+   **/
+  bool resolve(DnsName qname, QueryType qtype, ResolveCallback onDone,
+               std::chrono::steady_clock::time_point receivedAt =
+                   std::chrono::steady_clock::now());
+
+  /**
+   * Resolve `qname` past its cached answer, the result replaces it in the
+   * cache and nothing else is done with it. False means too many
+   * resolutions are in flight. Safe to call from any thread
+   **/
+  bool refresh(DnsName qname, QueryType qtype);
+};
+
+inline bool AsyncResolver::resolve(DnsName qname, QueryType qtype,
+                                   ResolveCallback onDone,
+                                   std::chrono::steady_clock::time_point
+                                       receivedAt) {
+  if (this->shedder != nullptr && !this->shedder->admitResolution()) {
+    return false;
+  }
+
+  auto res = std::make_shared<Resolution>(std::move(qname), qtype, 0,
+                                          std::make_shared<VisitedNames>(),
+                                          std::move(onDone));
+  if (this->shedder != nullptr) {
+    res->admitted = true;
+    res->deadline = this->shedder->resolveDeadline(receivedAt);
+  }
+  this->loop.post([this, res] { this->start(res); });
+  return true;
+}
+
+inline bool AsyncResolver::refresh(DnsName qname, QueryType qtype) {
+  if (this->shedder != nullptr && !this->shedder->admitResolution()) {
+    return false;
+  }
+
+  auto res = std::make_shared<Resolution>(
+      qname, qtype, 0, std::make_shared<VisitedNames>(),
+      [cache = &this->cache, qname,
+       qtype](DnsPacket &result, std::exception_ptr error) {
+        finishPrefetch(*cache, qname, qtype, result, error);
+      });
+  res->refresh = true;
+  res->admitted = this->shedder != nullptr;
+  this->loop.post([this, res] { this->start(res); });
+  return true;
+}
+
+inline void AsyncResolver::start(const ResolutionPtr &res) {
+  if (!res->visited->insert(res->qname).second) {
+    std::cerr << "Circular reference detected: " << res->qname << std::endl;
+    DnsPacket error_response;
+    error_response.header.rescode = ResultCode::SERVFAIL;
+    this->finish(res, error_response);
+    return;
+  }
+
+  // if we exceed maximum depth we'll return out
+  if (res->depth >= MAX_RECURSION_DEPTH) {
+    std::cerr << "Max recursion depth (" << MAX_RECURSION_DEPTH
+              << ") exceeded for " << res->qname << std::endl;
+    DnsPacket error_response;
+    error_response.header.rescode = ResultCode::SERVFAIL;
+    this->finish(res, error_response);
+    return;
+  }
+
+  // check main cache
+  std::optional<std::vector<DnsRecord>> cached;
+  if (!res->refresh) {
+    cached = this->cache.lookup(res->qname, res->qtype);
+  }
+  if (cached.has_value()) {
+    std::cout << "Cache HIT: " << res->qname << std::endl;
+    DnsPacket response;
+
+    if (cached->empty()) {
+      response.header.rescode = ResultCode::NXDOMAIN;
+    } else {
+      response.answers.assign(std::make_move_iterator(cached->begin()),
+                              std::make_move_iterator(cached->end()));
+      response.header.rescode = ResultCode::NOERROR;
+    }
+
+    this->finish(res, response);
+    return;
+  }
+
+  std::cout << "Cache MISS: " << res->qname << std::endl;
+
+  // try to find cached ns for this domain, then each parent domain up to
+  // the tld
+  for (DnsNameView domain = res->qname; !domain.isRoot();
+       domain = domain.parent()) {
+    res->ns = this->cache.lookupNS(domain);
+    if (res->ns.has_value()) {
+      std::cout << "NS Cache HIT for domain " << domain << " -> "
+                << stringutils::ipv4ToString(*res->ns) << std::endl;
+      break;
+    }
+  }
+
+  std::cout << "[Depth " << res->depth << "] Looking up " << res->qname
+            << std::endl;
+
+  this->nextRootServer(res);
+}
+
+inline void AsyncResolver::nextRootServer(const ResolutionPtr &res) {
+  if (res->rootIndex >= RootServerRepository::servers.size()) {
+    this->fail(res, std::make_exception_ptr(
+                        std::runtime_error("all root servers failed")));
+    return;
+  }
+
+  auto &rs = RootServerRepository::servers[res->rootIndex];
+
+  // if no cached ns found start from root
+  if (!res->ns.has_value() || res->prevNSTimedOut) {
+    // pick a root server
+    res->ns = rs.ipv4address;
+    std::cout << "=== Using root server: " << rs.hostname << " ("
+              << stringutils::ipv4ToString(rs.ipv4address) << ")"
+              << " [hits: " << rs.hits << ", timeouts: " << rs.timeoutCounts
+              << "]" << std::endl;
+  }
+
+  this->beginQuery(res);
+}
+
+inline void AsyncResolver::beginQuery(const ResolutionPtr &res) {
+  std::cout << "attempting lookup of " << fromQueryTypeToNumber(res->qtype)
+            << " " << res->qname << " with ns "
+            << stringutils::ipv4ToString(*res->ns) << "\n";
+
+  // start counter for tracking latency, spans the retries like before
+  res->queryStart = std::chrono::steady_clock::now();
+  res->attempt = 0;
+  res->retryDelayMs = this->netConf.initialRetryDelayMs;
+
+  this->sendQuery(res);
+}
+
+inline void AsyncResolver::sendQuery(const ResolutionPtr &res) {
+  // generate a new transaction id. we run on the loop, anything thrown
+  // here would be swallowed and the client left without an answer
+  uint16_t txnId = 0;
+  BytePacketBuffer reqBuffer;
+  try {
+    txnId = SecurityUtils::generateTransactionId(this->tracker);
+    writeQuery(reqBuffer, txnId, res->qname, res->qtype);
+  } catch (...) {
+    // the id is reserved once generated
+    if (txnId != 0) {
+      this->tracker.removeTxn(txnId);
+    }
+    res->txnId = 0;
+    this->fail(res, std::current_exception());
+    return;
+  }
+
+  res->txnId = txnId;
+  Server server{*res->ns, 53};
+
+  // the reply lands on the pool's receiver thread, bounce it to the loop.
+  // only the loop is touched there, the receiver can outlive the resolver
+  bool sent = this->upstream.submit(
+      txnId, res->qname, res->qtype, server, reqBuffer,
+      [loop = &this->loop, this, res, txnId](BytePacketBuffer &resBuffer) {
+        loop->post([this, res, txnId, resBuffer]() mutable {
+          this->onResponse(res, txnId, resBuffer);
+        });
+      });
+  if (!sent) {
+    res->txnId = 0;
+    this->fail(res, std::make_exception_ptr(std::runtime_error(
+                        "sendto failed: " + std::string(strerror(errno)))));
+    return;
+  }
+
+  res->timer = this->loop.runAfter(
+      std::chrono::milliseconds(this->netConf.recvTimeoutMs),
+      [this, res, txnId] { this->onTimeout(res, txnId); });
+}
+
+inline void AsyncResolver::onTimeout(const ResolutionPtr &res,
+                                     uint16_t txnId) {
+  if (res->finished || res->txnId != txnId) {
+    return;
+  }
+
+  this->upstream.cancel(txnId);
+  res->txnId = 0;
+  res->attempt++;
+
+  // the client has stopped waiting, don't keep an upstream busy for it
+  if (std::chrono::steady_clock::now() >= res->deadline) {
+    this->fail(res, std::make_exception_ptr(
+                        std::runtime_error("client stopped waiting")));
+    return;
+  }
+
+  if (res->attempt < this->netConf.maxRetries) {
+    std::cerr << "Attempt " << res->attempt << " timed out, retrying in "
+              << res->retryDelayMs << "ms..." << std::endl;
+
+    res->timer = this->loop.runAfter(
+        std::chrono::milliseconds(res->retryDelayMs), [this, res] {
+          if (!res->finished) {
+            this->sendQuery(res);
+          }
+        });
+    res->retryDelayMs *= this->netConf.backoffMultiplier;
+    return;
+  }
+
+  auto &rs = RootServerRepository::servers[res->rootIndex];
+  rs.timeoutCounts++;
+  std::cerr << "Root server " << rs.hostname << " timed out after retries"
+            << std::endl;
+  res->prevNSTimedOut = true;
+  res->rootIndex++;
+
+  this->nextRootServer(res);
+}
+
+inline void AsyncResolver::onResponse(const ResolutionPtr &res, uint16_t txnId,
+                                      BytePacketBuffer &resBuffer) {
+  // a reply that raced its own timeout, the retry already went out
+  if (res->finished || res->txnId != txnId) {
+    return;
+  }
+
+  this->loop.cancelTimer(res->timer);
+  res->txnId = 0;
+
+  std::optional<DnsPacketView> response;
+  try {
+    response.emplace(parseUpstreamReply(resBuffer));
+  } catch (...) {
+    this->fail(res, std::current_exception());
+    return;
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     end - res->queryStart)
+                     .count();
+
+  auto &rs = RootServerRepository::servers[res->rootIndex];
+  rs.avgLatency = (rs.avgLatency * rs.hits + latency) / (rs.hits + 1);
+  rs.hits++;
+
+  this->handleResponse(res, *response, resBuffer);
+}
+
+inline void AsyncResolver::handleResponse(const ResolutionPtr &res,
+                                          const DnsPacketView &response,
+                                          BytePacketBuffer &resBuffer) {
+  // if entries in answer section and no errors we are done
+  if (response.answerCount() > 0 &&
+      response.rescode() == ResultCode::NOERROR) {
+    DnsPacket result = response.toPacket();
+    this->cache.insert(res->qname, res->qtype, result.answers);
+    this->finish(res, result);
+    return;
+  }
+
+  // exit if NXDOMAIN
+  if (response.rescode() == ResultCode::NXDOMAIN) {
+    this->cache.insertNegative(res->qname, res->qtype, ResultCode::NXDOMAIN,
+                               300);
+    DnsPacket result = response.toPacket();
+    this->finish(res, result);
+    return;
+  }
+
+  // exit if SERVFAIL. a failed refresh leaves the answer it was refreshing
+  // in place
+  if (response.rescode() == ResultCode::SERVFAIL) {
+    if (!res->refresh) {
+      this->cache.insertNegative(res->qname, res->qtype, ResultCode::SERVFAIL,
+                                 300);
+    }
+    DnsPacket result = response.toPacket();
+    this->finish(res, result);
+    return;
+  }
+
+  // cache NS records from authority section that came with glue (a records
+  // for the ns in the additional section)
+  response.forEachGlue(res->qname, [this](const NameView &domain,
+                                          const RecordView &glue) {
+    DnsName zone = domain.toName();
+    this->cache.insertNS(zone, glue.ipv4(), glue.ttl);
+    std::cout << "Cached NS: " << zone << " -> "
+              << stringutils::ipv4ToString(glue.ipv4()) << std::endl;
+  });
+
+  auto resolvedNs = response.getResolvedNs(res->qname);
+  if (resolvedNs.has_value()) {
+    res->ns = resolvedNs;
+    this->beginQuery(res);
+    return;
+  }
+
+  auto unresolvedNs = response.getUnresolvedNs(res->qname);
+  if (!unresolvedNs.has_value()) {
+    DnsPacket result = response.toPacket();
+    this->finish(res, result);
+    return;
+  }
+
+  // resolve the nameserver's address first, then carry on from here
+  res->referral = resBuffer;
+  auto child = std::make_shared<Resolution>(
+      std::move(*unresolvedNs), A{}, res->depth + 1, res->visited,
+      [this, res](DnsPacket &recursiveResponse, std::exception_ptr error) {
+        if (error) {
+          this->fail(res, error);
+          return;
+        }
+
+        auto newNs = recursiveResponse.getRandomA();
+        if (newNs.has_value()) {
+          res->ns = newNs;
+          this->beginQuery(res);
+        } else {
+          DnsPacket result = DnsPacketView(res->referral).toPacket();
+          this->finish(res, result);
+        }
+      });
+  child->deadline = res->deadline;
+  this->start(child);
+}
+
+inline void AsyncResolver::finish(const ResolutionPtr &res,
+                                  DnsPacket &result) {
+  res->finished = true;
+  if (res->admitted) {
+    this->shedder->finishResolution();
+  }
+  res->onDone(result, nullptr);
+}
+
+inline void AsyncResolver::fail(const ResolutionPtr &res,
+                                std::exception_ptr error) {
+  res->finished = true;
+  if (res->admitted) {
+    this->shedder->finishResolution();
+  }
+  DnsPacket empty;
+  res->onDone(empty, error);
+}
+
+#endif // ASYNC_RESOLVER_HPP
@@ -0,0 +1,140 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the awaitables the coroutine resolver suspends on
+ **/
+
+#ifndef AWAITABLES_HPP
+#define AWAITABLES_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "../BytePacketBuffer.hpp"
+#include "../QueryType.hpp"
+#include "../common/ServerConfig.hpp"
+#include "../errors/errors.hpp"
+#include "../io/UpstreamSocketPool.hpp"
+#include "../names/DnsName.hpp"
+#include "EventLoop.hpp"
+
+/**
+ * co_await UpstreamExchange{...} sends `request` over the upstream pool and
+ * suspends until either the matching reply or `timeoutMs` arrives. Both are
+ * delivered on the event loop thread, whichever comes first resumes the
+ * coroutine and the other one is ignored. Resumes with the reply, throws
+ * TimeoutException on timeout. Must be awaited from the loop thread
+ **/
+class UpstreamExchange {
+private:
+  // outlives the awaiting frame, the losing event may still show up later
+  struct State {
+    std::coroutine_handle<> waiting;
+    bool done = false;
+    bool timedOut = false;
+    EventLoop::TimerId timer = 0;
+    BytePacketBuffer response;
+  };
+
+  EventLoop &loop;
+  UpstreamSocketPool &upstream;
+  uint16_t txnId;
+  // owned by the awaiting frame, which outlives the co_await
+  const DnsName &qname;
+  QueryType qtype;
+  Server server;
+  BytePacketBuffer &request;
+  uint32_t timeoutMs;
+
+  std::shared_ptr<State> state = std::make_shared<State>();
+  bool sendFailed = false;
+  int sendErrno = 0;
+
+public:
+  UpstreamExchange(EventLoop &loop_, UpstreamSocketPool &upstream_,
+                   uint16_t txnId_, const DnsName &qname_, QueryType qtype_,
+                   Server server_, BytePacketBuffer &request_,
+                   uint32_t timeoutMs_)
+      : loop(loop_), upstream(upstream_), txnId(txnId_),
+        qname(qname_), qtype(qtype_), server(server_),
+        request(request_), timeoutMs(timeoutMs_) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    auto state = this->state;
+    state->waiting = handle;
+
+    // the reply comes in on the pool's receiver thread, hop onto the loop
+    bool sent = this->upstream.submit(
+        this->txnId, this->qname, this->qtype, this->server, this->request,
+        [loop = &this->loop, state](BytePacketBuffer &resBuffer) {
+          loop->post([loop, state, resBuffer] {
+            if (state->done) {
+              return;
+            }
+            state->done = true;
+            loop->cancelTimer(state->timer);
+            state->response = resBuffer;
+            state->waiting.resume();
+          });
+        });
+    if (!sent) {
+      this->sendFailed = true;
+      this->sendErrno = errno;
+      return false;
+    }
+
+    state->timer = this->loop.runAfter(
+        std::chrono::milliseconds(this->timeoutMs),
+        [upstream = &this->upstream, state, txnId = this->txnId] {
+          if (state->done) {
+            return;
+          }
+          state->done = true;
+          state->timedOut = true;
+          upstream->cancel(txnId);
+          state->waiting.resume();
+        });
+    return true;
+  }
+
+  BytePacketBuffer await_resume() {
+    if (this->sendFailed) {
+      throw std::runtime_error("sendto failed: " +
+                               std::string(strerror(this->sendErrno)));
+    }
+
+    if (this->state->timedOut) {
+      throw TimeoutException("DNS query timed out");
+    }
+
+    this->state->response.seek(0);
+    return this->state->response;
+  }
+};
+
+/**
+ * co_await SleepFor{loop, delay} resumes the coroutine on the loop thread
+ * once `delay` has passed, without blocking the thread
+ **/
+struct SleepFor {
+  EventLoop &loop;
+  std::chrono::milliseconds delay;
+
+  bool await_ready() const noexcept { return this->delay.count() <= 0; }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    this->loop.runAfter(this->delay, [handle] { handle.resume(); });
+  }
+
+  void await_resume() const noexcept {}
+};
+
+#endif // AWAITABLES_HPP
@@ -0,0 +1,136 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the coroutine based recursive resolver
+ **/
+
+#ifndef CORO_RESOLVER_HPP
+#define CORO_RESOLVER_HPP
+
+#include <chrono>
+#include <exception>
+#include <string>
+#include <utility>
+
+#include "../Core.hpp"
+#include "../DnsPacket.hpp"
+#include "../QueryType.hpp"
+#include "../cache/ThreadSafeCache.hpp"
+#include "../config/NetworkConfig.hpp"
+#include "../io/UpstreamSocketPool.hpp"
+#include "../names/DnsName.hpp"
+#include "../overload/CoDelShedder.hpp"
+#include "../tracking/TransactionTracker.hpp"
+#include "AsyncResolver.hpp"
+#include "EventLoop.hpp"
+#include "Task.hpp"
+
+/**
+ * CoroResolver runs recursiveLookupCo() on an EventLoop. Every query is a
+ * coroutine suspended on its upstream exchange, so concurrency is bounded
+ * by memory (frames come from the loop thread's FramePool) rather than by
+ * the number of threads.
+ *
+ * Same interface as AsyncResolver, including the in-flight cap and client
+ * deadline when given a CoDelShedder. As there, the loop has to outlive the
+ * UpstreamSocketPool's receiver and the resolver stops it on destruction;
+ * coroutines still suspended at that point are never resumed.
+ **/
+class CoroResolver {
+private:
+  EventLoop &loop;
+  ThreadSafeCache &cache;
+  TransactionTracker &tracker;
+  UpstreamSocketPool &upstream;
+  NetworkConfig &netConf;
+  CoDelShedder *shedder;
+
+  // every run holds one of the shedder's in-flight slots
+  static DetachedTask run(CoroResolver *self, DnsName qname,
+                          QueryType qtype, ResolveCallback onDone,
+                          CacheUse use = CacheUse::Answer,
+                          std::chrono::steady_clock::time_point deadline =
+                              std::chrono::steady_clock::time_point::max());
+
+public:
+  CoroResolver(EventLoop &loop_, ThreadSafeCache &cache_,
+               TransactionTracker &tracker_, UpstreamSocketPool &upstream_,
+               NetworkConfig &netConf_, CoDelShedder *shedder_ = nullptr)
+      : loop(loop_), cache(cache_), tracker(tracker_), upstream(upstream_),
+        netConf(netConf_), shedder(shedder_) {}
+
+  ~CoroResolver() { this->loop.stop(); }
+
+  CoroResolver(const CoroResolver &) = delete;
+  CoroResolver &operator=(const CoroResolver &) = delete;
+
+  /**
+   * Start resolving `qname` for a query received at `receivedAt`, returns
+   * immediately. `onDone` runs on the loop thread. False means too many
+   * resolutions are in flight, the query should be shed and `onDone` never
+   * runs. Safe to call from any thread
+   **/
+  bool resolve(DnsName qname, QueryType qtype, ResolveCallback onDone,
+               std::chrono::steady_clock::time_point receivedAt =
+                   std::chrono::steady_clock::now()) {
+    if (this->shedder != nullptr && !this->shedder->admitResolution()) {
+      return false;
+    }
+
+    auto deadline = this->shedder != nullptr
+                        ? this->shedder->resolveDeadline(receivedAt)
+                        : std::chrono::steady_clock::time_point::max();
+    this->loop.post([this, qname = std::move(qname), qtype,
+                     onDone = std::move(onDone), deadline]() mutable {
+      run(this, std::move(qname), qtype, std::move(onDone), CacheUse::Answer,
+          deadline);
+    });
+    return true;
+  }
+
+  /**
+   * Resolve `qname` past its cached answer, the result replaces it in the
+   * cache and nothing else is done with it. False means too many
+   * resolutions are in flight. Safe to call from any thread
+   **/
+  bool refresh(DnsName qname, QueryType qtype) {
+    if (this->shedder != nullptr && !this->shedder->admitResolution()) {
+      return false;
+    }
+
+    this->loop.post([this, qname = std::move(qname), qtype]() mutable {
+      ResolveCallback onDone = [cache = &this->cache, qname,
+                                qtype](DnsPacket &result,
+                                       std::exception_ptr error) {
+        finishPrefetch(*cache, qname, qtype, result, error);
+      };
+      run(this, std::move(qname), qtype, std::move(onDone),
+          CacheUse::Refresh);
+    });
+    return true;
+  }
+};
+
+inline DetachedTask CoroResolver::run(CoroResolver *self, DnsName qname,
+                                      QueryType qtype, ResolveCallback onDone,
+                                      CacheUse use,
+                                      std::chrono::steady_clock::time_point
+                                          deadline) {
+  DnsPacket result;
+  std::exception_ptr error;
+  try {
+    result = co_await recursiveLookupCo(std::move(qname), qtype, self->cache,
+                                        self->netConf, self->tracker,
+                                        self->upstream, self->loop, 0,
+                                        nullptr, use, deadline);
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  if (self->shedder != nullptr) {
+    self->shedder->finishResolution();
+  }
+  onDone(result, error);
+}
+
+#endif // CORO_RESOLVER_HPP
@@ -0,0 +1,294 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the single threaded event loop that drives the
+ * non-blocking resolver
+ **/
+
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else
+#include <poll.h>
+#endif
+
+/**
+ * EventLoop owns one thread that runs callbacks posted from other threads
+ * and timers scheduled from the loop itself. The thread sleeps in
+ * epoll_wait (poll on non-Linux) on a wakeup fd, with the timeout set to
+ * the nearest timer deadline.
+ *
+ * Everything that runs on the loop runs on the same thread, so state only
+ * touched from loop callbacks needs no locking.
+ **/
+class EventLoop {
+public:
+  using Clock = std::chrono::steady_clock;
+  using Callback = std::function<void()>;
+  using TimerId = uint64_t;
+
+private:
+  // callbacks handed over by other threads
+  std::mutex postedMtx;
+  std::vector<Callback> posted;
+
+  // timers ordered by deadline, plus an index so cancel doesn't have to scan
+  using TimerQueue =
+      std::multimap<Clock::time_point, std::pair<TimerId, Callback>>;
+  TimerQueue timers;
+  std::unordered_map<TimerId, TimerQueue::iterator> timerIndex;
+  TimerId nextTimerId = 1;
+
+#ifdef __linux__
+  int epollFd = -1;
+  int wakeFd = -1;
+#else
+  int wakePipe[2] = {-1, -1};
+#endif
+
+  // runs once per iteration after the ready work is done, right before the
+  // loop goes back to sleep
+  std::function<void()> onIdle;
+
+  std::atomic<bool> _thread__running{false};
+  std::jthread loopThread;
+
+  void wake();
+  void drainWake();
+  int waitTimeoutMs() const;
+  void runPosted();
+  void runTimers();
+  void _thread__run();
+
+public:
+  explicit EventLoop(std::function<void()> onIdle_ = nullptr);
+  ~EventLoop();
+
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  /**
+   * Run `callback` on the loop thread. Safe to call from any thread
+   **/
+  void post(Callback callback);
+
+  /**
+   * Run `callback` on the loop thread once `delay` has passed. Loop thread
+   * only
+   **/
+  TimerId runAfter(std::chrono::milliseconds delay, Callback callback);
+
+  /**
+   * Drop a timer that hasn't fired yet, unknown ids are ignored. Loop
+   * thread only
+   **/
+  void cancelTimer(TimerId id);
+
+  /**
+   * Stop the loop and join its thread, whatever is still queued is dropped.
+   * Posting afterwards is harmless but nothing runs again
+   **/
+  void stop();
+
+  bool inLoopThread() const {
+    return std::this_thread::get_id() == this->loopThread.get_id();
+  }
+};
+
+inline EventLoop::EventLoop(std::function<void()> onIdle_)
+    : onIdle(std::move(onIdle_)) {
+#ifdef __linux__
+  this->epollFd = epoll_create1(EPOLL_CLOEXEC);
+  this->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (this->epollFd < 0 || this->wakeFd < 0) {
+    if (this->epollFd >= 0) {
+      close(this->epollFd);
+    }
+    if (this->wakeFd >= 0) {
+      close(this->wakeFd);
+    }
+    throw std::runtime_error("failed to set up event loop");
+  }
+
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = this->wakeFd;
+  epoll_ctl(this->epollFd, EPOLL_CTL_ADD, this->wakeFd, &ev);
+#else
+  if (pipe(this->wakePipe) < 0) {
+    throw std::runtime_error("failed to set up event loop");
+  }
+#endif
+
+  this->_thread__running = true;
+  this->loopThread = std::jthread(&EventLoop::_thread__run, this);
+}
+
+inline EventLoop::~EventLoop() {
+  this->stop();
+
+#ifdef __linux__
+  close(this->wakeFd);
+  close(this->epollFd);
+#else
+  close(this->wakePipe[0]);
+  close(this->wakePipe[1]);
+#endif
+}
+
+inline void EventLoop::stop() {
+  this->_thread__running = false;
+  this->wake();
+
+  if (this->loopThread.joinable()) {
+    this->loopThread.join();
+  }
+}
+
+inline void EventLoop::wake() {
+#ifdef __linux__
+  uint64_t one = 1;
+  ssize_t _ = write(this->wakeFd, &one, sizeof(one));
+#else
+  char byte = 0;
+  ssize_t _ = write(this->wakePipe[1], &byte, 1);
+#endif
+  (void)_;
+}
+
+inline void EventLoop::drainWake() {
+#ifdef __linux__
+  uint64_t count;
+  ssize_t _ = read(this->wakeFd, &count, sizeof(count));
+  (void)_;
+#else
+  char bytes[64];
+  while (true) {
+    struct pollfd pfd = {this->wakePipe[0], POLLIN, 0};
+    if (poll(&pfd, 1, 0) <= 0 ||
+        read(this->wakePipe[0], bytes, sizeof(bytes)) <= 0) {
+      break;
+    }
+  }
+#endif
+}
+
+inline void EventLoop::post(Callback callback) {
+  bool wasEmpty;
+  {
+    std::lock_guard<std::mutex> lock(this->postedMtx);
+    wasEmpty = this->posted.empty();
+    this->posted.push_back(std::move(callback));
+  }
+
+  // one wakeup covers everything queued before the loop drains
+  if (wasEmpty) {
+    this->wake();
+  }
+}
+
+inline EventLoop::TimerId EventLoop::runAfter(std::chrono::milliseconds delay,
+                                              Callback callback) {
+  TimerId id = this->nextTimerId++;
+  auto it = this->timers.emplace(Clock::now() + delay,
+                                 std::make_pair(id, std::move(callback)));
+  this->timerIndex.emplace(id, it);
+  return id;
+}
+
+inline void EventLoop::cancelTimer(TimerId id) {
+  auto it = this->timerIndex.find(id);
+  if (it == this->timerIndex.end()) {
+    return;
+  }
+
+  this->timers.erase(it->second);
+  this->timerIndex.erase(it);
+}
+
+inline int EventLoop::waitTimeoutMs() const {
+  if (this->timers.empty()) {
+    return 1000;
+  }
+
+  auto untilNext = std::chrono::ceil<std::chrono::milliseconds>(
+      this->timers.begin()->first - Clock::now());
+  return static_cast<int>(std::clamp<int64_t>(untilNext.count(), 0, 1000));
+}
+
+inline void EventLoop::runPosted() {
+  std::vector<Callback> ready;
+  {
+    std::lock_guard<std::mutex> lock(this->postedMtx);
+    ready.swap(this->posted);
+  }
+
+  for (auto &callback : ready) {
+    try {
+      callback();
+    } catch (const std::exception &e) {
+      std::cerr << "Event loop callback exception: " << e.what() << std::endl;
+    }
+  }
+}
+
+inline void EventLoop::runTimers() {
+  auto now = Clock::now();
+  while (!this->timers.empty() && this->timers.begin()->first <= now) {
+    auto it = this->timers.begin();
+    Callback callback = std::move(it->second.second);
+    this->timerIndex.erase(it->second.first);
+    this->timers.erase(it);
+
+    try {
+      callback();
+    } catch (const std::exception &e) {
+      std::cerr << "Event loop timer exception: " << e.what() << std::endl;
+    }
+  }
+}
+
+inline void EventLoop::_thread__run() {
+  while (this->_thread__running) {
+    int timeoutMs = this->waitTimeoutMs();
+
+#ifdef __linux__
+    struct epoll_event ev;
+    int ready = epoll_wait(this->epollFd, &ev, 1, timeoutMs);
+#else
+    struct pollfd pfd = {this->wakePipe[0], POLLIN, 0};
+    int ready = poll(&pfd, 1, timeoutMs);
+#endif
+    if (ready > 0) {
+      this->drainWake();
+    }
+
+    this->runPosted();
+    this->runTimers();
+
+    if (this->onIdle) {
+      this->onIdle();
+    }
+  }
+}
+
+#endif // EVENT_LOOP_HPP
@@ -0,0 +1,96 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the per-thread allocator for coroutine frames
+ **/
+
+#ifndef FRAME_POOL_HPP
+#define FRAME_POOL_HPP
+
+#include <array>
+#include <cstddef>
+#include <new>
+
+/**
+ * FramePool hands out coroutine frames from per-thread free lists, one list
+ * per 64 byte size class. A frame that is freed goes back on the list of the
+ * thread freeing it and is reused by the next coroutine of that size, so
+ * once the resolver warms up a lookup doesn't touch the global allocator.
+ *
+ * Frames bigger than the largest class go straight to operator new.
+ **/
+class FramePool {
+private:
+  static constexpr size_t GRANULARITY = 64;
+  static constexpr size_t NUM_CLASSES = 64; // up to 4KiB
+
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  struct FreeLists {
+    std::array<FreeBlock *, NUM_CLASSES> heads{};
+
+    ~FreeLists() {
+      for (auto *head : heads) {
+        while (head != nullptr) {
+          FreeBlock *next = head->next;
+          ::operator delete(head);
+          head = next;
+        }
+      }
+    }
+  };
+
+  static FreeLists &lists() {
+    static thread_local FreeLists freeLists;
+    return freeLists;
+  }
+
+  static size_t sizeClass(size_t size) {
+    return (size + GRANULARITY - 1) / GRANULARITY - 1;
+  }
+
+public:
+  static void *allocate(size_t size) {
+    size_t cls = sizeClass(size);
+    if (cls >= NUM_CLASSES) {
+      return ::operator new(size);
+    }
+
+    auto &head = lists().heads[cls];
+    if (head != nullptr) {
+      FreeBlock *block = head;
+      head = block->next;
+      return block;
+    }
+
+    return ::operator new((cls + 1) * GRANULARITY);
+  }
+
+  static void deallocate(void *ptr, size_t size) noexcept {
+    size_t cls = sizeClass(size);
+    if (cls >= NUM_CLASSES) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    auto *block = static_cast<FreeBlock *>(ptr);
+    auto &head = lists().heads[cls];
+    block->next = head;
+    head = block;
+  }
+};
+
+/**
+ * Mixed into a coroutine promise so its frame comes from FramePool
+ **/
+struct FramePoolAllocated {
+  static void *operator new(size_t size) { return FramePool::allocate(size); }
+
+  static void operator delete(void *ptr, size_t size) noexcept {
+    FramePool::deallocate(ptr, size);
+  }
+};
+
+#endif // FRAME_POOL_HPP
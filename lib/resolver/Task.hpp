@@ -0,0 +1,125 @@
+/**
+ * Author: frostzt
+ *
+ * This file contains the coroutine types used by the coroutine resolver
+ **/
+
+#ifndef TASK_HPP
+#define TASK_HPP
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <utility>
+
+#include "FramePool.hpp"
+
+/**
+ * Task<T> is a lazily started coroutine producing a T. Nothing runs until
+ * the task is co_await-ed, the awaiting coroutine is resumed (by symmetric
+ * transfer, so deep chains don't grow the stack) once the task returns or
+ * throws. Exceptions are rethrown at the co_await.
+ **/
+template <typename T> class Task {
+public:
+  struct promise_type : FramePoolAllocated {
+    std::optional<T> value;
+    std::exception_ptr error;
+    std::coroutine_handle<> continuation;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    auto final_suspend() noexcept {
+      struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+          auto continuation = handle.promise().continuation;
+          return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+      };
+      return FinalAwaiter{};
+    }
+
+    void return_value(T result) { this->value.emplace(std::move(result)); }
+
+    void unhandled_exception() { this->error = std::current_exception(); }
+  };
+
+private:
+  std::coroutine_handle<promise_type> handle;
+
+public:
+  explicit Task(std::coroutine_handle<promise_type> handle_)
+      : handle(handle_) {}
+
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (this->handle) {
+        this->handle.destroy();
+      }
+      this->handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() {
+    if (this->handle) {
+      this->handle.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    this->handle.promise().continuation = awaiting;
+    return this->handle;
+  }
+
+  T await_resume() {
+    auto &promise = this->handle.promise();
+    if (promise.error) {
+      std::rethrow_exception(promise.error);
+    }
+    return std::move(*promise.value);
+  }
+};
+
+/**
+ * Fire and forget coroutine, starts right away and frees its own frame when
+ * it finishes. Used to hang a Task off the event loop without anyone
+ * awaiting it
+ **/
+struct DetachedTask {
+  struct promise_type : FramePoolAllocated {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+
+    void unhandled_exception() {
+      try {
+        std::rethrow_exception(std::current_exception());
+      } catch (const std::exception &e) {
+        std::cerr << "Detached task exception: " << e.what() << std::endl;
+      }
+    }
+  };
+};
+
+#endif // TASK_HPP
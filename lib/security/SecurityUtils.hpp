@@ -1,6 +1,7 @@
 #ifndef SECURITY_UTILS_HPP
 #define SECURITY_UTILS_HPP
 
+#include <atomic>
 #include <cstdint>
 #include <random>
 #include <stdexcept>
@@ -9,27 +10,32 @@
 
 class SecurityUtils {
 private:
-  static size_t collisions;
-  static std::mt19937 gen;
-  static std::random_device rd;
-  static std::uniform_int_distribution<uint16_t> dist;
+  static std::atomic<size_t> collisions;
+
+  // every worker, loop and coroutine picks ids, each thread has its own
+  static std::mt19937 &generator() {
+    thread_local std::mt19937 gen(std::random_device{}());
+    return gen;
+  }
 
 public:
+  /**
+   * A random id, reserved in `tracker` so no other query can pick it until
+   * it is registered and retired (or removed)
+   **/
   static uint16_t generateTransactionId(TransactionTracker &tracker) {
+    std::uniform_int_distribution<uint16_t> dist(1, 65535);
     for (int attempt = 0; attempt < 5; attempt++) {
-      uint16_t id = dist(gen);
-      if (!tracker.checkTxnId(id)) {
+      uint16_t id = dist(generator());
+      if (tracker.reserveTxnId(id)) {
         return id;
       }
-      collisions++;
+      collisions.fetch_add(1, std::memory_order_relaxed);
     }
     throw std::runtime_error("too many txnId collisions occurred");
   }
 };
 
-inline size_t SecurityUtils::collisions = 0;
-inline std::random_device SecurityUtils::rd;
-inline std::mt19937 SecurityUtils::gen(rd());
-inline std::uniform_int_distribution<uint16_t> SecurityUtils::dist(1, 65535);
+inline std::atomic<size_t> SecurityUtils::collisions{0};
 
 #endif // SECURITY_UTILS_HPP
@@ -1,22 +1,47 @@
 #ifndef TRANSACTION_TRACKER_HPP
 #define TRANSACTION_TRACKER_HPP
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <cstdint>
 #include <ctime>
+#include <functional>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
+#include "../BytePacketBuffer.hpp"
+#include "../DnsHeader.hpp"
+#include "../DnsQuestion.hpp"
 #include "../QueryType.hpp"
 #include "../common/ServerConfig.hpp"
+#include "../names/DnsName.hpp"
+#include "../names/NameKernels.hpp"
+
+// called with the raw response once it has been matched to its transaction
+using TxnCallback = std::function<void(BytePacketBuffer &)>;
+
+// outcome of matching an upstream response against the in-flight set
+enum class TxnMatch {
+  Matched,
+  // no transaction with this id (late, duplicate or guessed)
+  Unknown,
+  // id is in flight but server, port or question don't line up
+  Mismatched,
+};
 
 struct Transaction {
   uint16_t id;
-  std::string qname;
+  DnsName qname;
   QueryType qtype;
   Server server;
   std::chrono::time_point<std::chrono::steady_clock> sentAt;
+  TxnCallback onResponse;
+
+  // id picked by generateTransactionId, not sent yet
+  bool reserved = false;
 
   bool isExpired(uint32_t timeoutMs) const {
     auto now = std::chrono::steady_clock::now();
@@ -32,9 +57,18 @@ private:
   mutable std::mutex mtx;
 
 public:
-  uint16_t registerTxn(uint16_t id, const std::string &qname, QueryType qtype,
-                       const Server &server);
+  // claim `id` for a query about to be built, false if it is taken
+  bool reserveTxnId(uint16_t id);
+
+  // fill in `id`, free or reserved. false if another query has it in
+  // flight, that one is left alone
+  bool registerTxn(uint16_t id, const DnsName &qname, QueryType qtype,
+                   const Server &server, TxnCallback onResponse = nullptr);
   bool checkTxnId(uint16_t) const;
+
+  // match a response by (server, port, txn id, question), on success the
+  // txn is removed and its callback runs on the calling thread
+  TxnMatch completeTxn(const Server &from, BytePacketBuffer &response);
   void removeTxn(uint16_t id);
   void cleanup(uint32_t timeoutMs);
 };
@@ -44,23 +78,96 @@ inline bool TransactionTracker::checkTxnId(uint16_t txnId) const {
   return this->inFlight.contains(txnId);
 }
 
-inline uint16_t TransactionTracker::registerTxn(uint16_t id,
-                                                const std::string &qname,
-                                                QueryType qtype,
-                                                const Server &server) {
+inline bool TransactionTracker::reserveTxnId(uint16_t id) {
+  std::lock_guard<std::mutex> lock(this->mtx);
+  auto [it, inserted] = this->inFlight.try_emplace(id);
+  if (inserted) {
+    it->second.id = id;
+    it->second.sentAt = std::chrono::steady_clock::now();
+    it->second.reserved = true;
+  }
+  return inserted;
+}
+
+inline bool TransactionTracker::registerTxn(uint16_t id, const DnsName &qname,
+                                            QueryType qtype,
+                                            const Server &server,
+                                            TxnCallback onResponse) {
   std::unique_lock<std::mutex> lock(this->mtx);
 
-  // construct txn
-  Transaction thisTxn;
+  // never overwrite a query that is waiting on this id
+  auto [it, inserted] = this->inFlight.try_emplace(id);
+  if (!inserted && !it->second.reserved) {
+    return false;
+  }
+
+  Transaction &thisTxn = it->second;
   thisTxn.id = id;
   thisTxn.qname = qname;
   thisTxn.qtype = qtype;
   thisTxn.server = server;
   thisTxn.sentAt = std::chrono::steady_clock::now();
+  thisTxn.onResponse = std::move(onResponse);
+  thisTxn.reserved = false;
+  return true;
+}
 
-  // insert the txn
-  this->inFlight[id] = thisTxn;
-  return thisTxn.id;
+inline TxnMatch TransactionTracker::completeTxn(const Server &from,
+                                                BytePacketBuffer &response) {
+  // pull the id and question out before taking the lock, the name stays in
+  // wire form
+  uint16_t id;
+  uint16_t qtype = 0;
+  uint8_t qname[namekernels::MAX_NAME_WIRE];
+  size_t qnameLength = 0;
+  try {
+    DnsHeader header;
+    response.seek(0);
+    header.read(response);
+    id = header.id;
+
+    if (header.questions > 0) {
+      qnameLength = response.readWireName(qname);
+      qtype = *response.readU16();
+    }
+  } catch (const std::exception &e) {
+    response.seek(0);
+    return TxnMatch::Unknown;
+  }
+  response.seek(0);
+
+  TxnCallback callback;
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    auto it = this->inFlight.find(id);
+    if (it == this->inFlight.end() || it->second.reserved) {
+      return TxnMatch::Unknown;
+    }
+
+    const Transaction &txn = it->second;
+    if (txn.server.s_addr != from.s_addr ||
+        txn.server.s_port != from.s_port) {
+      return TxnMatch::Mismatched;
+    }
+
+    // names are case-insensitive (ours is lowercase already, the reply's
+    // may not be), the qtype has to match exactly
+    if (qnameLength == 0 || qtype != fromQueryTypeToNumber(txn.qtype) ||
+        !namekernels::equalsIgnoreCase(
+            std::string_view(reinterpret_cast<const char *>(qname),
+                             qnameLength),
+            txn.qname.wire())) {
+      return TxnMatch::Mismatched;
+    }
+
+    callback = std::move(it->second.onResponse);
+    this->inFlight.erase(it);
+  }
+
+  if (callback) {
+    callback(response);
+  }
+  return TxnMatch::Matched;
 }
 
 inline void TransactionTracker::removeTxn(uint16_t id) {
@@ -1,5 +1,5 @@
 #include "../../lib/security/SecurityUtils.hpp"
-#include "../catch.hpp"
+#include "../unit/catch.hpp"
 
 TEST_CASE("Basic tests for random number generation", "[security]") {
   SECTION("generates a random number") {
@@ -0,0 +1,152 @@
+#include "../../lib/Core.hpp"
+#include "../../lib/resolver/AsyncResolver.hpp"
+#include "../../lib/resolver/CoroResolver.hpp"
+#include "catch.hpp"
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("AsyncResolver finishes a resolution it can't send", "[resolver]") {
+  // the loop outlives the pool's receiver
+  EventLoop loop;
+  ThreadSafeCache cache;
+  TransactionTracker tracker;
+  UpstreamSocketPool upstream(tracker, 1);
+  NetworkConfig netConf;
+  AsyncResolver resolver(loop, cache, tracker, upstream, netConf);
+
+  // every id is taken, picking one for the query throws
+  for (uint32_t id = 1; id <= 65535; id++) {
+    tracker.reserveTxnId(static_cast<uint16_t>(id));
+  }
+
+  std::promise<bool> failed;
+  resolver.resolve(DnsName("example.com"), A{},
+                   [&failed](DnsPacket &, std::exception_ptr error) {
+                     failed.set_value(error != nullptr);
+                   });
+
+  auto result = failed.get_future();
+  REQUIRE(result.wait_for(std::chrono::seconds(2)) ==
+          std::future_status::ready);
+  REQUIRE(result.get());
+}
+
+TEST_CASE("A refresh that doesn't land can be asked for again",
+          "[resolver]") {
+  ThreadSafeCache cache(CacheConfig(60, 86400, 100, size_t{1} << 20, true, 1,
+                                    EvictionPolicy::Sieve, 256, 100, 1));
+  DnsName qname("hot.example.com");
+  cache.insert(qname, A{},
+               std::vector<DnsRecord>{
+                   ARecord{"hot.example.com", {192, 0, 2, 1}, 300}});
+
+  int asked = 0;
+  cache.setPrefetcher([&asked](const DnsName &, QueryType) {
+    asked++;
+    return true;
+  });
+
+  cache.lookup(qname, A{});
+  cache.lookup(qname, A{});
+  REQUIRE(asked == 1);
+
+  SECTION("it failed") {
+    DnsPacket empty;
+    finishPrefetch(cache, qname, A{}, empty,
+                   std::make_exception_ptr(std::runtime_error("timed out")));
+    cache.lookup(qname, A{});
+    REQUIRE(asked == 2);
+  }
+
+  SECTION("it came back without an answer") {
+    DnsPacket servfail;
+    servfail.header.rescode = ResultCode::SERVFAIL;
+    finishPrefetch(cache, qname, A{}, servfail, nullptr);
+    cache.lookup(qname, A{});
+    REQUIRE(asked == 2);
+  }
+}
+
+// four queries against an upstream that never answers, two fit under the cap
+template <typename Resolver> static void shedWhileUpstreamStalls() {
+  // nothing listens on the loopback port 53, every query times out
+  auto roots = RootServerRepository::servers;
+  RootServerRepository::servers = {RootServer{"stalled", {127, 0, 0, 1}}};
+
+  std::mutex mtx;
+  std::vector<ResultCode> sent;
+  ResponseBatcher::routeTo([&mtx, &sent](int, const uint8_t *data, size_t len,
+                                         const struct sockaddr_in &) {
+    std::lock_guard<std::mutex> lock(mtx);
+    sent.push_back(DnsPacketView(data, len).rescode());
+    return true;
+  });
+  auto sentCount = [&mtx, &sent] {
+    std::lock_guard<std::mutex> lock(mtx);
+    return sent.size();
+  };
+
+  {
+    EventLoop loop;
+    ThreadSafeCache cache;
+    TransactionTracker tracker;
+    UpstreamSocketPool upstream(tracker, 1);
+    // without a deadline this would go on retrying for seconds
+    NetworkConfig netConf(100, 1000, 5000, 50, 10, 1.0, 1);
+    CoDelShedder shedder(
+        OverloadConfig{20, 100, 1000, ShedPolicy::ServFail, 2, 250});
+    Resolver resolver(loop, cache, tracker, upstream, netConf, &shedder);
+    RateLimiter rateLimiter{RateLimitConfig{}};
+    struct sockaddr_in client {};
+
+    for (uint16_t id = 1; id <= 4; id++) {
+      DnsPacket query;
+      query.header.id = id;
+      query.header.questions = 1;
+      query.header.recursionDesired = true;
+      query.questions.push_back(
+          DnsQuestion("q" + std::to_string(id) + ".example.com", A{}));
+      BytePacketBuffer buffer;
+      query.write(buffer);
+      buffer.seek(0);
+
+      handleQueryAsync(1, buffer, client, rateLimiter, resolver, true,
+                       QueryTimer{}, &shedder);
+    }
+
+    // the two over the cap are turned away on the spot
+    REQUIRE(shedder.getStats().shedInFlight == 2);
+    REQUIRE(sentCount() == 2);
+
+    // the other two stop retrying once their clients have given up
+    auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (sentCount() < 4 && std::chrono::steady_clock::now() < giveUp) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(sentCount() == 4);
+    REQUIRE(shedder.getStats().shedLate == 2);
+
+    // and leave room for the next ones
+    REQUIRE(shedder.admitResolution());
+    shedder.finishResolution();
+  }
+
+  for (ResultCode rescode : sent) {
+    REQUIRE(rescode == ResultCode::SERVFAIL);
+  }
+
+  ResponseBatcher::routeTo(nullptr);
+  RootServerRepository::servers = roots;
+}
+
+TEST_CASE("Recursions on the event loop are shed when upstream stalls",
+          "[resolver]") {
+  SECTION("event driven") { shedWhileUpstreamStalls<AsyncResolver>(); }
+  SECTION("coroutines") { shedWhileUpstreamStalls<CoroResolver>(); }
+}
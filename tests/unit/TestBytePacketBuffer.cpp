@@ -0,0 +1,157 @@
+#include "../../lib/DnsPacket.hpp"
+#include "../../lib/DnsPacketView.hpp"
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+static std::string readNameAt(BytePacketBuffer &buffer, size_t pos) {
+  std::string name;
+  buffer.seek(pos);
+  buffer.readQName(name);
+  return name;
+}
+
+TEST_CASE("writeQName compresses repeated suffixes", "[buffer]") {
+  BytePacketBuffer buffer;
+  buffer.seek(12);
+
+  buffer.writeQName("www.example.com");
+  REQUIRE(buffer.currentPosition() == 12 + 17);
+
+  SECTION("an identical name is a single pointer") {
+    size_t start = buffer.currentPosition();
+    buffer.writeQName("www.example.com");
+
+    REQUIRE(buffer.currentPosition() == start + 2);
+    REQUIRE(buffer.buf[start] == 0xC0);
+    REQUIRE(buffer.buf[start + 1] == 12);
+    REQUIRE(readNameAt(buffer, start) == "www.example.com");
+  }
+
+  SECTION("a shared suffix is labels followed by a pointer") {
+    size_t start = buffer.currentPosition();
+    buffer.writeQName("mail.example.com");
+
+    // "mail" then a pointer to "example.com" inside the first name
+    REQUIRE(buffer.currentPosition() == start + 5 + 2);
+    REQUIRE(buffer.buf[start + 5] == 0xC0);
+    REQUIRE(buffer.buf[start + 6] == 16);
+    REQUIRE(readNameAt(buffer, start) == "mail.example.com");
+  }
+
+  SECTION("pointers can chain through earlier compressed names") {
+    size_t mail = buffer.currentPosition();
+    buffer.writeQName("mail.example.com");
+    size_t deep = buffer.currentPosition();
+    buffer.writeQName("a.b.mail.example.com");
+
+    REQUIRE(buffer.currentPosition() == deep + 2 + 2 + 2);
+    REQUIRE(readNameAt(buffer, deep) == "a.b.mail.example.com");
+    REQUIRE(readNameAt(buffer, mail) == "mail.example.com");
+  }
+
+  SECTION("unrelated names and partial labels are written in full") {
+    size_t start = buffer.currentPosition();
+    buffer.writeQName("example.org");
+    REQUIRE(buffer.currentPosition() == start + 13);
+
+    // "ample.com" is not a label boundary of "example.com"
+    start = buffer.currentPosition();
+    buffer.writeQName("ample.com");
+    REQUIRE(buffer.currentPosition() == start + 6 + 2);
+    REQUIRE(readNameAt(buffer, start) == "ample.com");
+  }
+
+  SECTION("matching is case sensitive so readers get the case back") {
+    size_t start = buffer.currentPosition();
+    buffer.writeQName("WWW.EXAMPLE.COM");
+    REQUIRE(buffer.currentPosition() == start + 17);
+    REQUIRE(readNameAt(buffer, start) == "WWW.EXAMPLE.COM");
+  }
+}
+
+TEST_CASE("writeQName ignores names left over from an older message",
+          "[buffer]") {
+  BytePacketBuffer buffer;
+  buffer.seek(12);
+  buffer.writeQName("old.example.com");
+  buffer.writeQName("filler.example.net");
+
+  // reuse the buffer for a new, shorter message
+  buffer.seek(12);
+  buffer.writeQName("new.example.org");
+  size_t start = buffer.currentPosition();
+  buffer.writeQName("filler.example.net");
+
+  REQUIRE(buffer.currentPosition() == start + 20);
+  REQUIRE(readNameAt(buffer, start) == "filler.example.net");
+}
+
+TEST_CASE("Compressed packets round trip through both parsers", "[buffer]") {
+  DnsPacket packet;
+  packet.header.id = 99;
+  packet.header.response = true;
+  packet.questions.push_back(DnsQuestion("www.example.com", A{}));
+  packet.answers.push_back(CNAMERecord{"www.example.com", "web.example.com",
+                                       300});
+  packet.answers.push_back(ARecord{"web.example.com", {192, 0, 2, 1}, 300});
+  packet.answers.push_back(ARecord{"web.example.com", {192, 0, 2, 2}, 300});
+  packet.authorities.push_back(
+      NSRecord{"example.com", "ns1.example.com", 3600});
+  packet.authorities.push_back(
+      NSRecord{"example.com", "ns2.example.com", 3600});
+  packet.resources.push_back(
+      MXRecord{"example.com", 10, "mail.example.com", 300});
+  packet.resources.push_back(ARecord{"ns1.example.com", {192, 0, 2, 53}, 600});
+
+  BytePacketBuffer buffer;
+  packet.write(buffer);
+  size_t written = buffer.currentPosition();
+
+  // every name after the question shares its "example.com"
+  REQUIRE(written < 200);
+
+  DnsPacketView view(buffer.buf, written);
+  REQUIRE(view.answerCount() == 3);
+  REQUIRE(view.getResolvedNs(DnsName("www.example.com")) ==
+          std::array<uint8_t, 4>{192, 0, 2, 53});
+
+  buffer.seek(0);
+  DnsPacket parsed = DnsPacket::fromBuffer(buffer);
+  REQUIRE(buffer.currentPosition() == written);
+  REQUIRE(parsed.questions[0].name == "www.example.com");
+  REQUIRE(std::get<CNAMERecord>(parsed.answers[0]).host == "web.example.com");
+  REQUIRE(std::get<ARecord>(parsed.answers[2]).domain == "web.example.com");
+  REQUIRE(std::get<ARecord>(parsed.answers[2]).addr ==
+          std::array<uint8_t, 4>{192, 0, 2, 2});
+  REQUIRE(std::get<NSRecord>(parsed.authorities[1]).host == "ns2.example.com");
+  REQUIRE(std::get<MXRecord>(parsed.resources[0]).priority == 10);
+  REQUIRE(std::get<MXRecord>(parsed.resources[0]).host == "mail.example.com");
+  REQUIRE(std::get<ARecord>(parsed.resources[1]).domain == "ns1.example.com");
+}
+
+TEST_CASE("Compression fits answers that used to overflow 512 bytes",
+          "[buffer]") {
+  const char *const qname =
+      "a-rather-long-service-name.eu-west-1.some-cloud-provider.example.com";
+
+  DnsPacket packet;
+  packet.header.response = true;
+  packet.questions.push_back(DnsQuestion(qname, A{}));
+  for (uint8_t i = 0; i < 20; i++) {
+    packet.answers.push_back(ARecord{qname, {10, 0, 0, i}, 60});
+  }
+
+  // uncompressed that's 12 + 74 + 20 * 84 = 1766 bytes
+  BytePacketBuffer buffer;
+  packet.write(buffer);
+  REQUIRE(buffer.currentPosition() == 12 + 74 + 20 * 16);
+
+  buffer.seek(0);
+  DnsPacket parsed = DnsPacket::fromBuffer(buffer);
+  REQUIRE(parsed.answers.size() == 20);
+  REQUIRE(std::get<ARecord>(parsed.answers[19]).domain == qname);
+  REQUIRE(std::get<ARecord>(parsed.answers[19]).addr ==
+          std::array<uint8_t, 4>{10, 0, 0, 19});
+}
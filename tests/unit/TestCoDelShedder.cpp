@@ -0,0 +1,47 @@
+#include "../../lib/overload/CoDelShedder.hpp"
+#include "catch.hpp"
+
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("CoDel shedder admits a healthy queue and sheds a standing one",
+          "[overload]") {
+  // 1ms target, 10ms interval, 200ms hard deadline
+  CoDelShedder shedder(OverloadConfig{1, 10, 200, ShedPolicy::Refused});
+  auto now = [] { return CoDelShedder::Clock::now(); };
+
+  SECTION("queries under target are admitted") {
+    for (int i = 0; i < 100; i++) {
+      REQUIRE(!shedder.shouldShed(now()));
+    }
+    REQUIRE(shedder.getStats().admitted == 100);
+    REQUIRE(shedder.getStats().sojourn.samples() == 100);
+  }
+
+  SECTION("queries past the deadline are always shed") {
+    REQUIRE(shedder.shouldShed(now() - 500ms));
+    REQUIRE(shedder.getStats().shedDeadline == 1);
+  }
+
+  SECTION("delay above target for a whole interval starts shedding") {
+    // first sighting only starts the clock
+    REQUIRE(!shedder.shouldShed(now() - 5ms));
+
+    std::this_thread::sleep_for(15ms);
+    REQUIRE(shedder.shouldShed(now() - 5ms));
+    REQUIRE(shedder.getStats().shedStanding == 1);
+
+    // delay back under target, the next query goes through
+    REQUIRE(!shedder.shouldShed(now()));
+    REQUIRE(!shedder.shouldShed(now()));
+  }
+
+  SECTION("a short spike above target is tolerated") {
+    REQUIRE(!shedder.shouldShed(now() - 5ms));
+    REQUIRE(!shedder.shouldShed(now()));
+    REQUIRE(!shedder.shouldShed(now() - 5ms));
+    REQUIRE(shedder.getStats().shedStanding == 0);
+  }
+}
@@ -1,11 +1,421 @@
+#include "../../lib/DnsPacket.hpp"
 #include "../../lib/cache/DnsCache.hpp"
+#include "../../lib/cache/ThreadSafeCache.hpp"
 #include "catch.hpp"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
 TEST_CASE("DnsCache basic operations", "[cache]") {
   DnsCache cache(60, 86400);
 
   SECTION("cache starts empty") {
-    auto result = cache.lookup("google.com", A{});
+    auto result = cache.lookup(DnsName("google.com"), A{});
     REQUIRE(!result.has_value());
   }
 }
+
+static DnsPacket lookupWirePacket(DnsCache &cache, const DnsName &qname,
+                                  QueryType qtype, size_t &length) {
+  BytePacketBuffer buffer;
+  length = cache.lookupWire(qname, qtype, buffer.buf);
+  return DnsPacket::fromBuffer(buffer);
+}
+
+TEST_CASE("DnsCache keeps answers as encoded responses", "[cache]") {
+  DnsCache cache(60, 86400);
+  DnsName qname("example.com");
+  cache.insert(qname, A{},
+               std::vector<DnsRecord>{
+                   ARecord{"example.com", {192, 0, 2, 1}, 300},
+                   ARecord{"example.com", {192, 0, 2, 2}, 120}});
+
+  SECTION("a hit is the whole response with the TTLs counting down") {
+    size_t length = 0;
+    DnsPacket response = lookupWirePacket(cache, qname, A{}, length);
+    REQUIRE(length > 0);
+    REQUIRE(response.header.response);
+    REQUIRE(response.header.rescode == ResultCode::NOERROR);
+    REQUIRE(response.questions.size() == 1);
+    REQUIRE(response.questions[0].name == "example.com");
+    REQUIRE(response.answers.size() == 2);
+
+    uint32_t first = std::get<ARecord>(response.answers[0]).ttl;
+    uint32_t second = std::get<ARecord>(response.answers[1]).ttl;
+    REQUIRE((first <= 300 && first >= 299));
+    REQUIRE((second <= 120 && second >= 119));
+    REQUIRE(cache.getStats().wireHits == 1);
+    REQUIRE(cache.getStats().hits == 1);
+  }
+
+  SECTION("a cached negative answer replaces the records") {
+    cache.insertNegative(qname, A{}, ResultCode::NXDOMAIN, 300);
+    size_t length = 0;
+    lookupWirePacket(cache, qname, A{}, length);
+    REQUIRE(length == 0);
+    REQUIRE(cache.lookup(qname, A{})->empty());
+    REQUIRE(cache.getStats().currentEntries == 0);
+
+    // and records replace the negative answer
+    cache.insert(qname, A{},
+                 std::vector<DnsRecord>{
+                     ARecord{"example.com", {192, 0, 2, 3}, 300}});
+    REQUIRE(cache.lookup(qname, A{})->size() == 1);
+    lookupWirePacket(cache, qname, A{}, length);
+    REQUIRE(length > 0);
+  }
+
+  SECTION("inserting again replaces the encoding") {
+    cache.insert(qname, A{},
+                 std::vector<DnsRecord>{
+                     ARecord{"example.com", {192, 0, 2, 3}, 300}});
+    size_t length = 0;
+    DnsPacket response = lookupWirePacket(cache, qname, A{}, length);
+    REQUIRE(response.answers.size() == 1);
+    REQUIRE(std::get<ARecord>(response.answers[0]).addr ==
+            std::array<uint8_t, 4>{192, 0, 2, 3});
+  }
+
+  SECTION("other types and names miss") {
+    size_t length = 0;
+    lookupWirePacket(cache, qname, AAAA{}, length);
+    REQUIRE(length == 0);
+    lookupWirePacket(cache, DnsName("www.example.com"), A{}, length);
+    REQUIRE(length == 0);
+  }
+}
+
+TEST_CASE("DnsCache without the wire tier only has records", "[cache]") {
+  CacheConfig config;
+  config.wireAnswers = false;
+  DnsCache cache(config);
+
+  DnsName qname("example.com");
+  cache.insert(qname, A{},
+               std::vector<DnsRecord>{
+                   ARecord{"example.com", {192, 0, 2, 1}, 300}});
+
+  uint8_t out[512];
+  REQUIRE(cache.lookupWire(qname, A{}, out) == 0);
+  REQUIRE(cache.lookup(qname, A{})->size() == 1);
+  REQUIRE(cache.getStats().wireHits == 0);
+}
+
+TEST_CASE("ThreadSafeCache splits names over its shards", "[cache]") {
+  CacheConfig config;
+  config.shards = 5;
+  ThreadSafeCache cache(config);
+  REQUIRE(cache.shardCount() == 8);
+
+  std::vector<DnsName> names;
+  for (int i = 0; i < 256; i++) {
+    names.emplace_back("host-" + std::to_string(i) + ".example.com");
+    cache.insert(names.back(), A{},
+                 std::vector<DnsRecord>{
+                     ARecord{"example.com", {192, 0, 2, 1}, 300}});
+  }
+
+  for (const auto &name : names) {
+    REQUIRE(cache.lookup(name, A{}).has_value());
+  }
+
+  CacheStats stats = cache.getStats();
+  REQUIRE(stats.inserts == 256);
+  REQUIRE(stats.hits == 256);
+  REQUIRE(stats.currentEntries == 256);
+
+  SECTION("a parent zone view finds the shard its name went to") {
+    cache.insertNS(DnsName("example.com"), {192, 0, 2, 53}, 3600);
+    DnsName qname("www.Example.com");
+    REQUIRE(cache.lookupNS(qname.suffix(1)).has_value());
+  }
+
+  SECTION("threads working on different names all land") {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([&cache, &names, t] {
+        for (int round = 0; round < 50; round++) {
+          for (size_t i = t; i < names.size(); i += 4) {
+            cache.lookup(names[i], A{});
+            cache.insert(names[i], AAAA{},
+                         std::vector<DnsRecord>{AAAARecord{
+                             "example.com", {0x20, 0x01, 0x0d, 0xb8}, 300}});
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    CacheStats after = cache.getStats();
+    REQUIRE(after.hits == 256 + 4 * 50 * 64);
+    REQUIRE(after.inserts == 256 + 4 * 50 * 64);
+  }
+}
+
+TEST_CASE("DnsCache keeps hit keys when it evicts", "[cache]") {
+  auto policy = GENERATE(EvictionPolicy::Sieve, EvictionPolicy::Clock);
+  DnsCache cache(
+      CacheConfig(60, 86400, 2, size_t{1} << 20, true, 1, policy));
+  auto answer = std::vector<DnsRecord>{
+      ARecord{"example.com", {192, 0, 2, 1}, 300}};
+
+  DnsName first("first.example.com");
+  DnsName second("second.example.com");
+  cache.insert(first, A{}, answer);
+  cache.insert(second, A{}, answer);
+
+  // `first` is the least recently inserted but was hit since
+  REQUIRE(cache.lookup(first, A{}).has_value());
+  cache.insert(DnsName("third.example.com"), A{}, answer);
+
+  REQUIRE(cache.lookup(first, A{}).has_value());
+  REQUIRE(!cache.lookup(second, A{}).has_value());
+  REQUIRE(cache.getStats().evictions == 1);
+  REQUIRE(cache.getStats().currentEntries == 2);
+}
+
+TEST_CASE("DnsCache keeps all three caches within one byte budget",
+          "[cache]") {
+  const size_t budget = 16 * 1024;
+  DnsCache cache(CacheConfig(60, 86400, 10000, budget, true, 1));
+
+  SECTION("each cache is charged to its own gauge") {
+    DnsName qname("example.com");
+    cache.insert(qname, A{},
+                 std::vector<DnsRecord>{
+                     ARecord{"example.com", {192, 0, 2, 1}, 300}});
+    CacheStats stats = cache.getStats();
+    REQUIRE(stats.answerBytes > 0);
+    REQUIRE(stats.negBytes == 0);
+    REQUIRE(stats.maxBytes == budget);
+
+    // the negative answer takes the key over, bytes and all
+    cache.insertNegative(qname, A{}, ResultCode::NXDOMAIN, 300);
+    stats = cache.getStats();
+    REQUIRE(stats.answerBytes == 0);
+    REQUIRE(stats.negBytes > 0);
+
+    cache.insertNS(DnsName("example.com"), {192, 0, 2, 53}, 300);
+    REQUIRE(cache.getStats().nsBytes > 0);
+    REQUIRE(cache.lookup(qname, A{})->empty());
+  }
+
+  SECTION("going over evicts across the caches") {
+    // long CNAME targets, so the records' strings count too
+    std::string target(100, 'x');
+    target += ".example.net";
+    for (int i = 0; i < 200; i++) {
+      std::string name = "host-" + std::to_string(i) + ".example.com";
+      cache.insert(DnsName(name), CNAME{},
+                   std::vector<DnsRecord>{
+                       CNAMERecord{name.c_str(), target.c_str(), 300}});
+    }
+    CacheStats stats = cache.getStats();
+    REQUIRE(stats.evictions > 0);
+    REQUIRE(stats.usedBytes() <= budget);
+
+    // nameservers are no longer refused, they push answers out
+    uint64_t evicted = stats.evictions;
+    for (int i = 0; i < 100; i++) {
+      cache.insertNS(DnsName("zone-" + std::to_string(i) + ".example"),
+                     {192, 0, 2, 53}, 300);
+    }
+    stats = cache.getStats();
+    REQUIRE(stats.nsInserts == 100);
+    REQUIRE(stats.evictions > evicted);
+    REQUIRE(stats.nsBytes > 0);
+    REQUIRE(stats.usedBytes() <= budget);
+    REQUIRE(cache.lookupNS(DnsName("zone-99.example").view()).has_value());
+  }
+}
+
+TEST_CASE("DnsCache expires entries through its timers", "[cache]") {
+  // one second TTLs, two entries per slice
+  DnsCache cache(
+      CacheConfig(1, 86400, 100, size_t{1} << 20, true, 1,
+                              EvictionPolicy::Sieve, 2));
+
+  for (int i = 0; i < 5; i++) {
+    cache.insert(DnsName("host-" + std::to_string(i) + ".example.com"), A{},
+                 std::vector<DnsRecord>{
+                     ARecord{"example.com", {192, 0, 2, 1}, 1}});
+  }
+  // only one of its records expires, the other is waited for again
+  DnsName mixed("mixed.example.com");
+  cache.insert(mixed, A{},
+               std::vector<DnsRecord>{
+                   ARecord{"mixed.example.com", {192, 0, 2, 1}, 1},
+                   ARecord{"mixed.example.com", {192, 0, 2, 2}, 3600}});
+  cache.insertNS(DnsName("example.com"), {192, 0, 2, 53}, 1);
+  REQUIRE(cache.getStats().currentEntries == 7);
+
+  // timers have whole second resolution, rounded up
+  std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+
+  REQUIRE(cache.expireDue(2) == 2);
+  cache.cleanupExpired();
+
+  CacheStats stats = cache.getStats();
+  REQUIRE(stats.expirations == 6);
+  REQUIRE(stats.currentEntries == 1);
+  REQUIRE(!cache.lookup(DnsName("host-0.example.com"), A{}).has_value());
+  REQUIRE(cache.lookup(mixed, A{})->size() == 1);
+  REQUIRE(!cache.lookupNS(DnsName("example.com").view()).has_value());
+}
+
+TEST_CASE("DnsCache asks for hot answers to be refreshed", "[cache]") {
+  DnsName qname("hot.example.com");
+  auto records = [](uint32_t ttl) {
+    return std::vector<DnsRecord>{
+        ARecord{"hot.example.com", {192, 0, 2, 1}, ttl}};
+  };
+
+  SECTION("once, on the hit that reaches the threshold") {
+    // the whole TTL is the prefetch window, three hits needed
+    DnsCache cache(CacheConfig(60, 86400, 100, size_t{1} << 20, true, 1,
+                               EvictionPolicy::Sieve, 256, 100, 3));
+    cache.insert(qname, A{}, records(300));
+
+    bool prefetch = false;
+    cache.lookup(qname, A{}, &prefetch);
+    uint8_t wire[512];
+    REQUIRE(cache.lookupWire(qname, A{}, wire, &prefetch) > 0);
+    REQUIRE(!prefetch);
+
+    // hits through either path count
+    cache.lookup(qname, A{}, &prefetch);
+    REQUIRE(prefetch);
+
+    prefetch = false;
+    cache.lookup(qname, A{}, &prefetch);
+    cache.lookupWire(qname, A{}, wire, &prefetch);
+    REQUIRE(!prefetch);
+
+    CacheStats stats = cache.getStats();
+    REQUIRE(stats.prefetches == 1);
+    REQUIRE(stats.hits == 5);
+    REQUIRE(stats.prefetchRate() == Approx(20.0));
+  }
+
+  SECTION("not before the last part of the TTL") {
+    DnsCache cache(CacheConfig(60, 86400, 100, size_t{1} << 20, true, 1,
+                               EvictionPolicy::Sieve, 256, 10, 1));
+    cache.insert(qname, A{}, records(300));
+
+    bool prefetch = false;
+    for (int i = 0; i < 10; i++) {
+      cache.lookup(qname, A{}, &prefetch);
+    }
+    REQUIRE(!prefetch);
+    REQUIRE(cache.getStats().prefetches == 0);
+  }
+
+  SECTION("and counts the miss a refresh saved") {
+    DnsCache cache(CacheConfig(1, 86400, 100, size_t{1} << 20, true, 1,
+                               EvictionPolicy::Sieve, 256, 100, 1));
+    cache.insert(qname, A{}, records(1));
+
+    bool prefetch = false;
+    cache.lookup(qname, A{}, &prefetch);
+    REQUIRE(prefetch);
+
+    // the refresh lands before the answer expires, and outlives it
+    cache.insert(qname, A{}, records(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    REQUIRE(cache.lookup(qname, A{}).has_value());
+    REQUIRE(cache.lookup(qname, A{}).has_value());
+
+    CacheStats stats = cache.getStats();
+    REQUIRE(stats.prefetchSavedMisses == 1);
+    REQUIRE(stats.inserts == 2);
+  }
+}
+
+TEST_CASE("ThreadSafeCache hands due refreshes to its prefetcher",
+          "[cache]") {
+  ThreadSafeCache cache(CacheConfig(60, 86400, 100, size_t{1} << 20, true, 4,
+                                    EvictionPolicy::Sieve, 256, 100, 2));
+  DnsName qname("hot.example.com");
+  cache.insert(qname, A{},
+               std::vector<DnsRecord>{
+                   ARecord{"hot.example.com", {192, 0, 2, 1}, 300}});
+
+  // nothing is claimed without one
+  cache.lookup(qname, A{});
+  cache.lookup(qname, A{});
+  REQUIRE(cache.getStats().prefetches == 0);
+
+  // the first refresh isn't started (a full queue, say)
+  std::vector<std::string> refreshed;
+  bool started = false;
+  cache.setPrefetcher([&](const DnsName &name, QueryType) {
+    refreshed.emplace_back(name.toString());
+    bool queued = started;
+    started = true;
+    return queued;
+  });
+
+  uint8_t wire[512];
+  cache.lookupWire(qname, A{}, wire);
+  REQUIRE(refreshed.size() == 1);
+
+  // so the next hit asks again, and once one is underway no other does
+  for (int i = 0; i < 4; i++) {
+    cache.lookupWire(qname, A{}, wire);
+    cache.lookup(qname, A{});
+  }
+  REQUIRE(refreshed == std::vector<std::string>{"hot.example.com",
+                                                "hot.example.com"});
+  REQUIRE(cache.getStats().prefetches == 2);
+
+  // a refresh that failed lets the next hit ask again too
+  cache.cancelPrefetch(qname, A{});
+  cache.lookup(qname, A{});
+  REQUIRE(refreshed.size() == 3);
+}
+
+TEST_CASE("DnsCache lookups run concurrently with writers", "[cache]") {
+  ThreadSafeCache cache(CacheConfig(60, 86400, 64, size_t{1} << 20, true, 2));
+  std::vector<DnsName> names;
+  for (int i = 0; i < 128; i++) {
+    names.emplace_back("host-" + std::to_string(i) + ".example.com");
+  }
+  auto answer = std::vector<DnsRecord>{
+      ARecord{"example.com", {192, 0, 2, 1}, 300}};
+
+  std::atomic<uint64_t> hits{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t] {
+      uint8_t wire[512];
+      for (int round = 0; round < 20; round++) {
+        for (size_t i = 0; i < names.size(); i++) {
+          if (t == 0 && i % 4 == 0) {
+            cache.insert(names[i], A{}, answer);
+          } else if (cache.lookup(names[i], A{}).has_value()) {
+            hits++;
+          }
+          if (cache.lookupWire(names[i], A{}, wire) > 0) {
+            hits++;
+          }
+          cache.lookupNS(names[i]);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // every fourth name, reinserted each round
+  CacheStats stats = cache.getStats();
+  REQUIRE(stats.hits == hits.load());
+  REQUIRE(stats.inserts == 20 * 32);
+  REQUIRE(stats.currentEntries == 32);
+}
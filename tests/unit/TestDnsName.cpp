@@ -0,0 +1,126 @@
+#include "../../lib/BytePacketBuffer.hpp"
+#include "../../lib/cache/DnsCache.hpp"
+#include "../../lib/memory/QueryArena.hpp"
+#include "../../lib/names/DnsName.hpp"
+#include "catch.hpp"
+
+#include <array>
+#include <string>
+#include <unordered_map>
+
+TEST_CASE("DnsName holds the lowercase wire form", "[name]") {
+  DnsName name("WWW.Example.com");
+
+  REQUIRE(name.wire() == std::string_view("\3www\7example\3com\0", 17));
+  REQUIRE(name.toString() == "www.example.com");
+  REQUIRE(name.labelCount() == 3);
+  REQUIRE(name.label(0) == "www");
+  REQUIRE(name.label(1) == "example");
+  REQUIRE(name.label(2) == "com");
+
+  SECTION("case and a trailing dot don't change the name or its hash") {
+    DnsName other("www.EXAMPLE.com.");
+    REQUIRE(other == name);
+    REQUIRE(other.hash() == name.hash());
+    REQUIRE(DnsName("mail.example.com") != name);
+  }
+
+  SECTION("suffixes come from the offset table and match parent()") {
+    REQUIRE(name.suffix(1).toString() == "example.com");
+    REQUIRE(name.suffix(1) == name.view().parent());
+    REQUIRE(name.suffix(2) == DnsName("com").view());
+    REQUIRE(name.suffix(3).isRoot());
+    REQUIRE(name.suffix(1).hash() == DnsName("example.com").hash());
+  }
+
+  SECTION("zones match on label boundaries, in any case") {
+    auto wire = [](const DnsName &zone) { return zone.wire(); };
+    REQUIRE(name.isSubdomainOf(wire(DnsName("example.com"))));
+    REQUIRE(name.isSubdomainOf(std::string_view("\7EXAMPLE\3com\0", 13)));
+    REQUIRE(name.isSubdomainOf(wire(name)));
+    REQUIRE(name.isSubdomainOf(wire(DnsName())));
+    REQUIRE(!name.isSubdomainOf(wire(DnsName("ample.com"))));
+    REQUIRE(!name.isSubdomainOf(wire(DnsName("a.www.example.com"))));
+  }
+
+  SECTION("wire labels build the same name as text") {
+    const uint8_t labels[] = {3, 'W', 'w', 'W', 7,   'e', 'x', 'a',
+                              'm', 'p', 'l', 'e', 3, 'C', 'O', 'M'};
+    REQUIRE(DnsName::fromLabels(labels, sizeof(labels)) == name);
+  }
+}
+
+TEST_CASE("DnsName rejects what the wire can't hold", "[name]") {
+  REQUIRE(DnsName("").isRoot());
+  REQUIRE(DnsName(".").isRoot());
+  REQUIRE_THROWS(DnsName("www..example.com"));
+  REQUIRE_THROWS(DnsName(std::string(64, 'a') + ".com"));
+  REQUIRE_THROWS(DnsName(std::string(254, 'a')));
+}
+
+TEST_CASE("DnsName allocates from a QueryArena and copies out of it",
+          "[name]") {
+  QueryArena::Scope arena;
+  DnsName inArena("a-fairly-long-name.example.com", QueryArena::resource());
+  REQUIRE(inArena.get_allocator().resource() == QueryArena::resource());
+
+  // a plain copy is what outlives the query, e.g. a cache key
+  DnsName copy(inArena);
+  REQUIRE(copy.get_allocator().resource() == std::pmr::get_default_resource());
+  REQUIRE(copy == inArena);
+}
+
+TEST_CASE("DnsName keys find parent zones without copying", "[name]") {
+  std::unordered_map<DnsName, int, DnsNameHash, DnsNameEqual> zones;
+  zones.emplace(DnsName("example.com"), 1);
+  zones.emplace(DnsName("com"), 2);
+
+  DnsName qname("a.b.EXAMPLE.com");
+  auto it = zones.end();
+  for (DnsNameView zone = qname; !zone.isRoot() && it == zones.end();
+       zone = zone.parent()) {
+    it = zones.find(zone);
+  }
+  REQUIRE(it != zones.end());
+  REQUIRE(it->second == 1);
+
+  SECTION("the cache's nameserver lookup walks the same way") {
+    DnsCache cache;
+    cache.insertNS(DnsName("Example.COM"), {192, 0, 2, 53}, 3600);
+    REQUIRE(cache.lookupNS(qname.suffix(2)) ==
+            std::array<uint8_t, 4>{192, 0, 2, 53});
+    REQUIRE(!cache.lookupNS(qname.suffix(1)).has_value());
+  }
+}
+
+TEST_CASE("BytePacketBuffer writes and reads wire names", "[name]") {
+  BytePacketBuffer buffer;
+  buffer.seek(12);
+  buffer.writeQName("www.Example.com");
+
+  // the compressor compares bytes, so the lowercase "example" is written
+  // out again and only "com" becomes a pointer
+  size_t start = buffer.currentPosition();
+  buffer.writeName(DnsName("mail.example.com"));
+  REQUIRE(buffer.currentPosition() == start + 5 + 8 + 2);
+
+  start = buffer.currentPosition();
+  buffer.writeName(DnsName("ns.mail.example.com"));
+  REQUIRE(buffer.currentPosition() == start + 3 + 2);
+
+  uint8_t wire[namekernels::MAX_NAME_WIRE];
+  buffer.seek(start);
+  size_t length = buffer.readWireName(wire);
+  REQUIRE(buffer.currentPosition() == start + 5);
+  REQUIRE(DnsName::fromLabels(wire, length - 1) ==
+          DnsName("ns.mail.example.com"));
+
+  SECTION("label bytes the text form can't hold are refused") {
+    const uint8_t spoofed[] = {11, 'w', 'w', 'w', '.', 'e', 'x',
+                               'a', 'm', 'p', 'l', 'e', 0};
+    buffer.seek(0);
+    buffer.writeBytes(spoofed, sizeof(spoofed));
+    buffer.seek(0);
+    REQUIRE_THROWS(buffer.readWireName(wire));
+  }
+}
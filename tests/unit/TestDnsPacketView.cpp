@@ -0,0 +1,143 @@
+#include "../../lib/DnsPacketView.hpp"
+#include "catch.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// referral for www.example.com: two nameservers, only one with glue
+static BytePacketBuffer makeReferral() {
+  DnsPacket packet;
+  packet.header.id = 4242;
+  packet.header.response = true;
+  packet.questions.push_back(DnsQuestion("www.example.com", A{}));
+  packet.authorities.push_back(
+      NSRecord{"example.com", "ns1.example.net", 3600});
+  packet.authorities.push_back(
+      NSRecord{"example.com", "ns2.example.net", 3600});
+  packet.authorities.push_back(NSRecord{"other.org", "ns.other.org", 3600});
+  packet.resources.push_back(ARecord{"ns2.example.net", {192, 0, 2, 53}, 600});
+
+  BytePacketBuffer buffer;
+  packet.write(buffer);
+  buffer.seek(0);
+  return buffer;
+}
+
+TEST_CASE("DnsPacketView walks a referral without copying it", "[packet]") {
+  BytePacketBuffer buffer = makeReferral();
+  DnsPacketView view(buffer);
+
+  REQUIRE(view.id() == 4242);
+  REQUIRE(view.response());
+  REQUIRE(view.questionCount() == 1);
+  REQUIRE(view.authorityCount() == 3);
+  REQUIRE(view.question().name == "www.example.com");
+
+  SECTION("nameservers are matched against the query name") {
+    std::vector<std::string> hosts;
+    view.forEachNs(DnsName("www.example.com"),
+                   [&hosts](const NameView &domain, const NameView &host) {
+                     REQUIRE(domain == "example.com");
+                     hosts.push_back(host.toString());
+                   });
+    REQUIRE(hosts ==
+            std::vector<std::string>{"ns1.example.net", "ns2.example.net"});
+  }
+
+  SECTION("glue resolves the nameserver that has it") {
+    REQUIRE(view.getResolvedNs(DnsName("www.example.com")) ==
+            std::array<uint8_t, 4>{192, 0, 2, 53});
+    REQUIRE(view.getUnresolvedNs(DnsName("www.example.com")) ==
+            DnsName("ns1.example.net"));
+    REQUIRE(!view.getResolvedNs(DnsName("www.other.org")).has_value());
+
+    // zones match on label boundaries and ignore case
+    REQUIRE(view.getResolvedNs(DnsName("WWW.Example.COM")).has_value());
+    REQUIRE(!view.getResolvedNs(DnsName("www.anexample.com")).has_value());
+  }
+
+  SECTION("agrees with the owning parser") {
+    BytePacketBuffer copy = buffer;
+    DnsPacket owned = DnsPacket::fromBuffer(copy);
+    DnsPacket viewed = view.toPacket();
+
+    REQUIRE(viewed.header.id == owned.header.id);
+    REQUIRE(viewed.questions[0].name == owned.questions[0].name);
+    REQUIRE(viewed.authorities.size() == owned.authorities.size());
+    REQUIRE(std::get<NSRecord>(viewed.authorities[1]).host ==
+            std::get<NSRecord>(owned.authorities[1]).host);
+    REQUIRE(std::get<ARecord>(viewed.resources[0]).addr ==
+            std::get<ARecord>(owned.resources[0]).addr);
+  }
+}
+
+TEST_CASE("DnsPacketView follows compression pointers", "[packet]") {
+  // header, then "example.com" at 12 and "www" + pointer to it at 29
+  const uint8_t wire[] = {0,   1,   0x80, 0,   0,   2,   0,   0,   0,   0,
+                          0,   0,   7,    'e', 'x', 'a', 'm', 'p', 'l', 'e',
+                          3,   'c', 'o',  'm', 0,   0,   1,   0,   1,   3,
+                          'w', 'w', 'w',  0xC0, 12, 0,   1,   0,   1};
+  DnsPacketView view(wire, sizeof(wire));
+
+  DnsPacket packet = view.toPacket();
+  REQUIRE(packet.questions[0].name == "example.com");
+  REQUIRE(packet.questions[1].name == "www.example.com");
+  REQUIRE(view.size() == sizeof(wire));
+
+  REQUIRE(NameView(wire, 29) == "www.example.com");
+  REQUIRE(NameView(wire, 12).isSuffixOf(DnsName("www.example.com")));
+  REQUIRE(!NameView(wire, 29).isSuffixOf(DnsName("example.com")));
+  REQUIRE(NameView(wire, 29).toName() == DnsName("WWW.example.com"));
+}
+
+TEST_CASE("DnsPacketView rejects malformed messages", "[packet]") {
+  SECTION("truncated header") {
+    const uint8_t wire[] = {0, 1, 0x80, 0};
+    REQUIRE_THROWS(DnsPacketView(wire, sizeof(wire)));
+  }
+
+  SECTION("pointer loop") {
+    const uint8_t wire[] = {0, 1, 0, 0, 0, 1, 0, 0, 0,
+                            0, 0, 0, 0xC0, 12, 0, 1, 0, 1};
+    REQUIRE_THROWS(DnsPacketView(wire, sizeof(wire)));
+  }
+
+  SECTION("rdata past the end") {
+    BytePacketBuffer buffer = makeReferral();
+    DnsPacketView full(buffer);
+    REQUIRE_THROWS(DnsPacketView(buffer.buf, full.size() - 1));
+  }
+
+  SECTION("name longer than 255 bytes") {
+    // seven 60 byte labels, 428 bytes on the wire
+    std::vector<uint8_t> wire = {0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 7; i++) {
+      wire.push_back(60);
+      wire.insert(wire.end(), 60, 'a');
+    }
+    wire.insert(wire.end(), {0, 0, 1, 0, 1});
+    REQUIRE_THROWS(DnsPacketView(wire.data(), wire.size()));
+  }
+
+  SECTION("name over 255 bytes through a pointer") {
+    // the second question is two labels followed by all of the first one
+    std::vector<uint8_t> wire = {0, 1, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+      wire.push_back(60);
+      wire.insert(wire.end(), 60, 'a');
+    }
+    wire.insert(wire.end(), {0, 0, 1, 0, 1});
+    for (int i = 0; i < 2; i++) {
+      wire.push_back(60);
+      wire.insert(wire.end(), 60, 'b');
+    }
+    wire.insert(wire.end(), {0xC0, 12, 0, 1, 0, 1});
+    REQUIRE_THROWS(DnsPacketView(wire.data(), wire.size()));
+
+    // the first question alone is fine
+    wire[5] = 1;
+    DnsPacketView view(wire.data(), wire.size());
+    REQUIRE(view.question().name.toName().labelCount() == 4);
+  }
+}
@@ -0,0 +1,36 @@
+#include "../../lib/resolver/EventLoop.hpp"
+#include "catch.hpp"
+
+#include <chrono>
+#include <future>
+#include <vector>
+
+TEST_CASE("EventLoop runs posted callbacks and timers", "[eventloop]") {
+  EventLoop loop;
+
+  SECTION("posted callbacks run on the loop thread") {
+    std::promise<bool> onLoop;
+    loop.post([&loop, &onLoop] { onLoop.set_value(loop.inLoopThread()); });
+    REQUIRE(onLoop.get_future().get());
+  }
+
+  SECTION("timers fire in deadline order and cancelled ones never fire") {
+    std::vector<int> fired;
+    std::promise<void> done;
+
+    loop.post([&] {
+      loop.runAfter(std::chrono::milliseconds(30), [&] {
+        fired.push_back(3);
+        done.set_value();
+      });
+      loop.runAfter(std::chrono::milliseconds(10), [&] { fired.push_back(1); });
+      auto cancelled = loop.runAfter(std::chrono::milliseconds(20),
+                                     [&] { fired.push_back(2); });
+      loop.cancelTimer(cancelled);
+    });
+
+    REQUIRE(done.get_future().wait_for(std::chrono::seconds(2)) ==
+            std::future_status::ready);
+    REQUIRE(fired == std::vector<int>{1, 3});
+  }
+}
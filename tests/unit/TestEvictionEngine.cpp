@@ -0,0 +1,77 @@
+#include "../../lib/cache/EvictionEngine.hpp"
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+// the engine with the owner's side: what each slot holds
+struct Tracked {
+  EvictionEngine engine;
+  std::vector<std::string> slots;
+
+  Tracked(EvictionPolicy policy, size_t capacity)
+      : engine(policy, capacity), slots(capacity) {}
+
+  uint32_t add(const std::string &key) {
+    uint32_t slot = this->engine.add();
+    this->slots[slot] = key;
+    return slot;
+  }
+
+  // evict one key, the way DnsCache does
+  std::string evict() {
+    uint32_t slot = this->engine.victim();
+    std::string key = this->slots[slot];
+    this->engine.remove(slot);
+    return key;
+  }
+};
+
+TEST_CASE("EvictionEngine keeps keys that were hit", "[cache]") {
+  auto policy = GENERATE(EvictionPolicy::Sieve, EvictionPolicy::Clock);
+  Tracked tracked(policy, 3);
+
+  uint32_t a = tracked.add("a");
+  tracked.add("b");
+  tracked.add("c");
+  REQUIRE(tracked.engine.full());
+
+  // "a" is the oldest but was hit, "b" goes first
+  tracked.engine.touch(a);
+  REQUIRE(tracked.evict() == "b");
+  REQUIRE(tracked.engine.size() == 2);
+
+  tracked.add("d");
+  REQUIRE(tracked.evict() == "c");
+
+  SECTION("the policies differ in where a new key waits") {
+    tracked.add("e");
+    // clock put "d" behind the hand and now wraps around to "a", whose hit
+    // was used up, sieve's hand stayed put and reaches "d" first
+    REQUIRE(tracked.evict() == (policy == EvictionPolicy::Clock ? "a" : "d"));
+  }
+
+  SECTION("removed slots are reused") {
+    tracked.add("e");
+    REQUIRE(tracked.engine.full());
+    REQUIRE(tracked.engine.size() == 3);
+  }
+}
+
+TEST_CASE("EvictionEngine survives removing the slot under the hand",
+          "[cache]") {
+  Tracked tracked(EvictionPolicy::Sieve, 3);
+  uint32_t a = tracked.add("a");
+  tracked.add("b");
+  tracked.add("c");
+
+  // the hand ends up on "b", then "b" expires and goes without eviction
+  tracked.engine.touch(a);
+  uint32_t b = tracked.engine.victim();
+  REQUIRE(tracked.slots[b] == "b");
+  tracked.engine.remove(b);
+
+  REQUIRE(tracked.evict() == "c");
+  REQUIRE(tracked.evict() == "a");
+  REQUIRE(tracked.engine.size() == 0);
+}
@@ -0,0 +1,95 @@
+#include "../../lib/Core.hpp"
+#include "catch.hpp"
+
+#include <array>
+#include <vector>
+
+static BytePacketBuffer makeQuery(uint16_t id, std::string qname,
+                                  bool recursionDesired = true) {
+  DnsPacket packet;
+  packet.header.id = id;
+  packet.header.questions = 1;
+  packet.header.recursionDesired = recursionDesired;
+  packet.questions.push_back(DnsQuestion(std::move(qname), A{}));
+
+  BytePacketBuffer buffer;
+  packet.write(buffer);
+  buffer.seek(0);
+  return buffer;
+}
+
+TEST_CASE("Cache hits are answered on the receive path", "[fastpath]") {
+  ThreadSafeCache cache;
+  RateLimiter rateLimiter{RateLimitConfig{}};
+  LatencyHistogram latency;
+  struct sockaddr_in client = serverToSockaddr(Server{{127, 0, 0, 1}, 4000});
+
+  // capture what would have gone out on the socket
+  std::vector<DnsPacket> sent;
+  ResponseBatcher::routeTo([&sent](int, const uint8_t *data, size_t len,
+                                   const struct sockaddr_in &) {
+    BytePacketBuffer buffer;
+    std::memcpy(buffer.buf, data, len);
+    sent.push_back(DnsPacket::fromBuffer(buffer));
+    return true;
+  });
+
+  cache.insert(
+      DnsName("example.com"), A{},
+      std::vector<DnsRecord>{ARecord{"example.com", {192, 0, 2, 1}, 300}});
+
+  SECTION("hit is answered with the cached records") {
+    auto query = makeQuery(77, "example.com");
+    REQUIRE(answerFromCache(1, query, client, cache, rateLimiter,
+                            QueryTimer{&latency}) == FastPathResult::Answered);
+    REQUIRE(sent.size() == 1);
+    REQUIRE(sent[0].header.id == 77);
+    REQUIRE(sent[0].header.rescode == ResultCode::NOERROR);
+    REQUIRE(sent[0].answers.size() == 1);
+    REQUIRE(latency.samples() == 1);
+  }
+
+  SECTION("encoded hit takes the query's id, RD bit and spelling") {
+    auto query = makeQuery(4242, "ExAmple.COM", false);
+    REQUIRE(answerFromCache(1, query, client, cache, rateLimiter,
+                            QueryTimer{&latency}) == FastPathResult::Answered);
+    REQUIRE(sent.size() == 1);
+    REQUIRE(sent[0].header.id == 4242);
+    REQUIRE(!sent[0].header.recursionDesired);
+    REQUIRE(sent[0].header.recursionAvailable);
+    REQUIRE(sent[0].questions[0].name == "ExAmple.COM");
+
+    const auto &answer = std::get<ARecord>(sent[0].answers[0]);
+    REQUIRE(answer.addr == std::array<uint8_t, 4>{192, 0, 2, 1});
+    REQUIRE((answer.ttl <= 300 && answer.ttl >= 299));
+  }
+
+  SECTION("without the wire tier the records answer the same way") {
+    CacheConfig config;
+    config.wireAnswers = false;
+    ThreadSafeCache recordsOnly(config);
+    recordsOnly.insert(
+        DnsName("example.com"), A{},
+        std::vector<DnsRecord>{ARecord{"example.com", {192, 0, 2, 1}, 300}});
+
+    auto query = makeQuery(79, "ExAmple.COM", false);
+    REQUIRE(answerFromCache(1, query, client, recordsOnly, rateLimiter,
+                            QueryTimer{&latency}) == FastPathResult::Answered);
+    REQUIRE(sent.size() == 1);
+    REQUIRE(sent[0].header.id == 79);
+    REQUIRE(!sent[0].header.recursionDesired);
+    REQUIRE(sent[0].questions[0].name == "ExAmple.COM");
+    REQUIRE(sent[0].answers.size() == 1);
+  }
+
+  SECTION("miss is left for the workers with the buffer rewound") {
+    auto query = makeQuery(78, "example.org");
+    REQUIRE(answerFromCache(1, query, client, cache, rateLimiter,
+                            QueryTimer{&latency}) == FastPathResult::Miss);
+    REQUIRE(sent.empty());
+    REQUIRE(query.currentPosition() == 0);
+    REQUIRE(DnsPacket::fromBuffer(query).questions[0].name == "example.org");
+  }
+
+  ResponseBatcher::routeTo(nullptr);
+}
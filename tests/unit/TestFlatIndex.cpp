@@ -0,0 +1,77 @@
+#include "../../lib/cache/FlatIndex.hpp"
+#include "catch.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// the owner's slab: id -> key, hashed so that many keys share a tag
+struct Slab {
+  std::vector<uint64_t> keys;
+
+  static size_t hash(uint64_t key) { return key * 0x9E3779B97F4A7C15ull; }
+
+  uint32_t find(const FlatIndex &index, uint64_t key) const {
+    return index.find(hash(key),
+                      [&](uint32_t id) { return this->keys[id] == key; });
+  }
+
+  uint32_t insert(FlatIndex &index, uint64_t key) {
+    uint32_t id = static_cast<uint32_t>(this->keys.size());
+    this->keys.push_back(key);
+    index.insert(hash(key), id,
+                 [this](uint32_t stored) { return hash(this->keys[stored]); });
+    return id;
+  }
+};
+
+TEST_CASE("FlatIndex finds, erases and grows", "[cache]") {
+  FlatIndex index(8);
+  Slab slab;
+
+  for (uint64_t key = 0; key < 1000; key++) {
+    slab.insert(index, key);
+  }
+  REQUIRE(index.size() == 1000);
+
+  // grown well past its starting size, everything is still there
+  for (uint64_t key = 0; key < 1000; key++) {
+    REQUIRE(slab.find(index, key) == key);
+  }
+  REQUIRE(slab.find(index, 1000) == FlatIndex::NONE);
+
+  SECTION("erased ids are gone, the rest stay") {
+    for (uint64_t key = 0; key < 1000; key += 2) {
+      index.erase(Slab::hash(key), static_cast<uint32_t>(key));
+    }
+    REQUIRE(index.size() == 500);
+
+    for (uint64_t key = 0; key < 1000; key++) {
+      REQUIRE(slab.find(index, key) ==
+              (key % 2 == 0 ? FlatIndex::NONE : key));
+    }
+  }
+}
+
+TEST_CASE("FlatIndex reuses tombstones under churn", "[cache]") {
+  // a fixed population with one key replaced per step, the tombstones
+  // left behind get rebuilt away rather than filling the table
+  FlatIndex index(64);
+  Slab slab;
+
+  std::vector<uint32_t> live;
+  for (uint64_t key = 0; key < 64; key++) {
+    live.push_back(slab.insert(index, key));
+  }
+
+  for (uint64_t key = 64; key < 20000; key++) {
+    uint32_t old = live[key % 64];
+    index.erase(Slab::hash(slab.keys[old]), old);
+    live[key % 64] = slab.insert(index, key);
+  }
+
+  REQUIRE(index.size() == 64);
+  for (uint32_t id : live) {
+    REQUIRE(slab.find(index, slab.keys[id]) == id);
+  }
+  REQUIRE(slab.find(index, 0) == FlatIndex::NONE);
+}
@@ -0,0 +1,43 @@
+#include "../../lib/InlineTask.hpp"
+#include "catch.hpp"
+
+#include <memory>
+#include <utility>
+
+TEST_CASE("InlineTask runs and moves its callable", "[threadpool]") {
+  int calls = 0;
+
+  SECTION("invokes the stored callable") {
+    InlineTask<64> task([&calls] { calls++; });
+    REQUIRE(static_cast<bool>(task));
+    task();
+    task();
+    REQUIRE(calls == 2);
+  }
+
+  SECTION("holds move-only captures and leaves the source empty") {
+    auto owned = std::make_unique<int>(7);
+    InlineTask<64> task([&calls, owned = std::move(owned)] { calls += *owned; });
+
+    InlineTask<64> moved(std::move(task));
+    REQUIRE(!task);
+    moved();
+    REQUIRE(calls == 7);
+
+    InlineTask<64> assigned;
+    assigned = std::move(moved);
+    REQUIRE(!moved);
+    assigned();
+    REQUIRE(calls == 14);
+  }
+
+  SECTION("destroys its captures exactly once") {
+    auto shared = std::make_shared<int>(0);
+    {
+      InlineTask<64> task([shared] {});
+      InlineTask<64> moved(std::move(task));
+      REQUIRE(shared.use_count() == 2);
+    }
+    REQUIRE(shared.use_count() == 1);
+  }
+}
@@ -0,0 +1,130 @@
+#include "../../lib/DnsPacketView.hpp"
+#include "../../lib/names/NameKernels.hpp"
+#include "catch.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namekernels::SimdLevel;
+
+static std::vector<SimdLevel> supportedLevels() {
+  std::vector<SimdLevel> levels;
+  for (auto level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+    if (namekernels::supported(level)) {
+      levels.push_back(level);
+    }
+  }
+  return levels;
+}
+
+TEST_CASE("Vector name kernels agree with the scalar ones", "[names]") {
+  const auto &reference = namekernels::kernelsFor(SimdLevel::Scalar);
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> byte(0, 255);
+
+  for (auto level : supportedLevels()) {
+    const auto &kernels = namekernels::kernelsFor(level);
+    REQUIRE(kernels.level == level);
+
+    // every length around the 16 and 32 byte blocks, every byte value
+    for (size_t len = 0; len <= 100; len++) {
+      std::string input(len, '\0');
+      for (auto &c : input) {
+        c = static_cast<char>(byte(gen));
+      }
+
+      std::string expected(len, '\0');
+      std::string actual(len, '\0');
+      reference.toLower(input.data(), expected.data(), len);
+      kernels.toLower(input.data(), actual.data(), len);
+      REQUIRE(actual == expected);
+
+      REQUIRE(kernels.labelBytesValid(input.data(), len) ==
+              reference.labelBytesValid(input.data(), len));
+
+      std::string upper = expected;
+      for (auto &c : upper) {
+        if (c >= 'a' && c <= 'z') {
+          c = static_cast<char>(c - 32);
+        }
+      }
+      REQUIRE(kernels.equalsIgnoreCase(upper.data(), expected.data(), len));
+      if (len > 0) {
+        upper[len - 1] ^= 0x01;
+        REQUIRE(!kernels.equalsIgnoreCase(upper.data(), expected.data(), len));
+      }
+    }
+  }
+}
+
+TEST_CASE("Name kernels handle the edges of ASCII", "[names]") {
+  for (auto level : supportedLevels()) {
+    const auto &kernels = namekernels::kernelsFor(level);
+
+    std::string mixed = "WwW.ExAmPlE-Service_01.COM@[`{\xC3\x89\x7F";
+    std::string lowered(mixed.size(), '\0');
+    kernels.toLower(mixed.data(), lowered.data(), mixed.size());
+    REQUIRE(lowered == "www.example-service_01.com@[`{\xC3\x89\x7F");
+
+    // '@' and '[' sit right next to 'A' and 'Z'
+    REQUIRE(!kernels.equalsIgnoreCase("@", "`", 1));
+    REQUIRE(!kernels.equalsIgnoreCase("[", "{", 1));
+
+    std::string label(40, 'a');
+    REQUIRE(kernels.labelBytesValid(label.data(), label.size()));
+    for (char bad : {'.', '\\', ' ', '\x7F', '\x00', '\x80', '\xFF'}) {
+      std::string withBad = label;
+      withBad[37] = bad;
+      REQUIRE(!kernels.labelBytesValid(withBad.data(), withBad.size()));
+    }
+  }
+}
+
+TEST_CASE("Names convert between text and labels", "[names]") {
+  uint8_t wire[namekernels::MAX_NAME_WIRE];
+
+  SECTION("round trip") {
+    size_t len = namekernels::textToLabels("www.example.com", wire);
+    REQUIRE(len == 16);
+    REQUIRE(wire[0] == 3);
+    REQUIRE(wire[4] == 7);
+    REQUIRE(wire[12] == 3);
+
+    char text[namekernels::MAX_NAME_WIRE];
+    REQUIRE(namekernels::labelsToText(wire, len, text));
+    REQUIRE(std::string(text, len - 1) == "www.example.com");
+  }
+
+  SECTION("root and trailing dots") {
+    REQUIRE(namekernels::textToLabels("", wire) == 0);
+    REQUIRE(namekernels::textToLabels(".", wire) == 0);
+    REQUIRE(namekernels::textToLabels("example.com.", wire) == 12);
+  }
+
+  SECTION("bad names are rejected") {
+    REQUIRE_THROWS(namekernels::textToLabels("a..b", wire));
+    REQUIRE_THROWS(namekernels::textToLabels(".a", wire));
+    REQUIRE_THROWS(namekernels::textToLabels(std::string(64, 'a'), wire));
+    REQUIRE_NOTHROW(namekernels::textToLabels(std::string(63, 'a'), wire));
+
+    // 4 x 63 byte labels is 256 bytes on the wire with the terminator
+    std::string label(63, 'a');
+    std::string tooLong = label + "." + label + "." + label + "." + label;
+    REQUIRE_THROWS(namekernels::textToLabels(tooLong, wire));
+    REQUIRE_NOTHROW(namekernels::textToLabels(tooLong.substr(2), wire));
+  }
+
+  SECTION("a dot inside a label does not read back as two labels") {
+    // one label "www.example" then "com"
+    const uint8_t spoofed[] = {11,  'w', 'w', 'w', '.', 'e', 'x', 'a',
+                               'm', 'p', 'l', 'e', 3,   'c', 'o', 'm'};
+    char text[sizeof(spoofed)];
+    REQUIRE(!namekernels::labelsToText(spoofed, sizeof(spoofed), text));
+
+    BytePacketBuffer buffer;
+    std::memcpy(buffer.buf, spoofed, sizeof(spoofed));
+    std::string name;
+    REQUIRE_THROWS(buffer.readQName(name));
+  }
+}
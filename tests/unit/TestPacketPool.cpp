@@ -0,0 +1,38 @@
+#include "../../lib/io/PacketPool.hpp"
+#include "catch.hpp"
+
+#include <utility>
+#include <vector>
+
+TEST_CASE("PacketPool hands out and recycles buffers", "[io]") {
+  PacketPool pool(4);
+
+  SECTION("copies the packet into a rewound slot") {
+    BytePacketBuffer packet;
+    packet.writeU16(0xbeef);
+
+    PacketHandle handle = pool.copyOf(packet);
+    REQUIRE(static_cast<bool>(handle));
+    REQUIRE(handle->currentPosition() == 0);
+    REQUIRE(handle->readU16() == 0xbeef);
+    REQUIRE(pool.available() == 3);
+  }
+
+  SECTION("runs dry when every slot is out and refills as handles die") {
+    std::vector<PacketHandle> held;
+    for (int i = 0; i < 4; i++) {
+      held.push_back(pool.acquire());
+      REQUIRE(static_cast<bool>(held.back()));
+    }
+    REQUIRE(!pool.acquire());
+
+    // moving a handle keeps the slot out of the pool
+    PacketHandle moved = std::move(held.back());
+    held.pop_back();
+    REQUIRE(pool.available() == 0);
+
+    held.clear();
+    REQUIRE(pool.available() == 3);
+    REQUIRE(static_cast<bool>(pool.acquire()));
+  }
+}
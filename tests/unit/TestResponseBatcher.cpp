@@ -0,0 +1,50 @@
+#include "../../lib/io/ResponseBatcher.hpp"
+#include "catch.hpp"
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+TEST_CASE("ResponseBatcher only counts datagrams that went out", "[io]") {
+  // outlives the test, the batcher keeps pointing at it
+  static IoStats stats;
+  stats.sendCalls = 0;
+  stats.sendDatagrams = 0;
+  stats.sendFailures = 0;
+
+  const uint8_t data[] = {1, 2, 3, 4};
+  struct sockaddr_in dest {};
+  dest.sin_family = AF_INET;
+  dest.sin_port = htons(9);
+  dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  SECTION("single sends") {
+    ResponseBatcher::configure(1, stats);
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    REQUIRE(sockfd >= 0);
+    ResponseBatcher::send(sockfd, data, sizeof(data), dest);
+    close(sockfd);
+
+    // nothing behind this descriptor any more
+    ResponseBatcher::send(sockfd, data, sizeof(data), dest);
+
+    REQUIRE(stats.sendCalls == 2);
+    REQUIRE(stats.sendDatagrams == 1);
+    REQUIRE(stats.sendFailures == 1);
+  }
+
+#ifdef __linux__
+  SECTION("batched sends") {
+    ResponseBatcher::configure(4, stats);
+
+    ResponseBatcher::send(-1, data, sizeof(data), dest);
+    ResponseBatcher::send(-1, data, sizeof(data), dest);
+    ResponseBatcher::flush();
+
+    REQUIRE(stats.sendDatagrams == 0);
+    REQUIRE(stats.sendFailures == 2);
+  }
+#endif
+
+  ResponseBatcher::configure(1, stats);
+}
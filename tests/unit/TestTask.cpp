@@ -0,0 +1,52 @@
+#include "../../lib/resolver/FramePool.hpp"
+#include "../../lib/resolver/Task.hpp"
+#include "catch.hpp"
+
+#include <stdexcept>
+
+static Task<int> answer() { co_return 42; }
+
+static Task<int> addOne() {
+  int value = co_await answer();
+  co_return value + 1;
+}
+
+static Task<int> failing() {
+  throw std::runtime_error("boom");
+  co_return 0;
+}
+
+static DetachedTask drive(Task<int> task, int &result, bool &threw) {
+  try {
+    result = co_await task;
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+}
+
+TEST_CASE("Task chains results and exceptions", "[coroutine]") {
+  int result = 0;
+  bool threw = false;
+
+  SECTION("awaited tasks resume their caller with the value") {
+    drive(addOne(), result, threw);
+    REQUIRE(result == 43);
+    REQUIRE(!threw);
+  }
+
+  SECTION("exceptions are rethrown at the co_await") {
+    drive(failing(), result, threw);
+    REQUIRE(threw);
+  }
+}
+
+TEST_CASE("FramePool reuses freed frames of the same size class",
+          "[coroutine]") {
+  void *first = FramePool::allocate(200);
+  FramePool::deallocate(first, 200);
+
+  // 200 and 250 round up to the same 256 byte class
+  void *second = FramePool::allocate(250);
+  REQUIRE(second == first);
+  FramePool::deallocate(second, 250);
+}
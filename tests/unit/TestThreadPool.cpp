@@ -0,0 +1,49 @@
+#include "../../lib/ThreadPool.hpp"
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static void waitFor(const std::atomic<int> &counter, int expected) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (counter.load() < expected &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+TEST_CASE("ThreadPool runs every task in both scheduling modes",
+          "[threadpool]") {
+  auto mode = GENERATE(SchedulingMode::SharedQueue,
+                       SchedulingMode::WorkStealing);
+  std::atomic<int> done{0};
+
+  ThreadPool pool(3, nullptr, 64, mode);
+  for (int i = 0; i < 500; i++) {
+    pool.enqueue([&done] { done++; });
+  }
+
+  waitFor(done, 500);
+  REQUIRE(done == 500);
+}
+
+TEST_CASE("Work-stealing pool runs tasks spawned by its workers",
+          "[threadpool]") {
+  std::atomic<int> done{0};
+  ThreadPool pool(3, nullptr, 64, SchedulingMode::WorkStealing);
+
+  // each parent lands on a worker's own deque with its children
+  for (int i = 0; i < 50; i++) {
+    pool.enqueue([&pool, &done] {
+      for (int j = 0; j < 10; j++) {
+        pool.enqueue([&done] { done++; });
+      }
+      done++;
+    });
+  }
+
+  waitFor(done, 550);
+  REQUIRE(done == 550);
+  REQUIRE(pool.queueSize() == 0);
+}
@@ -0,0 +1,103 @@
+#include "../../lib/cache/TimerWheel.hpp"
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace std::chrono_literals;
+using time_point = TimerWheel<uint32_t>::time_point;
+
+// fire everything due by `now`, in the order it fires
+static std::vector<uint32_t> due(TimerWheel<uint32_t> &wheel, time_point now,
+                                 size_t budget = SIZE_MAX) {
+  std::vector<uint32_t> fired;
+  wheel.advance(now, budget, [&](uint32_t payload) { fired.push_back(payload); });
+  return fired;
+}
+
+TEST_CASE("TimerWheel fires timers once their time has passed", "[cache]") {
+  time_point start = std::chrono::steady_clock::now();
+  TimerWheel<uint32_t> wheel(start);
+
+  // one per level, and one past the top level
+  wheel.schedule(start + 5s, 1);
+  wheel.schedule(start + 100s, 2);
+  wheel.schedule(start + 5000s, 3);
+  wheel.schedule(start + 300000s, 4);
+  wheel.schedule(start + 20000000s, 5);
+  REQUIRE(wheel.size() == 5);
+
+  REQUIRE(due(wheel, start + 4s).empty());
+  REQUIRE(due(wheel, start + 5s) == std::vector<uint32_t>{1});
+  REQUIRE(due(wheel, start + 99s).empty());
+  REQUIRE(due(wheel, start + 4999s) == std::vector<uint32_t>{2});
+  REQUIRE(due(wheel, start + 5000s) == std::vector<uint32_t>{3});
+  REQUIRE(due(wheel, start + 299999s).empty());
+  REQUIRE(due(wheel, start + 300000s) == std::vector<uint32_t>{4});
+  REQUIRE(due(wheel, start + 19999999s).empty());
+  REQUIRE(due(wheel, start + 20000000s) == std::vector<uint32_t>{5});
+  REQUIRE(wheel.size() == 0);
+}
+
+TEST_CASE("TimerWheel cancels, reschedules and works in slices", "[cache]") {
+  time_point start = std::chrono::steady_clock::now();
+  TimerWheel<uint32_t> wheel(start);
+
+  SECTION("cancelled and moved timers") {
+    uint32_t a = wheel.schedule(start + 10s, 1);
+    uint32_t b = wheel.schedule(start + 10s, 2);
+    wheel.schedule(start + 10s, 3);
+    wheel.cancel(a);
+    wheel.reschedule(b, start + 200s);
+
+    REQUIRE(due(wheel, start + 10s) == std::vector<uint32_t>{3});
+    REQUIRE(due(wheel, start + 200s) == std::vector<uint32_t>{2});
+
+    // ids are reused, past times fire on the next advance
+    REQUIRE(wheel.schedule(start, 4) < 3);
+    REQUIRE(due(wheel, start + 200s) == std::vector<uint32_t>{4});
+  }
+
+  SECTION("a backlog goes at most `budget` at a time") {
+    for (uint32_t i = 0; i < 10; i++) {
+      wheel.schedule(start + std::chrono::seconds(1 + i % 3), i);
+    }
+
+    REQUIRE(due(wheel, start + 1h, 4).size() == 4);
+    REQUIRE(due(wheel, start + 1h, 4).size() == 4);
+    REQUIRE(due(wheel, start + 1h, 4).size() == 2);
+    REQUIRE(wheel.size() == 0);
+  }
+}
+
+TEST_CASE("TimerWheel fires every timer on time", "[cache]") {
+  time_point start = std::chrono::steady_clock::now();
+  TimerWheel<uint32_t> wheel(start);
+  std::mt19937 gen(7);
+
+  // timers anywhere up to a few top level turns out, checked at random steps
+  std::vector<int64_t> at;
+  std::uniform_int_distribution<int64_t> delay(1, 40000000);
+  for (uint32_t i = 0; i < 2000; i++) {
+    at.push_back(delay(gen));
+    wheel.schedule(start + std::chrono::seconds(at.back()), i);
+  }
+
+  int64_t now = 0;
+  std::uniform_int_distribution<int64_t> step(1, 200000);
+  std::vector<bool> fired(at.size(), false);
+  while (wheel.size() > 0) {
+    int64_t previous = now;
+    now += step(gen);
+    for (uint32_t id : due(wheel, start + std::chrono::seconds(now))) {
+      // never early, never left behind a step
+      REQUIRE(at[id] <= now);
+      REQUIRE(at[id] > previous);
+      fired[id] = true;
+    }
+  }
+  REQUIRE(std::find(fired.begin(), fired.end(), false) == fired.end());
+}
@@ -0,0 +1,88 @@
+#include "../../lib/DnsPacket.hpp"
+#include "../../lib/tracking/TransactionTracker.hpp"
+#include "catch.hpp"
+
+static BytePacketBuffer makeResponse(uint16_t id, std::string qname) {
+  DnsPacket packet;
+  packet.header.id = id;
+  packet.header.response = true;
+  packet.questions.push_back(DnsQuestion(std::move(qname), A{}));
+
+  BytePacketBuffer buffer;
+  packet.write(buffer);
+  return buffer;
+}
+
+TEST_CASE("TransactionTracker matches upstream responses", "[tracker]") {
+  TransactionTracker tracker;
+  Server server{{192, 0, 2, 1}, 53};
+
+  bool called = false;
+  tracker.registerTxn(4242, DnsName("example.com"), A{}, server,
+                      [&called](BytePacketBuffer &) { called = true; });
+
+  SECTION("matching response runs the callback and retires the txn") {
+    auto response = makeResponse(4242, "EXAMPLE.com");
+    REQUIRE(tracker.completeTxn(server, response) == TxnMatch::Matched);
+    REQUIRE(called);
+    REQUIRE(!tracker.checkTxnId(4242));
+  }
+
+  SECTION("response from another server is rejected") {
+    auto response = makeResponse(4242, "example.com");
+    Server other{{192, 0, 2, 2}, 53};
+    REQUIRE(tracker.completeTxn(other, response) == TxnMatch::Mismatched);
+    REQUIRE(!called);
+    REQUIRE(tracker.checkTxnId(4242));
+  }
+
+  SECTION("response for another question is rejected") {
+    auto response = makeResponse(4242, "example.org");
+    REQUIRE(tracker.completeTxn(server, response) == TxnMatch::Mismatched);
+    REQUIRE(!called);
+  }
+
+  SECTION("unknown id is ignored") {
+    auto response = makeResponse(1, "example.com");
+    REQUIRE(tracker.completeTxn(server, response) == TxnMatch::Unknown);
+    REQUIRE(!called);
+  }
+}
+
+TEST_CASE("TransactionTracker never hands one id to two queries",
+          "[tracker]") {
+  TransactionTracker tracker;
+  Server server{{192, 0, 2, 1}, 53};
+
+  SECTION("a registered id isn't overwritten") {
+    int first = 0;
+    int second = 0;
+    REQUIRE(tracker.registerTxn(4242, DnsName("example.com"), A{}, server,
+                                [&first](BytePacketBuffer &) { first++; }));
+    REQUIRE(!tracker.registerTxn(4242, DnsName("example.org"), A{}, server,
+                                 [&second](BytePacketBuffer &) { second++; }));
+
+    auto response = makeResponse(4242, "example.com");
+    REQUIRE(tracker.completeTxn(server, response) == TxnMatch::Matched);
+    REQUIRE(first == 1);
+    REQUIRE(second == 0);
+  }
+
+  SECTION("a reserved id is taken until it is retired") {
+    REQUIRE(tracker.reserveTxnId(7));
+    REQUIRE(!tracker.reserveTxnId(7));
+    REQUIRE(tracker.checkTxnId(7));
+
+    // nothing was sent with it yet, replies don't match
+    auto early = makeResponse(7, "example.com");
+    REQUIRE(tracker.completeTxn(server, early) == TxnMatch::Unknown);
+
+    // the query that reserved it registers it
+    REQUIRE(tracker.registerTxn(7, DnsName("example.com"), A{}, server));
+    REQUIRE(!tracker.reserveTxnId(7));
+
+    auto response = makeResponse(7, "example.com");
+    REQUIRE(tracker.completeTxn(server, response) == TxnMatch::Matched);
+    REQUIRE(tracker.reserveTxnId(7));
+  }
+}
@@ -0,0 +1,91 @@
+#include "../../lib/DnsPacket.hpp"
+#include "../../lib/io/UpstreamSocketPool.hpp"
+#include "catch.hpp"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+
+// waits up to two seconds for `done`
+template <typename Predicate> static bool eventually(Predicate done) {
+  auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= giveUp) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+TEST_CASE("UpstreamSocketPool moves queries to new source ports",
+          "[upstream]") {
+  // stands in for an upstream nameserver on the loopback
+  int serverfd = socket(AF_INET, SOCK_DGRAM, 0);
+  REQUIRE(serverfd >= 0);
+  struct sockaddr_in serverAddr = {};
+  serverAddr.sin_family = AF_INET;
+  serverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  REQUIRE(bind(serverfd, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) ==
+          0);
+  socklen_t addrLen = sizeof(serverAddr);
+  getsockname(serverfd, (struct sockaddr *)&serverAddr, &addrLen);
+  struct timeval timeout = {2, 0};
+  setsockopt(serverfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  Server upstream{{127, 0, 0, 1}, ntohs(serverAddr.sin_port)};
+  DnsName qname("example.com");
+  TransactionTracker tracker;
+  std::atomic<int> answered{0};
+
+  // sends query `id` through the pool, returns what the server got and
+  // where from
+  auto query = [&](UpstreamSocketPool &pool, uint16_t id,
+                   BytePacketBuffer &received, struct sockaddr_in &from) {
+    BytePacketBuffer request;
+    writeQuery(request, id, qname, A{});
+    REQUIRE(pool.submit(id, qname, A{}, upstream, request,
+                        [&answered](BytePacketBuffer &) { answered++; }));
+
+    socklen_t fromLen = sizeof(from);
+    ssize_t bytes = recvfrom(serverfd, received.buf, sizeof(received.buf), 0,
+                             (struct sockaddr *)&from, &fromLen);
+    REQUIRE(bytes > 0);
+    return static_cast<size_t>(bytes);
+  };
+
+  SECTION("after a number of queries") {
+    UpstreamSocketPool pool(tracker, 1, 2, 60000, 2000);
+
+    BytePacketBuffer first, second, third;
+    struct sockaddr_in firstFrom, secondFrom, thirdFrom;
+    size_t firstLength = query(pool, 1, first, firstFrom);
+    query(pool, 2, second, secondFrom);
+    REQUIRE(firstFrom.sin_port == secondFrom.sin_port);
+
+    REQUIRE(eventually([&pool] { return pool.getStats().portRotations > 0; }));
+    query(pool, 3, third, thirdFrom);
+    REQUIRE(thirdFrom.sin_port != firstFrom.sin_port);
+
+    // the retired socket still hears the reply to a query it sent
+    sendto(serverfd, first.buf, firstLength, 0, (struct sockaddr *)&firstFrom,
+           sizeof(firstFrom));
+    REQUIRE(eventually([&answered] { return answered == 1; }));
+    REQUIRE(pool.getStats().responsesMatched == 1);
+  }
+
+  SECTION("after a while") {
+    UpstreamSocketPool pool(tracker, 1, 1000, 50, 2000);
+
+    BytePacketBuffer first, second;
+    struct sockaddr_in firstFrom, secondFrom;
+    query(pool, 1, first, firstFrom);
+    REQUIRE(eventually([&pool] { return pool.getStats().portRotations > 0; }));
+    query(pool, 2, second, secondFrom);
+    REQUIRE(secondFrom.sin_port != firstFrom.sin_port);
+  }
+
+  close(serverfd);
+}
@@ -0,0 +1,80 @@
+#include "../../lib/WorkQueue.hpp"
+#include "catch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST_CASE("BoundedMPMCQueue behaves like a bounded FIFO", "[workqueue]") {
+  BoundedMPMCQueue<int> queue(4);
+
+  SECTION("items come out in push order") {
+    for (int i = 1; i <= 3; i++) {
+      queue.push(i);
+    }
+
+    int item = 0;
+    for (int i = 1; i <= 3; i++) {
+      REQUIRE(queue.tryPop(item));
+      REQUIRE(item == i);
+    }
+    REQUIRE(!queue.tryPop(item));
+  }
+
+  SECTION("tryPush refuses once the ring is full") {
+    for (int i = 0; i < 4; i++) {
+      int item = i;
+      REQUIRE(queue.tryPush(item));
+    }
+    int extra = 99;
+    REQUIRE(!queue.tryPush(extra));
+    REQUIRE(queue.size() == 4);
+  }
+
+  SECTION("pop returns false after shutdown once drained") {
+    queue.push(7);
+    queue.shutdownQueue();
+
+    int item = 0;
+    REQUIRE(queue.pop(item));
+    REQUIRE(item == 7);
+    REQUIRE(!queue.pop(item));
+  }
+}
+
+TEST_CASE("BoundedMPMCQueue hands every item to exactly one consumer",
+          "[workqueue]") {
+  BoundedMPMCQueue<int> queue(64);
+  std::atomic<long> sum{0};
+  constexpr int PER_PRODUCER = 10000;
+
+  {
+    std::vector<std::jthread> consumers;
+    for (int c = 0; c < 3; c++) {
+      consumers.emplace_back([&queue, &sum] {
+        int item;
+        while (queue.pop(item)) {
+          sum += item;
+        }
+      });
+    }
+
+    {
+      std::vector<std::jthread> producers;
+      for (int p = 0; p < 3; p++) {
+        producers.emplace_back([&queue] {
+          for (int i = 1; i <= PER_PRODUCER; i++) {
+            queue.push(i);
+          }
+        });
+      }
+    }
+
+    while (queue.size() > 0) {
+      std::this_thread::yield();
+    }
+    queue.shutdownQueue();
+  }
+
+  REQUIRE(sum == 3L * PER_PRODUCER * (PER_PRODUCER + 1) / 2);
+}